@@ -26,6 +26,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "esp_log.h"
 
 #include "ral.h"
+#include "lorahub_clock.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
@@ -46,16 +47,16 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define TAKE_N_BITS_FROM( b, p, n ) ( ( ( b ) >> ( p ) ) & ( ( 1 << ( n ) ) - 1 ) )
 
 /**
-@brief Wait for a certain time (microsecond accuracy)
+@brief Wait for a certain time (microsecond accuracy), on the selected clock
 @param us number of microseconds to wait.
 */
-#define WAIT_US( us ) esp_rom_delay_us( us )
+#define WAIT_US( us ) lgw_clock_delay_us( us )
 
 /**
-@brief Wait for a certain time (millisecond accuracy)
+@brief Wait for a certain time (millisecond accuracy), on the selected clock
 @param ms number of milliseconds to wait.
 */
-#define WAIT_MS( ms ) esp_rom_delay_us( ms * 1000 )
+#define WAIT_MS( ms ) lgw_clock_delay_us( ( ms ) * 1000 )
 
 /*!
  * @brief Stringify constants
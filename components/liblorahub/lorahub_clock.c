@@ -0,0 +1,320 @@
+/*______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+(C)2024 Semtech
+
+Description:
+    LoRaHub clock abstraction (hardware timer or simulated discrete-event clock)
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stddef.h>  /* NULL */
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+#if defined( ESP_PLATFORM )
+#include <esp_timer.h>
+#include <esp_rom_sys.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "lorahub_clock.h"
+#include "lorahub_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#if !defined( ESP_PLATFORM )
+/* Thread waiting on the simulated clock, lives on the stack of the waiting thread */
+typedef struct sim_waiter_s
+{
+    int64_t              deadline_us; /* virtual time at which the thread is woken up */
+    uint32_t             rank;        /* rank of the thread, orders the wakeups due at the same time */
+    uint32_t             seq;         /* order of the wait, for threads sharing a rank */
+    bool                 woken;
+    struct sim_waiter_s* next;
+} sim_waiter_t;
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+#if defined( ESP_PLATFORM )
+static int64_t hw_get_time_us( void );
+static void    hw_delay_us( uint32_t us );
+static void    hw_sleep_ms( uint32_t ms );
+#else
+static int64_t sim_get_time_us( void );
+static void    sim_delay_us( uint32_t us );
+static void    sim_sleep_ms( uint32_t ms );
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+#if defined( ESP_PLATFORM )
+static const struct lgw_clock_s clock_hw = { .get_time_us = hw_get_time_us,
+                                             .delay_us    = hw_delay_us,
+                                             .sleep_ms    = hw_sleep_ms };
+#define CLOCK_DEFAULT ( &clock_hw )
+#else
+static const struct lgw_clock_s clock_sim = { .get_time_us = sim_get_time_us,
+                                              .delay_us    = sim_delay_us,
+                                              .sleep_ms    = sim_sleep_ms };
+#define CLOCK_DEFAULT ( &clock_sim )
+#endif
+
+static const struct lgw_clock_s* clock_sel = CLOCK_DEFAULT;
+
+#if !defined( ESP_PLATFORM )
+
+/* Simulated clock: virtual time and wakeup queue, sorted by deadline then rank */
+static pthread_mutex_t mx_sim         = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond_sim       = PTHREAD_COND_INITIALIZER; /* a waiter has been woken up */
+static int64_t         sim_time_us    = 0;
+static sim_waiter_t*   sim_queue      = NULL;
+static uint32_t        sim_seq        = 0;
+static uint32_t        sim_nb_thread  = 0; /* threads which have to wait before time moves */
+static uint32_t        sim_nb_waiting = 0; /* attached threads waiting in the queue */
+
+/* Rank of the calling thread, if attached to the simulated clock */
+static __thread bool     sim_attached = false;
+static __thread uint32_t sim_rank     = 0;
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+#if !defined( ESP_PLATFORM )
+/* Order of the wakeup queue */
+static bool sim_before( const sim_waiter_t* a, const sim_waiter_t* b )
+{
+    if( a->deadline_us != b->deadline_us )
+    {
+        return a->deadline_us < b->deadline_us;
+    }
+    if( a->rank != b->rank )
+    {
+        return a->rank < b->rank;
+    }
+    return ( int32_t ) ( a->seq - b->seq ) < 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Wake up the first waiter once all the attached threads wait, moving the time to its deadline (mx_sim held) */
+static void sim_dispatch( void )
+{
+    sim_waiter_t* w = sim_queue;
+
+    if( ( w == NULL ) || ( sim_nb_waiting < sim_nb_thread ) )
+    {
+        return;
+    }
+
+    /* a busy wait may have moved the time past the deadline, time never goes back */
+    if( w->deadline_us > sim_time_us )
+    {
+        sim_time_us = w->deadline_us;
+    }
+    sim_queue = w->next;
+    w->woken  = true;
+    sim_nb_waiting -= 1;
+    pthread_cond_broadcast( &cond_sim );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Wait until the time reaches the deadline, one attached thread runs at a time (mx_sim held) */
+static void sim_wait( int64_t deadline_us )
+{
+    sim_waiter_t   w = { .deadline_us = deadline_us, .rank = sim_rank, .seq = sim_seq++, .woken = false };
+    sim_waiter_t** pos;
+
+    pos = &sim_queue;
+    while( ( *pos != NULL ) && ( sim_before( *pos, &w ) == true ) )
+    {
+        pos = &( *pos )->next;
+    }
+    w.next = *pos;
+    *pos   = &w;
+
+    sim_nb_waiting += 1;
+    sim_dispatch( );
+    while( w.woken == false )
+    {
+        pthread_cond_wait( &cond_sim, &mx_sim );
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int64_t sim_get_time_us( void )
+{
+    int64_t time_us;
+
+    pthread_mutex_lock( &mx_sim );
+    time_us = sim_time_us;
+    pthread_mutex_unlock( &mx_sim );
+
+    return time_us;
+}
+
+static void sim_delay_us( uint32_t us )
+{
+    /* a busy wait keeps the CPU: time moves without letting other threads run */
+    pthread_mutex_lock( &mx_sim );
+    sim_time_us += us;
+    pthread_mutex_unlock( &mx_sim );
+}
+
+static void sim_sleep_ms( uint32_t ms )
+{
+    pthread_mutex_lock( &mx_sim );
+    if( sim_attached == true )
+    {
+        sim_wait( sim_time_us + ( int64_t ) ms * 1000 );
+    }
+    else
+    {
+        sim_time_us += ( int64_t ) ms * 1000;
+    }
+    pthread_mutex_unlock( &mx_sim );
+}
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#if defined( ESP_PLATFORM )
+static int64_t hw_get_time_us( void )
+{
+    return esp_timer_get_time( );
+}
+
+static void hw_delay_us( uint32_t us )
+{
+    esp_rom_delay_us( us );
+}
+
+static void hw_sleep_ms( uint32_t ms )
+{
+    vTaskDelay( pdMS_TO_TICKS( ms ) );
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_clock_set( const struct lgw_clock_s* clock )
+{
+    if( clock == NULL )
+    {
+        clock_sel = CLOCK_DEFAULT;
+        return LGW_HAL_SUCCESS;
+    }
+
+    if( ( clock->get_time_us == NULL ) || ( clock->delay_us == NULL ) || ( clock->sleep_ms == NULL ) )
+    {
+        return LGW_HAL_ERROR;
+    }
+
+    clock_sel = clock;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int64_t lgw_clock_get_time_us( void )
+{
+    return clock_sel->get_time_us( );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_clock_delay_us( uint32_t us )
+{
+    clock_sel->delay_us( us );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_clock_sleep_ms( uint32_t ms )
+{
+    clock_sel->sleep_ms( ms );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#if !defined( ESP_PLATFORM )
+const struct lgw_clock_s* lgw_clock_sim_get( void )
+{
+    return &clock_sim;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_clock_sim_set_time_us( int64_t time_us )
+{
+    pthread_mutex_lock( &mx_sim );
+    sim_time_us = time_us;
+    pthread_mutex_unlock( &mx_sim );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_clock_sim_advance_us( uint32_t delta_us )
+{
+    sim_delay_us( delta_us );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_clock_sim_set_threads( uint32_t nb_thread )
+{
+    pthread_mutex_lock( &mx_sim );
+    sim_nb_thread = nb_thread;
+    sim_dispatch( );
+    pthread_mutex_unlock( &mx_sim );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_clock_sim_attach( uint32_t rank )
+{
+    sim_attached = true;
+    sim_rank     = rank;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_clock_sim_detach( void )
+{
+    if( sim_attached == false )
+    {
+        return;
+    }
+    sim_attached = false;
+
+    /* the remaining threads may all be waiting */
+    pthread_mutex_lock( &mx_sim );
+    sim_nb_thread -= 1;
+    sim_dispatch( );
+    pthread_mutex_unlock( &mx_sim );
+}
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
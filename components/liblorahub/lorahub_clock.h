@@ -0,0 +1,119 @@
+/*______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    LoRaHub clock abstraction (hardware timer or simulated discrete-event clock)
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_CLOCK_H
+#define _LORAHUB_CLOCK_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_clock_s
+@brief Set of primitives giving the notion of time to the HAL, JIT and packet forwarder threads
+*/
+struct lgw_clock_s
+{
+    int64_t ( *get_time_us )( void );  /*!> monotonic time since boot, in microseconds */
+    void ( *delay_us )( uint32_t us ); /*!> busy wait, microsecond accuracy */
+    void ( *sleep_ms )( uint32_t ms ); /*!> yield the calling thread, millisecond accuracy */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Select the clock backend used by the HAL and the packet forwarder
+@param clock pointer to the backend to be used, NULL to restore the default one
+@return LGW_HAL_ERROR if the backend is incomplete, LGW_HAL_SUCCESS otherwise
+
+The default backend is esp_timer on target, and the simulated clock on host builds.
+*/
+int lgw_clock_set( const struct lgw_clock_s* clock );
+
+/**
+@brief Get the current time of the selected clock
+@return time in microseconds (64-bits, never wraps)
+*/
+int64_t lgw_clock_get_time_us( void );
+
+/**
+@brief Busy wait on the selected clock
+@param us number of microseconds to wait
+*/
+void lgw_clock_delay_us( uint32_t us );
+
+/**
+@brief Yield the calling thread for a given duration of the selected clock
+@param ms number of milliseconds to sleep
+*/
+void lgw_clock_sleep_ms( uint32_t ms );
+
+#if !defined( ESP_PLATFORM )
+/**
+@brief Get the simulated discrete-event clock backend, only built for the host (tests and simulations)
+
+A sleep of an attached thread registers its wakeup time in a queue. Once all the attached threads sleep, the time
+jumps to the earliest wakeup and only that thread runs, until it sleeps again: hours of traffic are replayed in a
+few seconds, in the same order at each run. Wakeups due at the same time are ordered by thread rank.
+A busy wait keeps the CPU, it moves the time without letting other threads run.
+An attached thread must not sleep while holding a lock another attached thread waits for, as time would stop.
+@return pointer to the backend, to be given to lgw_clock_set()
+*/
+const struct lgw_clock_s* lgw_clock_sim_get( void );
+
+/**
+@brief Set the current time of the simulated clock, before any thread sleeps on it
+@param time_us new virtual time in microseconds (can be set close to 2^32 to exercise count_us wraparound)
+*/
+void lgw_clock_sim_set_time_us( int64_t time_us );
+
+/**
+@brief Move the simulated clock forward
+@param delta_us number of microseconds to add to the virtual time
+*/
+void lgw_clock_sim_advance_us( uint32_t delta_us );
+
+/**
+@brief Set the number of threads taking part in the simulation
+@param nb_thread time only moves once this number of threads sleep on the simulated clock
+
+To be called before the threads are started. Threads which are not attached do not wait when they sleep, their
+sleeps move the time forward (single threaded use).
+*/
+void lgw_clock_sim_set_threads( uint32_t nb_thread );
+
+/**
+@brief Attach the calling thread to the simulated clock, its sleeps then wait in the wakeup queue
+@param rank unique rank of the thread, the lowest rank runs first among wakeups due at the same time
+*/
+void lgw_clock_sim_attach( uint32_t rank );
+
+/**
+@brief Detach the calling thread from the simulated clock, when it exits
+*/
+void lgw_clock_sim_detach( void );
+#endif
+
+#endif  // _LORAHUB_CLOCK_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -17,11 +17,11 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include <string.h>
 
-#include <esp_timer.h>
-
 #include "lorahub_log.h"
+#include "lorahub_clock.h"
 #include "lorahub_aux.h"
 #include "lorahub_hal.h"
+#include "lorahub_toa.h"
 #include "lorahub_hal_rx.h"
 #include "lorahub_hal_tx.h"
 
@@ -89,6 +89,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define LLCC68_RTC_FREQ_IN_HZ 64000UL
 #define LR11XX_RTC_FREQ_IN_HZ 32768UL
 
+#define LBT_TX_SETUP_US 3000       /* time left after the channel scan to configure the radio for TX */
+#define LBT_SCAN_TIME_MAX_US 15000 /* scan + TX setup must fit in the JiT pre-delay (30ms) minus its polling period */
+
 static const char* TAG_HAL = LRHB_LOG_HAL;
 
 /* -------------------------------------------------------------------------- */
@@ -101,6 +104,13 @@ static bool    is_started = false;
 static uint8_t rx_status  = RX_STATUS_UNKNOWN;
 static uint8_t tx_status  = TX_STATUS_UNKNOWN;
 
+static uint32_t tx_config_us = 0; /* duration of the last TX radio configuration */
+static uint32_t tx_lbt_us    = 0; /* time spent in LBT by the last TX, waiting for the scan slot included */
+static int32_t  tx_slack_us  = 0; /* time left before the last TX start once the radio was configured */
+
+static struct lgw_conf_lbt_s  lbt_conf  = { .enable = false, .rssi_target = -80, .scan_time_us = 5000 };
+static struct lgw_lbt_stats_s lbt_stats = { 0 };
+
 static struct lgw_conf_rxrf_s rxrf_conf = { .freq_hz = 0, .rssi_offset = 0.0, .tx_enable = false };
 
 static struct lgw_conf_rxif_s rxif_conf = { .bandwidth  = BW_UNDEFINED,
@@ -129,6 +139,138 @@ const ral_t lgw_ral = RAL_LR11XX_INSTANTIATE( RADIO_CONTEXT );
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+static bool lora_check_toa_params( const struct lgw_pkt_tx_s* packet )
+{
+    if( packet->modulation != MOD_LORA )
+    {
+        ESP_LOGE( TAG_HAL, "ERROR: Cannot compute time on air for this packet, unsupported modulation (0x%02X)\n",
+                  packet->modulation );
+        return false;
+    }
+
+    if( ( IS_LORA_DR( packet->datarate ) == false ) ||
+        ( lgw_check_lora_mod_params( packet->freq_hz, packet->bandwidth, packet->coderate ) != LGW_HAL_SUCCESS ) )
+    {
+        ESP_LOGE( TAG_HAL, "ERROR: Failed to compute time on air, wrong modulation parameters\n" );
+        return false;
+    }
+
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Time on air computed by the radio driver, for the parameters not covered by lgw_lora_time_on_air_ms() */
+static uint32_t lora_time_on_air_ral_ms( const struct lgw_pkt_tx_s* packet )
+{
+    ral_lora_pkt_params_t ral_pkt_params;
+    ral_pkt_params.preamble_len_in_symb = packet->preamble;
+    ral_pkt_params.header_type = ( packet->no_header == false ) ? RAL_LORA_PKT_EXPLICIT : RAL_LORA_PKT_IMPLICIT;
+    ral_pkt_params.pld_len_in_bytes = packet->size;
+    ral_pkt_params.crc_is_on        = ( packet->no_crc == false ) ? true : false;
+    ral_pkt_params.invert_iq_is_on  = packet->invert_pol;
+
+    ral_lora_sf_t         ral_sf = lgw_convert_hal_to_ral_sf( packet->datarate );
+    ral_lora_bw_t         ral_bw = lgw_convert_hal_to_ral_bw( packet->bandwidth );
+    ral_lora_cr_t         ral_cr = lgw_convert_hal_to_ral_cr( packet->coderate );
+    ral_lora_mod_params_t ral_mod_params;
+    ral_mod_params.sf   = ral_sf;
+    ral_mod_params.bw   = ral_bw;
+    ral_mod_params.cr   = ral_cr;
+    ral_mod_params.ldro = ral_compute_lora_ldro( ral_sf, ral_bw );
+
+    return ral_get_lora_time_on_air_in_ms( &lgw_ral, &ral_pkt_params, &ral_mod_params );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int lbt_check_channel( const struct lgw_pkt_tx_s* pkt_data )
+{
+    uint32_t count_us_entry;
+    uint32_t count_us_start;
+    uint32_t count_us_now;
+    uint32_t setup_us;
+    uint32_t latency_us;
+    int16_t  rssi_max;
+    int      err;
+
+    /* Scan right before TX, leaving the time to configure the radio (as measured on previous TX) */
+    setup_us = ( tx_config_us > LBT_TX_SETUP_US ) ? tx_config_us : LBT_TX_SETUP_US;
+    lgw_get_instcnt( &count_us_entry );
+    if( pkt_data->tx_mode == TIMESTAMPED )
+    {
+        do
+        {
+            lgw_get_instcnt( &count_us_now );
+            WAIT_US( 100 );
+        } while( ( int32_t ) ( pkt_data->count_us - count_us_now ) > ( int32_t ) ( lbt_conf.scan_time_us + setup_us ) );
+    }
+
+    lgw_get_instcnt( &count_us_start );
+    err = lgw_radio_lbt_scan( &lgw_ral, pkt_data, lbt_conf.scan_time_us, &rssi_max );
+    lgw_get_instcnt( &count_us_now );
+    tx_lbt_us = count_us_now - count_us_entry;
+    if( err != LGW_HAL_SUCCESS )
+    {
+        return LGW_HAL_ERROR;
+    }
+
+    /* Update statistics */
+    latency_us = count_us_now - count_us_start;
+    lbt_stats.nb_scan += 1;
+    lbt_stats.latency_us_sum += latency_us;
+    if( latency_us > lbt_stats.latency_us_max )
+    {
+        lbt_stats.latency_us_max = latency_us;
+    }
+
+    rssi_max += ( int16_t ) rxrf_conf.rssi_offset;
+    if( rssi_max > lbt_conf.rssi_target )
+    {
+        if( ( lbt_stats.nb_busy == 0 ) || ( rssi_max > lbt_stats.rssi_busy_max ) )
+        {
+            lbt_stats.rssi_busy_max = rssi_max;
+        }
+        lbt_stats.nb_busy += 1;
+        return LGW_LBT_NOT_ALLOWED;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int check_rxif_conf( const struct lgw_conf_rxif_s* conf )
+{
+    if( IS_LORA_DR( conf->datarate[0] ) == false )
+    {
+        ESP_LOGE( TAG_HAL, "ERROR: wrong datarate[0] - %s\n", __FUNCTION__ );
+        return LGW_HAL_ERROR;
+    }
+
+    if( ( conf->datarate[1] != DR_UNDEFINED ) && ( IS_LORA_DR( conf->datarate[1] ) == false ) )
+    {
+        ESP_LOGE( TAG_HAL, "ERROR: wrong datarate[1] - %s\n", __FUNCTION__ );
+        return LGW_HAL_ERROR;
+    }
+
+    if( IS_LORA_BW( conf->bandwidth ) == false )
+    {
+        ESP_LOGE( TAG_HAL, "ERROR: wrong bandwidth - %s\n", __FUNCTION__ );
+        return LGW_HAL_ERROR;
+    }
+
+    if( IS_LORA_CR( conf->coderate ) == false )
+    {
+        ESP_LOGE( TAG_HAL, "ERROR: wrong coderate - %s\n", __FUNCTION__ );
+        return LGW_HAL_ERROR;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_connect( void )
 {
     esp_err_t ret;
@@ -327,34 +469,40 @@ int lgw_rxif_setconf( struct lgw_conf_rxif_s* conf )
         return LGW_HAL_ERROR;
     }
 
-    if( IS_LORA_DR( conf->datarate[0] ) == false )
+    if( check_rxif_conf( conf ) != LGW_HAL_SUCCESS )
     {
-        ESP_LOGE( TAG_HAL, "ERROR: wrong datarate[0] - %s\n", __FUNCTION__ );
         return LGW_HAL_ERROR;
     }
 
-    if( ( conf->datarate[1] != DR_UNDEFINED ) && ( IS_LORA_DR( conf->datarate[1] ) == false ) )
-    {
-        ESP_LOGE( TAG_HAL, "ERROR: wrong datarate[1] - %s\n", __FUNCTION__ );
-        return LGW_HAL_ERROR;
-    }
+    memcpy( &rxif_conf, conf, sizeof( struct lgw_conf_rxif_s ) );
 
-    if( IS_LORA_BW( conf->bandwidth ) == false )
+    return LGW_HAL_SUCCESS;
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_lbt_setconf( struct lgw_conf_lbt_s* conf )
+{
+    CHECK_NULL( conf );
+
+    /* check if the concentrator is running */
+    if( is_started == true )
     {
-        ESP_LOGE( TAG_HAL, "ERROR: wrong bandwidth - %s\n", __FUNCTION__ );
+        ESP_LOGI( TAG_HAL, "ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE CHANGING CONFIGURATION\n" );
         return LGW_HAL_ERROR;
     }
 
-    if( IS_LORA_CR( conf->coderate ) == false )
+    if( ( conf->enable == true ) && ( ( conf->scan_time_us == 0 ) || ( conf->scan_time_us > LBT_SCAN_TIME_MAX_US ) ) )
     {
-        ESP_LOGE( TAG_HAL, "ERROR: wrong coderate - %s\n", __FUNCTION__ );
+        ESP_LOGE( TAG_HAL, "ERROR: LBT scan time %u us not supported (max %u us)\n", conf->scan_time_us,
+                  LBT_SCAN_TIME_MAX_US );
         return LGW_HAL_ERROR;
     }
 
-    memcpy( &rxif_conf, conf, sizeof( struct lgw_conf_rxif_s ) );
+    memcpy( &lbt_conf, conf, sizeof( struct lgw_conf_lbt_s ) );
 
     return LGW_HAL_SUCCESS;
-};
+}
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -481,6 +629,47 @@ int lgw_stop( void )
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_rx_retune( struct lgw_conf_rxrf_s* rf_conf, struct lgw_conf_rxif_s* if_conf )
+{
+    int err;
+
+    CHECK_NULL( rf_conf );
+    CHECK_NULL( if_conf );
+
+    /* check if the concentrator is running */
+    if( is_started == false )
+    {
+        ESP_LOGE( TAG_HAL, "ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RETUNING\n" );
+        return LGW_HAL_ERROR;
+    }
+
+    if( check_rxif_conf( if_conf ) != LGW_HAL_SUCCESS )
+    {
+        return LGW_HAL_ERROR;
+    }
+
+    /* Same sequence as the return to RX after a TX (image calibration included), the counter keeps running */
+    rx_status = RX_SUSPENDED;
+    err       = lgw_radio_configure_rx( &lgw_ral, rf_conf->freq_hz, if_conf );
+    if( err == LGW_HAL_ERROR )
+    {
+        ESP_LOGE( TAG_HAL, "ERROR: FAILED TO CONFIGURE RADIO FOR RX, BACK TO PREVIOUS CONFIGURATION" );
+        lgw_radio_configure_rx( &lgw_ral, rxrf_conf.freq_hz, &rxif_conf );
+        lgw_radio_set_rx( &lgw_ral );
+        rx_status = RX_ON;
+        return LGW_HAL_ERROR;
+    }
+    lgw_radio_set_rx( &lgw_ral );
+    rx_status = RX_ON;
+
+    memcpy( &rxrf_conf, rf_conf, sizeof( struct lgw_conf_rxrf_s ) );
+    memcpy( &rxif_conf, if_conf, sizeof( struct lgw_conf_rxif_s ) );
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_receive( uint8_t max_pkt, struct lgw_pkt_rx_s* pkt_data )
 {
     struct lgw_pkt_rx_s* p = &pkt_data[0];
@@ -547,8 +736,29 @@ int lgw_send( struct lgw_pkt_tx_s* pkt_data )
 
     /* Update RX status */
     rx_status = RX_SUSPENDED;
+    tx_lbt_us = 0;
+
+    /* Listen Before Talk on the TX channel */
+    if( lbt_conf.enable == true )
+    {
+        err = lbt_check_channel( pkt_data );
+        if( err != LGW_HAL_SUCCESS )
+        {
+            if( err == LGW_HAL_ERROR )
+            {
+                ESP_LOGE( TAG_HAL, "ERROR: FAILED TO SCAN CHANNEL FOR LBT" );
+            }
+            /* Back to RX */
+            lgw_radio_configure_rx( &lgw_ral, rxrf_conf.freq_hz, &rxif_conf );
+            lgw_radio_set_rx( &lgw_ral );
+            rx_status = RX_ON;
+            return err;
+        }
+    }
 
     /* Configure for TX */
+    uint32_t count_us_start;
+    lgw_get_instcnt( &count_us_start );
     err = lgw_radio_configure_tx( &lgw_ral, pkt_data );
     if( err == LGW_HAL_ERROR )
     {
@@ -579,6 +789,9 @@ int lgw_send( struct lgw_pkt_tx_s* pkt_data )
 
     /* Wait for time to send packet */
     uint32_t count_us_now;
+    lgw_get_instcnt( &count_us_now );
+    tx_config_us = count_us_now - count_us_start;
+    tx_slack_us  = ( int32_t ) ( pkt_data->count_us - count_us_now ); /* no log here, TX start is imminent */
     do
     {
         lgw_get_instcnt( &count_us_now );
@@ -612,7 +825,7 @@ int lgw_send( struct lgw_pkt_tx_s* pkt_data )
         }
 
         /* Yield for 10ms (avoid TWDT watchdog timeout) for long TX */
-        vTaskDelay( pdMS_TO_TICKS( 10 ) );
+        lgw_clock_sleep_ms( 10 );
     } while( ( flag_tx_done == false ) && ( flag_tx_timeout == false ) );
 
     ESP_LOGD( TAG_HAL, "TCXO startup time: %lu", tcxo_startup_time_us );
@@ -678,9 +891,38 @@ int lgw_status( uint8_t rf_chain, uint8_t select, uint8_t* code )
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_lbt_get_stats( struct lgw_lbt_stats_s* stats )
+{
+    CHECK_NULL( stats );
+
+    *stats = lbt_stats;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_tx_timing( uint32_t* config_us, uint32_t* lbt_us, int32_t* slack_us )
+{
+    CHECK_NULL( config_us );
+    CHECK_NULL( lbt_us );
+    CHECK_NULL( slack_us );
+
+    *config_us = tx_config_us;
+    *lbt_us    = tx_lbt_us;
+    *slack_us  = tx_slack_us;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_get_instcnt( uint32_t* inst_cnt_us )
 {
-    int64_t count_us_64 = esp_timer_get_time( );
+    CHECK_NULL( inst_cnt_us );
+
+    /* 32-bits counter wraps every ~71 minutes, as the concentrator one */
+    int64_t count_us_64 = lgw_clock_get_time_us( );
 
     *inst_cnt_us = ( uint32_t ) count_us_64;
 
@@ -691,7 +933,7 @@ int lgw_get_instcnt( uint32_t* inst_cnt_us )
 
 uint32_t lgw_time_on_air( const struct lgw_pkt_tx_s* packet )
 {
-    uint32_t toa_ms = 0;
+    uint32_t toa_ms;
 
     if( packet == NULL )
     {
@@ -699,36 +941,15 @@ uint32_t lgw_time_on_air( const struct lgw_pkt_tx_s* packet )
         return 0;
     }
 
-    if( packet->modulation == MOD_LORA )
+    if( lora_check_toa_params( packet ) == false )
     {
-        if( lgw_check_lora_mod_params( packet->freq_hz, packet->bandwidth, packet->coderate ) != LGW_HAL_SUCCESS )
-        {
-            ESP_LOGE( TAG_HAL, "ERROR: Failed to compute time on air, wrong modulation parameters\n" );
-            return 0;
-        }
-
-        ral_lora_pkt_params_t ral_pkt_params;
-        ral_pkt_params.preamble_len_in_symb = packet->preamble;
-        ral_pkt_params.header_type = ( packet->no_header == false ) ? RAL_LORA_PKT_EXPLICIT : RAL_LORA_PKT_IMPLICIT;
-        ral_pkt_params.pld_len_in_bytes = packet->size;
-        ral_pkt_params.crc_is_on        = ( packet->no_crc == false ) ? true : false;
-        ral_pkt_params.invert_iq_is_on  = packet->invert_pol;
-
-        ral_lora_sf_t         ral_sf = lgw_convert_hal_to_ral_sf( packet->datarate );
-        ral_lora_bw_t         ral_bw = lgw_convert_hal_to_ral_bw( packet->bandwidth );
-        ral_lora_cr_t         ral_cr = lgw_convert_hal_to_ral_cr( packet->coderate );
-        ral_lora_mod_params_t ral_mod_params;
-        ral_mod_params.sf   = ral_sf;
-        ral_mod_params.bw   = ral_bw;
-        ral_mod_params.cr   = ral_cr;
-        ral_mod_params.ldro = ral_compute_lora_ldro( ral_sf, ral_bw );
-        toa_ms              = ral_get_lora_time_on_air_in_ms( &lgw_ral, &ral_pkt_params, &ral_mod_params );
+        return 0;
     }
-    else
+
+    toa_ms = lgw_lora_time_on_air_ms( packet );
+    if( toa_ms == 0 )
     {
-        toa_ms = 0;
-        ESP_LOGE( TAG_HAL, "ERROR: Cannot compute time on air for this packet, unsupported modulation (0x%02X)\n",
-                  packet->modulation );
+        return lora_time_on_air_ral_ms( packet );
     }
 
     return toa_ms;
@@ -736,6 +957,32 @@ uint32_t lgw_time_on_air( const struct lgw_pkt_tx_s* packet )
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+uint32_t lgw_time_on_air_us( const struct lgw_pkt_tx_s* packet )
+{
+    uint32_t toa_us;
+
+    if( packet == NULL )
+    {
+        ESP_LOGE( TAG_HAL, "ERROR: Failed to compute time on air, wrong parameter\n" );
+        return 0;
+    }
+
+    if( lora_check_toa_params( packet ) == false )
+    {
+        return 0;
+    }
+
+    toa_us = lgw_lora_time_on_air_us( packet );
+    if( toa_us == 0 )
+    {
+        return lora_time_on_air_ral_ms( packet ) * 1000;
+    }
+
+    return toa_us;
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_get_min_max_freq_hz( uint32_t* min_freq_hz, uint32_t* max_freq_hz )
 {
     if( rxrf_conf.freq_hz == 0 )
@@ -40,6 +40,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* return status code */
 #define LGW_HAL_SUCCESS 0
 #define LGW_HAL_ERROR -1
+#define LGW_LBT_NOT_ALLOWED 1
 
 /* radio-specific parameters */
 #define LGW_RF_CHAIN_NB 1 /* number of RF chains */
@@ -154,6 +155,30 @@ struct lgw_conf_rxif_s
     uint8_t coderate;                  /*!> RX coding rate */
 };
 
+/**
+@struct lgw_conf_lbt_s
+@brief Listen-Before-Talk configuration structure
+*/
+struct lgw_conf_lbt_s
+{
+    bool     enable;       /*!> enable or disable LBT before each TX */
+    int8_t   rssi_target;  /*!> RSSI threshold above which the channel is considered busy, in dBm */
+    uint16_t scan_time_us; /*!> duration of the channel scan, in microseconds */
+};
+
+/**
+@struct lgw_lbt_stats_s
+@brief Listen-Before-Talk statistics, since boot
+*/
+struct lgw_lbt_stats_s
+{
+    uint32_t nb_scan;        /*!> number of channel scans performed */
+    uint32_t nb_busy;        /*!> number of TX aborted because the channel was busy */
+    int16_t  rssi_busy_max;  /*!> highest RSSI measured on a busy channel, in dBm */
+    uint32_t latency_us_sum; /*!> total time spent in LBT, to compute the average added latency */
+    uint32_t latency_us_max; /*!> longest time spent in LBT for one TX */
+};
+
 /**
 @struct lgw_pkt_rx_s
 @brief Structure containing the metadata of a packet that was received and a pointer to the payload
@@ -216,6 +241,13 @@ int lgw_rxrf_setconf( struct lgw_conf_rxrf_s* conf );
 */
 int lgw_rxif_setconf( struct lgw_conf_rxif_s* conf );
 
+/**
+@brief Configure the Listen-Before-Talk stage of lgw_send() (must configure before start)
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_lbt_setconf( struct lgw_conf_lbt_s* conf );
+
 /**
 @brief Connect to the LoRa concentrator, reset it and configure it according to previously set parameters
 @return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
@@ -228,6 +260,17 @@ int lgw_start( void );
 */
 int lgw_stop( void );
 
+/**
+@brief Change the RX channel of a running concentrator, without resetting it nor stopping its counter
+@param rf_conf structure containing the new radio parameters (TX enable and RSSI offset are replaced as well)
+@param if_conf structure containing the new modulation parameters
+@return LGW_HAL_ERROR id the operation failed (previous channel kept), LGW_HAL_SUCCESS else
+
+The caller must make sure no lgw_receive() or lgw_send() is running concurrently. The receiver is blind for the time
+needed to configure the radio, a packet being received at that time is lost.
+*/
+int lgw_rx_retune( struct lgw_conf_rxrf_s* rf_conf, struct lgw_conf_rxif_s* if_conf );
+
 /**
 @brief A non-blocking function that will fetch up to 'max_pkt' packets from the LoRa concentrator FIFO and data buffer
 @param max_pkt maximum number of packet that must be retrieved (equal to the size of the array of struct)
@@ -239,7 +282,7 @@ int lgw_receive( uint8_t max_pkt, struct lgw_pkt_rx_s* pkt_data );
 /**
 @brief Schedule a packet to be send immediately or after a delay depending on tx_mode
 @param pkt_data structure containing the data and metadata for the packet to send
-@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+@return LGW_HAL_ERROR id the operation failed, LGW_LBT_NOT_ALLOWED if LBT found the channel busy, LGW_HAL_SUCCESS else
 
 /!\ When sending a packet, there is a delay (approx 1.5ms) for the analog
 circuitry to start and be stable. This delay is adjusted by the HAL depending
@@ -277,6 +320,24 @@ int lgw_status( uint8_t rf_chain, uint8_t select, uint8_t* code );
 */
 int lgw_get_instcnt( uint32_t* inst_cnt_us );
 
+/**
+@brief Return timing measurements of the last lgw_send() call
+@param config_us pointer to receive the time spent to configure the radio for TX, in microseconds
+@param lbt_us pointer to receive the time spent in Listen-Before-Talk, waiting for the scan slot included, in
+microseconds (0 if LBT is disabled)
+@param slack_us pointer to receive the time left before the TX start once the radio was configured, in microseconds
+(negative if the packet was programmed too late)
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_get_tx_timing( uint32_t* config_us, uint32_t* lbt_us, int32_t* slack_us );
+
+/**
+@brief Return the Listen-Before-Talk statistics
+@param stats pointer to receive the statistics
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_lbt_get_stats( struct lgw_lbt_stats_s* stats );
+
 /**
 @brief Return time on air of given packet, in milliseconds
 @param packet is a pointer to the packet structure
@@ -284,6 +345,14 @@ int lgw_get_instcnt( uint32_t* inst_cnt_us );
 */
 uint32_t lgw_time_on_air( const struct lgw_pkt_tx_s* packet );
 
+/**
+@brief Return time on air of given packet, in microseconds
+@param packet is a pointer to the packet structure
+@return the packet time on air in microseconds (rounded up), the millisecond value of lgw_time_on_air() is the same
+rounded up to the next millisecond
+*/
+uint32_t lgw_time_on_air_us( const struct lgw_pkt_tx_s* packet );
+
 /**
 @brief Return minimum and maximum frequency supported by the configured radio (in Hz)
 @param  min_freq_hz pointer to hold the minimum frequency supported
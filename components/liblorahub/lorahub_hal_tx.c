@@ -31,6 +31,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ----------------------------------------------------- */
 
+#define LBT_RSSI_SETTLE_US 250 /* time for the RSSI to be valid after entering RX */
+#define LBT_RSSI_PERIOD_US 100 /* instantaneous RSSI sampling period */
+
 static const char* TAG_HAL_TX = LRHB_LOG_HAL_TX;
 
 /* -------------------------------------------------------------------------- */
@@ -115,4 +118,48 @@ int lgw_radio_configure_tx( const ral_t* ral, struct lgw_pkt_tx_s* pkt_data )
     return LGW_HAL_SUCCESS;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_radio_lbt_scan( const ral_t* ral, const struct lgw_pkt_tx_s* pkt_data, uint32_t scan_time_us,
+                        int16_t* rssi_max )
+{
+    uint32_t count_us_start;
+    uint32_t count_us_now;
+    int16_t  rssi;
+
+    /* Listen on the TX channel, with the TX bandwidth */
+    ASSERT_RAL_RC( ral_set_standby( ral, RAL_STANDBY_CFG_RC ) );
+    ASSERT_RAL_RC( ral_set_pkt_type( ral, RAL_PKT_TYPE_LORA ) );
+    ASSERT_RAL_RC( ral_set_rf_freq( ral, pkt_data->freq_hz ) );
+
+    ral_lora_sf_t         ral_sf          = lgw_convert_hal_to_ral_sf( pkt_data->datarate );
+    ral_lora_bw_t         ral_bw          = lgw_convert_hal_to_ral_bw( pkt_data->bandwidth );
+    ral_lora_mod_params_t lora_mod_params = {
+        .sf = ral_sf, .bw = ral_bw, .cr = RAL_LORA_CR_4_5, .ldro = ral_compute_lora_ldro( ral_sf, ral_bw )
+    };
+    ASSERT_RAL_RC( ral_set_lora_mod_params( ral, &lora_mod_params ) );
+
+    ASSERT_RAL_RC( ral_set_dio_irq_params( ral, RAL_IRQ_NONE ) );
+    ASSERT_RAL_RC( ral_set_rx( ral, RAL_RX_TIMEOUT_CONTINUOUS_MODE ) );
+    WAIT_US( LBT_RSSI_SETTLE_US );
+
+    /* Sample the instantaneous RSSI over the scan window, and keep the highest value */
+    *rssi_max = INT16_MIN;
+    lgw_get_instcnt( &count_us_start );
+    do
+    {
+        ASSERT_RAL_RC( ral_get_rssi_inst( ral, &rssi ) );
+        if( rssi > *rssi_max )
+        {
+            *rssi_max = rssi;
+        }
+        WAIT_US( LBT_RSSI_PERIOD_US );
+        lgw_get_instcnt( &count_us_now );
+    } while( ( count_us_now - count_us_start ) < scan_time_us );
+
+    ASSERT_RAL_RC( ral_set_standby( ral, RAL_STANDBY_CFG_RC ) );
+
+    return LGW_HAL_SUCCESS;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
\ No newline at end of file
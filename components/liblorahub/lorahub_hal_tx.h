@@ -35,6 +35,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 int lgw_radio_configure_tx( const ral_t* ral, struct lgw_pkt_tx_s* pkt_data );
 
+int lgw_radio_lbt_scan( const ral_t* ral, const struct lgw_pkt_tx_s* pkt_data, uint32_t scan_time_us,
+                        int16_t* rssi_max );
+
 #endif  // _LORAHUB_HAL_TX_H
 
 /* --- EOF ------------------------------------------------------------------ */
\ No newline at end of file
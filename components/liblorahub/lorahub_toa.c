@@ -0,0 +1,124 @@
+/*______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+(C)2024 Semtech
+
+Description:
+    LoRa time on air, same integer formula as the sx126x, llcc68 and lr11xx radio drivers
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+#include "lorahub_toa.h"
+#include "lorahub_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t bw_hz;       /* bandwidth, as used by the radio drivers to compute the symbol time */
+    uint8_t  ldro_sf_min; /* lowest spreading factor with Low Data Rate Optimization (symbol time >= 16.38ms) */
+} lora_bw_params_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* Indexed by the HAL bandwidth, same LDRO rule as ral_compute_lora_ldro() */
+static const lora_bw_params_t lora_bw_params[BW_800KHZ + 1] = {
+    [BW_125KHZ] = { 125000, DR_LORA_SF11 }, [BW_250KHZ] = { 250000, DR_LORA_SF12 },
+    [BW_500KHZ] = { 500000, DR_LORA_SF12 + 1 }, [BW_200KHZ] = { 203125, DR_LORA_SF11 },
+    [BW_400KHZ] = { 406250, DR_LORA_SF11 }, [BW_800KHZ] = { 812500, DR_LORA_SF11 },
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+uint32_t lgw_lora_time_on_air_numerator( const struct lgw_pkt_tx_s* packet, uint32_t* bw_hz )
+{
+    int32_t sf = packet->datarate;
+    int32_t ceil_numerator;
+    int32_t ceil_denominator;
+    int32_t nb_symb;
+
+    if( ( sf < DR_LORA_SF5 ) || ( sf > DR_LORA_SF12 ) || ( packet->bandwidth > BW_800KHZ ) ||
+        ( lora_bw_params[packet->bandwidth].bw_hz == 0 ) || ( packet->coderate < CR_LORA_4_5 ) ||
+        ( packet->coderate > CR_LORA_4_8 ) )
+    {
+        return 0;
+    }
+
+    /* Payload symbols: header, payload and CRC bits spread over SF (or SF-2 with LDRO) bits per symbol */
+    ceil_numerator = ( packet->size << 3 ) + ( ( packet->no_crc == false ) ? 16 : 0 ) - ( 4 * sf ) +
+                     ( ( packet->no_header == false ) ? 20 : 0 );
+    if( sf <= DR_LORA_SF6 )
+    {
+        ceil_denominator = 4 * sf;
+    }
+    else
+    {
+        ceil_numerator += 8;
+        ceil_denominator = ( sf >= lora_bw_params[packet->bandwidth].ldro_sf_min ) ? ( 4 * ( sf - 2 ) ) : ( 4 * sf );
+    }
+    if( ceil_numerator < 0 )
+    {
+        ceil_numerator = 0;
+    }
+
+    /* Preamble + sync word (4.25 symbols) + 8 symbols of header/first block + coded payload symbols */
+    nb_symb = ( ( ceil_numerator + ceil_denominator - 1 ) / ceil_denominator ) * ( packet->coderate + 4 ) +
+              packet->preamble + 12;
+    if( sf <= DR_LORA_SF6 )
+    {
+        nb_symb += 2;
+    }
+
+    *bw_hz = lora_bw_params[packet->bandwidth].bw_hz;
+
+    /* Number of quarter symbols, by the 2^SF/4 chips of a quarter symbol */
+    return ( uint32_t ) ( ( 4 * nb_symb + 1 ) << ( sf - 2 ) );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_lora_time_on_air_ms( const struct lgw_pkt_tx_s* packet )
+{
+    uint32_t numerator;
+    uint32_t bw_hz;
+
+    numerator = lgw_lora_time_on_air_numerator( packet, &bw_hz );
+    if( numerator == 0 )
+    {
+        return 0;
+    }
+
+    /* Rounded up, as the radio drivers do */
+    return ( uint32_t ) ( ( ( uint64_t ) numerator * 1000 + bw_hz - 1 ) / bw_hz );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_lora_time_on_air_us( const struct lgw_pkt_tx_s* packet )
+{
+    uint32_t numerator;
+    uint32_t bw_hz;
+
+    numerator = lgw_lora_time_on_air_numerator( packet, &bw_hz );
+    if( numerator == 0 )
+    {
+        return 0;
+    }
+
+    return ( uint32_t ) ( ( ( uint64_t ) numerator * 1000000 + bw_hz - 1 ) / bw_hz );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,53 @@
+/*______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    LoRa time on air, same integer formula as the sx126x, llcc68 and lr11xx radio drivers
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_TOA_H
+#define _LORAHUB_TOA_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+#include "lorahub_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Compute the time on air of a LoRa packet, as a number of 1/bw_hz seconds
+@param packet packet to be sent, modulation parameters are expected to be checked by the caller
+@param bw_hz pointer to receive the bandwidth used by the radio drivers, in Hz
+@return time on air in 1/bw_hz seconds, 0 for parameters not covered (invalid, or LR11xx long interleaver coding rates)
+*/
+uint32_t lgw_lora_time_on_air_numerator( const struct lgw_pkt_tx_s* packet, uint32_t* bw_hz );
+
+/**
+@brief Compute the time on air of a LoRa packet, rounded up to the millisecond as the radio drivers do
+@param packet packet to be sent, modulation parameters are expected to be checked by the caller
+@return time on air in milliseconds, 0 for parameters not covered
+*/
+uint32_t lgw_lora_time_on_air_ms( const struct lgw_pkt_tx_s* packet );
+
+/**
+@brief Compute the time on air of a LoRa packet, rounded up to the microsecond
+@param packet packet to be sent, modulation parameters are expected to be checked by the caller
+@return time on air in microseconds, 0 for parameters not covered
+*/
+uint32_t lgw_lora_time_on_air_us( const struct lgw_pkt_tx_s* packet );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
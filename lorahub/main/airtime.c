@@ -0,0 +1,256 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Downlink airtime ledger: sliding window duty-cycle accounting per sub-band
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <string.h>  /* memset */
+#include <time.h>    /* clock_gettime */
+#include <pthread.h>
+
+#include "sdkconfig.h"
+
+#include "airtime.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#ifdef CONFIG_DOWNLINK_DUTY_CYCLE_WINDOW_S
+#define AIRTIME_WINDOW_S CONFIG_DOWNLINK_DUTY_CYCLE_WINDOW_S
+#else
+#define AIRTIME_WINDOW_S 3600
+#endif
+
+#ifdef CONFIG_DOWNLINK_DUTY_CYCLE_BUDGET
+#define AIRTIME_BUDGET_PERCENT CONFIG_DOWNLINK_DUTY_CYCLE_BUDGET
+#else
+#define AIRTIME_BUDGET_PERCENT 100
+#endif
+
+#ifdef CONFIG_DOWNLINK_DUTY_CYCLE_ENFORCE
+#define AIRTIME_ENFORCE true
+#else
+#define AIRTIME_ENFORCE false
+#endif
+
+/* The sub-bands limits only apply to the EU868 region, other regions have no duty-cycle limit */
+#ifdef CONFIG_DOWNLINK_DUTY_CYCLE_REGION_EU868
+#define AIRTIME_REGION_SUBBAND_NB AIRTIME_SUBBAND_NB
+#else
+#define AIRTIME_REGION_SUBBAND_NB 0
+#endif
+
+#define AIRTIME_BUCKET_NB 60 /* The window slides by 1/60th of its length */
+
+typedef struct
+{
+    uint32_t freq_min_hz;
+    uint32_t freq_max_hz;
+    uint16_t duty_permille; /* regulatory duty-cycle limit */
+} airtime_subband_t;
+
+/* EU868 sub-bands (ETSI EN 300 220, ERC REC 70-03 annexes 1 and 7), searched in order: the last one gives the most
+ * restrictive limit to any other frequency */
+static const airtime_subband_t subbands[AIRTIME_SUBBAND_NB] = {
+    { 863000000, 865000000, 1 },   { 865000000, 868000000, 10 },  { 868000000, 868600000, 10 },
+    { 868600000, 868700000, 10 },  { 868700000, 869200000, 1 },   { 869200000, 869250000, 1 },
+    { 869250000, 869300000, 1 },   { 869300000, 869400000, 10 },  { 869400000, 869650000, 100 },
+    { 869650000, 869700000, 100 }, { 869700000, 870000000, 10 },  { 0, UINT32_MAX, 1 },
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static pthread_mutex_t mx_airtime = PTHREAD_MUTEX_INITIALIZER; /* control access to the ledger */
+
+static uint32_t bucket_id[AIRTIME_BUCKET_NB];                     /* absolute index of the bucket in each slot */
+static uint32_t bucket_ms[AIRTIME_BUCKET_NB][AIRTIME_SUBBAND_NB]; /* airtime emitted during each bucket */
+static uint32_t pending_ms[AIRTIME_SUBBAND_NB];                   /* airtime of enqueued downlinks */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int get_subband( uint32_t freq_hz )
+{
+    int i;
+
+    for( i = 0; i < AIRTIME_REGION_SUBBAND_NB; i++ )
+    {
+        if( ( freq_hz >= subbands[i].freq_min_hz ) && ( freq_hz < subbands[i].freq_max_hz ) )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t get_budget_ms( int subband )
+{
+    /* window_s * 1000 * (duty_permille / 1000) * (budget_percent / 100) */
+    return ( uint32_t ) ( ( ( uint64_t ) AIRTIME_WINDOW_S * subbands[subband].duty_permille * AIRTIME_BUDGET_PERCENT ) /
+                          100 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Must be called with mx_airtime locked, returns the absolute index of the current bucket */
+static uint32_t update_buckets( void )
+{
+    struct timespec now;
+    uint32_t        id;
+    int             slot;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    id   = ( uint32_t ) ( ( ( uint64_t ) now.tv_sec * AIRTIME_BUCKET_NB ) / AIRTIME_WINDOW_S );
+    slot = id % AIRTIME_BUCKET_NB;
+    if( bucket_id[slot] != id )
+    {
+        bucket_id[slot] = id;
+        memset( bucket_ms[slot], 0, sizeof bucket_ms[slot] );
+    }
+
+    return id;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Must be called with mx_airtime locked */
+static uint32_t get_used_ms( uint32_t current_id, int subband )
+{
+    uint32_t used_ms = 0;
+    int      i;
+
+    for( i = 0; i < AIRTIME_BUCKET_NB; i++ )
+    {
+        if( ( current_id - bucket_id[i] ) < AIRTIME_BUCKET_NB )
+        {
+            used_ms += bucket_ms[i][subband];
+        }
+    }
+
+    return used_ms;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int airtime_reserve( uint32_t freq_hz, uint32_t toa_ms )
+{
+    int      subband;
+    uint32_t id;
+    int      err = 0;
+
+    subband = get_subband( freq_hz );
+    if( subband < 0 )
+    {
+        /* No duty-cycle limit for this frequency */
+        return 0;
+    }
+
+    pthread_mutex_lock( &mx_airtime );
+    id = update_buckets( );
+    if( ( AIRTIME_ENFORCE == true ) &&
+        ( ( get_used_ms( id, subband ) + pending_ms[subband] + toa_ms ) > get_budget_ms( subband ) ) )
+    {
+        err = -1;
+    }
+    else
+    {
+        pending_ms[subband] += toa_ms;
+    }
+    pthread_mutex_unlock( &mx_airtime );
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void airtime_release( uint32_t freq_hz, uint32_t toa_ms )
+{
+    int subband;
+
+    subband = get_subband( freq_hz );
+    if( subband < 0 )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &mx_airtime );
+    pending_ms[subband] -= ( toa_ms < pending_ms[subband] ) ? toa_ms : pending_ms[subband];
+    pthread_mutex_unlock( &mx_airtime );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void airtime_commit( uint32_t freq_hz, uint32_t toa_ms )
+{
+    int      subband;
+    uint32_t id;
+
+    subband = get_subband( freq_hz );
+    if( subband < 0 )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &mx_airtime );
+    id = update_buckets( );
+    pending_ms[subband] -= ( toa_ms < pending_ms[subband] ) ? toa_ms : pending_ms[subband];
+    bucket_ms[id % AIRTIME_BUCKET_NB][subband] += toa_ms;
+    pthread_mutex_unlock( &mx_airtime );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void airtime_get_stats( airtime_stats_t* stats )
+{
+    uint32_t id;
+    float    utilisation;
+    int      i;
+
+    if( stats == NULL )
+    {
+        return;
+    }
+
+    stats->enforced        = AIRTIME_ENFORCE;
+    stats->window_s        = AIRTIME_WINDOW_S;
+    stats->nb_subband      = AIRTIME_REGION_SUBBAND_NB;
+    stats->max_utilisation = 0.0;
+
+    pthread_mutex_lock( &mx_airtime );
+    id = update_buckets( );
+    for( i = 0; i < AIRTIME_REGION_SUBBAND_NB; i++ )
+    {
+        stats->freq_min_hz[i] = subbands[i].freq_min_hz;
+        stats->freq_max_hz[i] = subbands[i].freq_max_hz;
+        stats->budget_ms[i]   = get_budget_ms( i );
+        stats->used_ms[i]     = get_used_ms( id, i );
+        stats->pending_ms[i]  = pending_ms[i];
+
+        utilisation = 100.0 * ( float ) ( stats->used_ms[i] + stats->pending_ms[i] ) / ( float ) stats->budget_ms[i];
+        if( utilisation > stats->max_utilisation )
+        {
+            stats->max_utilisation = utilisation;
+        }
+    }
+    pthread_mutex_unlock( &mx_airtime );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
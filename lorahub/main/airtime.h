@@ -0,0 +1,82 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Downlink airtime ledger: sliding window duty-cycle accounting per sub-band
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_AIRTIME_H
+#define _LORAHUB_AIRTIME_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define AIRTIME_SUBBAND_NB 12 /* Number of EU868 sub-bands with a duty-cycle limit, other frequencies included */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct airtime_stats_s
+@brief Current utilisation of the sub-bands over the sliding window
+*/
+typedef struct airtime_stats_s
+{
+    bool     enforced;                        /* downlinks over budget are rejected */
+    uint32_t window_s;                        /* length of the sliding window */
+    uint8_t  nb_subband;                      /* number of sub-bands limited in the configured region */
+    uint32_t freq_min_hz[AIRTIME_SUBBAND_NB]; /* sub-band lower edge */
+    uint32_t freq_max_hz[AIRTIME_SUBBAND_NB]; /* sub-band upper edge */
+    uint32_t budget_ms[AIRTIME_SUBBAND_NB];   /* airtime allowed over the window */
+    uint32_t used_ms[AIRTIME_SUBBAND_NB];     /* airtime emitted over the window */
+    uint32_t pending_ms[AIRTIME_SUBBAND_NB];  /* airtime of enqueued downlinks, not yet emitted */
+    float    max_utilisation;                 /* highest (used + pending) / budget ratio, in percent */
+} airtime_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Account for a downlink about to be enqueued (thread safe)
+@param freq_hz TX frequency of the downlink
+@param toa_ms time on air of the downlink, as given by lgw_time_on_air()
+@return 0 if the downlink fits in the budget of its sub-band (or if the budget is not enforced), -1 otherwise
+*/
+int airtime_reserve( uint32_t freq_hz, uint32_t toa_ms );
+
+/**
+@brief Cancel a reservation, for a downlink rejected by the JiT queue or failed to be emitted (thread safe)
+@param freq_hz TX frequency of the downlink
+@param toa_ms time on air given to airtime_reserve()
+*/
+void airtime_release( uint32_t freq_hz, uint32_t toa_ms );
+
+/**
+@brief Move a reservation to the sliding window once the downlink has been emitted (TX_DONE) (thread safe)
+@param freq_hz TX frequency of the downlink
+@param toa_ms time on air given to airtime_reserve()
+*/
+void airtime_commit( uint32_t freq_hz, uint32_t toa_ms );
+
+/**
+@brief Get the current utilisation of all sub-bands (thread safe)
+@param stats[out] utilisation of the sub-bands
+*/
+void airtime_get_stats( airtime_stats_t* stats );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -15,8 +15,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDENCIES --------------------------------------------------------- */
 
-#include <stdio.h>
-#include <stdlib.h>
+#include <stddef.h> /* NULL */
 #include <stdint.h>
 
 #include "base64.h"
@@ -24,273 +23,179 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
 
-#define ARRAY_SIZE( a ) ( sizeof( a ) / sizeof( ( a )[0] ) )
-#define CRIT( a )                                                                    \
-    fprintf( stderr, "\nCRITICAL file:%s line:%u msg:%s\n", __FILE__, __LINE__, a ); \
-    exit( EXIT_FAILURE )
-
 //#define DEBUG(args...)    fprintf(stderr,"debug: " args) /* diagnostic message that is destined to the user */
 #define DEBUG( args... )
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
+/* RFC 1421 standard alphabet, code 62 is '+' and code 63 is '/' */
+static const char code_to_char[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Inverse of code_to_char, indexed by the character, 0xFF for characters out of the base64 alphabet */
+static const uint8_t char_to_code[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MODULE-WIDE VARIABLES ---------------------------------------- */
 
-static char code_62  = '+'; /* RFC 1421 standard character for code 62 */
-static char code_63  = '/'; /* RFC 1421 standard character for code 63 */
 static char code_pad = '='; /* RFC 1421 padding character if padding */
 
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
-
-/**
-@brief Convert a code in the range 0-63 to an ASCII character
-*/
-char code_to_char( uint8_t x );
-
-/**
-@brief Convert an ASCII character to a code in the range 0-63
-*/
-uint8_t char_to_code( char x );
-
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
-
-char code_to_char( uint8_t x )
-{
-    if( x <= 25 )
-    {
-        return 'A' + x;
-    }
-    else if( ( x >= 26 ) && ( x <= 51 ) )
-    {
-        return 'a' + ( x - 26 );
-    }
-    else if( ( x >= 52 ) && ( x <= 61 ) )
-    {
-        return '0' + ( x - 52 );
-    }
-    else if( x == 62 )
-    {
-        return code_62;
-    }
-    else if( x == 63 )
-    {
-        return code_63;
-    }
-    else
-    {
-        DEBUG( "ERROR: %i IS OUT OF RANGE 0-63 FOR BASE64 ENCODING\n", x );
-        exit( EXIT_FAILURE );
-    }  // TODO: improve error management
-}
-
-uint8_t char_to_code( char x )
-{
-    if( ( x >= 'A' ) && ( x <= 'Z' ) )
-    {
-        return ( uint8_t ) x - ( uint8_t ) 'A';
-    }
-    else if( ( x >= 'a' ) && ( x <= 'z' ) )
-    {
-        return ( uint8_t ) x - ( uint8_t ) 'a' + 26;
-    }
-    else if( ( x >= '0' ) && ( x <= '9' ) )
-    {
-        return ( uint8_t ) x - ( uint8_t ) '0' + 52;
-    }
-    else if( x == code_62 )
-    {
-        return 62;
-    }
-    else if( x == code_63 )
-    {
-        return 63;
-    }
-    else
-    {
-        DEBUG( "ERROR: %c (0x%x) IS INVALID CHARACTER FOR BASE64 DECODING\n", x, x );
-        exit( EXIT_FAILURE );
-    }  // TODO: improve error management
-}
-
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 int bin_to_b64_nopad( const uint8_t* in, int size, char* out, int max_len )
 {
-    int      i;
     int      result_len;  /* size of the result */
     int      full_blocks; /* number of 3 unsigned chars / 4 characters blocks */
     int      last_bytes;  /* number of unsigned chars <3 in the last block */
-    int      last_chars;  /* number of characters <4 in the last block */
     uint32_t b;
 
     /* check input values */
-    if( ( out == NULL ) || ( in == NULL ) )
+    if( ( out == NULL ) || ( in == NULL ) || ( size < 0 ) )
     {
         DEBUG( "ERROR: NULL POINTER AS OUTPUT IN BIN_TO_B64\n" );
         return -1;
     }
-    if( size == 0 )
-    {
-        *out = 0; /* null string */
-        return 0;
-    }
 
-    /* calculate the number of base64 'blocks' */
+    /* calculate the number of base64 'blocks', a last block of 1 or 2 bytes gives 2 or 3 chars */
     full_blocks = size / 3;
     last_bytes  = size % 3;
-    switch( last_bytes )
-    {
-    case 0: /* no byte left to encode */
-        last_chars = 0;
-        break;
-    case 1: /* 1 byte left to encode -> +2 chars */
-        last_chars = 2;
-        break;
-    case 2: /* 2 bytes left to encode -> +3 chars */
-        last_chars = 3;
-        break;
-    default:
-        CRIT( "switch default that should not be possible" );
-    }
+    result_len  = ( 4 * full_blocks ) + ( ( last_bytes == 0 ) ? 0 : ( last_bytes + 1 ) );
 
     /* check if output buffer is big enough */
-    result_len = ( 4 * full_blocks ) + last_chars;
     if( max_len < ( result_len + 1 ) )
     { /* 1 char added for string terminator */
         DEBUG( "ERROR: OUTPUT BUFFER TOO SMALL IN BIN_TO_B64\n" );
         return -1;
     }
 
-    /* process all the full blocks */
-    for( i = 0; i < full_blocks; ++i )
+    /* process all the full blocks, 3 bytes in a 24-bit word give 4 codes */
+    for( ; full_blocks > 0; --full_blocks )
     {
-        b = ( 0xFF & in[3 * i] ) << 16;
-        b |= ( 0xFF & in[3 * i + 1] ) << 8;
-        b |= 0xFF & in[3 * i + 2];
-        out[4 * i + 0] = code_to_char( ( b >> 18 ) & 0x3F );
-        out[4 * i + 1] = code_to_char( ( b >> 12 ) & 0x3F );
-        out[4 * i + 2] = code_to_char( ( b >> 6 ) & 0x3F );
-        out[4 * i + 3] = code_to_char( b & 0x3F );
+        b      = ( ( uint32_t ) in[0] << 16 ) | ( ( uint32_t ) in[1] << 8 ) | in[2];
+        out[0] = code_to_char[( b >> 18 ) & 0x3F];
+        out[1] = code_to_char[( b >> 12 ) & 0x3F];
+        out[2] = code_to_char[( b >> 6 ) & 0x3F];
+        out[3] = code_to_char[b & 0x3F];
+        in += 3;
+        out += 4;
     }
 
     /* process the last 'partial' block and terminate string */
-    i = full_blocks;
-    if( last_chars == 0 )
-    {
-        out[4 * i] = 0; /* null character to terminate string */
-    }
-    else if( last_chars == 2 )
+    if( last_bytes == 1 )
     {
-        b              = ( 0xFF & in[3 * i] ) << 16;
-        out[4 * i + 0] = code_to_char( ( b >> 18 ) & 0x3F );
-        out[4 * i + 1] = code_to_char( ( b >> 12 ) & 0x3F );
-        out[4 * i + 2] = 0; /* null character to terminate string */
+        b      = ( uint32_t ) in[0] << 16;
+        out[0] = code_to_char[( b >> 18 ) & 0x3F];
+        out[1] = code_to_char[( b >> 12 ) & 0x3F];
+        out += 2;
     }
-    else if( last_chars == 3 )
+    else if( last_bytes == 2 )
     {
-        b = ( 0xFF & in[3 * i] ) << 16;
-        b |= ( 0xFF & in[3 * i + 1] ) << 8;
-        out[4 * i + 0] = code_to_char( ( b >> 18 ) & 0x3F );
-        out[4 * i + 1] = code_to_char( ( b >> 12 ) & 0x3F );
-        out[4 * i + 2] = code_to_char( ( b >> 6 ) & 0x3F );
-        out[4 * i + 3] = 0; /* null character to terminate string */
+        b      = ( ( uint32_t ) in[0] << 16 ) | ( ( uint32_t ) in[1] << 8 );
+        out[0] = code_to_char[( b >> 18 ) & 0x3F];
+        out[1] = code_to_char[( b >> 12 ) & 0x3F];
+        out[2] = code_to_char[( b >> 6 ) & 0x3F];
+        out += 3;
     }
+    *out = 0; /* null character to terminate string */
 
     return result_len;
 }
 
 int b64_to_bin_nopad( const char* in, int size, uint8_t* out, int max_len )
 {
-    int      i;
-    int      result_len;  /* size of the result */
-    int      full_blocks; /* number of 3 unsigned chars / 4 characters blocks */
-    int      last_chars;  /* number of characters <4 in the last block */
-    int      last_bytes;  /* number of unsigned chars <3 in the last block */
-    uint32_t b;
-    ;
+    const uint8_t* s        = ( const uint8_t* ) in;
+    uint8_t        codes_or = 0; /* OR of all the codes, to check them all at once */
+    int            result_len;   /* size of the result */
+    int            full_blocks;  /* number of 3 unsigned chars / 4 characters blocks */
+    int            last_chars;   /* number of characters <4 in the last block */
+    uint32_t       b;
 
     /* check input values */
-    if( ( out == NULL ) || ( in == NULL ) )
+    if( ( out == NULL ) || ( in == NULL ) || ( size < 0 ) )
     {
         DEBUG( "ERROR: NULL POINTER AS OUTPUT OR INPUT IN B64_TO_BIN\n" );
         return -1;
     }
-    if( size == 0 )
-    {
-        return 0;
-    }
 
-    /* calculate the number of base64 'blocks' */
+    /* calculate the number of base64 'blocks', a last block of 2 or 3 chars gives 1 or 2 bytes */
     full_blocks = size / 4;
     last_chars  = size % 4;
-    switch( last_chars )
-    {
-    case 0: /* no char left to decode */
-        last_bytes = 0;
-        break;
-    case 1: /* only 1 char left is an error */
+    if( last_chars == 1 )
+    { /* only 1 char left is an error */
         DEBUG( "ERROR: ONLY ONE CHAR LEFT IN B64_TO_BIN\n" );
         return -1;
-    case 2: /* 2 chars left to decode -> +1 byte */
-        last_bytes = 1;
-        break;
-    case 3: /* 3 chars left to decode -> +2 bytes */
-        last_bytes = 2;
-        break;
-    default:
-        CRIT( "switch default that should not be possible" );
     }
+    result_len = ( 3 * full_blocks ) + ( ( last_chars == 0 ) ? 0 : ( last_chars - 1 ) );
 
     /* check if output buffer is big enough */
-    result_len = ( 3 * full_blocks ) + last_bytes;
     if( max_len < result_len )
     {
         DEBUG( "ERROR: OUTPUT BUFFER TOO SMALL IN B64_TO_BIN\n" );
         return -1;
     }
 
-    /* process all the full blocks */
-    for( i = 0; i < full_blocks; ++i )
+    /* process all the full blocks, 4 codes in a 24-bit word give 3 bytes */
+    for( ; full_blocks > 0; --full_blocks )
     {
-        b = ( 0x3F & char_to_code( in[4 * i] ) ) << 18;
-        b |= ( 0x3F & char_to_code( in[4 * i + 1] ) ) << 12;
-        b |= ( 0x3F & char_to_code( in[4 * i + 2] ) ) << 6;
-        b |= 0x3F & char_to_code( in[4 * i + 3] );
-        out[3 * i + 0] = ( b >> 16 ) & 0xFF;
-        out[3 * i + 1] = ( b >> 8 ) & 0xFF;
-        out[3 * i + 2] = b & 0xFF;
+        codes_or |= char_to_code[s[0]] | char_to_code[s[1]] | char_to_code[s[2]] | char_to_code[s[3]];
+        b = ( ( uint32_t ) char_to_code[s[0]] << 18 ) | ( ( uint32_t ) char_to_code[s[1]] << 12 ) |
+            ( ( uint32_t ) char_to_code[s[2]] << 6 ) | char_to_code[s[3]];
+        out[0] = ( b >> 16 ) & 0xFF;
+        out[1] = ( b >> 8 ) & 0xFF;
+        out[2] = b & 0xFF;
+        s += 4;
+        out += 3;
     }
 
     /* process the last 'partial' block */
-    i = full_blocks;
-    if( last_bytes == 1 )
+    if( last_chars == 2 )
     {
-        b = ( 0x3F & char_to_code( in[4 * i] ) ) << 18;
-        b |= ( 0x3F & char_to_code( in[4 * i + 1] ) ) << 12;
-        out[3 * i + 0] = ( b >> 16 ) & 0xFF;
+        codes_or |= char_to_code[s[0]] | char_to_code[s[1]];
+        b      = ( ( uint32_t ) char_to_code[s[0]] << 18 ) | ( ( uint32_t ) char_to_code[s[1]] << 12 );
+        out[0] = ( b >> 16 ) & 0xFF;
         if( ( ( b >> 12 ) & 0x0F ) != 0 )
         {
             DEBUG( "WARNING: last character contains unusable bits\n" );
         }
     }
-    else if( last_bytes == 2 )
+    else if( last_chars == 3 )
     {
-        b = ( 0x3F & char_to_code( in[4 * i] ) ) << 18;
-        b |= ( 0x3F & char_to_code( in[4 * i + 1] ) ) << 12;
-        b |= ( 0x3F & char_to_code( in[4 * i + 2] ) ) << 6;
-        out[3 * i + 0] = ( b >> 16 ) & 0xFF;
-        out[3 * i + 1] = ( b >> 8 ) & 0xFF;
+        codes_or |= char_to_code[s[0]] | char_to_code[s[1]] | char_to_code[s[2]];
+        b = ( ( uint32_t ) char_to_code[s[0]] << 18 ) | ( ( uint32_t ) char_to_code[s[1]] << 12 ) |
+            ( ( uint32_t ) char_to_code[s[2]] << 6 );
+        out[0] = ( b >> 16 ) & 0xFF;
+        out[1] = ( b >> 8 ) & 0xFF;
         if( ( ( b >> 6 ) & 0x03 ) != 0 )
         {
             DEBUG( "WARNING: last character contains unusable bits\n" );
         }
     }
 
+    /* valid codes are 0-63, only an invalid character sets the 2 MSBs */
+    if( codes_or > 0x3F )
+    {
+        DEBUG( "ERROR: INVALID CHARACTER FOR BASE64 DECODING\n" );
+        return -1;
+    }
+
     return result_len;
 }
 
@@ -308,9 +213,6 @@ int bin_to_b64( const uint8_t* in, int size, char* out, int max_len )
     {
     case 0: /* nothing to do */
         return ret;
-    case 1:
-        DEBUG( "ERROR: INVALID UNPADDED BASE64 STRING\n" );
-        return -1;
     case 2: /* 2 chars in last block, must add 2 padding char */
         if( max_len >= ( ret + 2 + 1 ) )
         {
@@ -336,8 +238,9 @@ int bin_to_b64( const uint8_t* in, int size, char* out, int max_len )
             DEBUG( "ERROR: not enough room to add padding in bin_to_b64\n" );
             return -1;
         }
-    default:
-        CRIT( "switch default that should not be possible" );
+    default: /* 1 char in last block is not possible */
+        DEBUG( "ERROR: INVALID UNPADDED BASE64 STRING\n" );
+        return -1;
     }
 }
 
@@ -39,7 +39,7 @@ int bin_to_b64_nopad( const uint8_t* in, int size, char* out, int max_len );
 @param size number of characters to be decoded from base64 (w/o null char)
 @param out pointer to a data buffer where the function will output decoded data
 @param out_max_len usable size of the output data buffer
-@return >=0 number of bytes written to the data buffer, -1 for error
+@return >=0 number of bytes written to the data buffer, -1 for error (including a character out of the base64 alphabet)
 */
 int b64_to_bin_nopad( const char* in, int size, uint8_t* out, int max_len );
 
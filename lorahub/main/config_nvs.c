@@ -15,10 +15,12 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDENCIES --------------------------------------------------------- */
 
+#include <stdbool.h> /* bool type */
 #include <string.h>  // strncpy
 
 #include <esp_log.h>
 #include <nvs_flash.h>
+#include <esp_rom_crc.h>
 
 #include "config_nvs.h"
 
@@ -30,6 +32,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 static const char* TAG_NVS = "NVS";
 
+#define CFG_BLOB_VERSION 1 /* to be incremented when fields are appended to lgw_nvs_cfg_t */
+#define CFG_BLOB_SLOT_NB 2
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
 
@@ -41,242 +46,266 @@ static lgw_nvs_cfg_t lgw_nvs_config = { .lns_address        = CONFIG_NETWORK_SER
                                         .chan_bandwidth_khz = ( uint16_t ) CONFIG_CHANNEL_LORA_BANDWIDTH,
                                         .sntp_address       = CONFIG_SNTP_SERVER_ADDRESS };
 
+/* Configuration as saved in NVS, CRC first so that it covers the rest of the blob */
+typedef struct
+{
+    uint32_t crc;     /* CRC32 of the rest of the blob */
+    uint32_t seq;     /* incremented at each save, the valid slot with the highest sequence is the current one */
+    uint16_t version; /* CFG_BLOB_VERSION of the firmware which saved the blob */
+    uint16_t size;    /* size of the configuration which follows */
+} cfg_blob_hdr_t;
+
+typedef struct
+{
+    cfg_blob_hdr_t hdr;
+    lgw_nvs_cfg_t  cfg;
+} cfg_blob_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
+static const char* blob_keys[CFG_BLOB_SLOT_NB] = { CFG_NVS_KEY_CFG_BLOB_A, CFG_NVS_KEY_CFG_BLOB_B };
+
+static cfg_blob_t blob_slots[CFG_BLOB_SLOT_NB]; /* static, to keep them off the stack of the caller */
+static int        blob_last_slot = -1;          /* slot of the current configuration, -1 if none */
+static uint32_t   blob_last_seq  = 0;           /* sequence of the current configuration */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
-/* -------------------------------------------------------------------------- */
-/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
-
-esp_err_t lgw_nvs_load_config( void )
+/* Configuration saved by previous firmwares, one key per parameter */
+static void load_legacy_config( nvs_handle_t handle )
 {
-    nvs_handle_t my_handle;
-    esp_err_t    err = ESP_OK;
+    esp_err_t err;
+    size_t    size;
 
-    /* Get configuration from NVS */
-    ESP_LOGI( TAG_NVS, "Opening Non-Volatile Storage (NVS) handle for reading..." );
-    err = nvs_open( "storage", NVS_READONLY, &my_handle );
-    if( err != ESP_OK )
+    size = sizeof( lgw_nvs_config.lns_address );
+    err  = nvs_get_str( handle, CFG_NVS_KEY_LNS_ADDRESS, lgw_nvs_config.lns_address, &size );
+    if( err == ESP_OK )
     {
-        ESP_LOGW( TAG_NVS, "Error (%s) opening NVS handle!", esp_err_to_name( err ) );
-        return ESP_FAIL;
+        printf( "NVS -> %s = %s\n", CFG_NVS_KEY_LNS_ADDRESS, lgw_nvs_config.lns_address );
     }
     else
     {
-        size_t size = sizeof( lgw_nvs_config.lns_address );
-        err         = nvs_get_str( my_handle, CFG_NVS_KEY_LNS_ADDRESS, lgw_nvs_config.lns_address, &size );
-        if( err == ESP_OK )
-        {
-            printf( "NVS -> %s = %s\n", CFG_NVS_KEY_LNS_ADDRESS, lgw_nvs_config.lns_address );
-        }
-        else
-        {
-            ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_LNS_ADDRESS, esp_err_to_name( err ) );
-        }
-
-        err = nvs_get_u16( my_handle, CFG_NVS_KEY_LNS_PORT, &( lgw_nvs_config.lns_port ) );
-        if( err == ESP_OK )
-        {
-            printf( "NVS -> %s = %" PRIu16 "\n", CFG_NVS_KEY_LNS_PORT, lgw_nvs_config.lns_port );
-        }
-        else
-        {
-            ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_LNS_PORT, esp_err_to_name( err ) );
-        }
-
-        err = nvs_get_u32( my_handle, CFG_NVS_KEY_CHAN_FREQ, &( lgw_nvs_config.chan_freq_hz ) );
-        if( err == ESP_OK )
-        {
-            printf( "NVS -> %s = %" PRIu32 "hz\n", CFG_NVS_KEY_CHAN_FREQ, lgw_nvs_config.chan_freq_hz );
-        }
-        else
-        {
-            ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_CHAN_FREQ, esp_err_to_name( err ) );
-        }
-
-        err = nvs_get_u8( my_handle, CFG_NVS_KEY_CHAN_DR_1, &( lgw_nvs_config.chan_datarate_1 ) );
-        if( err == ESP_OK )
-        {
-            printf( "NVS -> %s = %" PRIu8 "\n", CFG_NVS_KEY_CHAN_DR_1, lgw_nvs_config.chan_datarate_1 );
-        }
-        else
-        {
-            ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_CHAN_DR_1, esp_err_to_name( err ) );
-        }
-
-        err = nvs_get_u8( my_handle, CFG_NVS_KEY_CHAN_DR_2, &( lgw_nvs_config.chan_datarate_2 ) );
-        if( err == ESP_OK )
-        {
-            printf( "NVS -> %s = %" PRIu8 "\n", CFG_NVS_KEY_CHAN_DR_2, lgw_nvs_config.chan_datarate_2 );
-        }
-        else
-        {
-            ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_CHAN_DR_2, esp_err_to_name( err ) );
-        }
-
-        err = nvs_get_u16( my_handle, CFG_NVS_KEY_CHAN_BW, &( lgw_nvs_config.chan_bandwidth_khz ) );
-        if( err == ESP_OK )
-        {
-            printf( "NVS -> %s = %" PRIu16 "khz\n", CFG_NVS_KEY_CHAN_BW, lgw_nvs_config.chan_bandwidth_khz );
-        }
-        else
-        {
-            ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_CHAN_BW, esp_err_to_name( err ) );
-        }
-
-        size = sizeof( lgw_nvs_config.sntp_address );
-        err  = nvs_get_str( my_handle, CFG_NVS_KEY_SNTP_ADDRESS, lgw_nvs_config.sntp_address, &size );
-        if( err == ESP_OK )
-        {
-            printf( "NVS -> %s = %s\n", CFG_NVS_KEY_SNTP_ADDRESS, lgw_nvs_config.sntp_address );
-        }
-        else
-        {
-            ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_SNTP_ADDRESS, esp_err_to_name( err ) );
-        }
+        ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_LNS_ADDRESS, esp_err_to_name( err ) );
     }
-    nvs_close( my_handle );
-    ESP_LOGI( TAG_NVS, "Closed NVS handle for reading" );
 
-    return ESP_OK;
-}
-
-esp_err_t lgw_nvs_save_config( void )
-{
-    esp_err_t    err = ESP_OK;
-    nvs_handle_t my_handle;
-
-    printf( "Opening Non-Volatile Storage (NVS) handle for writing... " );
-    err = nvs_open( "storage", NVS_READWRITE, &my_handle );
-    if( err != ESP_OK )
+    err = nvs_get_u16( handle, CFG_NVS_KEY_LNS_PORT, &( lgw_nvs_config.lns_port ) );
+    if( err == ESP_OK )
     {
-        printf( "Error (%s) opening NVS handle!\n", esp_err_to_name( err ) );
-        return ESP_FAIL;
+        printf( "NVS -> %s = %" PRIu16 "\n", CFG_NVS_KEY_LNS_PORT, lgw_nvs_config.lns_port );
     }
     else
     {
-        printf( "Done\n" );
+        ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_LNS_PORT, esp_err_to_name( err ) );
     }
 
-    printf( "NVS <- %s = %s ... ", CFG_NVS_KEY_LNS_ADDRESS, lgw_nvs_config.lns_address );
-    err = nvs_set_str( my_handle, CFG_NVS_KEY_LNS_ADDRESS, lgw_nvs_config.lns_address );
+    err = nvs_get_u32( handle, CFG_NVS_KEY_CHAN_FREQ, &( lgw_nvs_config.chan_freq_hz ) );
     if( err == ESP_OK )
     {
-        printf( "Done\n" );
+        printf( "NVS -> %s = %" PRIu32 "hz\n", CFG_NVS_KEY_CHAN_FREQ, lgw_nvs_config.chan_freq_hz );
     }
     else
     {
-        printf( "Failed\n" );
-        nvs_close( my_handle );
-        printf( "Closed NVS handle for writing.\n" );
-        return ESP_FAIL;
+        ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_CHAN_FREQ, esp_err_to_name( err ) );
     }
 
-    printf( "NVS <- %s = %" PRIu16 " ... ", CFG_NVS_KEY_LNS_PORT, lgw_nvs_config.lns_port );
-    err = nvs_set_u16( my_handle, CFG_NVS_KEY_LNS_PORT, lgw_nvs_config.lns_port );
+    err = nvs_get_u8( handle, CFG_NVS_KEY_CHAN_DR_1, &( lgw_nvs_config.chan_datarate_1 ) );
     if( err == ESP_OK )
     {
-        printf( "Done\n" );
+        printf( "NVS -> %s = %" PRIu8 "\n", CFG_NVS_KEY_CHAN_DR_1, lgw_nvs_config.chan_datarate_1 );
     }
     else
     {
-        printf( "Failed\n" );
-        nvs_close( my_handle );
-        printf( "Closed NVS handle for writing.\n" );
-        return ESP_FAIL;
+        ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_CHAN_DR_1, esp_err_to_name( err ) );
     }
 
-    printf( "NVS <- %s = %" PRIu32 " ... ", CFG_NVS_KEY_CHAN_FREQ, lgw_nvs_config.chan_freq_hz );
-    err = nvs_set_u32( my_handle, CFG_NVS_KEY_CHAN_FREQ, lgw_nvs_config.chan_freq_hz );
+    err = nvs_get_u8( handle, CFG_NVS_KEY_CHAN_DR_2, &( lgw_nvs_config.chan_datarate_2 ) );
     if( err == ESP_OK )
     {
-        printf( "Done\n" );
+        printf( "NVS -> %s = %" PRIu8 "\n", CFG_NVS_KEY_CHAN_DR_2, lgw_nvs_config.chan_datarate_2 );
     }
     else
     {
-        printf( "Failed\n" );
-        nvs_close( my_handle );
-        printf( "Closed NVS handle for writing.\n" );
-        return ESP_FAIL;
+        ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_CHAN_DR_2, esp_err_to_name( err ) );
     }
 
-    printf( "NVS <- %s = %" PRIu8 " ... ", CFG_NVS_KEY_CHAN_DR_1, lgw_nvs_config.chan_datarate_1 );
-    err = nvs_set_u8( my_handle, CFG_NVS_KEY_CHAN_DR_1, lgw_nvs_config.chan_datarate_1 );
+    err = nvs_get_u16( handle, CFG_NVS_KEY_CHAN_BW, &( lgw_nvs_config.chan_bandwidth_khz ) );
     if( err == ESP_OK )
     {
-        printf( "Done\n" );
+        printf( "NVS -> %s = %" PRIu16 "khz\n", CFG_NVS_KEY_CHAN_BW, lgw_nvs_config.chan_bandwidth_khz );
     }
     else
     {
-        printf( "Failed\n" );
-        nvs_close( my_handle );
-        printf( "Closed NVS handle for writing.\n" );
-        return ESP_FAIL;
+        ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_CHAN_BW, esp_err_to_name( err ) );
     }
 
-    printf( "NVS <- %s = %" PRIu8 " ... ", CFG_NVS_KEY_CHAN_DR_2, lgw_nvs_config.chan_datarate_2 );
-    err = nvs_set_u8( my_handle, CFG_NVS_KEY_CHAN_DR_2, lgw_nvs_config.chan_datarate_2 );
+    size = sizeof( lgw_nvs_config.sntp_address );
+    err  = nvs_get_str( handle, CFG_NVS_KEY_SNTP_ADDRESS, lgw_nvs_config.sntp_address, &size );
     if( err == ESP_OK )
     {
-        printf( "Done\n" );
+        printf( "NVS -> %s = %s\n", CFG_NVS_KEY_SNTP_ADDRESS, lgw_nvs_config.sntp_address );
     }
     else
     {
-        printf( "Failed\n" );
-        nvs_close( my_handle );
-        printf( "Closed NVS handle for writing.\n" );
+        ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", CFG_NVS_KEY_SNTP_ADDRESS, esp_err_to_name( err ) );
+    }
+}
+
+static uint32_t blob_crc( const cfg_blob_t* blob, size_t len )
+{
+    /* everything after the CRC itself */
+    return esp_rom_crc32_le( 0, ( const uint8_t* ) blob + sizeof( blob->hdr.crc ), len - sizeof( blob->hdr.crc ) );
+}
+
+/* Read a slot, return true if it holds a valid configuration */
+static bool read_blob( nvs_handle_t handle, const char* key, cfg_blob_t* blob )
+{
+    esp_err_t err;
+    size_t    len = sizeof( cfg_blob_t );
+
+    err = nvs_get_blob( handle, key, blob, &len );
+    if( err != ESP_OK )
+    {
+        if( err == ESP_ERR_NVS_INVALID_LENGTH )
+        {
+            ESP_LOGW( TAG_NVS, "Configuration %s saved by a newer firmware, ignored", key );
+        }
+        else if( err != ESP_ERR_NVS_NOT_FOUND )
+        {
+            ESP_LOGW( TAG_NVS, "Failed to get %s from NVS - %s", key, esp_err_to_name( err ) );
+        }
+        return false;
+    }
+
+    if( ( len < sizeof( cfg_blob_hdr_t ) ) || ( blob->hdr.size != ( len - sizeof( cfg_blob_hdr_t ) ) ) ||
+        ( blob->hdr.crc != blob_crc( blob, len ) ) )
+    {
+        ESP_LOGW( TAG_NVS, "Configuration %s is corrupted, ignored", key );
+        return false;
+    }
+
+    return true;
+}
+
+/* Load a valid blob over the current configuration */
+static void load_blob( const cfg_blob_t* blob )
+{
+    size_t size = blob->hdr.size;
+
+    /* Fields are only ever appended, those missing from a blob of an older version keep their default value */
+    if( blob->hdr.version != CFG_BLOB_VERSION )
+    {
+        ESP_LOGI( TAG_NVS, "Migrating configuration from version %u to %u", blob->hdr.version, CFG_BLOB_VERSION );
+    }
+    memcpy( &lgw_nvs_config, &( blob->cfg ), size );
+    lgw_nvs_config.lns_address[LNS_ADDRESS_STR_MAX_SIZE - 1]   = '\0';
+    lgw_nvs_config.sntp_address[SNTP_ADDRESS_STR_MAX_SIZE - 1] = '\0';
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+esp_err_t lgw_nvs_load_config( void )
+{
+    nvs_handle_t my_handle;
+    esp_err_t    err = ESP_OK;
+    bool         valid[CFG_BLOB_SLOT_NB];
+    int          slot;
+
+    /* Get configuration from NVS */
+    ESP_LOGI( TAG_NVS, "Opening Non-Volatile Storage (NVS) handle for reading..." );
+    err = nvs_open( "storage", NVS_READONLY, &my_handle );
+    if( err != ESP_OK )
+    {
+        ESP_LOGW( TAG_NVS, "Error (%s) opening NVS handle!", esp_err_to_name( err ) );
         return ESP_FAIL;
     }
 
-    printf( "NVS <- %s = %" PRIu16 " ... ", CFG_NVS_KEY_CHAN_BW, lgw_nvs_config.chan_bandwidth_khz );
-    err = nvs_set_u16( my_handle, CFG_NVS_KEY_CHAN_BW, lgw_nvs_config.chan_bandwidth_khz );
-    if( err == ESP_OK )
+    /* The valid slot saved last wins, the other one holds the previous configuration */
+    valid[0] = read_blob( my_handle, blob_keys[0], &blob_slots[0] );
+    valid[1] = read_blob( my_handle, blob_keys[1], &blob_slots[1] );
+    if( valid[0] && valid[1] )
+    {
+        slot = ( ( int32_t ) ( blob_slots[1].hdr.seq - blob_slots[0].hdr.seq ) > 0 ) ? 1 : 0;
+    }
+    else if( valid[0] || valid[1] )
     {
-        printf( "Done\n" );
+        slot = valid[0] ? 0 : 1;
     }
     else
     {
-        printf( "Failed\n" );
-        nvs_close( my_handle );
-        printf( "Closed NVS handle for writing.\n" );
-        return ESP_FAIL;
+        slot = -1;
     }
 
-    printf( "NVS <- %s = %s ... ", CFG_NVS_KEY_SNTP_ADDRESS, lgw_nvs_config.sntp_address );
-    err = nvs_set_str( my_handle, CFG_NVS_KEY_SNTP_ADDRESS, lgw_nvs_config.sntp_address );
-    if( err == ESP_OK )
+    if( slot >= 0 )
     {
-        printf( "Done\n" );
+        load_blob( &blob_slots[slot] );
+        blob_last_slot = slot;
+        blob_last_seq  = blob_slots[slot].hdr.seq;
+        ESP_LOGI( TAG_NVS, "Configuration loaded from %s (version %u, seq %" PRIu32 ")", blob_keys[slot],
+                  blob_slots[slot].hdr.version, blob_last_seq );
     }
     else
     {
-        printf( "Failed\n" );
-        nvs_close( my_handle );
-        printf( "Closed NVS handle for writing.\n" );
+        /* First boot after an update, or nothing saved yet: the next save writes a blob */
+        ESP_LOGI( TAG_NVS, "No configuration blob, looking for legacy keys" );
+        load_legacy_config( my_handle );
+    }
+    nvs_close( my_handle );
+    ESP_LOGI( TAG_NVS, "Closed NVS handle for reading" );
+
+    printf( "NVS -> %s:%" PRIu16 ", %" PRIu32 "hz, SF%" PRIu8 "/%" PRIu8 ", %" PRIu16 "khz, sntp %s\n",
+            lgw_nvs_config.lns_address, lgw_nvs_config.lns_port, lgw_nvs_config.chan_freq_hz,
+            lgw_nvs_config.chan_datarate_1, lgw_nvs_config.chan_datarate_2, lgw_nvs_config.chan_bandwidth_khz,
+            lgw_nvs_config.sntp_address );
+
+    return ESP_OK;
+}
+
+esp_err_t lgw_nvs_save_config( void )
+{
+    esp_err_t    err = ESP_OK;
+    nvs_handle_t my_handle;
+    cfg_blob_t*  blob;
+    int          slot;
+
+    ESP_LOGI( TAG_NVS, "Opening Non-Volatile Storage (NVS) handle for writing..." );
+    err = nvs_open( "storage", NVS_READWRITE, &my_handle );
+    if( err != ESP_OK )
+    {
+        ESP_LOGE( TAG_NVS, "Error (%s) opening NVS handle!", esp_err_to_name( err ) );
         return ESP_FAIL;
     }
 
-    printf( "Committing updates in NVS ... " );
-    err = nvs_commit( my_handle );
+    /* Never overwrite the last valid configuration, so that a power loss while saving leaves it intact */
+    slot = ( blob_last_slot == 0 ) ? 1 : 0;
+    blob = &blob_slots[slot];
+    memset( blob, 0, sizeof( cfg_blob_t ) );
+    memcpy( &( blob->cfg ), &lgw_nvs_config, sizeof( lgw_nvs_cfg_t ) );
+    blob->hdr.seq     = blob_last_seq + 1;
+    blob->hdr.version = CFG_BLOB_VERSION;
+    blob->hdr.size    = sizeof( lgw_nvs_cfg_t );
+    blob->hdr.crc     = blob_crc( blob, sizeof( cfg_blob_t ) );
+
+    err = nvs_set_blob( my_handle, blob_keys[slot], blob, sizeof( cfg_blob_t ) );
     if( err == ESP_OK )
     {
-        printf( "Done\n" );
+        err = nvs_commit( my_handle );
     }
-    else
+    nvs_close( my_handle );
+    if( err != ESP_OK )
     {
-        printf( "Failed\n" );
-        nvs_close( my_handle );
-        printf( "Closed NVS handle for writing.\n" );
+        ESP_LOGE( TAG_NVS, "Failed to save %s to NVS - %s", blob_keys[slot], esp_err_to_name( err ) );
         return ESP_FAIL;
     }
 
-    nvs_close( my_handle );
-    ESP_LOGI( TAG_NVS, "Closed NVS handle for writing" );
+    blob_last_slot = slot;
+    blob_last_seq  = blob->hdr.seq;
+    ESP_LOGI( TAG_NVS, "Configuration saved to %s (seq %" PRIu32 ")", blob_keys[slot], blob_last_seq );
 
     return ESP_OK;
 }
@@ -35,6 +35,10 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define CFG_NVS_KEY_CHAN_BW "chan_bw"
 #define CFG_NVS_KEY_SNTP_ADDRESS "sntp_addr"
 
+/* Whole configuration, saved alternately in 2 slots */
+#define CFG_NVS_KEY_CFG_BLOB_A "cfg_a"
+#define CFG_NVS_KEY_CFG_BLOB_B "cfg_b"
+
 #define LNS_ADDRESS_STR_MAX_SIZE ( 64 )
 #define SNTP_ADDRESS_STR_MAX_SIZE ( 64 )
 
@@ -0,0 +1,238 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Table of the devices heard by the hub, with their link quality
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <string.h>  /* memcpy, memset */
+#include <pthread.h>
+
+#include "dev_table.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define SLOT_MASK ( DEV_TABLE_SLOT_NB - 1 )
+#define SLOT_IS_FREE( slot ) ( table[slot].nb_pkt == 0 )
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define EWMA_SHIFT 3 /* weight of a new sample in the moving averages: 1/8 */
+
+#define FCNT_GAP_MAX 16384 /* larger FCnt gaps are taken as a device reset, not as losses (LoRaWAN MAX_FCNT_GAP) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static pthread_mutex_t   mx_dev_table = PTHREAD_MUTEX_INITIALIZER; /* control access to the table */
+static dev_table_entry_t table[DEV_TABLE_SLOT_NB];                 /* open addressing, linear probing */
+static uint32_t          nb_dev     = 0;
+static uint32_t          nb_evicted = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Slot where the search for a device starts (Fibonacci hashing, DevAddr LSBs are not evenly distributed) */
+static int home_slot( uint32_t devaddr )
+{
+    return ( int ) ( ( uint32_t ) ( devaddr * 2654435769U ) >> ( 32 - DEV_TABLE_SLOT_BITS ) );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Slot of a device, or the free slot where it can be inserted */
+static int find_slot( uint32_t devaddr )
+{
+    int slot = home_slot( devaddr );
+
+    /* there is always a free slot, as the number of devices is limited */
+    while( ( SLOT_IS_FREE( slot ) == false ) && ( table[slot].devaddr != devaddr ) )
+    {
+        slot = ( slot + 1 ) & SLOT_MASK;
+    }
+
+    return slot;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Free a slot, moving back the following devices of the cluster so that they can still be found */
+static void remove_slot( int slot )
+{
+    int next = slot;
+    int home;
+
+    while( true )
+    {
+        next = ( next + 1 ) & SLOT_MASK;
+        if( SLOT_IS_FREE( next ) == true )
+        {
+            break;
+        }
+
+        /* a device can be moved to the free slot if its home slot is not between the free slot and its slot */
+        home = home_slot( table[next].devaddr );
+        if( ( ( next - home ) & SLOT_MASK ) >= ( ( next - slot ) & SLOT_MASK ) )
+        {
+            table[slot] = table[next];
+            slot        = next;
+        }
+    }
+
+    memset( &table[slot], 0, sizeof table[slot] );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Remove the least recently seen device */
+static void evict_oldest( void )
+{
+    int oldest = -1;
+    int i;
+
+    for( i = 0; i < DEV_TABLE_SLOT_NB; i++ )
+    {
+        if( ( SLOT_IS_FREE( i ) == false ) &&
+            ( ( oldest < 0 ) || ( ( int32_t ) ( table[i].last_seen_s - table[oldest].last_seen_s ) < 0 ) ) )
+        {
+            oldest = i;
+        }
+    }
+
+    if( oldest >= 0 )
+    {
+        remove_slot( oldest );
+        nb_dev -= 1;
+        nb_evicted += 1;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void dev_table_update( uint32_t devaddr, uint16_t fcnt, float rssi, float snr, uint8_t datarate, uint32_t now_s )
+{
+    dev_table_entry_t* dev;
+    uint16_t           gap;
+    int                slot;
+
+    pthread_mutex_lock( &mx_dev_table );
+
+    slot = find_slot( devaddr );
+    if( SLOT_IS_FREE( slot ) == true )
+    {
+        if( nb_dev >= DEV_TABLE_DEVICE_NB_MAX )
+        {
+            /* the free slot found may move */
+            evict_oldest( );
+            slot = find_slot( devaddr );
+        }
+        dev          = &table[slot];
+        dev->devaddr = devaddr;
+        dev->rssi    = rssi;
+        dev->snr     = snr;
+        nb_dev += 1;
+    }
+    else
+    {
+        dev = &table[slot];
+
+        /* same FCnt is a retransmission, a large gap is a reset of the device */
+        gap = fcnt - dev->last_fcnt;
+        if( ( gap > 1 ) && ( gap <= FCNT_GAP_MAX ) )
+        {
+            dev->nb_lost += gap - 1;
+        }
+        dev->rssi += ( rssi - dev->rssi ) / ( 1 << EWMA_SHIFT );
+        dev->snr += ( snr - dev->snr ) / ( 1 << EWMA_SHIFT );
+    }
+
+    dev->nb_pkt += 1;
+    dev->last_seen_s = now_s;
+    dev->last_fcnt   = fcnt;
+    if( ( datarate >= DEV_TABLE_SF_MIN ) && ( datarate < ( DEV_TABLE_SF_MIN + DEV_TABLE_SF_NB ) ) &&
+        ( dev->sf_hist[datarate - DEV_TABLE_SF_MIN] < UINT16_MAX ) )
+    {
+        dev->sf_hist[datarate - DEV_TABLE_SF_MIN] += 1;
+    }
+
+    pthread_mutex_unlock( &mx_dev_table );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int dev_table_get_entries( dev_table_entry_t* entries, int nb_max )
+{
+    int nb = 0;
+    int i;
+
+    pthread_mutex_lock( &mx_dev_table );
+    for( i = 0; ( i < DEV_TABLE_SLOT_NB ) && ( nb < nb_max ); i++ )
+    {
+        if( SLOT_IS_FREE( i ) == false )
+        {
+            memcpy( &entries[nb], &table[i], sizeof entries[nb] );
+            nb += 1;
+        }
+    }
+    pthread_mutex_unlock( &mx_dev_table );
+
+    return nb;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void dev_table_get_summary( uint32_t since_s, dev_table_summary_t* summary )
+{
+    int i;
+
+    memset( summary, 0, sizeof *summary );
+
+    pthread_mutex_lock( &mx_dev_table );
+    summary->nb_dev     = nb_dev;
+    summary->nb_evicted = nb_evicted;
+    for( i = 0; i < DEV_TABLE_SLOT_NB; i++ )
+    {
+        if( SLOT_IS_FREE( i ) == true )
+        {
+            continue;
+        }
+        if( ( int32_t ) ( table[i].last_seen_s - since_s ) >= 0 )
+        {
+            summary->nb_active += 1;
+        }
+        if( dev_table_get_loss_pct( &table[i] ) > DEV_TABLE_DEGRADED_LOSS_PCT )
+        {
+            summary->nb_degraded += 1;
+        }
+    }
+    pthread_mutex_unlock( &mx_dev_table );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+float dev_table_get_loss_pct( const dev_table_entry_t* entry )
+{
+    if( ( entry->nb_pkt + entry->nb_lost ) == 0 )
+    {
+        return 0.0;
+    }
+
+    return 100.0 * ( float ) entry->nb_lost / ( float ) ( entry->nb_pkt + entry->nb_lost );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
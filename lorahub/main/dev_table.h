@@ -0,0 +1,105 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Table of the devices heard by the hub, with their link quality
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_DEV_TABLE_H
+#define _LORAHUB_DEV_TABLE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define DEV_TABLE_SLOT_BITS 6                                /* 64 slots in the hash table */
+#define DEV_TABLE_SLOT_NB ( 1 << DEV_TABLE_SLOT_BITS )       /* Number of slots in the hash table */
+#define DEV_TABLE_DEVICE_NB_MAX ( DEV_TABLE_SLOT_NB * 3 / 4 ) /* Least recently seen device evicted above */
+
+#define DEV_TABLE_SF_MIN 5 /* SF of the first bin of the SF histogram */
+#define DEV_TABLE_SF_NB 8  /* SF5 to SF12 */
+
+#define DEV_TABLE_DEGRADED_LOSS_PCT 10 /* a device losing more frames than this is reported as degraded */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct dev_table_entry_s
+@brief Link quality of a device, built from its data uplinks received with a valid CRC
+*/
+typedef struct dev_table_entry_s
+{
+    uint32_t devaddr;                  /* DevAddr of the device */
+    uint32_t last_seen_s;              /* time since boot of the last uplink */
+    uint32_t nb_pkt;                   /* uplinks received, retransmissions included (0 for a free slot) */
+    uint32_t nb_lost;                  /* uplinks lost, estimated from the FCnt gaps */
+    float    rssi;                     /* moving average of the channel RSSI, in dBm */
+    float    snr;                      /* moving average of the SNR, in dB */
+    uint16_t sf_hist[DEV_TABLE_SF_NB]; /* uplinks received per spreading factor, from SF5 */
+    uint16_t last_fcnt;                /* 16 LSB of the FCnt of the last uplink */
+} dev_table_entry_t;
+
+/**
+@struct dev_table_summary_s
+@brief Overview of the devices heard
+*/
+typedef struct dev_table_summary_s
+{
+    uint32_t nb_dev;      /* devices in the table */
+    uint32_t nb_active;   /* devices heard since the given time */
+    uint32_t nb_degraded; /* devices with an estimated loss above DEV_TABLE_DEGRADED_LOSS_PCT */
+    uint32_t nb_evicted;  /* devices removed to make room for new ones, since boot */
+} dev_table_summary_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Account for a data uplink received with a valid CRC (thread safe)
+@param devaddr DevAddr of the frame
+@param fcnt FCnt of the frame
+@param rssi channel RSSI, in dBm
+@param snr SNR, in dB
+@param datarate spreading factor (DR_LORA_SFx)
+@param now_s time since boot
+*/
+void dev_table_update( uint32_t devaddr, uint16_t fcnt, float rssi, float snr, uint8_t datarate, uint32_t now_s );
+
+/**
+@brief Copy the devices of the table (thread safe)
+@param entries[out] devices, in no particular order
+@param nb_max number of entries which can be copied
+@return number of devices copied
+*/
+int dev_table_get_entries( dev_table_entry_t* entries, int nb_max );
+
+/**
+@brief Get an overview of the devices heard (thread safe)
+@param since_s devices heard from this time since boot are counted as active
+@param summary[out] overview of the table
+*/
+void dev_table_get_summary( uint32_t since_s, dev_table_summary_t* summary );
+
+/**
+@brief Get the estimated loss of a device
+@param entry device
+@return uplinks lost over uplinks sent, in percent
+*/
+float dev_table_get_loss_pct( const dev_table_entry_t* entry );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
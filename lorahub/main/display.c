@@ -17,6 +17,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include <stdint.h>  /* C99 types */
 #include <stdbool.h> /* bool type */
+#include <string.h>  /* memcpy, strcmp */
 
 #include <esp_log.h>
 #include <esp_timer.h>
@@ -37,6 +38,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
 
+#define DISP_DIRTY( line ) ( 1UL << ( line ) )
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
@@ -52,11 +55,24 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define LABEL_STR_MAX_SIZE 64
 
+#define IP_POLL_PERIOD_US ( 1000 * 1000 ) /* IP address changes are not notified, check it every second */
+
 static const char* TAG_DISP = "display";
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
 
+/* Lines of the display, each one has a dirty flag */
+typedef enum
+{
+    DISP_LINE_STATUS,
+    DISP_LINE_CONNECTION,
+    DISP_LINE_CHAN_CFG,
+    DISP_LINE_STATISTICS,
+    DISP_LINE_LAST_RX,
+    DISP_LINE_NB
+} disp_line_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
@@ -68,30 +84,41 @@ static lv_obj_t*  label_line4                   = NULL; /* Uplink/Downlink stats
 static lv_obj_t*  label_line5                   = NULL; /* Last packet received info */
 static char       label_str[LABEL_STR_MAX_SIZE] = { 0 };
 
-/* flags to indicate if a line should be refreshed */
-static bool flag_refresh_status         = true;
-static bool flag_refresh_chan_cfg       = false;
-static bool flag_refresh_statistics     = false;
-static bool flag_refresh_connection     = false;
-static bool flag_refresh_last_rx_packet = false;
+/* text currently displayed on each line */
+static char line_text[DISP_LINE_NB][LABEL_STR_MAX_SIZE] = { { 0 } };
+
+/* lines to be rendered, set by the update functions and cleared by display_refresh() */
+static uint32_t disp_dirty = DISP_DIRTY( DISP_LINE_STATUS ) | DISP_DIRTY( DISP_LINE_CONNECTION );
+
+/* number of renders avoided (update merged with a pending one, or text unchanged) */
+static uint32_t renders_skipped = 0;
+
+/* IP address displayed, polled by display_refresh() only */
+static bool     ip_connected = false;
+static uint32_t ip_addr      = 0;
+static int64_t  ip_poll_time = 0;
 
 /* Status to be sent to display */
 static display_status_t disp_status = DISPLAY_STATUS_UNKNOWN;
 
 /* Channel configuration to be sent to display */
-display_channel_conf_t disp_chan_cfg = { 0 };
+static display_channel_conf_t disp_chan_cfg     = { 0 };
+static uint32_t               disp_chan_cfg_seq = 0;
 
 /* RX/TX statistics to be sent to display */
 static display_stats_t disp_stats = { 0 };
 
 /* Gateway/Hub ID to be sent to display */
-static display_connection_info_t disp_connection = { 0 };
+static display_connection_info_t disp_connection     = { 0 };
+static uint32_t                  disp_connection_seq = 0;
 
 /* Last received packet information to be sent to display */
-static display_last_rx_packet_t disp_last_rx_pkt = { 0 };
+static display_last_rx_packet_t disp_last_rx_pkt     = { 0 };
+static uint32_t                 disp_last_rx_pkt_seq = 0;
 
 /* Fatal error to be sent to display */
-static display_error_t disp_error = { .err = LRHB_ERROR_NONE, .line = 0 };
+static display_error_t disp_error     = { .err = LRHB_ERROR_NONE, .line = 0 };
+static uint32_t        disp_error_seq = 0;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -99,6 +126,92 @@ static display_error_t disp_error = { .err = LRHB_ERROR_NONE, .line = 0 };
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* Mark a line to be rendered, an update of a line already pending is merged with it */
+static void mark_dirty( disp_line_t line )
+{
+    if( ( __atomic_fetch_or( &disp_dirty, DISP_DIRTY( line ), __ATOMIC_RELEASE ) & DISP_DIRTY( line ) ) != 0 )
+    {
+        __atomic_fetch_add( &renders_skipped, 1, __ATOMIC_RELAXED );
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Copy data to be displayed, the sequence is odd while it is being written (one writer at a time) */
+static void post_data( uint32_t* seq, void* dest, const void* src, size_t size )
+{
+    __atomic_fetch_add( seq, 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    memcpy( dest, src, size );
+    __atomic_fetch_add( seq, 1, __ATOMIC_RELEASE );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Copy data posted, without waiting for the writer: false if it was being written */
+static bool fetch_data( const uint32_t* seq, void* dest, const void* src, size_t size )
+{
+    uint32_t s;
+
+    s = __atomic_load_n( seq, __ATOMIC_ACQUIRE );
+    memcpy( dest, src, size );
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+    return ( ( s & 1 ) == 0 ) && ( s == __atomic_load_n( seq, __ATOMIC_RELAXED ) );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Set the text of a label, only if it changed (LVGL then redraws and flushes the line over I2C) */
+static void render_line( lv_obj_t* label, disp_line_t line, const char* text )
+{
+    if( label == NULL )
+    {
+        return;
+    }
+
+    if( strcmp( line_text[line], text ) == 0 )
+    {
+        __atomic_fetch_add( &renders_skipped, 1, __ATOMIC_RELAXED );
+        return;
+    }
+
+    snprintf( line_text[line], sizeof line_text[line], "%s", text );
+    lv_label_set_text( label, text );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Check if the IP address changed since it was displayed */
+static void poll_ip_address( void )
+{
+    esp_netif_ip_info_t ip_info   = { 0 };
+    bool                connected = false;
+    esp_netif_t*        netif;
+    esp_err_t           err;
+
+    if( wifi_get_status( ) == WIFI_STATUS_CONNECTED )
+    {
+        netif = esp_netif_get_handle_from_ifkey( "WIFI_STA_DEF" );
+        if( netif != NULL )
+        {
+            err = esp_netif_get_ip_info( netif, &ip_info );
+            if( err != ESP_OK )
+            {
+                ESP_LOGE( TAG_DISP, "ERROR: esp_netif_get_ip_info failed with %s\n", esp_err_to_name( err ) );
+            }
+        }
+        connected = true;
+    }
+
+    if( ( connected != ip_connected ) || ( ip_info.ip.addr != ip_addr ) )
+    {
+        ip_connected = connected;
+        ip_addr      = ip_info.ip.addr;
+        mark_dirty( DISP_LINE_CONNECTION );
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
@@ -250,7 +363,30 @@ void display_init( void )
 
 void display_refresh( void )
 {
-    esp_netif_ip_info_t ip_info;
+    display_status_t          status;
+    display_channel_conf_t    chan_cfg;
+    display_connection_info_t connection;
+    display_last_rx_packet_t  last_rx_pkt;
+    display_error_t           error;
+    esp_ip4_addr_t            ip;
+    uint32_t                  dirty;
+    uint32_t                  retry = 0;
+    int64_t                   now;
+
+    /* IP address changes are not notified */
+    now = esp_timer_get_time( );
+    if( ( now - ip_poll_time ) >= IP_POLL_PERIOD_US )
+    {
+        ip_poll_time = now;
+        poll_ip_address( );
+    }
+
+    /* Nothing to do, LVGL and the I2C bus are left alone */
+    dirty = __atomic_exchange_n( &disp_dirty, 0, __ATOMIC_ACQUIRE );
+    if( dirty == 0 )
+    {
+        return;
+    }
 
 #if DEBUG_REFRESH
     int64_t time_start = esp_timer_get_time( );
@@ -259,29 +395,12 @@ void display_refresh( void )
     /* LVGL Task lock */
     lvgl_port_lock( 0 );
 
-    /* Get current IP address */
-    if( wifi_get_status( ) == WIFI_STATUS_CONNECTED )
-    {
-        esp_netif_t* netif = NULL;
-        netif              = esp_netif_get_handle_from_ifkey( "WIFI_STA_DEF" );
-        if( netif != NULL )
-        {
-            esp_err_t err = esp_netif_get_ip_info( netif, &ip_info );
-            if( err != ESP_OK )
-            {
-                ESP_LOGE( TAG_DISP, "ERROR: esp_netif_get_ip_info failed with %s\n", esp_err_to_name( err ) );
-            }
-        }
-    }
-
     /* Line 1: status */
-    if( label_line1 != NULL && flag_refresh_status == true )
+    if( ( dirty & DISP_DIRTY( DISP_LINE_STATUS ) ) != 0 )
     {
-        switch( disp_status )
+        status = __atomic_load_n( &disp_status, __ATOMIC_RELAXED );
+        switch( status )
         {
-        case DISPLAY_STATUS_UNKNOWN:
-            snprintf( label_str, sizeof label_str, "LoRaHub - ..." );
-            break;
         case DISPLAY_STATUS_INITIALIZING:
             snprintf( label_str, sizeof label_str, "LoRaHub - Initializing" );
             break;
@@ -292,138 +411,175 @@ void display_refresh( void )
         case DISPLAY_STATUS_RECEIVING:
             snprintf( label_str, sizeof label_str, "LoRaHub - Receiving" );
             break;
+        case DISPLAY_STATUS_UNKNOWN:
         default:
+            snprintf( label_str, sizeof label_str, "LoRaHub - ..." );
             break;
         }
-        lv_label_set_text( label_line1, label_str );
-        flag_refresh_status = false;
+        render_line( label_line1, DISP_LINE_STATUS, label_str );
     }
 
     /* Line 2: IP address, Gateway ID, ... */
-    if( label_line2 != NULL )
+    if( ( dirty & DISP_DIRTY( DISP_LINE_CONNECTION ) ) != 0 )
     {
-        if( wifi_get_status( ) == WIFI_STATUS_CONNECTED )
+        if( ip_connected == true )
         {
-            if( flag_refresh_connection == true )
+            ip.addr = ip_addr;
+            if( __atomic_load_n( &disp_connection_seq, __ATOMIC_ACQUIRE ) == 0 )
             {
-                snprintf( label_str, sizeof label_str, "%016llX - " IPSTR, disp_connection.gateway_id,
-                          IP2STR( &ip_info.ip ) );
+                snprintf( label_str, sizeof label_str, IPSTR, IP2STR( &ip ) );
+            }
+            else if( fetch_data( &disp_connection_seq, &connection, &disp_connection, sizeof connection ) == true )
+            {
+                snprintf( label_str, sizeof label_str, "%016llX - " IPSTR, connection.gateway_id, IP2STR( &ip ) );
             }
             else
             {
-                snprintf( label_str, sizeof label_str, IPSTR, IP2STR( &ip_info.ip ) );
+                retry |= DISP_DIRTY( DISP_LINE_CONNECTION );
             }
         }
         else
         {
             snprintf( label_str, sizeof label_str, "not connected" );
         }
-        lv_label_set_text( label_line2, label_str );
-        /* keep flag_refresh_connection to true for now */
+        if( ( retry & DISP_DIRTY( DISP_LINE_CONNECTION ) ) == 0 )
+        {
+            render_line( label_line2, DISP_LINE_CONNECTION, label_str );
+        }
     }
 
     /* Line 3: channel configuration */
-    if( label_line3 != NULL && flag_refresh_chan_cfg == true )
+    if( ( dirty & DISP_DIRTY( DISP_LINE_CHAN_CFG ) ) != 0 )
     {
+        if( fetch_data( &disp_chan_cfg_seq, &chan_cfg, &disp_chan_cfg, sizeof chan_cfg ) == true )
+        {
 #if defined( CONFIG_RADIO_TYPE_LR1121 )
-        snprintf( label_str, sizeof label_str, "%.4lf  SF%u-SF%u BW%u", ( double ) ( disp_chan_cfg.freq_hz ) / 1e6,
-                  disp_chan_cfg.datarate[0], disp_chan_cfg.datarate[1], disp_chan_cfg.bw_khz );
+            snprintf( label_str, sizeof label_str, "%.4lf  SF%u-SF%u BW%u", ( double ) ( chan_cfg.freq_hz ) / 1e6,
+                      chan_cfg.datarate[0], chan_cfg.datarate[1], chan_cfg.bw_khz );
 #else
-        snprintf( label_str, sizeof label_str, "%.4lf  SF%u BW%u", ( double ) ( disp_chan_cfg.freq_hz ) / 1e6,
-                  disp_chan_cfg.datarate[0], disp_chan_cfg.bw_khz );
+            snprintf( label_str, sizeof label_str, "%.4lf  SF%u BW%u", ( double ) ( chan_cfg.freq_hz ) / 1e6,
+                      chan_cfg.datarate[0], chan_cfg.bw_khz );
 #endif
-        lv_label_set_text( label_line3, label_str );
-        flag_refresh_chan_cfg = false;
+            render_line( label_line3, DISP_LINE_CHAN_CFG, label_str );
+        }
+        else
+        {
+            retry |= DISP_DIRTY( DISP_LINE_CHAN_CFG );
+        }
     }
 
     /* Line 4: RX/TX packets stats */
-    if( label_line4 != NULL && flag_refresh_statistics == true )
+    if( ( dirty & DISP_DIRTY( DISP_LINE_STATISTICS ) ) != 0 )
     {
-        snprintf( label_str, sizeof label_str, "up %lu  dn %lu", disp_stats.nb_rx, disp_stats.nb_tx );
-        lv_label_set_text( label_line4, label_str );
-        flag_refresh_statistics = false;
+        snprintf( label_str, sizeof label_str, "up %lu  dn %lu", __atomic_load_n( &disp_stats.nb_rx, __ATOMIC_RELAXED ),
+                  __atomic_load_n( &disp_stats.nb_tx, __ATOMIC_RELAXED ) );
+        render_line( label_line4, DISP_LINE_STATISTICS, label_str );
     }
 
     /* Line 5: Last packet info or FATAL ERROR */
-    if( label_line5 != NULL )
+    if( ( dirty & DISP_DIRTY( DISP_LINE_LAST_RX ) ) != 0 )
     {
-        if( disp_error.err == LRHB_ERROR_NONE )
+        if( fetch_data( &disp_error_seq, &error, &disp_error, sizeof error ) == false )
+        {
+            retry |= DISP_DIRTY( DISP_LINE_LAST_RX );
+        }
+        else if( error.err != LRHB_ERROR_NONE )
+        {
+            /* display fatal error */
+            snprintf( label_str, sizeof label_str, "ERROR(%d) - %d", error.err, error.line );
+            render_line( label_line5, DISP_LINE_LAST_RX, label_str );
+        }
+        else if( __atomic_load_n( &disp_last_rx_pkt_seq, __ATOMIC_ACQUIRE ) == 0 )
+        {
+            /* No error and no packet received yet */
+        }
+        else if( fetch_data( &disp_last_rx_pkt_seq, &last_rx_pkt, &disp_last_rx_pkt, sizeof last_rx_pkt ) == true )
         {
             /* No error : display last packet info */
-            if( flag_refresh_last_rx_packet == true )
-            {
-                snprintf( label_str, sizeof label_str, "%08lX sf:%u rssi:%d snr:%d", disp_last_rx_pkt.devaddr,
-                          disp_last_rx_pkt.sf, ( int16_t ) disp_last_rx_pkt.rssi, ( int8_t ) disp_last_rx_pkt.snr );
-                lv_label_set_text( label_line5, label_str );
-                flag_refresh_last_rx_packet = false;
-            }
+            snprintf( label_str, sizeof label_str, "%08lX sf:%u rssi:%d snr:%d", last_rx_pkt.devaddr, last_rx_pkt.sf,
+                      ( int16_t ) last_rx_pkt.rssi, ( int8_t ) last_rx_pkt.snr );
+            render_line( label_line5, DISP_LINE_LAST_RX, label_str );
         }
         else
         {
-            /* display fatal error */
-            snprintf( label_str, sizeof label_str, "ERROR(%d) - %d", disp_error.err, disp_error.line );
-            lv_label_set_text( label_line5, label_str );
+            retry |= DISP_DIRTY( DISP_LINE_LAST_RX );
         }
     }
 
     /* LVGL Task unlock */
     lvgl_port_unlock( );
 
+    /* Data being written while it was read, render it next time */
+    if( retry != 0 )
+    {
+        __atomic_fetch_or( &disp_dirty, retry, __ATOMIC_RELAXED );
+    }
+
 #if DEBUG_REFRESH
     int64_t time_stop = esp_timer_get_time( );
-    ESP_LOGE( TAG_DISP, "display_refresh %lldus\n", time_stop - time_start );
+    ESP_LOGE( TAG_DISP, "display_refresh %lldus (lines:0x%02lX)\n", time_stop - time_start, dirty );
 #endif
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+uint32_t display_get_renders_skipped( void )
+{
+    return __atomic_load_n( &renders_skipped, __ATOMIC_RELAXED );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 void display_update_status( display_status_t status )
 {
-    disp_status = status;
+    __atomic_store_n( &disp_status, status, __ATOMIC_RELAXED );
 
-    flag_refresh_status = true;
+    mark_dirty( DISP_LINE_STATUS );
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void display_update_statistics( const display_stats_t* stats )
 {
-    disp_stats.nb_rx += stats->nb_rx;
-    disp_stats.nb_tx += stats->nb_tx;
+    /* called by both upstream and JiT threads */
+    __atomic_fetch_add( &disp_stats.nb_rx, stats->nb_rx, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &disp_stats.nb_tx, stats->nb_tx, __ATOMIC_RELAXED );
 
-    flag_refresh_statistics = true;
+    mark_dirty( DISP_LINE_STATISTICS );
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void display_update_last_rx_packet( const display_last_rx_packet_t* last_pkt )
 {
-    memcpy( &disp_last_rx_pkt, last_pkt, sizeof( display_last_rx_packet_t ) );
+    post_data( &disp_last_rx_pkt_seq, &disp_last_rx_pkt, last_pkt, sizeof( display_last_rx_packet_t ) );
 
-    flag_refresh_last_rx_packet = true;
+    mark_dirty( DISP_LINE_LAST_RX );
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void display_update_connection_info( const display_connection_info_t* info )
 {
-    memcpy( &disp_connection, info, sizeof( display_connection_info_t ) );
+    post_data( &disp_connection_seq, &disp_connection, info, sizeof( display_connection_info_t ) );
 
-    flag_refresh_connection = true;
+    mark_dirty( DISP_LINE_CONNECTION );
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void display_update_channel_config( const display_channel_conf_t* chan_cfg )
 {
-    memcpy( &disp_chan_cfg, chan_cfg, sizeof( display_channel_conf_t ) );
+    post_data( &disp_chan_cfg_seq, &disp_chan_cfg, chan_cfg, sizeof( display_channel_conf_t ) );
 
-    flag_refresh_chan_cfg = true;
+    mark_dirty( DISP_LINE_CHAN_CFG );
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void display_update_error( const display_error_t* error )
 {
-    memcpy( &disp_error, error, sizeof( display_error_t ) );
+    post_data( &disp_error_seq, &disp_error, error, sizeof( display_error_t ) );
+
+    mark_dirty( DISP_LINE_LAST_RX );
 }
\ No newline at end of file
@@ -27,6 +27,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
+#define DISPLAY_RENDER_PERIOD_MS 250 /* updates posted in between are rendered together */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
@@ -77,8 +79,19 @@ typedef struct
 
 void display_init( void );
 
+/**
+@brief Render the lines updated since the previous call, does nothing if none changed
+*/
 void display_refresh( void );
 
+/**
+@brief Get the number of renders avoided, as updates were merged or did not change the text displayed
+@return counter since boot
+*/
+uint32_t display_get_renders_skipped( void );
+
+/* Update functions below only post the data and never block, they can be called from any thread */
+
 void display_update_status( display_status_t status );
 
 void display_update_connection_info( const display_connection_info_t* info );
@@ -0,0 +1,191 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Exact conversion of the frequencies given in MHz by the network server to Hz, without floating point arithmetic
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h> /* C99 types */
+#include <string.h> /* memcpy */
+
+#include "freq_mhz.h"
+#include "parson.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+/* IEEE 754 binary64 layout */
+#define DOUBLE_MANT_BITS 52
+#define DOUBLE_EXP_MASK 0x7FF
+#define DOUBLE_EXP_BIAS 1075 /* exponent bias plus the 52 bits of the mantissa, value = mantissa * 2^(exp - 1075) */
+
+/* 1e6 = 15625 * 2^6, the power of 2 goes into the shift */
+#define MHZ_ODD_FACTOR 15625
+#define MHZ_POW2_FACTOR 6
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int freq_mhz_parse( const char* str, uint32_t* freq_hz )
+{
+    uint32_t mhz = 0;
+    uint32_t hz  = 0;
+    uint32_t mult;
+
+    if( ( *str < '0' ) || ( *str > '9' ) )
+    {
+        return -1;
+    }
+    while( ( *str >= '0' ) && ( *str <= '9' ) )
+    {
+        mhz = ( mhz * 10 ) + ( *str - '0' );
+        if( mhz > ( UINT32_MAX / 1000000 ) )
+        {
+            return -1;
+        }
+        str++;
+    }
+
+    if( *str == '.' )
+    {
+        str++;
+        for( mult = 100000; ( *str >= '0' ) && ( *str <= '9' ); str++ )
+        {
+            if( mult > 0 )
+            {
+                hz += ( *str - '0' ) * mult;
+                mult /= 10;
+            }
+            else
+            {
+                /* first digit below 1 Hz decides the rounding, skip the following ones */
+                hz += ( *str >= '5' ) ? 1 : 0;
+                for( str++; ( *str >= '0' ) && ( *str <= '9' ); str++ )
+                {
+                }
+                break;
+            }
+        }
+    }
+
+    if( *str != '\0' )
+    {
+        return -1;
+    }
+
+    if( hz > ( UINT32_MAX - ( mhz * 1000000 ) ) )
+    {
+        return -1;
+    }
+    *freq_hz = ( mhz * 1000000 ) + hz;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int freq_mhz_from_double( double mhz, uint32_t* freq_hz )
+{
+    uint64_t bits;
+    uint64_t mant;
+    uint64_t hi;
+    uint64_t lo;
+    int32_t  exp2;
+    int32_t  shift;
+
+    memcpy( &bits, &mhz, sizeof bits );
+    exp2 = ( int32_t ) ( ( bits >> DOUBLE_MANT_BITS ) & DOUBLE_EXP_MASK );
+    mant = bits & ( ( 1ULL << DOUBLE_MANT_BITS ) - 1 );
+
+    if( ( ( bits >> 63 ) != 0 ) && ( ( exp2 != 0 ) || ( mant != 0 ) ) )
+    {
+        return -1; /* negative */
+    }
+    if( exp2 == DOUBLE_EXP_MASK )
+    {
+        return -1; /* infinite or NaN */
+    }
+    if( exp2 == 0 )
+    {
+        *freq_hz = 0; /* zero or subnormal */
+        return 0;
+    }
+    mant |= 1ULL << DOUBLE_MANT_BITS;
+
+    /* Hz = mant * 15625 / 2^shift, the 53 bits mantissa by a 14 bits factor is kept on two 32 bits limbs */
+    shift = DOUBLE_EXP_BIAS - MHZ_POW2_FACTOR - exp2;
+    if( shift <= 0 )
+    {
+        return -1; /* above 2^53 Hz */
+    }
+    if( shift > ( DOUBLE_MANT_BITS + 1 + 14 + 1 ) )
+    {
+        *freq_hz = 0; /* below 0.5 Hz */
+        return 0;
+    }
+    lo = ( mant & 0xFFFFFFFF ) * MHZ_ODD_FACTOR;
+    hi = ( ( mant >> 32 ) * MHZ_ODD_FACTOR ) + ( lo >> 32 );
+    lo &= 0xFFFFFFFF;
+
+    /* Rounded half up, as llround() does for positive numbers */
+    if( shift > 32 )
+    {
+        hi += 1ULL << ( shift - 33 );
+    }
+    else
+    {
+        lo += 1ULL << ( shift - 1 );
+        hi += lo >> 32;
+        lo &= 0xFFFFFFFF;
+    }
+
+    if( shift >= 32 )
+    {
+        hi >>= ( shift - 32 );
+        if( hi > UINT32_MAX )
+        {
+            return -1;
+        }
+        *freq_hz = ( uint32_t ) hi;
+    }
+    else
+    {
+        if( ( hi >> shift ) != 0 )
+        {
+            return -1;
+        }
+        *freq_hz = ( uint32_t ) ( ( hi << ( 32 - shift ) ) | ( lo >> shift ) );
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int freq_mhz_from_json( const JSON_Value* val, uint32_t* freq_hz )
+{
+    const char* str;
+
+    switch( json_value_get_type( val ) )
+    {
+    case JSONNumber:
+        return freq_mhz_from_double( json_value_get_number( val ), freq_hz );
+    case JSONString:
+        str = json_value_get_string( val );
+        return ( str != NULL ) ? freq_mhz_parse( str, freq_hz ) : -1;
+    default:
+        return -1;
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,57 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Exact conversion of the frequencies given in MHz by the network server to Hz, without floating point arithmetic
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_FREQ_MHZ_H
+#define _LORAHUB_FREQ_MHZ_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h> /* C99 types */
+
+#include "parson.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Convert a decimal number of MHz to Hz, rounded half up after the 6th decimal
+@param str decimal number, digits with an optional fraction, exponent notation is not supported
+@param freq_hz[out] frequency in Hz
+@return 0 on success, -1 if the text is not a decimal number or does not fit in 32 bits
+*/
+int freq_mhz_parse( const char* str, uint32_t* freq_hz );
+
+/**
+@brief Convert a number of MHz stored as a double to the nearest Hz, from the bits of the double
+@param mhz frequency in MHz, as parsed by parson
+@param freq_hz[out] frequency in Hz
+@return 0 on success, -1 if the number is negative, not finite or does not fit in 32 bits
+
+The double nearest to a decimal number of MHz with up to 6 decimals gives back this exact number of Hz.
+Only integer operations are used, the ESP32-S3 FPU being single precision.
+*/
+int freq_mhz_from_double( double mhz, uint32_t* freq_hz );
+
+/**
+@brief Get a frequency in Hz from a JSON value given in MHz
+@param val JSON number, or JSON string holding a decimal number
+@param freq_hz[out] frequency in Hz
+@return 0 on success, -1 if the value is not a valid frequency
+*/
+int freq_mhz_from_json( const JSON_Value* val, uint32_t* freq_hz );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
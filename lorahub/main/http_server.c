@@ -18,20 +18,35 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <stdint.h>  /* C99 types */
 #include <stdbool.h> /* bool type */
 #include <string.h>
+#include <stdio.h>  /* snprintf, vsnprintf */
+#include <stdarg.h> /* va_list */
+#include <time.h>   /* clock_gettime */
+#include <pthread.h>
 
 #include <esp_log.h>
+#include <esp_system.h>    /* esp_get_free_heap_size */
+#include <esp_heap_caps.h> /* heap_caps_get_largest_free_block */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h> /* uxTaskGetStackHighWaterMark */
 
 #include <esp_http_server.h>
 
 #include "http_server.h"
 #include "wifi.h"
 #include "parson.h"
+#include "json_arena.h"
 #include "config_nvs.h"
+#include "pkt_fwd.h"
+#include "pkt_stream.h"
+#include "display.h"
+#include "dev_table.h"
+#include "uplink_filter.h"
 
 #include "lorahub_aux.h"
 #include "lorahub_hal.h"
 
 #include "lorahub_version.h"
+#include "main_defs.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -131,6 +146,22 @@ const char html_header[] =
       ( FORM_FIELD_NB *                \
         4 ) ) /* when converting a web form string to a json string, need to add {} and "" for each key/values */
 
+/* Maximum size of the statistics JSON string (two sets of counters with 10 digits values) */
+#define STATS_JSON_MAX_SIZE ( 2048 )
+
+/* Size of the stack buffer used to stream the Prometheus metrics, in chunks of complete lines */
+#define METRICS_CHUNK_SIZE ( 512 )
+
+/* The hash of the configuration page is given by the build, it is its HTTP entity tag */
+#define WEB_INDEX_ETAG_STR "\"" WEB_INDEX_ETAG "\""
+#define WEB_ETAG_HDR_MAX_SIZE ( 64 ) /* enough for a few entity tags in If-None-Match */
+
+/* Live packet stream: events are batched in one WebSocket frame per client and per period */
+#define STREAM_CLIENTS_MAX ( 2 )
+#define STREAM_PERIOD_MS ( 250 )
+#define STREAM_FRAME_MAX_SIZE ( 2048 )
+#define STREAM_EVENT_MAX_SIZE ( 256 ) /* room left in the frame for one more event */
+
 /* Radio type configured */
 #if defined( CONFIG_RADIO_TYPE_SX1261 )
 const char* radio_type = "SX1261";
@@ -155,14 +186,56 @@ typedef enum
     HTTP_POST_SRC_API
 } http_post_src_t;
 
+typedef struct
+{
+    httpd_req_t* req;
+    char         buf[METRICS_CHUNK_SIZE];
+    size_t       len;
+    esp_err_t    err; /* first error returned by httpd_resp_send_chunk() */
+} metrics_writer_t;
+
+typedef struct
+{
+    int      fd;         /* socket of the client, -1 if the slot is free */
+    uint32_t cursor;     /* position of the client in the packet stream */
+    uint32_t nb_dropped; /* events overwritten before they could be sent, the client is too slow */
+} stream_client_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
 static uint8_t web_inf_mac_addr[6]      = { 0 };
 static char    web_inf_mac_addr_str[18] = "unknown";
 
+/* Configuration page, compressed and embedded in the firmware (see web/index.html) */
+extern const uint8_t web_index_gz_start[] asm( "_binary_index_html_gz_start" );
+extern const uint8_t web_index_gz_end[] asm( "_binary_index_html_gz_end" );
+
 static char post_content_form[FORM_FULL_CONTENT_MAX_SIZE] = { 0 };
 static char post_content_json[JSON_FULL_CONTENT_MAX_SIZE] = { 0 };
+static char stats_content_json[STATS_JSON_MAX_SIZE]       = { 0 };
+
+/* Last statistics of the packet forwarder, the HTTP server task runs one handler at a time */
+static pkt_fwd_stats_t stats;
+
+/* Copy of the device table, formatted without holding it */
+static dev_table_entry_t devices[DEV_TABLE_DEVICE_NB_MAX];
+
+/* Matches of the uplink filter rules, with the default action of each list */
+static uplink_filter_rule_stats_t filter_stats[UPLINK_FILTER_NB * ( UPLINK_FILTER_RULE_NB_MAX + 1 )];
+
+static const int32_t ack_rtt_bounds_ms[PKT_FWD_HIST_NB - 1]  = PKT_FWD_ACK_RTT_BOUNDS_MS;
+static const int32_t tx_slack_bounds_us[PKT_FWD_HIST_NB - 1] = PKT_FWD_TX_SLACK_BOUNDS_US;
+static const char*   thread_names[PKT_FWD_THREAD_NB]          = PKT_FWD_THREAD_NAMES;
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+/* Live packet stream clients, only accessed from the HTTP server task */
+static httpd_handle_t  stream_server = NULL;
+static stream_client_t stream_clients[STREAM_CLIENTS_MAX];
+static int             stream_nb_clients   = 0;
+static bool            stream_work_pending = false;
+static char            stream_frame[STREAM_FRAME_MAX_SIZE];
+#endif
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -170,360 +243,291 @@ static char post_content_json[JSON_FULL_CONTENT_MAX_SIZE] = { 0 };
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
-static esp_err_t http_root_get_handler( httpd_req_t* req )
+/* Ratio of acknowledged datagrams, 0 if none was sent */
+static float ack_ratio( uint32_t nb_ack, uint32_t nb_sent )
 {
-    /* a string to hold the form field name property */
-    char field_name_str[FORM_FIELD_NAME_STR_MAX_SIZE + 1] = { 0 };
+    return ( nb_sent > 0 ) ? ( ( float ) nb_ack / ( float ) nb_sent ) : 0.0;
+}
 
-    /* a string to hold the form field value property */
-    char field_value_str[FORM_FIELD_VALUE_STR_MAX_SIZE + 1] = { 0 };
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* a string to hold the form field max_length property */
-    char field_maxlength_str[3 + 1] = { 0 }; /* hold a max_length of 999 max + null termination */
+/* Append formatted text to dest, len keeps counting when dest is full so that truncation can be detected */
+static void json_append( char* dest, size_t size, size_t* len, const char* format, ... )
+{
+    va_list args;
+    int     n;
 
-    ESP_LOGI( TAG_WEB, "root_get_handler req->uri=[%s]", req->uri );
+    va_start( args, format );
+    n = vsnprintf( dest + *len, ( *len < size ) ? ( size - *len ) : 0, ( *len < size ) ? format : "", args );
+    va_end( args );
+    if( n > 0 )
+    {
+        *len += n;
+    }
+}
 
-    /* Get info to be displayed */
-    wifi_get_mac_address( web_inf_mac_addr );
-    snprintf( web_inf_mac_addr_str, sizeof web_inf_mac_addr_str, "%02x:%02x:%02x:%02x:%02x:%02x", web_inf_mac_addr[0],
-              web_inf_mac_addr[1], web_inf_mac_addr[2], web_inf_mac_addr[3], web_inf_mac_addr[4], web_inf_mac_addr[5] );
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* Get current loaded config */
-    const lgw_nvs_cfg_t* nvs_config;
-    lgw_nvs_get_config( &nvs_config );
+/* Append a JSON array of integers to dest */
+static void json_append_array( char* dest, size_t size, size_t* len, const void* values, bool is_signed, int nb )
+{
+    int i;
 
-    /* Send HTML header */
-    httpd_resp_sendstr_chunk( req, "<!DOCTYPE html><html>" );
-    httpd_resp_sendstr_chunk( req, html_header );
-    httpd_resp_sendstr_chunk( req, "<body>" );
-
-    /* Configuration form*/
-    httpd_resp_sendstr_chunk( req, "<div>" );
-    httpd_resp_sendstr_chunk( req, "<form method=\"post\" action=\"/submit\">" );
-
-    /* HUB infos */
-    httpd_resp_sendstr_chunk( req, "<h2>LoRaHUB info</h2>" );
-
-    /* firmware version */
-    httpd_resp_sendstr_chunk( req, "<label>fw version: " );
-    httpd_resp_sendstr_chunk( req, LORAHUB_FW_VERSION_STR );
-    httpd_resp_sendstr_chunk( req, "</label>" );
-    httpd_resp_sendstr_chunk( req, "</br>" );
-
-    /* radio type */
-    httpd_resp_sendstr_chunk( req, "<label>radio type: " );
-    httpd_resp_sendstr_chunk( req, radio_type );
-    httpd_resp_sendstr_chunk( req, "</label>" );
-    httpd_resp_sendstr_chunk( req, "</br>" );
-
-    /* MAC address */
-    httpd_resp_sendstr_chunk( req, "<label>MAC address: " );
-    if( strlen( web_inf_mac_addr_str ) )
-    {
-        httpd_resp_sendstr_chunk( req, web_inf_mac_addr_str );
-    }
-    httpd_resp_sendstr_chunk( req, "</label>" );
-
-    /* LNS configuration */
-    httpd_resp_sendstr_chunk( req, "<h2>LoRaWAN network server</h2>" );
-
-    /* LNS server address */
-    httpd_resp_sendstr_chunk( req, "<label for=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_LNS_ADDRESS );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\">address</label>" );
-
-    httpd_resp_sendstr_chunk( req, "<input type=\"text\" id=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_LNS_ADDRESS );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_LNS_ADDRESS );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" ); /* close string */
-    httpd_resp_sendstr_chunk( req, " maxlength=\"" );
-    snprintf( field_maxlength_str, sizeof field_maxlength_str, "%d",
-              LNS_ADDRESS_STR_MAX_SIZE - 1 ); /* keep 1 byte for null termination */
-    httpd_resp_sendstr_chunk( req, field_maxlength_str );
-    httpd_resp_sendstr_chunk( req, "\"" );        /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"" ); /* 1 space prefix */
-    if( strlen( nvs_config->lns_address ) )
-    {
-        httpd_resp_sendstr_chunk( req, nvs_config->lns_address );
-    }
-    httpd_resp_sendstr_chunk( req, "\"><br>" );
-
-    /* LNS server port */
-    httpd_resp_sendstr_chunk( req, "<label for=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_LNS_PORT );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\">port</label>" );
-
-    httpd_resp_sendstr_chunk( req, "<input type=\"number\" id=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_LNS_PORT );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );
-    httpd_resp_sendstr_chunk( req, " step=1 min=0 max=65535" ); /* 1 space prefix */
-    httpd_resp_sendstr_chunk( req, " name=\"" );                /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_LNS_PORT );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );        /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"" ); /* 1 space prefix */
-    if( sizeof( field_value_str ) > LNS_PORT_STR_MAX_SIZE )
+    for( i = 0; i < nb; i++ )
     {
-        snprintf( field_value_str, sizeof field_value_str, "%u", nvs_config->lns_port );
-        httpd_resp_sendstr_chunk( req, field_value_str );
+        if( is_signed == true )
+        {
+            json_append( dest, size, len, "%c%ld", ( i == 0 ) ? '[' : ',', ( ( const int32_t* ) values )[i] );
+        }
+        else
+        {
+            json_append( dest, size, len, "%c%lu", ( i == 0 ) ? '[' : ',', ( ( const uint32_t* ) values )[i] );
+        }
     }
-    httpd_resp_sendstr_chunk( req, "\"><br>" );
+    json_append( dest, size, len, "]" );
+}
 
-    /* RX channel configuration */
-    httpd_resp_sendstr_chunk( req, "<h2>RX channel</h2>" );
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* channel frequency */
-    httpd_resp_sendstr_chunk( req, "<label for=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_FREQ );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\">frequency (MHz)</label>" );
+/* Append a set of packet forwarder counters as a JSON object to dest */
+static void json_append_counters( char* dest, size_t size, size_t* len, const pkt_fwd_counters_t* c )
+{
+    json_append( dest, size, len,
+                 "{\"rx\":{\"received\":%lu,\"ok\":%lu,\"bad\":%lu,\"nocrc\":%lu},"
+                 "\"up\":{\"forwarded\":%lu,\"push_sent\":%lu,\"push_ack\":%lu,\"push_ack_ratio\":%.3f},"
+                 "\"down\":{\"pull_sent\":%lu,\"pull_ack\":%lu,\"pull_ack_ratio\":%.3f,\"pull_resp\":%lu},"
+                 "\"tx\":{\"requested\":%lu,\"ok\":%lu,\"fail\":%lu,\"rx2_fallback\":%lu,\"preempted\":%lu,"
+                 "\"rejected\":{\"collision_packet\":%lu,\"collision_beacon\":%lu,\"too_late\":%lu,"
+                 "\"too_early\":%lu,\"duty_cycle\":%lu}},\"ack_rtt_ms\":",
+                 c->nb_rx_rcv, c->nb_rx_ok, c->nb_rx_bad, c->nb_rx_nocrc, c->up_pkt_fwd, c->up_dgram_sent,
+                 c->up_ack_rcv, ack_ratio( c->up_ack_rcv, c->up_dgram_sent ), c->dw_pull_sent, c->dw_ack_rcv,
+                 ack_ratio( c->dw_ack_rcv, c->dw_pull_sent ), c->dw_dgram_rcv, c->nb_tx_requested, c->nb_tx_ok,
+                 c->nb_tx_fail, c->nb_tx_rx2_fallback, c->nb_tx_preempted, c->nb_tx_rejected_collision_packet,
+                 c->nb_tx_rejected_collision_beacon, c->nb_tx_rejected_too_late, c->nb_tx_rejected_too_early,
+                 c->nb_tx_rejected_duty_cycle );
+    json_append_array( dest, size, len, c->ack_rtt_hist, false, PKT_FWD_HIST_NB );
+    json_append( dest, size, len, ",\"tx_slack_us\":" );
+    json_append_array( dest, size, len, c->tx_slack_hist, false, PKT_FWD_HIST_NB );
+    json_append( dest, size, len, "}" );
+}
 
-    httpd_resp_sendstr_chunk( req, "<input type=\"number\" id=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_FREQ );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );
-#if defined( CONFIG_RADIO_TYPE_LR1121 )
-    httpd_resp_sendstr_chunk( req, " step=\"any\" min=150 max=2500 lang=\"en\"" ); /* 1 space prefix */
-#else
-    httpd_resp_sendstr_chunk( req, " step=\"any\" min=150 max=960 lang=\"en\"" ); /* 1 space prefix */
-#endif
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_FREQ );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );        /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"" ); /* 1 space prefix */
-    if( sizeof( field_value_str ) > CHAN_FREQ_STR_MAX_SIZE )
-    {
-        snprintf( field_value_str, sizeof field_value_str, "%.6f", ( double ) nvs_config->chan_freq_hz / 1e6 );
-        httpd_resp_sendstr_chunk( req, field_value_str );
-    }
-    httpd_resp_sendstr_chunk( req, "\"><br>" );
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* channel spreading factor 1 */
-    httpd_resp_sendstr_chunk( req, "<label for=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_DR_1 );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-#if defined( CONFIG_RADIO_TYPE_LR1121 )
-    httpd_resp_sendstr_chunk( req, "\">spreading factor 1 - [5..12]</label>" );
-#else
-    httpd_resp_sendstr_chunk( req, "\">spreading factor - [5..12]</label>" );
-#endif
+/* Boot timeline as a JSON object, milestones not reached yet are null */
+static void json_append_boot_ms( char* dest, size_t size, size_t* len )
+{
+    static const char* names[BOOT_PHASE_NB] = BOOT_PHASE_NAMES;
+    uint32_t           ms;
+    int                i;
 
-    httpd_resp_sendstr_chunk( req, "<input type=\"number\" id=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_DR_1 );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );
-    httpd_resp_sendstr_chunk( req, " step=1 min=5 max=12" ); /* 1 space prefix */
-    httpd_resp_sendstr_chunk( req, " name=\"" );             /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_DR_1 );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );        /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"" ); /* 1 space prefix */
-    if( sizeof( field_value_str ) > CHAN_DR_STR_MAX_SIZE )
+    for( i = 0; i < BOOT_PHASE_NB; i++ )
     {
-        snprintf( field_value_str, sizeof field_value_str, "%u", nvs_config->chan_datarate_1 );
-        httpd_resp_sendstr_chunk( req, field_value_str );
+        json_append( dest, size, len, ( i == 0 ) ? "{\"%s\":" : ",\"%s\":", names[i] );
+        ms = boot_phase_get_ms( ( boot_phase_t ) i );
+        if( ms == 0 )
+        {
+            json_append( dest, size, len, "null" );
+        }
+        else
+        {
+            json_append( dest, size, len, "%lu", ms );
+        }
     }
-    httpd_resp_sendstr_chunk( req, "\"><br>" );
+    json_append( dest, size, len, "}" );
+}
 
-#if defined( CONFIG_RADIO_TYPE_LR1121 )
-    /* channel spreading factor 2 */
-    httpd_resp_sendstr_chunk( req, "<label for=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_DR_2 );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\">spreading factor 2 - [5..12, 0:disable]</label>" );
-
-    httpd_resp_sendstr_chunk( req, "<input type=\"number\" id=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_DR_2 );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );
-    httpd_resp_sendstr_chunk( req, " step=1 min=0 max=12" ); /* 1 space prefix */
-    httpd_resp_sendstr_chunk( req, " name=\"" );             /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_DR_2 );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );        /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"" ); /* 1 space prefix */
-    if( sizeof( field_value_str ) > CHAN_DR_STR_MAX_SIZE )
-    {
-        snprintf( field_value_str, sizeof field_value_str, "%u", nvs_config->chan_datarate_2 );
-        httpd_resp_sendstr_chunk( req, field_value_str );
-    }
-    httpd_resp_sendstr_chunk( req, "\">" );
-    httpd_resp_sendstr_chunk( req, "<br>" );
-#endif
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* channel bandwidth */
-    httpd_resp_sendstr_chunk( req, "<label>bandwidth</label>" );
-
-    /* 125 khz */
-    httpd_resp_sendstr_chunk( req, "<input type=\"radio\" id=\"bw_125\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_BW );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );             /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"125\"" ); /* 1 space prefix */
-    if( nvs_config->chan_bandwidth_khz == 125 )
-    {
-        httpd_resp_sendstr_chunk( req, " checked=\"checked\">" ); /* 1 space prefix */
-    }
-    else
-    {
-        httpd_resp_sendstr_chunk( req, ">" );
-    }
-    httpd_resp_sendstr_chunk( req, "<label for=\"bw_125\">125</label>" );
-
-    /* 250 khz */
-    httpd_resp_sendstr_chunk( req, "<input type=\"radio\" id=\"bw_250\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_BW );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );             /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"250\"" ); /* 1 space prefix */
-    if( nvs_config->chan_bandwidth_khz == 250 )
-    {
-        httpd_resp_sendstr_chunk( req, " checked=\"checked\">" ); /* 1 space prefix */
-    }
-    else
-    {
-        httpd_resp_sendstr_chunk( req, ">" );
-    }
-    httpd_resp_sendstr_chunk( req, "<label for=\"bw_250\">250</label>" );
-
-    /* 500 khz */
-    httpd_resp_sendstr_chunk( req, "<input type=\"radio\" id=\"bw_500\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_BW );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );             /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"500\"" ); /* 1 space prefix */
-    if( nvs_config->chan_bandwidth_khz == 500 )
-    {
-        httpd_resp_sendstr_chunk( req, " checked=\"checked\">" ); /* 1 space prefix */
-    }
-    else
+static void metrics_flush( metrics_writer_t* w )
+{
+    if( ( w->err == ESP_OK ) && ( w->len > 0 ) )
     {
-        httpd_resp_sendstr_chunk( req, ">" );
+        w->err = httpd_resp_send_chunk( w->req, w->buf, w->len );
     }
-    httpd_resp_sendstr_chunk( req, "<label for=\"bw_500\">500</label>" );
+    w->len = 0;
+}
 
-#if defined( CONFIG_RADIO_TYPE_LR1121 )
-    /* 200 khz (for 2.4 GHz) */
-    httpd_resp_sendstr_chunk( req, "<input type=\"radio\" id=\"bw_200\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_BW );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );             /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"200\"" ); /* 1 space prefix */
-    if( nvs_config->chan_bandwidth_khz == 200 )
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Append a line to the chunk being built, the chunk is sent when the line does not fit */
+static void metrics_printf( metrics_writer_t* w, const char* format, ... )
+{
+    va_list args;
+    int     n;
+
+    if( w->err != ESP_OK )
     {
-        httpd_resp_sendstr_chunk( req, " checked=\"checked\">" ); /* 1 space prefix */
+        return;
     }
-    else
+
+    va_start( args, format );
+    n = vsnprintf( w->buf + w->len, sizeof w->buf - w->len, format, args );
+    va_end( args );
+    if( ( n > 0 ) && ( ( size_t ) n >= ( sizeof w->buf - w->len ) ) )
     {
-        httpd_resp_sendstr_chunk( req, ">" );
+        metrics_flush( w );
+        va_start( args, format );
+        n = vsnprintf( w->buf, sizeof w->buf, format, args );
+        va_end( args );
+        if( ( size_t ) n >= sizeof w->buf )
+        {
+            n = sizeof w->buf - 1; /* truncated, the lines are much shorter than a chunk */
+        }
     }
-    httpd_resp_sendstr_chunk( req, "<strong><label for=\"bw_200\">200</label></strong>" );
-
-    /* 400 khz (for 2.4 GHz) */
-    httpd_resp_sendstr_chunk( req, "<input type=\"radio\" id=\"bw_400\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_BW );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );             /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"400\"" ); /* 1 space prefix */
-    if( nvs_config->chan_bandwidth_khz == 400 )
+    if( n > 0 )
     {
-        httpd_resp_sendstr_chunk( req, " checked=\"checked\">" ); /* 1 space prefix */
+        w->len += n;
     }
-    else
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void metrics_header( metrics_writer_t* w, const char* name, const char* type, const char* help )
+{
+    metrics_printf( w, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void metrics_counter( metrics_writer_t* w, const char* name, const char* help, uint32_t value )
+{
+    metrics_header( w, name, "counter", help );
+    metrics_printf( w, "%s %lu\n", name, value );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Cumulative histogram, bounds and sum are converted to seconds with scale */
+static void metrics_histogram( metrics_writer_t* w, const char* name, const char* help, const uint32_t* hist,
+                               const int32_t* bounds, int64_t sum, float scale )
+{
+    uint32_t count = 0;
+    int      i;
+
+    metrics_header( w, name, "histogram", help );
+    for( i = 0; i < ( PKT_FWD_HIST_NB - 1 ); i++ )
     {
-        httpd_resp_sendstr_chunk( req, ">" );
+        count += hist[i];
+        metrics_printf( w, "%s_bucket{le=\"%g\"} %lu\n", name, bounds[i] * scale, count );
     }
-    httpd_resp_sendstr_chunk( req, "<strong><label for=\"bw_400\">400</label></strong>" );
-
-    /* 800 khz (for 2.4 GHz) */
-    httpd_resp_sendstr_chunk( req, "<input type=\"radio\" id=\"bw_800\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_CHAN_BW );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );             /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"800\"" ); /* 1 space prefix */
-    if( nvs_config->chan_bandwidth_khz == 800 )
+    count += hist[PKT_FWD_HIST_NB - 1];
+    metrics_printf( w, "%s_bucket{le=\"+Inf\"} %lu\n%s_sum %g\n%s_count %lu\n", name, count, name,
+                    ( double ) sum * scale, name, count );
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+/* -------------------------------------------------------------------------- */
+
+/* Queued by thread_stream(), runs in the HTTP server task */
+static void stream_send_work( void* arg )
+{
+    stream_client_t*   client;
+    pkt_stream_event_t event;
+    httpd_ws_frame_t   frame;
+    size_t             size = sizeof stream_frame;
+    size_t             len;
+    int                nb_event;
+    int                i;
+
+    __atomic_store_n( &stream_work_pending, false, __ATOMIC_RELEASE );
+
+    for( i = 0; i < STREAM_CLIENTS_MAX; i++ )
     {
-        httpd_resp_sendstr_chunk( req, " checked=\"checked\">" ); /* 1 space prefix */
+        client = &stream_clients[i];
+        if( client->fd < 0 )
+        {
+            continue;
+        }
+        if( httpd_ws_get_fd_info( stream_server, client->fd ) != HTTPD_WS_CLIENT_WEBSOCKET )
+        {
+            ESP_LOGI( TAG_WEB, "live stream client %d disconnected", client->fd );
+            client->fd = -1;
+            stream_nb_clients -= 1;
+            continue;
+        }
+
+        /* Batch the pending events in a JSON array, a client which cannot keep up loses the oldest ones */
+        len      = 0;
+        nb_event = 0;
+        json_append( stream_frame, size, &len, "[" );
+        while( ( ( size - len ) > STREAM_EVENT_MAX_SIZE ) &&
+               ( pkt_stream_read( &client->cursor, &event, &client->nb_dropped ) == true ) )
+        {
+            json_append( stream_frame, size, &len, ( nb_event > 0 ) ? "," : "" );
+            len += pkt_stream_format( &event, stream_frame + len, size - len );
+            nb_event += 1;
+        }
+        if( client->nb_dropped > 0 )
+        {
+            json_append( stream_frame, size, &len, "%s{\"type\":\"drop\",\"count\":%lu}", ( nb_event > 0 ) ? "," : "",
+                         client->nb_dropped );
+            client->nb_dropped = 0;
+            nb_event += 1;
+        }
+        json_append( stream_frame, size, &len, "]" );
+        if( ( nb_event == 0 ) || ( len >= size ) )
+        {
+            continue;
+        }
+
+        memset( &frame, 0, sizeof frame );
+        frame.type    = HTTPD_WS_TYPE_TEXT;
+        frame.payload = ( uint8_t* ) stream_frame;
+        frame.len     = len;
+        if( httpd_ws_send_frame_async( stream_server, client->fd, &frame ) != ESP_OK )
+        {
+            ESP_LOGW( TAG_WEB, "live stream client %d not responding, closing", client->fd );
+            httpd_sess_trigger_close( stream_server, client->fd );
+            client->fd = -1;
+            stream_nb_clients -= 1;
+        }
     }
-    else
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* The forwarder threads only write to the event ring, the frames are sent from the HTTP server task */
+static void thread_stream( void )
+{
+    while( true )
     {
-        httpd_resp_sendstr_chunk( req, ">" );
+        vTaskDelay( STREAM_PERIOD_MS / portTICK_PERIOD_MS );
+
+        if( ( stream_nb_clients > 0 ) &&
+            ( __atomic_exchange_n( &stream_work_pending, true, __ATOMIC_ACQ_REL ) == false ) )
+        {
+            if( httpd_queue_work( stream_server, stream_send_work, NULL ) != ESP_OK )
+            {
+                __atomic_store_n( &stream_work_pending, false, __ATOMIC_RELEASE );
+            }
+        }
     }
-    httpd_resp_sendstr_chunk( req, "<strong><strong><label for=\"bw_800\">800</label></strong>" );
+}
 #endif
-    httpd_resp_sendstr_chunk( req, "<br>" );
-
-    /* Miscellaneous */
-    httpd_resp_sendstr_chunk( req, "<h2>Miscellaneous</h2>" );
-
-    /* SNTP server address */
-    httpd_resp_sendstr_chunk( req, "<label for=\"" );
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_SNTP_ADDRESS );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\">SNTP server address</label>" );
-
-    httpd_resp_sendstr_chunk( req, "<input type=\"text\" id=\"sntp_address\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_SNTP_ADDRESS );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" ); /* close string */
-    httpd_resp_sendstr_chunk( req, " maxlength=\"" );
-    snprintf( field_maxlength_str, sizeof field_maxlength_str, "%d",
-              SNTP_ADDRESS_STR_MAX_SIZE - 1 ); /* keep 1 byte for null termination */
-    httpd_resp_sendstr_chunk( req, field_maxlength_str );
-    httpd_resp_sendstr_chunk( req, "\"" );        /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"" ); /* 1 space prefix */
-    if( strlen( nvs_config->sntp_address ) )
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static esp_err_t http_root_get_handler( httpd_req_t* req )
+{
+    char if_none_match[WEB_ETAG_HDR_MAX_SIZE] = { 0 };
+
+    ESP_LOGI( TAG_WEB, "root_get_handler req->uri=[%s]", req->uri );
+
+    /* The page only changes with the firmware, a browser having it in cache just needs to be told so */
+    if( ( httpd_req_get_hdr_value_str( req, "If-None-Match", if_none_match, sizeof if_none_match ) == ESP_OK ) &&
+        ( strstr( if_none_match, WEB_INDEX_ETAG_STR ) != NULL ) )
     {
-        httpd_resp_sendstr_chunk( req, nvs_config->sntp_address );
+        httpd_resp_set_status( req, "304 Not Modified" );
+        httpd_resp_set_hdr( req, "ETag", WEB_INDEX_ETAG_STR );
+        return httpd_resp_send( req, NULL, 0 );
     }
-    httpd_resp_sendstr_chunk( req, "\"><br>" );
-
-    /* Submit form button */
-    httpd_resp_sendstr_chunk( req, "<br><input class=\"btn_cfg\" type=\"submit\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" ); /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_SUBMIT );
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );                    /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"configure\">" ); /* 1 space prefix */
-
-    /* End of config form */
-    httpd_resp_sendstr_chunk( req, "</form>" );
-
-    /* Reboot button form */
-    httpd_resp_sendstr_chunk( req, "<form method=\"post\" action=\"/reboot\">" );
-    httpd_resp_sendstr_chunk( req, "<input class=\"btn_rst\" type=\"submit\"" );
-    httpd_resp_sendstr_chunk( req, " name=\"" );                                     /* 1 space prefix */
-    snprintf( field_name_str, sizeof field_name_str, "%s", FORM_FIELD_NAME_SUBMIT ); /* 1 space prefix */
-    httpd_resp_sendstr_chunk( req, field_name_str );
-    httpd_resp_sendstr_chunk( req, "\"" );                 /* close string */
-    httpd_resp_sendstr_chunk( req, " value=\"reboot\">" ); /* 1 space prefix */
-    httpd_resp_sendstr_chunk( req, "</form><br>" );
-
-    /* End div */
-    httpd_resp_sendstr_chunk( req, "</div>" );
-
-    /* Send remaining chunk of HTML file to complete it */
-    httpd_resp_sendstr_chunk( req, "</body></html>" );
-
-    /* Send empty chunk to signal HTTP response completion */
-    httpd_resp_sendstr_chunk( req, NULL );
 
-    return ESP_OK;
+    /* Send the compressed page in one go, the configuration values are fetched by the page from the REST API */
+    httpd_resp_set_type( req, "text/html" );
+    httpd_resp_set_hdr( req, "Content-Encoding", "gzip" );
+    httpd_resp_set_hdr( req, "ETag", WEB_INDEX_ETAG_STR );
+    httpd_resp_set_hdr( req, "Cache-Control", "no-cache" );
+    return httpd_resp_send( req, ( const char* ) web_index_gz_start, web_index_gz_end - web_index_gz_start );
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -647,7 +651,9 @@ static esp_err_t set_config_post_handler( httpd_req_t* req )
     lgw_nvs_cfg_t updated_config = *current_config; /* local alloc for update */
 
     /* Parse JSON */
+    json_arena_attach( JSON_ARENA_HTTP );
     root_val = json_parse_string_with_comments( ( const char* ) ( post_content_json ) );
+    json_arena_detach( );
     if( root_val == NULL )
     {
         ESP_LOGW( TAG_WEB, "WARNING: invalid JSON, configuration failed" );
@@ -1058,6 +1064,50 @@ static esp_err_t reboot_post_handler( httpd_req_t* req )
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* POSTMAN:
+POST http://xxx.xxx.xxx.xxxx:8000/api/v1/apply_config
+{}
+*/
+
+static esp_err_t apply_config_post_handler( httpd_req_t* req )
+{
+    http_post_src_t  post_src = ( http_post_src_t )( intptr_t ) req->user_ctx;
+    pkt_fwd_reconf_t reconf;
+
+    ESP_LOGI( TAG_WEB, "%s: req->uri=%s", __FUNCTION__, req->uri );
+    ESP_LOGI( TAG_WEB, "%s: content length %d", __FUNCTION__, req->content_len );
+
+    /* Apply the stored configuration without reboot */
+    if( pkt_fwd_apply_config( &reconf ) != 0 )
+    {
+        ESP_LOGE( TAG_WEB, "ERROR: failed to apply configuration" );
+        httpd_resp_send_err( req, HTTPD_500_INTERNAL_SERVER_ERROR, "failed to apply config, reboot to apply it" );
+        return ESP_FAIL;
+    }
+
+    if( post_src == HTTP_POST_SRC_WEB_FORM )
+    {
+        ESP_LOGI( TAG_WEB, "%s: received POST apply config from web form", __FUNCTION__ );
+        /* Redirect back to root page */
+        httpd_resp_set_status( req, "302 Found" );
+        httpd_resp_set_hdr( req, "Location", "/" );
+        httpd_resp_send( req, NULL, 0 );
+    }
+    else
+    {  // HTTP_POST_SRC_API
+        ESP_LOGI( TAG_WEB, "%s: received POST apply config from API", __FUNCTION__ );
+        snprintf( post_content_json, JSON_FULL_CONTENT_MAX_SIZE,
+                  "{\"radio_changed\":%s,\"lns_changed\":%s,\"downtime_us\":%lu}",
+                  reconf.radio_changed ? "true" : "false", reconf.lns_changed ? "true" : "false", reconf.downtime_us );
+        httpd_resp_set_type( req, "application/json" );
+        httpd_resp_sendstr( req, post_content_json );
+    }
+
+    return ESP_OK;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* POSTMAN:
 GET http://xxx.xxx.xxx.xxxx:8000/api/v1/get_config
 */
@@ -1095,12 +1145,22 @@ GET http://xxx.xxx.xxx.xxxx:8000/api/v1/get_info
 
 esp_err_t get_info_get_handler( httpd_req_t* req )
 {
+    size_t len = 0;
+
     ESP_LOGI( TAG_WEB, "%s: req->uri=%s", __FUNCTION__, req->uri );
     ESP_LOGI( TAG_WEB, "%s: content length %d", __FUNCTION__, req->content_len );
 
+    /* Get info to be displayed */
+    wifi_get_mac_address( web_inf_mac_addr );
+    snprintf( web_inf_mac_addr_str, sizeof web_inf_mac_addr_str, "%02x:%02x:%02x:%02x:%02x:%02x", web_inf_mac_addr[0],
+              web_inf_mac_addr[1], web_inf_mac_addr[2], web_inf_mac_addr[3], web_inf_mac_addr[4], web_inf_mac_addr[5] );
+
     /* Generate the JSON string */
-    snprintf( post_content_json, JSON_FULL_CONTENT_MAX_SIZE, "{\"fw_version\":\"%s\",\"radio_type\":\"%s\"}",
-              LORAHUB_FW_VERSION_STR, radio_type );
+    json_append( post_content_json, JSON_FULL_CONTENT_MAX_SIZE, &len,
+                 "{\"fw_version\":\"%s\",\"radio_type\":\"%s\",\"mac_addr\":\"%s\",\"boot_ms\":",
+                 LORAHUB_FW_VERSION_STR, radio_type, web_inf_mac_addr_str );
+    json_append_boot_ms( post_content_json, JSON_FULL_CONTENT_MAX_SIZE, &len );
+    json_append( post_content_json, JSON_FULL_CONTENT_MAX_SIZE, &len, "}" );
 
     /* Send response */
     httpd_resp_set_type( req, "application/json" );
@@ -1109,15 +1169,352 @@ esp_err_t get_info_get_handler( httpd_req_t* req )
     return ESP_OK;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* POSTMAN:
+GET http://xxx.xxx.xxx.xxxx:8000/api/v1/stats
+*/
+
+esp_err_t get_stats_get_handler( httpd_req_t* req )
+{
+    size_t size = sizeof stats_content_json;
+    size_t len  = 0;
+
+    ESP_LOGI( TAG_WEB, "%s: req->uri=%s", __FUNCTION__, req->uri );
+
+    /* Get the last snapshot published by the packet forwarder */
+    pkt_fwd_get_stats( &stats );
+
+    /* Generate the JSON string, histograms bins are given by their upper bound (the last one is unbounded) */
+    json_append( stats_content_json, size, &len,
+                 "{\"uptime_s\":%lu,\"interval_s\":%lu,\"hist_bounds\":{\"ack_rtt_ms\":", stats.uptime_s,
+                 stats.interval_s );
+    json_append_array( stats_content_json, size, &len, ack_rtt_bounds_ms, true, PKT_FWD_HIST_NB - 1 );
+    json_append( stats_content_json, size, &len, ",\"tx_slack_us\":" );
+    json_append_array( stats_content_json, size, &len, tx_slack_bounds_us, true, PKT_FWD_HIST_NB - 1 );
+    json_append( stats_content_json, size, &len, "},\"window\":" );
+    json_append_counters( stats_content_json, size, &len, &stats.window );
+    json_append( stats_content_json, size, &len, ",\"total\":" );
+    json_append_counters( stats_content_json, size, &len, &stats.total );
+    json_append( stats_content_json, size, &len, ",\"boot_ms\":" );
+    json_append_boot_ms( stats_content_json, size, &len );
+    json_append( stats_content_json, size, &len, "}" );
+    if( len >= size )
+    {
+        ESP_LOGE( TAG_WEB, "%s: statistics too long (%u, max:%u)", __FUNCTION__, ( unsigned ) len,
+                  ( unsigned ) size );
+        httpd_resp_send_err( req, HTTPD_500_INTERNAL_SERVER_ERROR, "statistics too long" );
+        return ESP_FAIL;
+    }
+
+    /* Send response */
+    httpd_resp_set_type( req, "application/json" );
+    httpd_resp_send( req, stats_content_json, len );
+
+    return ESP_OK;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* PROMETHEUS:
+GET http://xxx.xxx.xxx.xxxx:8000/metrics
+*/
+
+esp_err_t metrics_get_handler( httpd_req_t* req )
+{
+    metrics_writer_t          w = { .req = req, .len = 0, .err = ESP_OK };
+    const pkt_fwd_counters_t* c = &stats.total;
+    json_arena_stats_t        arena_stats;
+    int                       nb_filter_stats;
+    int                       i;
+
+    /* Get the last snapshot published by the packet forwarder, counters are kept since start */
+    pkt_fwd_get_stats( &stats );
+
+    httpd_resp_set_type( req, "text/plain; version=0.0.4" );
+
+    metrics_counter( &w, "lorahub_rx_packets_total", "Packets received by the radio", c->nb_rx_rcv );
+    metrics_header( &w, "lorahub_rx_packets_crc_total", "counter", "Packets received by the radio, by CRC status" );
+    metrics_printf( &w, "lorahub_rx_packets_crc_total{crc=\"ok\"} %lu\n", c->nb_rx_ok );
+    metrics_printf( &w, "lorahub_rx_packets_crc_total{crc=\"bad\"} %lu\n", c->nb_rx_bad );
+    metrics_printf( &w, "lorahub_rx_packets_crc_total{crc=\"none\"} %lu\n", c->nb_rx_nocrc );
+    metrics_counter( &w, "lorahub_up_forwarded_packets_total", "Packets forwarded to the server", c->up_pkt_fwd );
+    metrics_counter( &w, "lorahub_push_data_sent_total", "PUSH_DATA datagrams sent", c->up_dgram_sent );
+    metrics_counter( &w, "lorahub_push_ack_received_total", "PUSH_DATA datagrams acknowledged", c->up_ack_rcv );
+    metrics_counter( &w, "lorahub_pull_data_sent_total", "PULL_DATA datagrams sent", c->dw_pull_sent );
+    metrics_counter( &w, "lorahub_pull_ack_received_total", "PULL_DATA datagrams acknowledged", c->dw_ack_rcv );
+    metrics_counter( &w, "lorahub_pull_resp_received_total", "Valid PULL_RESP datagrams received", c->dw_dgram_rcv );
+    metrics_histogram( &w, "lorahub_ack_rtt_seconds", "PUSH_ACK and PULL_ACK round trip time", c->ack_rtt_hist,
+                       ack_rtt_bounds_ms, c->ack_rtt_sum_ms, 1e-3 );
+
+    metrics_counter( &w, "lorahub_tx_requested_total", "Downlinks requested by the server", c->nb_tx_requested );
+    metrics_counter( &w, "lorahub_tx_ok_total", "Downlinks emitted", c->nb_tx_ok );
+    metrics_counter( &w, "lorahub_tx_fail_total", "Downlinks failed to be programmed or aborted by LBT",
+                     c->nb_tx_fail );
+    metrics_counter( &w, "lorahub_tx_rx2_fallback_total", "Class A downlinks moved to RX2", c->nb_tx_rx2_fallback );
+    metrics_counter( &w, "lorahub_tx_preempted_total", "Accepted downlinks dropped for a higher priority one",
+                     c->nb_tx_preempted );
+    metrics_header( &w, "lorahub_tx_rejected_total", "counter", "Downlinks rejected by the JiT queue, by cause" );
+    metrics_printf( &w, "lorahub_tx_rejected_total{cause=\"collision_packet\"} %lu\n",
+                    c->nb_tx_rejected_collision_packet );
+    metrics_printf( &w, "lorahub_tx_rejected_total{cause=\"collision_beacon\"} %lu\n",
+                    c->nb_tx_rejected_collision_beacon );
+    metrics_printf( &w, "lorahub_tx_rejected_total{cause=\"too_late\"} %lu\n", c->nb_tx_rejected_too_late );
+    metrics_printf( &w, "lorahub_tx_rejected_total{cause=\"too_early\"} %lu\n", c->nb_tx_rejected_too_early );
+    metrics_printf( &w, "lorahub_tx_rejected_total{cause=\"duty_cycle\"} %lu\n", c->nb_tx_rejected_duty_cycle );
+    metrics_histogram( &w, "lorahub_tx_slack_seconds", "Time left before TX start once programmed (late if < 0)",
+                       c->tx_slack_hist, tx_slack_bounds_us, c->tx_slack_sum_us, 1e-6 );
+
+    metrics_counter( &w, "lorahub_jit_deferred_total", "Class C downlinks deferred to the overflow queue",
+                     stats.state.jit_nb_deferred );
+    metrics_counter( &w, "lorahub_jit_expired_total", "Deferred downlinks dropped as they waited for too long",
+                     stats.state.jit_nb_expired );
+    metrics_counter( &w, "lorahub_jit_preempted_total", "Downlinks evicted by a higher priority one",
+                     stats.state.jit_nb_preempted );
+    metrics_counter( &w, "lorahub_jit_asap_late_total", "Downlinks programmed too close to their timestamp",
+                     stats.state.asap_nb_late );
+    metrics_header( &w, "lorahub_jit_queue_length", "gauge", "Downlinks waiting in the JiT queue" );
+    metrics_printf( &w, "lorahub_jit_queue_length %lu\n", stats.state.jit_queue_len );
+    metrics_header( &w, "lorahub_jit_overflow_length", "gauge", "Class C downlinks waiting for a slot" );
+    metrics_printf( &w, "lorahub_jit_overflow_length %lu\n", stats.state.jit_overflow_len );
+    metrics_header( &w, "lorahub_jit_asap_lead_seconds", "gauge", "Lead time given to immediate downlinks" );
+    metrics_printf( &w, "lorahub_jit_asap_lead_seconds %.6f\n", stats.state.asap_lead_us * 1e-6 );
+    metrics_counter( &w, "lorahub_lbt_scans_total", "Listen-Before-Talk channel scans", stats.state.lbt_nb_scan );
+    metrics_counter( &w, "lorahub_lbt_busy_total", "Downlinks aborted because the channel was busy",
+                     stats.state.lbt_nb_busy );
+
+    if( c->nb_rx_rcv > 0 )
+    {
+        metrics_header( &w, "lorahub_last_rssi_dbm", "gauge", "RSSI of the last packet received" );
+        metrics_printf( &w, "lorahub_last_rssi_dbm %.1f\n", stats.state.last_rssi );
+        metrics_header( &w, "lorahub_last_snr_db", "gauge", "SNR of the last packet received" );
+        metrics_printf( &w, "lorahub_last_snr_db %.1f\n", stats.state.last_snr );
+    }
+    if( stats.state.temperature_valid == true )
+    {
+        metrics_header( &w, "lorahub_temperature_celsius", "gauge", "Concentrator temperature" );
+        metrics_printf( &w, "lorahub_temperature_celsius %.1f\n", stats.state.temperature );
+    }
+
+    metrics_header( &w, "lorahub_uptime_seconds", "gauge", "Time since boot of the last statistics snapshot" );
+    metrics_printf( &w, "lorahub_uptime_seconds %lu\n", stats.uptime_s );
+    metrics_header( &w, "lorahub_heap_free_bytes", "gauge", "Free heap" );
+    metrics_printf( &w, "lorahub_heap_free_bytes %lu\n", esp_get_free_heap_size( ) );
+    metrics_header( &w, "lorahub_heap_free_min_bytes", "gauge", "Lowest free heap since boot" );
+    metrics_printf( &w, "lorahub_heap_free_min_bytes %lu\n", esp_get_minimum_free_heap_size( ) );
+    metrics_header( &w, "lorahub_heap_largest_free_block_bytes", "gauge", "Largest free heap block" );
+    metrics_printf( &w, "lorahub_heap_largest_free_block_bytes %u\n",
+                    heap_caps_get_largest_free_block( MALLOC_CAP_8BIT ) );
+    metrics_header( &w, "lorahub_task_stack_free_min_bytes", "gauge", "Lowest free stack space of each task" );
+    for( i = 0; i < PKT_FWD_THREAD_NB; i++ )
+    {
+        metrics_printf( &w, "lorahub_task_stack_free_min_bytes{task=\"%s\"} %lu\n", thread_names[i],
+                        stats.state.stack_free_min[i] );
+    }
+    metrics_printf( &w, "lorahub_task_stack_free_min_bytes{task=\"httpd\"} %u\n",
+                    uxTaskGetStackHighWaterMark( NULL ) );
+    metrics_header( &w, "lorahub_json_arena_high_water_bytes", "gauge", "Highest use of the JSON parsing arenas" );
+    for( i = 0; i < JSON_ARENA_NB; i++ )
+    {
+        json_arena_get_stats( i, &arena_stats );
+        metrics_printf( &w, "lorahub_json_arena_high_water_bytes{arena=\"%s\"} %lu\n", arena_stats.name,
+                        arena_stats.high_water );
+    }
+    nb_filter_stats = uplink_filter_get_stats( filter_stats, sizeof filter_stats / sizeof filter_stats[0] );
+    if( nb_filter_stats > 0 )
+    {
+        metrics_header( &w, "lorahub_uplink_filter_matches_total", "counter",
+                        "Valid uplinks which matched each filter rule, default when no rule matched" );
+    }
+    for( i = 0; i < nb_filter_stats; i++ )
+    {
+        metrics_printf( &w, "lorahub_uplink_filter_matches_total{list=\"%s\",rule=\"%s\",action=\"%s\"} %lu\n",
+                        ( filter_stats[i].list == UPLINK_FILTER_DEVADDR ) ? "devaddr" : "joineui", filter_stats[i].rule,
+                        ( filter_stats[i].allow == true ) ? "forward" : "drop", filter_stats[i].nb_match );
+    }
+#if defined( CONFIG_GATEWAY_DISPLAY )
+    metrics_counter( &w, "lorahub_display_renders_skipped_total",
+                     "Display renders avoided, as updates were merged or did not change the text",
+                     display_get_renders_skipped( ) );
+#endif
+
+    /* Send the last chunk, then terminate the response */
+    metrics_flush( &w );
+    if( w.err == ESP_OK )
+    {
+        w.err = httpd_resp_send_chunk( req, NULL, 0 );
+    }
+    if( w.err != ESP_OK )
+    {
+        ESP_LOGW( TAG_WEB, "%s: failed to send metrics - %s", __FUNCTION__, esp_err_to_name( w.err ) );
+    }
+
+    return w.err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* POSTMAN:
+GET http://xxx.xxx.xxx.xxxx:8000/api/v1/devices
+*/
+
+esp_err_t get_devices_get_handler( httpd_req_t* req )
+{
+    metrics_writer_t   w = { .req = req, .len = 0, .err = ESP_OK };
+    dev_table_entry_t* d;
+    struct timespec    now;
+    int                nb;
+    int                i;
+    int                j;
+
+    ESP_LOGI( TAG_WEB, "%s: req->uri=%s", __FUNCTION__, req->uri );
+
+    /* Copy the table, the upstream thread is not held while the response is sent */
+    nb = dev_table_get_entries( devices, DEV_TABLE_DEVICE_NB_MAX );
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    httpd_resp_set_type( req, "application/json" );
+
+    /* The response is sent in chunks, as for the metrics */
+    metrics_printf( &w, "{\"sf_min\":%d,\"devices\":[", DEV_TABLE_SF_MIN );
+    for( i = 0; i < nb; i++ )
+    {
+        d = &devices[i];
+        metrics_printf( &w,
+                        "%s{\"devaddr\":\"%08lX\",\"age_s\":%lu,\"nb_pkt\":%lu,\"nb_lost\":%lu,\"loss_pct\":%.1f,"
+                        "\"rssi\":%.1f,\"snr\":%.1f,\"fcnt\":%u,\"sf_hist\":[",
+                        ( i == 0 ) ? "" : ",", d->devaddr, ( uint32_t ) now.tv_sec - d->last_seen_s, d->nb_pkt,
+                        d->nb_lost, dev_table_get_loss_pct( d ), d->rssi, d->snr, d->last_fcnt );
+        for( j = 0; j < DEV_TABLE_SF_NB; j++ )
+        {
+            metrics_printf( &w, ( j == 0 ) ? "%u" : ",%u", d->sf_hist[j] );
+        }
+        metrics_printf( &w, "]}" );
+    }
+    metrics_printf( &w, "]}" );
+
+    /* Send the last chunk, then terminate the response */
+    metrics_flush( &w );
+    if( w.err == ESP_OK )
+    {
+        w.err = httpd_resp_send_chunk( req, NULL, 0 );
+    }
+    if( w.err != ESP_OK )
+    {
+        ESP_LOGW( TAG_WEB, "%s: failed to send devices - %s", __FUNCTION__, esp_err_to_name( w.err ) );
+    }
+
+    return w.err;
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+/* -------------------------------------------------------------------------- */
+
+/* WEBSOCKET:
+ws://xxx.xxx.xxx.xxxx:8000/api/v1/stream
+*/
+
+esp_err_t stream_ws_handler( httpd_req_t* req )
+{
+    httpd_ws_frame_t frame;
+    uint8_t          payload[16];
+    int              fd;
+    int              i;
+
+    if( req->method == HTTP_GET )
+    {
+        /* Handshake done, the client receives the events pushed from now on */
+        fd = httpd_req_to_sockfd( req );
+        for( i = 0; i < STREAM_CLIENTS_MAX; i++ )
+        {
+            if( stream_clients[i].fd == fd )
+            {
+                /* The socket of a closed client has been reused */
+                stream_clients[i].fd = -1;
+                stream_nb_clients -= 1;
+            }
+        }
+        for( i = 0; i < STREAM_CLIENTS_MAX; i++ )
+        {
+            if( stream_clients[i].fd < 0 )
+            {
+                stream_clients[i].fd         = fd;
+                stream_clients[i].cursor     = pkt_stream_get_head( );
+                stream_clients[i].nb_dropped = 0;
+                stream_nb_clients += 1;
+                ESP_LOGI( TAG_WEB, "live stream client %d connected", fd );
+                return ESP_OK;
+            }
+        }
+        ESP_LOGW( TAG_WEB, "%s: too many live stream clients (max:%d)", __FUNCTION__, STREAM_CLIENTS_MAX );
+        return ESP_FAIL;
+    }
+
+    /* Nothing is expected from the client, drain small frames and close on anything else */
+    memset( &frame, 0, sizeof frame );
+    if( httpd_ws_recv_frame( req, &frame, 0 ) != ESP_OK )
+    {
+        return ESP_FAIL;
+    }
+    if( frame.len > sizeof payload )
+    {
+        return ESP_FAIL;
+    }
+    if( frame.len > 0 )
+    {
+        frame.payload = payload;
+        return httpd_ws_recv_frame( req, &frame, frame.len );
+    }
+
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* WEB PAGE:
+GET http://xxx.xxx.xxx.xxxx:8000/live
+*/
+
+esp_err_t live_get_handler( httpd_req_t* req )
+{
+    ESP_LOGI( TAG_WEB, "%s: req->uri=%s", __FUNCTION__, req->uri );
+
+    httpd_resp_sendstr_chunk( req, "<!DOCTYPE html><html>" );
+    httpd_resp_sendstr_chunk( req, html_header );
+    httpd_resp_sendstr_chunk( req, "<body><div><h2>Live packets</h2><pre id=\"log\"></pre></div>" );
+    httpd_resp_sendstr_chunk( req,
+                              "<script>"
+                              "var log = document.getElementById('log');"
+                              "var ws = new WebSocket('ws://' + location.host + '/api/v1/stream');"
+                              "ws.onmessage = function(e) {"
+                              "    JSON.parse(e.data).forEach(function(ev) {"
+                              "        log.textContent = JSON.stringify(ev) + '\\n' + log.textContent.slice(0, 20000);"
+                              "    });"
+                              "};"
+                              "ws.onclose = function() { log.textContent = 'connection closed\\n' + log.textContent; };"
+                              "</script>" );
+    httpd_resp_sendstr_chunk( req, "</body></html>" );
+
+    return httpd_resp_sendstr_chunk( req, NULL );
+}
+#endif
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 void http_server_init( void )
 {
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    pthread_t thrid_stream;
+    int       i;
+#endif
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG( );
     config.server_port    = 8000;  // TODO: make it configurable
 
+    /* The web interface, the REST API and the metrics need more than the default 8 handlers */
+    config.max_uri_handlers = 16;
+
     /* Use the URI wildcard matching function in order to
      * allow the same handler to respond to multiple different
      * target URIs which match the wildcard scheme */
@@ -1164,6 +1561,20 @@ void http_server_init( void )
                                         .user_ctx = ( void* ) HTTP_POST_SRC_API };
     httpd_register_uri_handler( server, &api_reboot_post_uri );
 
+    /* URI handler for apply configuration POST from web form */
+    httpd_uri_t apply_post_uri = { .uri      = "/apply",
+                                   .method   = HTTP_POST,
+                                   .handler  = apply_config_post_handler,
+                                   .user_ctx = ( void* ) HTTP_POST_SRC_WEB_FORM };
+    httpd_register_uri_handler( server, &apply_post_uri );
+
+    /* URI handler for apply configuration POST from API */
+    httpd_uri_t api_apply_config_post_uri = { .uri      = "/api/v1/apply_config",
+                                              .method   = HTTP_POST,
+                                              .handler  = apply_config_post_handler,
+                                              .user_ctx = ( void* ) HTTP_POST_SRC_API };
+    httpd_register_uri_handler( server, &api_apply_config_post_uri );
+
     /* URI handler got get_config GET from API */
     httpd_uri_t api_get_config_get_uri = {
         .uri = "/api/v1/get_config", .method = HTTP_GET, .handler = get_config_get_handler, .user_ctx = NULL
@@ -1175,4 +1586,47 @@ void http_server_init( void )
         .uri = "/api/v1/get_info", .method = HTTP_GET, .handler = get_info_get_handler, .user_ctx = NULL
     };
     httpd_register_uri_handler( server, &api_get_info_get_uri );
+
+    /* URI handler for stats GET from API */
+    httpd_uri_t api_get_stats_get_uri = {
+        .uri = "/api/v1/stats", .method = HTTP_GET, .handler = get_stats_get_handler, .user_ctx = NULL
+    };
+    httpd_register_uri_handler( server, &api_get_stats_get_uri );
+
+    /* URI handler for Prometheus metrics GET */
+    httpd_uri_t metrics_get_uri = {
+        .uri = "/metrics", .method = HTTP_GET, .handler = metrics_get_handler, .user_ctx = NULL
+    };
+    httpd_register_uri_handler( server, &metrics_get_uri );
+
+    /* URI handler for device table GET from API */
+    httpd_uri_t api_get_devices_get_uri = {
+        .uri = "/api/v1/devices", .method = HTTP_GET, .handler = get_devices_get_handler, .user_ctx = NULL
+    };
+    httpd_register_uri_handler( server, &api_get_devices_get_uri );
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    /* URI handler for the live packet stream WebSocket */
+    httpd_uri_t api_stream_ws_uri = { .uri          = "/api/v1/stream",
+                                      .method       = HTTP_GET,
+                                      .handler      = stream_ws_handler,
+                                      .user_ctx     = NULL,
+                                      .is_websocket = true };
+    httpd_register_uri_handler( server, &api_stream_ws_uri );
+
+    /* URI handler for the live packet stream web page */
+    httpd_uri_t live_get_uri = { .uri = "/live", .method = HTTP_GET, .handler = live_get_handler, .user_ctx = NULL };
+    httpd_register_uri_handler( server, &live_get_uri );
+
+    /* Start the thread feeding the live packet stream clients */
+    for( i = 0; i < STREAM_CLIENTS_MAX; i++ )
+    {
+        stream_clients[i].fd = -1;
+    }
+    stream_server = server;
+    if( pthread_create( &thrid_stream, NULL, ( void* ( * ) ( void* ) ) thread_stream, NULL ) != 0 )
+    {
+        ESP_LOGE( TAG_WEB, "ERROR: Failed to create live stream thread" );
+    }
+#endif
 }
\ No newline at end of file
@@ -26,6 +26,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include "trace.h"
 #include "jitqueue.h"
+#include "airtime.h"
+#include "lorawan.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -44,15 +46,71 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
                                     to ensure beacon can be sent */
 #define BEACON_RESERVED 2120000 /* Time on air of the beacon, with some margin */
 
+/* Class C overflow queue */
+#ifdef CONFIG_JIT_CLASS_C_MAX_AGE_MS
+#define JIT_OVERFLOW_MAX_AGE ( CONFIG_JIT_CLASS_C_MAX_AGE_MS * 1000UL )
+#else
+#define JIT_OVERFLOW_MAX_AGE 5000000 /* Max time a Class C packet waits for a slot, in microseconds */
+#endif
+
+/* Immediate (Class C) downlinks scheduling */
+#define TX_ASAP_MIN_DELAY \
+    ( TX_START_DELAY + TX_MARGIN_DELAY + TX_JIT_DELAY + 2000 ) /* Earliest slot accepted by enqueue criteria_1 */
+#define TX_ASAP_MAX_DELAY 1000000 /* Upper bound of the ASAP lead time (legacy fixed margin) */
+#define TX_ASAP_POLL_DELAY 10000  /* JIT thread polling period, worst case wait before dequeue */
+#define TX_ASAP_LATE_PENALTY 5000 /* Added to the lead time each time a downlink is programmed late */
+#ifdef CONFIG_DOWNLINK_LBT
+#define TX_ASAP_LBT_DELAY CONFIG_DOWNLINK_LBT_SCAN_TIME_US /* Channel scan right before TX, not in dispatch time */
+#else
+#define TX_ASAP_LBT_DELAY 0
+#endif
+
+/* Preemption of lower priority packets */
+#ifdef CONFIG_JIT_PREEMPTION
+#define JIT_PREEMPTION true
+#else
+#define JIT_PREEMPTION false
+#endif
+#define TX_PREEMPT_GUARD \
+    ( TX_JIT_DELAY + TX_ASAP_POLL_DELAY ) /* Packets closer than this may already be peeked by the JIT thread */
+
 static const char* TAG_JITQ = "jit_queue";
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 static pthread_mutex_t mx_jit_queue = PTHREAD_MUTEX_INITIALIZER; /* control access to JIT queue */
 
+/* Dispatch cost statistics, shared by all queues (same radio) and protected by mx_jit_queue */
+static uint32_t asap_dispatch_us     = 0; /* smoothed time from peek to radio configured for TX */
+static uint32_t asap_dispatch_dev_us = 0; /* smoothed mean deviation of the dispatch time */
+static uint32_t asap_penalty_us      = 0; /* extra margin learned from late downlinks */
+static uint32_t asap_lead_us         = TX_ASAP_MIN_DELAY;
+static uint32_t asap_nb_sample       = 0;
+static uint32_t asap_nb_late         = 0;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* Must be called with mx_jit_queue locked */
+static void jit_asap_compute_lead( void )
+{
+    uint32_t lead_us;
+
+    /* The downlink must survive one polling period of the JIT thread, the dispatch cost with some variance margin,
+     * the LBT channel scan, and still be programmed TX_START_DELAY before its timestamp */
+    lead_us = TX_ASAP_POLL_DELAY + asap_dispatch_us + ( 4 * asap_dispatch_dev_us ) + TX_ASAP_LBT_DELAY +
+              TX_START_DELAY + asap_penalty_us;
+    if( lead_us < TX_ASAP_MIN_DELAY )
+    {
+        lead_us = TX_ASAP_MIN_DELAY;
+    }
+    if( lead_us > TX_ASAP_MAX_DELAY )
+    {
+        lead_us = TX_ASAP_MAX_DELAY;
+    }
+    asap_lead_us = lead_us;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -142,30 +200,165 @@ bool jit_collision_test( uint32_t p1_count_us, uint32_t p1_pre_delay, uint32_t p
     }
 }
 
-enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struct lgw_pkt_tx_s* packet,
-                              enum jit_pkt_type_e pkt_type )
+/* Must be called with mx_jit_queue locked */
+static enum jit_priority_e jit_get_priority( const struct lgw_pkt_tx_s* packet, enum jit_pkt_type_e pkt_type )
+{
+    switch( pkt_type )
+    {
+    case JIT_PKT_TYPE_BEACON:
+        return JIT_PRIORITY_BEACON;
+    case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
+        /* A lost join-accept costs a whole join procedure to the device */
+        if( ( packet->size > 0 ) && ( lorawan_get_mtype( packet->payload ) == LORAWAN_MTYPE_JOIN_ACCEPT ) )
+        {
+            return JIT_PRIORITY_JOIN_ACCEPT;
+        }
+        return JIT_PRIORITY_CLASS_A;
+    case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
+        return JIT_PRIORITY_CLASS_B;
+    default:
+        return JIT_PRIORITY_CLASS_C;
+    }
+}
+
+/* Must be called with mx_jit_queue locked */
+static bool jit_overflow_push( struct jit_queue_s* queue, uint32_t time_us, const struct lgw_pkt_tx_s* packet,
+                               uint16_t token )
 {
-    int              i                 = 0;
-    uint32_t         packet_post_delay = 0;
-    uint32_t         packet_pre_delay  = 0;
-    uint32_t         target_pre_delay  = 0;
-    enum jit_error_e err_collision;
-    uint32_t         asap_count_us;
+    if( queue->num_overflow >= JIT_OVERFLOW_MAX )
+    {
+        return false;
+    }
 
-    MSG_DEBUG( DEBUG_JIT, "Current concentrator time is %lu, pkt_type=%d\n", time_us, pkt_type );
+    memcpy( &( queue->overflow[queue->num_overflow].pkt ), packet, sizeof( struct lgw_pkt_tx_s ) );
+    queue->overflow[queue->num_overflow].deferred_us = time_us;
+    queue->overflow[queue->num_overflow].token       = token;
+    queue->num_overflow++;
+    queue->nb_overflow_deferred++;
 
-    if( packet == NULL )
+    return true;
+}
+
+/* Must be called with mx_jit_queue locked */
+static bool jit_can_preempt( struct jit_queue_s* queue, uint32_t time_us, enum jit_pkt_type_e pkt_type,
+                             enum jit_priority_e priority, int index )
+{
+    if( JIT_PREEMPTION == false )
     {
-        MSG_DEBUG( DEBUG_JIT_ERROR, "ERROR: invalid parameter\n" );
-        return JIT_ERROR_INVALID;
+        return false;
+    }
+
+    /* Only a packet bound to its timestamp (RX1/RX2, ping slot) needs the slot of another one */
+    if( ( pkt_type != JIT_PKT_TYPE_DOWNLINK_CLASS_A ) && ( pkt_type != JIT_PKT_TYPE_DOWNLINK_CLASS_B ) )
+    {
+        return false;
     }
 
-    if( jit_queue_is_full( queue ) )
+    /* Beacons have the highest priority, they are never evicted */
+    if( queue->nodes[index].priority >= priority )
+    {
+        return false;
+    }
+
+    /* Do not evict a packet which may be on its way to lgw_send(), due and past-due packets included
+     *  Warning: signed difference (handle roll-over)
+     *      t_packet < t_current + TX_PREEMPT_GUARD
+     */
+    if( ( int32_t ) ( queue->nodes[index].pkt.count_us - time_us ) < ( int32_t ) TX_PREEMPT_GUARD )
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/* Must be called with mx_jit_queue locked */
+static void jit_dropped_push( struct jit_queue_s* queue, const struct lgw_pkt_tx_s* packet,
+                              enum jit_priority_e priority, uint16_t token, enum jit_error_e error )
+{
+    struct jit_dropped_s* dropped;
+
+    /* the packet has been accepted, keep it to be reported (the oldest are kept if too many) */
+    if( queue->num_dropped >= JIT_DROPPED_MAX )
+    {
+        return;
+    }
+
+    dropped            = &( queue->dropped[queue->num_dropped] );
+    dropped->count_us  = packet->count_us;
+    dropped->freq_hz   = packet->freq_hz;
+    dropped->size      = packet->size;
+    dropped->datarate  = packet->datarate;
+    dropped->bandwidth = packet->bandwidth;
+    dropped->priority  = priority;
+    dropped->token     = token;
+    dropped->error     = error;
+    queue->num_dropped++;
+}
+
+/* Must be called with mx_jit_queue locked, the queue is not sorted afterwards */
+static void jit_preempt( struct jit_queue_s* queue, uint32_t time_us, int index )
+{
+    struct jit_node_s* node     = &( queue->nodes[index] );
+    bool               deferred = false;
+
+    queue->nb_preempted[node->priority]++;
+
+    /* A Class C packet gets back to the overflow queue, to be placed ASAP once again */
+    if( node->pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C )
+    {
+        node->pkt.tx_mode = IMMEDIATE;
+        deferred          = jit_overflow_push( queue, time_us, &( node->pkt ), node->token );
+    }
+
+    if( deferred == true )
+    {
+        queue->nb_preempt_deferred++;
+        MSG_DEBUG( DEBUG_JIT, "packet preempted at count_us=%lu (prio=%d), deferred\n", node->pkt.count_us,
+                   node->priority );
+    }
+    else
+    {
+        ESP_LOGW( TAG_JITQ, "WARNING: --- Packet preempted and dropped (packet_time=%lu, prio=%d) ---\n",
+                  node->pkt.count_us, node->priority );
+        /* the airtime reserved at enqueue will never be used */
+        airtime_release( node->pkt.freq_hz, lgw_time_on_air( &( node->pkt ) ) );
+        jit_dropped_push( queue, &( node->pkt ), node->priority, node->token, JIT_ERROR_COLLISION_PACKET );
+    }
+
+    /* Replace evicted packet with last packet of the queue */
+    queue->num_pkt--;
+    memcpy( node, &( queue->nodes[queue->num_pkt] ), sizeof( struct jit_node_s ) );
+    memset( &( queue->nodes[queue->num_pkt] ), 0, sizeof( struct jit_node_s ) );
+}
+
+static enum jit_error_e jit_enqueue_locked( struct jit_queue_s* queue, uint32_t time_us, struct lgw_pkt_tx_s* packet,
+                                            enum jit_pkt_type_e pkt_type, uint16_t token )
+{
+    int                 i                 = 0;
+    uint32_t            packet_post_delay = 0;
+    uint32_t            packet_pre_delay  = 0;
+    uint32_t            target_pre_delay  = 0;
+    enum jit_error_e    err_collision;
+    uint32_t            asap_count_us;
+    uint32_t            asap_floor_us;
+    enum jit_priority_e priority;
+    int                 nb_victim = 0;
+    int                 victim;
+
+    MSG_DEBUG( DEBUG_JIT, "Current concentrator time is %lu, pkt_type=%d\n", time_us, pkt_type );
+
+    /* Only a Class A/B packet can take the slot of another one when the queue is full */
+    if( ( queue->num_pkt == JIT_QUEUE_MAX ) &&
+        ( ( JIT_PREEMPTION == false ) ||
+          ( ( pkt_type != JIT_PKT_TYPE_DOWNLINK_CLASS_A ) && ( pkt_type != JIT_PKT_TYPE_DOWNLINK_CLASS_B ) ) ) )
     {
         MSG_DEBUG( DEBUG_JIT_ERROR, "ERROR: cannot enqueue packet, JIT queue is full\n" );
         return JIT_ERROR_FULL;
     }
 
+    priority = jit_get_priority( packet, pkt_type );
+
     /* Compute packet pre/post delays depending on packet's type */
     switch( pkt_type )
     {
@@ -173,7 +366,7 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
     case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
     case JIT_PKT_TYPE_DOWNLINK_CLASS_C:
         packet_pre_delay  = TX_START_DELAY + TX_JIT_DELAY;
-        packet_post_delay = lgw_time_on_air( packet ) * 1000UL; /* in us */
+        packet_post_delay = lgw_time_on_air_us( packet );
         break;
     case JIT_PKT_TYPE_BEACON:
         /* As defined in LoRaWAN spec */
@@ -184,8 +377,6 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
         break;
     }
 
-    pthread_mutex_lock( &mx_jit_queue );
-
     /* An immediate downlink becomes a timestamped downlink "ASAP" */
     /* Set the packet count_us to the first available slot */
     if( pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C )
@@ -194,7 +385,8 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
         packet->tx_mode = TIMESTAMPED;
 
         /* Search for the ASAP timestamp to be given to the packet */
-        asap_count_us = time_us + 1E6; /* take 1 second margin */
+        asap_floor_us = time_us + asap_lead_us; /* earliest time the JIT thread can program the radio */
+        asap_count_us = asap_floor_us;
         if( queue->num_pkt == 0 )
         {
             /* If the jit queue is empty, we can insert this packet */
@@ -235,6 +427,11 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
                 {
                     asap_count_us = queue->nodes[i].pkt.count_us + queue->nodes[i].post_delay + packet_pre_delay +
                                     TX_JIT_DELAY + TX_MARGIN_DELAY;
+                    if( ( int32_t ) ( asap_count_us - asap_floor_us ) < 0 )
+                    {
+                        /* Gap ends before the earliest possible time, it will collide with a later packet anyway */
+                        continue;
+                    }
                     if( i == ( queue->num_pkt - 1 ) )
                     {
                         /* Last packet index, we can insert after this one */
@@ -283,7 +480,6 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
         MSG_DEBUG( DEBUG_JIT_ERROR,
                    "ERROR: Packet REJECTED, already too late to send it (current=%lu, packet=%lu, type=%d)\n", time_us,
                    packet->count_us, pkt_type );
-        pthread_mutex_unlock( &mx_jit_queue );
         return JIT_ERROR_TOO_LATE;
     }
 
@@ -306,7 +502,6 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
                        "ERROR: Packet REJECTED, timestamp seems wrong, too much in advance (current=%lu, packet=%lu, "
                        "type=%d)\n",
                        time_us, packet->count_us, pkt_type );
-            pthread_mutex_unlock( &mx_jit_queue );
             return JIT_ERROR_TOO_EARLY;
         }
     }
@@ -315,6 +510,7 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
      *  Note: - need to take into account packet's pre_delay and post_delay of each packet
      *        - Valid for both Downlinks and beacon packets
      *        - Beacon guard can be ignored if we try to queue a Class A downlink
+     *        - Packets of lower priority can be evicted if no other packet collides
      */
     for( i = 0; i < queue->num_pkt; i++ )
     {
@@ -337,6 +533,12 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
         if( jit_collision_test( packet->count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].pkt.count_us,
                                 target_pre_delay, queue->nodes[i].post_delay ) == true )
         {
+            if( jit_can_preempt( queue, time_us, pkt_type, priority, i ) == true )
+            {
+                nb_victim++;
+                continue;
+            }
+
             switch( queue->nodes[i].pkt_type )
             {
             case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
@@ -364,17 +566,57 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
                 assert( 0 );
                 break;
             }
-            pthread_mutex_unlock( &mx_jit_queue );
             return err_collision;
         }
     }
 
+    /* A full queue gives the slot of its lowest priority packet, the furthest in time first */
+    if( ( nb_victim == 0 ) && ( queue->num_pkt == JIT_QUEUE_MAX ) )
+    {
+        victim = -1;
+        for( i = 0; i < queue->num_pkt; i++ )
+        {
+            if( jit_can_preempt( queue, time_us, pkt_type, priority, i ) == false )
+            {
+                continue;
+            }
+            if( ( victim == -1 ) || ( queue->nodes[i].priority < queue->nodes[victim].priority ) ||
+                ( ( queue->nodes[i].priority == queue->nodes[victim].priority ) &&
+                  ( ( queue->nodes[i].pkt.count_us - time_us ) > ( queue->nodes[victim].pkt.count_us - time_us ) ) ) )
+            {
+                victim = i;
+            }
+        }
+        if( victim == -1 )
+        {
+            MSG_DEBUG( DEBUG_JIT_ERROR, "ERROR: cannot enqueue packet, JIT queue is full\n" );
+            return JIT_ERROR_FULL;
+        }
+        MSG_DEBUG( DEBUG_JIT, "JIT queue is full, evicting packet at count_us=%lu (prio=%d)\n",
+                   queue->nodes[victim].pkt.count_us, queue->nodes[victim].priority );
+        jit_preempt( queue, time_us, victim );
+    }
+
+    /* Evict the packets of lower priority, from the end as an evicted packet is replaced by the last one */
+    for( i = queue->num_pkt - 1; ( nb_victim > 0 ) && ( i >= 0 ); i-- )
+    {
+        if( ( jit_collision_test( packet->count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].pkt.count_us,
+                                  queue->nodes[i].pre_delay, queue->nodes[i].post_delay ) == true ) &&
+            ( jit_can_preempt( queue, time_us, pkt_type, priority, i ) == true ) )
+        {
+            jit_preempt( queue, time_us, i );
+            nb_victim--;
+        }
+    }
+
     /* Finally enqueue it */
     /* Insert packet at the end of the queue */
     memcpy( &( queue->nodes[queue->num_pkt].pkt ), packet, sizeof( struct lgw_pkt_tx_s ) );
     queue->nodes[queue->num_pkt].pre_delay  = packet_pre_delay;
     queue->nodes[queue->num_pkt].post_delay = packet_post_delay;
     queue->nodes[queue->num_pkt].pkt_type   = pkt_type;
+    queue->nodes[queue->num_pkt].token      = token;
+    queue->nodes[queue->num_pkt].priority   = priority;
     if( pkt_type == JIT_PKT_TYPE_BEACON )
     {
         queue->num_beacon++;
@@ -383,20 +625,118 @@ enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struc
     /* Sort the queue in ascending order of packet timestamp */
     jit_sort_queue( queue );
 
-    /* Done */
-    pthread_mutex_unlock( &mx_jit_queue );
-
-    jit_print_queue( queue, false, DEBUG_JIT );
-
     MSG_DEBUG( DEBUG_JIT, "enqueued packet with count_us=%lu (size=%u bytes, toa=%lu us, type=%u)\n", packet->count_us,
                packet->size, packet_post_delay, pkt_type );
 
     return JIT_ERROR_OK;
 }
 
+/* Must be called with mx_jit_queue locked */
+static void jit_overflow_remove( struct jit_queue_s* queue, int index )
+{
+    queue->num_overflow--;
+    memmove( &( queue->overflow[index] ), &( queue->overflow[index + 1] ),
+             ( queue->num_overflow - index ) * sizeof( struct jit_overflow_node_s ) );
+    memset( &( queue->overflow[queue->num_overflow] ), 0, sizeof( struct jit_overflow_node_s ) );
+}
+
+/* Must be called with mx_jit_queue locked */
+static void jit_overflow_expire( struct jit_queue_s* queue, uint32_t time_us )
+{
+    /* Packets are deferred in time order, the expired ones are at the head */
+    while( ( queue->num_overflow > 0 ) && ( ( time_us - queue->overflow[0].deferred_us ) > JIT_OVERFLOW_MAX_AGE ) )
+    {
+        ESP_LOGW( TAG_JITQ, "WARNING: --- Deferred Class C packet expired (deferred at %lu) ---\n",
+                  queue->overflow[0].deferred_us );
+        /* the airtime reserved at enqueue will never be used */
+        airtime_release( queue->overflow[0].pkt.freq_hz, lgw_time_on_air( &( queue->overflow[0].pkt ) ) );
+        /* it has been acknowledged OK when deferred, the server has to know it will never be sent */
+        jit_dropped_push( queue, &( queue->overflow[0].pkt ), JIT_PRIORITY_CLASS_C, queue->overflow[0].token,
+                          JIT_ERROR_TOO_LATE );
+        jit_overflow_remove( queue, 0 );
+        queue->nb_overflow_expired++;
+    }
+}
+
+/* Must be called with mx_jit_queue locked */
+static void jit_overflow_retry( struct jit_queue_s* queue, uint32_t time_us )
+{
+    struct lgw_pkt_tx_s pkt;
+    enum jit_error_e    err;
+
+    jit_overflow_expire( queue, time_us );
+
+    /* Oldest packets first, stop at the first one which still cannot be placed to keep the order */
+    while( queue->num_overflow > 0 )
+    {
+        memcpy( &pkt, &( queue->overflow[0].pkt ), sizeof( struct lgw_pkt_tx_s ) );
+        err = jit_enqueue_locked( queue, time_us, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_C, queue->overflow[0].token );
+        if( err != JIT_ERROR_OK )
+        {
+            break;
+        }
+        MSG_DEBUG( DEBUG_JIT, "deferred Class C packet placed at count_us=%lu\n", pkt.count_us );
+        jit_overflow_remove( queue, 0 );
+        queue->nb_overflow_sent++;
+    }
+}
+
+enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struct lgw_pkt_tx_s* packet,
+                              enum jit_pkt_type_e pkt_type, uint16_t token )
+{
+    struct lgw_pkt_tx_s pkt_immediate;
+    enum jit_error_e    err;
+
+    if( packet == NULL )
+    {
+        MSG_DEBUG( DEBUG_JIT_ERROR, "ERROR: invalid parameter\n" );
+        return JIT_ERROR_INVALID;
+    }
+
+    /* Keep the immediate version of a Class C packet, in case it has to be deferred */
+    if( pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C )
+    {
+        memcpy( &pkt_immediate, packet, sizeof( struct lgw_pkt_tx_s ) );
+    }
+
+    pthread_mutex_lock( &mx_jit_queue );
+
+    /* Deferred packets go first */
+    jit_overflow_retry( queue, time_us );
+    if( ( pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C ) && ( queue->num_overflow > 0 ) )
+    {
+        err = JIT_ERROR_FULL;
+    }
+    else
+    {
+        err = jit_enqueue_locked( queue, time_us, packet, pkt_type, token );
+    }
+
+    /* A Class C packet with no slot available waits in the overflow queue for one to be freed */
+    if( ( pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C ) &&
+        ( ( err == JIT_ERROR_FULL ) || ( err == JIT_ERROR_COLLISION_PACKET ) || ( err == JIT_ERROR_COLLISION_BEACON ) ) &&
+        ( jit_overflow_push( queue, time_us, &pkt_immediate, token ) == true ) )
+    {
+        MSG_DEBUG( DEBUG_JIT, "Class C packet deferred (jit error=%d), %u packet(s) waiting\n", err,
+                   queue->num_overflow );
+        err = JIT_ERROR_OK;
+    }
+
+    pthread_mutex_unlock( &mx_jit_queue );
+
+    if( err == JIT_ERROR_OK )
+    {
+        jit_print_queue( queue, false, DEBUG_JIT );
+    }
+
+    return err;
+}
+
 enum jit_error_e jit_dequeue( struct jit_queue_s* queue, int index, struct lgw_pkt_tx_s* packet,
                               enum jit_pkt_type_e* pkt_type )
 {
+    uint32_t time_us;
+
     if( packet == NULL )
     {
         ESP_LOGE( TAG_JITQ, "ERROR: invalid parameter\n" );
@@ -434,6 +774,13 @@ enum jit_error_e jit_dequeue( struct jit_queue_s* queue, int index, struct lgw_p
     /* Sort queue in ascending order of packet timestamp */
     jit_sort_queue( queue );
 
+    /* A slot has been freed, try to place deferred Class C packets */
+    if( queue->num_overflow > 0 )
+    {
+        lgw_get_instcnt( &time_us );
+        jit_overflow_retry( queue, time_us );
+    }
+
     /* Done */
     pthread_mutex_unlock( &mx_jit_queue );
 
@@ -455,12 +802,19 @@ enum jit_error_e jit_peek( struct jit_queue_s* queue, uint32_t time_us, int* pkt
         return JIT_ERROR_INVALID;
     }
 
-    if( jit_queue_is_empty( queue ) )
+    pthread_mutex_lock( &mx_jit_queue );
+
+    /* Deferred packets must not wait for an enqueue or dequeue to expire (and free their airtime) or to be placed */
+    if( queue->num_overflow > 0 )
     {
-        return JIT_ERROR_EMPTY;
+        jit_overflow_retry( queue, time_us );
     }
 
-    pthread_mutex_lock( &mx_jit_queue );
+    if( queue->num_pkt == 0 )
+    {
+        pthread_mutex_unlock( &mx_jit_queue );
+        return JIT_ERROR_EMPTY;
+    }
 
     /* Search for highest priority packet to be sent */
     for( i = 0; i < queue->num_pkt; i++ )
@@ -486,6 +840,8 @@ enum jit_error_e jit_peek( struct jit_queue_s* queue, uint32_t time_us, int* pkt
             {
                 ESP_LOGW( TAG_JITQ, "WARNING: --- Packet dropped (current_time=%lu, packet_time=%lu) ---\n", time_us,
                           queue->nodes[i].pkt.count_us );
+                /* the airtime reserved at enqueue will never be used */
+                airtime_release( queue->nodes[i].pkt.freq_hz, lgw_time_on_air( &( queue->nodes[i].pkt ) ) );
             }
 
             /* Replace dropped packet with last packet of the queue */
@@ -531,6 +887,120 @@ enum jit_error_e jit_peek( struct jit_queue_s* queue, uint32_t time_us, int* pkt
     return JIT_ERROR_OK;
 }
 
+void jit_asap_update( uint32_t dispatch_us, int32_t slack_us )
+{
+    uint32_t err_us;
+
+    pthread_mutex_lock( &mx_jit_queue );
+
+    /* Smoothed mean and mean deviation, as done for TCP round trip time estimation (gains 1/8 and 1/4) */
+    if( asap_nb_sample == 0 )
+    {
+        asap_dispatch_us     = dispatch_us;
+        asap_dispatch_dev_us = dispatch_us / 2;
+    }
+    else
+    {
+        err_us = ( dispatch_us > asap_dispatch_us ) ? ( dispatch_us - asap_dispatch_us )
+                                                    : ( asap_dispatch_us - dispatch_us );
+        asap_dispatch_dev_us = asap_dispatch_dev_us - ( asap_dispatch_dev_us / 4 ) + ( err_us / 4 );
+        asap_dispatch_us     = asap_dispatch_us - ( asap_dispatch_us / 8 ) + ( dispatch_us / 8 );
+    }
+    asap_nb_sample += 1;
+
+    /* A downlink programmed late widens the margin, which then slowly decays on successful dispatches */
+    if( slack_us < TX_START_DELAY )
+    {
+        asap_nb_late += 1;
+        asap_penalty_us += TX_ASAP_LATE_PENALTY;
+    }
+    else if( asap_penalty_us > 0 )
+    {
+        asap_penalty_us -= ( asap_penalty_us > 100 ) ? 100 : asap_penalty_us;
+    }
+
+    jit_asap_compute_lead( );
+
+    pthread_mutex_unlock( &mx_jit_queue );
+}
+
+void jit_overflow_get_stats( struct jit_queue_s* queue, struct jit_overflow_stats_s* stats )
+{
+    if( ( queue == NULL ) || ( stats == NULL ) )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &mx_jit_queue );
+    stats->num_waiting = queue->num_overflow;
+    stats->nb_deferred = queue->nb_overflow_deferred;
+    stats->nb_sent     = queue->nb_overflow_sent;
+    stats->nb_expired  = queue->nb_overflow_expired;
+    pthread_mutex_unlock( &mx_jit_queue );
+}
+
+void jit_preempt_get_stats( struct jit_queue_s* queue, struct jit_preempt_stats_s* stats )
+{
+    int i;
+
+    if( ( queue == NULL ) || ( stats == NULL ) )
+    {
+        return;
+    }
+
+    stats->nb_preempted = 0;
+
+    pthread_mutex_lock( &mx_jit_queue );
+    for( i = 0; i < JIT_PRIORITY_BEACON; i++ )
+    {
+        stats->nb_by_prio[i] = queue->nb_preempted[i];
+        stats->nb_preempted += queue->nb_preempted[i];
+    }
+    stats->nb_deferred = queue->nb_preempt_deferred;
+    pthread_mutex_unlock( &mx_jit_queue );
+
+    stats->nb_dropped = stats->nb_preempted - stats->nb_deferred;
+}
+
+bool jit_get_dropped( struct jit_queue_s* queue, struct jit_dropped_s* dropped )
+{
+    bool found = false;
+
+    if( ( queue == NULL ) || ( dropped == NULL ) )
+    {
+        return false;
+    }
+
+    pthread_mutex_lock( &mx_jit_queue );
+    if( queue->num_dropped > 0 )
+    {
+        memcpy( dropped, &( queue->dropped[0] ), sizeof( struct jit_dropped_s ) );
+        queue->num_dropped--;
+        memmove( &( queue->dropped[0] ), &( queue->dropped[1] ),
+                 queue->num_dropped * sizeof( struct jit_dropped_s ) );
+        found = true;
+    }
+    pthread_mutex_unlock( &mx_jit_queue );
+
+    return found;
+}
+
+void jit_asap_get_stats( struct jit_asap_stats_s* stats )
+{
+    if( stats == NULL )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &mx_jit_queue );
+    stats->lead_us         = asap_lead_us;
+    stats->dispatch_us     = asap_dispatch_us;
+    stats->dispatch_dev_us = asap_dispatch_dev_us;
+    stats->nb_sample       = asap_nb_sample;
+    stats->nb_late         = asap_nb_late;
+    pthread_mutex_unlock( &mx_jit_queue );
+}
+
 void jit_print_queue( struct jit_queue_s* queue, bool show_all, int debug_level )
 {
     int i = 0;
@@ -549,8 +1019,8 @@ void jit_print_queue( struct jit_queue_s* queue, bool show_all, int debug_level
         loop_end = ( show_all == true ) ? JIT_QUEUE_MAX : queue->num_pkt;
         for( i = 0; i < loop_end; i++ )
         {
-            MSG_DEBUG( debug_level, " - node[%d]: count_us=%lu - type=%d\n", i, queue->nodes[i].pkt.count_us,
-                       queue->nodes[i].pkt_type );
+            MSG_DEBUG( debug_level, " - node[%d]: count_us=%lu - type=%d - prio=%d\n", i,
+                       queue->nodes[i].pkt.count_us, queue->nodes[i].pkt_type, queue->nodes[i].priority );
         }
 
         pthread_mutex_unlock( &mx_jit_queue );
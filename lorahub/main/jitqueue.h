@@ -29,6 +29,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define JIT_QUEUE_MAX 32          /* Maximum number of packets to be stored in JiT queue */
 #define JIT_NUM_BEACON_IN_QUEUE 3 /* Number of beacons to be loaded in JiT queue at any time */
+#define JIT_OVERFLOW_MAX 16       /* Maximum number of Class C packets waiting for a slot */
+#define JIT_DROPPED_MAX 16        /* Maximum number of dropped accepted packets waiting to be reported */
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
@@ -41,6 +43,15 @@ enum jit_pkt_type_e
     JIT_PKT_TYPE_BEACON
 };
 
+enum jit_priority_e
+{
+    JIT_PRIORITY_CLASS_C,     /* Class C downlink, can be deferred */
+    JIT_PRIORITY_CLASS_B,     /* Class B downlink (ping slot) */
+    JIT_PRIORITY_CLASS_A,     /* Class A downlink (RX1/RX2) */
+    JIT_PRIORITY_JOIN_ACCEPT, /* Class A join-accept (MHDR MType 001) */
+    JIT_PRIORITY_BEACON       /* Beacon, never preempted */
+};
+
 enum jit_error_e
 {
     JIT_ERROR_OK,               /* Packet ok to be sent */
@@ -53,7 +64,9 @@ enum jit_error_e
     JIT_ERROR_TX_FREQ,          /* The required frequency for downlink is not supported */
     JIT_ERROR_TX_POWER,         /* The required power for downlink is not supported */
     JIT_ERROR_GPS_UNLOCKED,     /* GPS timestamp could not be used as GPS is unlocked */
-    JIT_ERROR_INVALID           /* Packet is invalid */
+    JIT_ERROR_INVALID,          /* Packet is invalid */
+    JIT_ERROR_RX2_FALLBACK,     /* Class A packet moved to RX2 as it could not be sent in RX1 (warning) */
+    JIT_ERROR_DUTY_CYCLE        /* The packet would exceed the duty-cycle budget of its sub-band */
 };
 
 struct jit_node_s
@@ -61,10 +74,56 @@ struct jit_node_s
     /* API fields */
     struct lgw_pkt_tx_s pkt;      /* TX packet */
     enum jit_pkt_type_e pkt_type; /* Packet type: Downlink, Beacon... */
+    uint16_t            token;    /* Token of the request, to report the packet if it is dropped */
 
     /* Internal fields */
-    uint32_t pre_delay;  /* Amount of time before packet timestamp to be reserved */
-    uint32_t post_delay; /* Amount of time after packet timestamp to be reserved (time on air) */
+    enum jit_priority_e priority;   /* Packets of lower priority can be preempted by this one */
+    uint32_t            pre_delay;  /* Amount of time before packet timestamp to be reserved */
+    uint32_t            post_delay; /* Amount of time after packet timestamp to be reserved (time on air) */
+};
+
+struct jit_overflow_node_s
+{
+    struct lgw_pkt_tx_s pkt;         /* TX packet, as received (immediate) */
+    uint32_t            deferred_us; /* Concentrator time when the packet has been deferred */
+    uint16_t            token;       /* Token of the request, to report the packet if it is dropped */
+};
+
+struct jit_dropped_s
+{
+    uint32_t            count_us;  /* Timestamp of the dropped packet */
+    uint32_t            freq_hz;   /* TX frequency */
+    uint16_t            size;      /* Payload size, in bytes */
+    uint8_t             datarate;  /* LoRa spreading factor */
+    uint8_t             bandwidth; /* Modulation bandwidth */
+    enum jit_priority_e priority;  /* Priority class of the dropped packet */
+    uint16_t            token;     /* Token of the request, as given to jit_enqueue() */
+    enum jit_error_e    error;     /* Reason of the drop, to be reported in a TX_ACK */
+};
+
+struct jit_overflow_stats_s
+{
+    uint8_t  num_waiting; /* Number of Class C packets currently waiting for a slot */
+    uint32_t nb_deferred; /* Number of Class C packets deferred since start */
+    uint32_t nb_sent;     /* Number of deferred packets placed in the JiT queue */
+    uint32_t nb_expired;  /* Number of deferred packets dropped as they waited for too long */
+};
+
+struct jit_preempt_stats_s
+{
+    uint32_t nb_preempted;                    /* Number of packets evicted from their slot by a higher priority one */
+    uint32_t nb_deferred;                     /* Number of evicted Class C packets moved to the overflow queue */
+    uint32_t nb_dropped;                      /* Number of evicted packets which could not be deferred */
+    uint32_t nb_by_prio[JIT_PRIORITY_BEACON]; /* Number of evicted packets, per priority class */
+};
+
+struct jit_asap_stats_s
+{
+    uint32_t lead_us;         /* Current lead time given to immediate downlinks */
+    uint32_t dispatch_us;     /* Smoothed time from dequeue to radio configured for TX */
+    uint32_t dispatch_dev_us; /* Smoothed mean deviation of the dispatch time */
+    uint32_t nb_sample;       /* Number of dispatches measured */
+    uint32_t nb_late;         /* Number of downlinks programmed less than TX_START_DELAY before their timestamp */
 };
 
 struct jit_queue_s
@@ -72,6 +131,21 @@ struct jit_queue_s
     uint8_t           num_pkt;              /* Total number of packets in the queue (downlinks, beacons...) */
     uint8_t           num_beacon;           /* Number of beacons in the queue */
     struct jit_node_s nodes[JIT_QUEUE_MAX]; /* Nodes/packets array in the queue */
+
+    /* Class C packets waiting for a slot, oldest first */
+    uint8_t                    num_overflow;
+    struct jit_overflow_node_s overflow[JIT_OVERFLOW_MAX];
+    uint32_t                   nb_overflow_deferred;
+    uint32_t                   nb_overflow_sent;
+    uint32_t                   nb_overflow_expired;
+
+    /* Packets evicted by a higher priority packet */
+    uint32_t nb_preempted[JIT_PRIORITY_BEACON];
+    uint32_t nb_preempt_deferred;
+
+    /* Evicted packets dropped after having been accepted, oldest first, to be reported */
+    uint8_t              num_dropped;
+    struct jit_dropped_s dropped[JIT_DROPPED_MAX];
 };
 
 /* -------------------------------------------------------------------------- */
@@ -109,14 +183,21 @@ void jit_queue_init( struct jit_queue_s* queue );
 @param time_us[in] Current concentrator time
 @param packet[in] Packet to be queued in JiT queue
 @param pkt_type[in] Type of packet to be queued: Downlink, Beacon
+@param token[in] Token of the request, given back by jit_get_dropped() if the packet is dropped once accepted
 @return success if the function was able to queue the packet
 
 This function is typically used when a packet is received from server for downlink.
 It will check if packet can be queued, with several criterias. Once the packet is queued, it has to be
 sent over the air. So all checks should happen before the packet being actually in the queue.
+A Class C packet which cannot be placed is kept in an overflow queue, and placed as soon as a slot is freed
+(checked by jit_dequeue() and each jit_peek()), unless it waited for too long: it is then dropped, its airtime
+released, counted as expired and kept to be reported by jit_get_dropped(). It is reported as queued successfully.
+A Class A/B packet colliding only with packets of lower priority takes their slot: evicted Class C packets are
+deferred to the overflow queue, other ones are dropped and kept to be reported by jit_get_dropped().
+If the queue is full, a Class A/B packet takes the slot of the lowest priority packet which can be evicted.
 */
 enum jit_error_e jit_enqueue( struct jit_queue_s* queue, uint32_t time_us, struct lgw_pkt_tx_s* packet,
-                              enum jit_pkt_type_e pkt_type );
+                              enum jit_pkt_type_e pkt_type, uint16_t token );
 
 /**
 @brief Dequeue a packet from a Just-in-Time queue
@@ -147,6 +228,54 @@ enough the current concentrator time.
 */
 enum jit_error_e jit_peek( struct jit_queue_s* queue, uint32_t time_us, int* pkt_idx );
 
+/**
+@brief Get the statistics of the Class C overflow queue
+
+@param queue[in] Just in Time queue
+@param stats[out] Number of packets waiting, deferred, placed and expired
+*/
+void jit_overflow_get_stats( struct jit_queue_s* queue, struct jit_overflow_stats_s* stats );
+
+/**
+@brief Get the statistics of the preemption of lower priority packets
+
+@param queue[in] Just in Time queue
+@param stats[out] Number of packets evicted, deferred and dropped
+*/
+void jit_preempt_get_stats( struct jit_queue_s* queue, struct jit_preempt_stats_s* stats );
+
+/**
+@brief Get the oldest packet dropped after having been accepted, not reported yet
+
+@param queue[in] Just in Time queue
+@param dropped[out] Description of the dropped packet, with the token of its request
+@return true if a dropped packet has been returned, false if there is none to report
+
+A dropped packet had been accepted by jit_enqueue(), it has to be reported to the server as a TX failure:
+JIT_ERROR_COLLISION_PACKET when it has been preempted by a higher priority packet, JIT_ERROR_TOO_LATE for a Class C
+packet which waited too long in the overflow queue.
+*/
+bool jit_get_dropped( struct jit_queue_s* queue, struct jit_dropped_s* dropped );
+
+/**
+@brief Feed the immediate downlinks scheduler with the timing of a dispatched packet
+
+@param dispatch_us[in] Time from jit_peek() to the radio being configured for TX, in microseconds,
+Listen-Before-Talk excluded
+@param slack_us[in] Time left before the packet timestamp once the radio was configured (negative if late)
+
+Immediate (Class C) downlinks are scheduled at the earliest collision-free time, with a lead time learned from
+these measurements instead of a fixed 1 second margin.
+*/
+void jit_asap_update( uint32_t dispatch_us, int32_t slack_us );
+
+/**
+@brief Get the statistics of the immediate downlinks scheduler
+
+@param stats[out] Current lead time and dispatch measurements
+*/
+void jit_asap_get_stats( struct jit_asap_stats_s* stats );
+
 /**
 @brief Debug function to print the queue's content on console
 
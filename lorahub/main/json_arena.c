@@ -0,0 +1,166 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Bump allocator arenas for the parson JSON library, one per parsing context
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <stdlib.h>  /* malloc, free */
+
+#include "sdkconfig.h"
+
+#include "json_arena.h"
+#include "parson.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define JSON_ARENA_ALIGN 8 /* alignment of the blocks, enough for double */
+
+#ifdef CONFIG_JSON_ARENA_SIZE
+#define JSON_ARENA_SIZE ( ( CONFIG_JSON_ARENA_SIZE + JSON_ARENA_ALIGN - 1 ) & ~( JSON_ARENA_ALIGN - 1 ) )
+#else
+#define JSON_ARENA_SIZE 4096
+#endif
+
+typedef struct
+{
+    uint8_t* mem;
+    uint32_t used;        /* bytes allocated since the last reset */
+    uint32_t nb_live;     /* blocks allocated and not freed yet */
+    uint32_t high_water;  /* highest value of used */
+    uint32_t nb_reset;    /* number of times the arena has been emptied */
+    uint32_t nb_fallback; /* allocations sent to the heap because the arena was full */
+} json_arena_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint8_t arena_mem[JSON_ARENA_NB][JSON_ARENA_SIZE] __attribute__( ( aligned( JSON_ARENA_ALIGN ) ) );
+
+static json_arena_t arenas[JSON_ARENA_NB] = {
+    { .mem = arena_mem[JSON_ARENA_DOWNLINK] },
+    { .mem = arena_mem[JSON_ARENA_HTTP] },
+};
+
+static const char* arena_names[JSON_ARENA_NB] = { "downlink", "http" };
+
+/* Arena bound to the running task, each arena is only written by the task it is attached to */
+static __thread json_arena_t* current_arena = NULL;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void* arena_malloc( size_t size )
+{
+    json_arena_t* arena = current_arena;
+    uint32_t      aligned_size;
+    void*         ptr;
+
+    if( arena == NULL )
+    {
+        return malloc( size );
+    }
+
+    aligned_size = ( size + JSON_ARENA_ALIGN - 1 ) & ~( JSON_ARENA_ALIGN - 1 );
+    if( ( size > JSON_ARENA_SIZE ) || ( aligned_size > ( JSON_ARENA_SIZE - arena->used ) ) )
+    {
+        arena->nb_fallback += 1;
+        return malloc( size );
+    }
+
+    ptr = arena->mem + arena->used;
+    arena->used += aligned_size;
+    arena->nb_live += 1;
+    if( arena->used > arena->high_water )
+    {
+        arena->high_water = arena->used;
+    }
+
+    return ptr;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void arena_free( void* ptr )
+{
+    json_arena_t* arena;
+    int           i;
+
+    if( ptr == NULL )
+    {
+        return;
+    }
+
+    /* The block may have been allocated before the arena was detached, look for its owner */
+    for( i = 0; i < JSON_ARENA_NB; i++ )
+    {
+        arena = &arenas[i];
+        if( ( ( uint8_t* ) ptr >= arena->mem ) && ( ( uint8_t* ) ptr < ( arena->mem + JSON_ARENA_SIZE ) ) )
+        {
+            /* Individual blocks are not reclaimed, the whole arena is emptied with its last block */
+            arena->nb_live -= 1;
+            if( arena->nb_live == 0 )
+            {
+                arena->used = 0;
+                arena->nb_reset += 1;
+            }
+            return;
+        }
+    }
+
+    free( ptr );
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void json_arena_init( void )
+{
+    json_set_allocation_functions( arena_malloc, arena_free );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void json_arena_attach( json_arena_id_t id )
+{
+    current_arena = ( id < JSON_ARENA_NB ) ? &arenas[id] : NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void json_arena_detach( void )
+{
+    current_arena = NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void json_arena_get_stats( json_arena_id_t id, json_arena_stats_t* stats )
+{
+    if( ( stats == NULL ) || ( id >= JSON_ARENA_NB ) )
+    {
+        return;
+    }
+
+    /* Counters are only incremented by the owner task, a 32-bit read is atomic */
+    stats->name        = arena_names[id];
+    stats->size        = JSON_ARENA_SIZE;
+    stats->high_water  = arenas[id].high_water;
+    stats->nb_reset    = arenas[id].nb_reset;
+    stats->nb_fallback = arenas[id].nb_fallback;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
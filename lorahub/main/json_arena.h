@@ -0,0 +1,77 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Bump allocator arenas for the parson JSON library, one per parsing context
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_JSON_ARENA_H
+#define _LORAHUB_JSON_ARENA_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h> /* C99 types */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef enum
+{
+    JSON_ARENA_DOWNLINK, /* PULL_RESP datagrams, parsed by thread_down */
+    JSON_ARENA_HTTP,     /* REST requests, parsed by the HTTP server task */
+    JSON_ARENA_NB
+} json_arena_id_t;
+
+/**
+@struct json_arena_stats_s
+@brief Usage of a JSON arena since boot
+*/
+typedef struct json_arena_stats_s
+{
+    const char* name;
+    uint32_t    size;        /* size of the arena, in bytes */
+    uint32_t    high_water;  /* highest number of bytes used by a single JSON document */
+    uint32_t    nb_reset;    /* number of JSON documents parsed then freed */
+    uint32_t    nb_fallback; /* number of allocations which did not fit and went to the heap */
+} json_arena_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Install the arena allocator in parson, must be called once before any other parson function
+*/
+void json_arena_init( void );
+
+/**
+@brief Bind an arena to the calling task, subsequent parson allocations of this task are taken from it
+@param id arena to be used, it must not be attached to another task at the same time
+
+The arena is reset when all the memory taken from it has been freed, i.e. when the root JSON value is freed.
+Allocations which do not fit fall back to the heap.
+*/
+void json_arena_attach( json_arena_id_t id );
+
+/**
+@brief Unbind the arena from the calling task, JSON values already parsed can still be used and freed
+*/
+void json_arena_detach( void );
+
+/**
+@brief Get the usage of an arena
+@param id arena
+@param stats[out] usage of the arena
+*/
+void json_arena_get_stats( json_arena_id_t id, json_arena_stats_t* stats );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,74 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Decoding of the few LoRaWAN frame fields used by the hub (MHDR, DevAddr, FCnt, JoinEUI)
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+#include "lorawan.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+uint8_t lorawan_get_mtype( const uint8_t* payload )
+{
+    return payload[0] >> 5;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool lorawan_is_data_up( const uint8_t* payload, uint16_t size )
+{
+    if( size < LORAWAN_DATA_UP_SIZE_MIN )
+    {
+        return false;
+    }
+
+    return ( lorawan_get_mtype( payload ) == LORAWAN_MTYPE_UNCONF_DATA_UP ) ||
+           ( lorawan_get_mtype( payload ) == LORAWAN_MTYPE_CONF_DATA_UP );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lorawan_get_devaddr( const uint8_t* payload )
+{
+    return ( uint32_t ) payload[1] | ( ( uint32_t ) payload[2] << 8 ) | ( ( uint32_t ) payload[3] << 16 ) |
+           ( ( uint32_t ) payload[4] << 24 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint16_t lorawan_get_fcnt( const uint8_t* payload )
+{
+    return ( uint16_t ) ( payload[6] | ( payload[7] << 8 ) );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t lorawan_get_joineui( const uint8_t* payload )
+{
+    uint64_t joineui = 0;
+    int      i;
+
+    for( i = 8; i > 0; i-- )
+    {
+        joineui = ( joineui << 8 ) | payload[i];
+    }
+
+    return joineui;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,78 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Decoding of the few LoRaWAN frame fields used by the hub (MHDR, DevAddr, FCnt, JoinEUI)
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_LORAWAN_H
+#define _LORAHUB_LORAWAN_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+/* MType field of the MHDR (3 MSBs of the first byte) */
+#define LORAWAN_MTYPE_JOIN_REQUEST 0
+#define LORAWAN_MTYPE_JOIN_ACCEPT 1
+#define LORAWAN_MTYPE_UNCONF_DATA_UP 2
+#define LORAWAN_MTYPE_CONF_DATA_UP 4
+
+#define LORAWAN_JOIN_REQUEST_SIZE 23 /* MHDR, JoinEUI, DevEUI, DevNonce, MIC */
+#define LORAWAN_DATA_UP_SIZE_MIN 12  /* MHDR, FHDR without FOpts, MIC */
+#define LORAWAN_FCNT_END 8           /* MHDR, DevAddr, FCtrl, FCnt: size needed to read the DevAddr and FCnt */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Get the message type of a frame
+@param payload PHYPayload of the frame, at least 1 byte
+@return MType field of the MHDR
+*/
+uint8_t lorawan_get_mtype( const uint8_t* payload );
+
+/**
+@brief Check if a frame is a data uplink, confirmed or not, long enough to hold a frame header
+@param payload PHYPayload of the frame
+@param size size of the PHYPayload
+@return true for a data uplink
+*/
+bool lorawan_is_data_up( const uint8_t* payload, uint16_t size );
+
+/**
+@brief Get the DevAddr of a data frame
+@param payload PHYPayload of the frame, at least LORAWAN_FCNT_END bytes
+@return DevAddr, sent little endian
+*/
+uint32_t lorawan_get_devaddr( const uint8_t* payload );
+
+/**
+@brief Get the 16 LSBs of the frame counter of a data frame
+@param payload PHYPayload of the frame, at least LORAWAN_FCNT_END bytes
+@return FCnt, sent little endian
+*/
+uint16_t lorawan_get_fcnt( const uint8_t* payload );
+
+/**
+@brief Get the JoinEUI of a join request
+@param payload PHYPayload of the frame, LORAWAN_JOIN_REQUEST_SIZE bytes
+@return JoinEUI, sent little endian
+*/
+uint64_t lorawan_get_joineui( const uint8_t* payload );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -30,6 +30,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include <esp_log.h>
 #include <esp_pthread.h>
+#include <esp_timer.h>
 #include <driver/gpio.h>
 #include <driver/temperature_sensor.h>
 
@@ -43,6 +44,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "display.h"
 #include "http_server.h"
 #include "pkt_fwd.h"
+#include "json_arena.h"
 
 #include "lorahub_version.h"
 #include "main_defs.h"
@@ -73,6 +75,10 @@ static char ntp_serv_addr[64] = CONFIG_SNTP_SERVER_ADDRESS; /* address of the SN
 /* Board specific */
 static int user_button_pressed = 0; /* Number of time the user button has been pressed */
 
+/* Boot timeline, in milliseconds since boot (0 if not reached yet) */
+static uint32_t    boot_phase_ms[BOOT_PHASE_NB]    = { 0 };
+static const char* boot_phase_names[BOOT_PHASE_NB] = BOOT_PHASE_NAMES;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
@@ -104,6 +110,47 @@ void wait_on_error( lorahub_error_t error, int line )
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+void boot_phase_done( boot_phase_t phase )
+{
+    uint32_t not_reached = 0;
+    uint32_t now_ms;
+
+    if( phase >= BOOT_PHASE_NB )
+    {
+        return;
+    }
+
+    /* at least 1ms, 0 means not reached */
+    now_ms = ( uint32_t ) ( esp_timer_get_time( ) / 1000 ) + 1;
+    if( __atomic_compare_exchange_n( &boot_phase_ms[phase], &not_reached, now_ms, false, __ATOMIC_RELAXED,
+                                     __ATOMIC_RELAXED ) == true )
+    {
+        ESP_LOGI( TAG_MAIN, "boot: %s done at %lums", boot_phase_names[phase], now_ms );
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t boot_phase_get_ms( boot_phase_t phase )
+{
+    if( phase >= BOOT_PHASE_NB )
+    {
+        return 0;
+    }
+
+    return __atomic_load_n( &boot_phase_ms[phase], __ATOMIC_RELAXED );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sntp_sync_callback( struct timeval* tv )
+{
+    ESP_LOGI( TAG_MAIN, "SNTP synchronized" );
+    boot_phase_done( BOOT_PHASE_SNTP );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 static void IRAM_ATTR gpio_interrupt_handler( void* args )
 {
     user_button_pressed += 1;
@@ -156,7 +203,7 @@ void thread_display( void )
 
     while( !exit_sig )
     {
-        vTaskDelay( 1000 / portTICK_PERIOD_MS );
+        vTaskDelay( DISPLAY_RENDER_PERIOD_MS / portTICK_PERIOD_MS );
         display_refresh( );
     }
 }
@@ -188,6 +235,9 @@ void app_main( )
     /* Update display */
     display_update_status( DISPLAY_STATUS_INITIALIZING );
 
+    /* Make JSON parsing use static arenas instead of the heap */
+    json_arena_init( );
+
     /* configure LED */
     configure_user_led( );
 
@@ -205,6 +255,15 @@ void app_main( )
         ESP_LOGW( TAG_MAIN, "WARNING: [main] failed to load config from NVS" );
     }
 #endif
+    boot_phase_done( BOOT_PHASE_NVS );
+
+    /* Initialize temperature sensor (before running the pkt fwd thread) */
+    temperature_sensor_config_t temp_sensor_config = TEMPERATURE_SENSOR_CONFIG_DEFAULT( -10, 80 );
+    ESP_ERROR_CHECK( temperature_sensor_install( &temp_sensor_config, &temp_sensor ) );
+    ESP_ERROR_CHECK( temperature_sensor_enable( temp_sensor ) );
+
+    /* Start Packet Forwarder: the radio is started while WiFi connects, forwarding starts once the network is ready */
+    launch_pkt_fwd( temp_sensor );
 
     /* Initialize the underlying TCP/IP stack */
     ESP_ERROR_CHECK( esp_netif_init( ) );
@@ -237,10 +296,15 @@ void app_main( )
         wait_on_error( LRHB_ERROR_WIFI, __LINE__ );
     }
 
+    boot_phase_done( BOOT_PHASE_WIFI );
+
     /* Update display */
     display_update_status( DISPLAY_STATUS_INITIALIZING );
 
-    /* Initialize SNTP to get time from network */
+    /* Let the packet forwarder connect to the server */
+    pkt_fwd_network_ready( );
+
+    /* Initialize SNTP to get time from network, in background as packets are timestamped by the concentrator */
     if( wifi_get_status( ) == WIFI_STATUS_CONNECTED )
     {
         /* Get SNTP server address from loaded config */
@@ -250,27 +314,17 @@ void app_main( )
 
         ESP_LOGI( TAG_MAIN, "Initializing SNTP from %s...", ntp_serv_addr );
         esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG( ntp_serv_addr );
-        esp_netif_sntp_init( &config );
-        if( ( esp_err = esp_netif_sntp_sync_wait( pdMS_TO_TICKS( 10000 ) ) ) != ESP_OK )
-        {
-            ESP_LOGE( TAG_MAIN, "ERROR: SNTP timeout with %s", esp_err_to_name( esp_err ) );
-        }
-        else
+        config.sync_cb           = sntp_sync_callback;
+        esp_err                  = esp_netif_sntp_init( &config );
+        if( esp_err != ESP_OK )
         {
-            ESP_LOGI( TAG_MAIN, "SNTP initialized" );
+            ESP_LOGE( TAG_MAIN, "ERROR: SNTP initialization failed with %s", esp_err_to_name( esp_err ) );
         }
     }
 
     /* Initialize HTTP server */
     http_server_init( );
-
-    /* Initialize temperature sensor (before running the pkt fwd thread) */
-    temperature_sensor_config_t temp_sensor_config = TEMPERATURE_SENSOR_CONFIG_DEFAULT( -10, 80 );
-    ESP_ERROR_CHECK( temperature_sensor_install( &temp_sensor_config, &temp_sensor ) );
-    ESP_ERROR_CHECK( temperature_sensor_enable( temp_sensor ) );
-
-    /* Start Packet Forwarder */
-    launch_pkt_fwd( temp_sensor );
+    boot_phase_done( BOOT_PHASE_HTTP );
 
     while( !exit_sig )
     {
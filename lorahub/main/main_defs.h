@@ -18,12 +18,16 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDENCIES --------------------------------------------------------- */
 
+#include <stdint.h> /* C99 types */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC MACROS -------------------------------------------------------- */
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
+#define BOOT_PHASE_NAMES { "nvs", "radio", "wifi", "http", "fwd", "sntp" }
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
@@ -37,11 +41,36 @@ typedef enum
     LRHB_ERROR_UNKNOWN,
 } lorahub_error_t;
 
+/* Boot milestones, some of them are reached in parallel */
+typedef enum
+{
+    BOOT_PHASE_NVS,   /* configuration loaded from flash */
+    BOOT_PHASE_RADIO, /* concentrator started */
+    BOOT_PHASE_WIFI,  /* WiFi connected */
+    BOOT_PHASE_HTTP,  /* HTTP server started */
+    BOOT_PHASE_FWD,   /* packet forwarder connected to the server, packets are forwarded */
+    BOOT_PHASE_SNTP,  /* time synchronized by SNTP */
+    BOOT_PHASE_NB
+} boot_phase_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS ----------------------------------------------------- */
 
 void wait_on_error( lorahub_error_t error, int line );
 
+/**
+@brief Record the time since boot at which a boot milestone is reached (only the first time, thread safe)
+@param phase milestone reached
+*/
+void boot_phase_done( boot_phase_t phase );
+
+/**
+@brief Get the time since boot at which a boot milestone was reached
+@param phase milestone
+@return time since boot in milliseconds, 0 if not reached yet
+*/
+uint32_t boot_phase_get_ms( boot_phase_t phase );
+
 #endif  // _PKTFWD_DEFS_H
 
 /* --- EOF ------------------------------------------------------------------ */
\ No newline at end of file
@@ -17,6 +17,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include <stdint.h>  /* C99 types */
 #include <stdbool.h> /* bool type */
+#include <stddef.h>  /* offsetof */
 #include <time.h>    /* time, clock_gettime, strftime, gmtime */
 #include <stdlib.h>  /* atoi, exit */
 #include <math.h>    /* modf */
@@ -37,9 +38,18 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "pkt_fwd.h"
 #include "trace.h"
 #include "jitqueue.h"
+#include "region.h"
+#include "airtime.h"
+#include "pkt_stream.h"
+#include "dev_table.h"
+#include "uplink_filter.h"
+#include "lorawan.h"
 #include "parson.h"
+#include "json_arena.h"
+#include "freq_mhz.h"
 #include "base64.h"
 #include "lorahub_hal.h"
+#include "lorahub_clock.h"
 
 /* Services */
 #include "display.h"
@@ -78,7 +88,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define NB_PKT_MAX 1 /* max number of packets per fetch/send cycle */
 
-#define STATUS_SIZE 200
+#define RX1_UPLINK_NB 8 /* number of last forwarded uplinks whose RX1 window can fall back to RX2 */
+
+#define STATUS_SIZE 320
 #define TX_BUFF_SIZE ( ( 540 * NB_PKT_MAX ) + 30 + STATUS_SIZE )
 #define ACK_BUFF_SIZE 64
 
@@ -91,6 +103,15 @@ static const char* TAG_JIT     = "th_jit";
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
 
+/* index of the threads in thread_tasks, same order as PKT_FWD_THREAD_NAMES */
+typedef enum
+{
+    THREAD_PKTFWD,
+    THREAD_UP,
+    THREAD_DOWN,
+    THREAD_JIT
+} thread_id_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
@@ -136,6 +157,7 @@ static uint32_t        meas_nb_rx_ok    = 0;                         /* count pa
 static uint32_t        meas_nb_rx_bad   = 0;                         /* count packets received with PAYLOAD CRC ERROR */
 static uint32_t        meas_nb_rx_nocrc = 0;                         /* count packets received with NO PAYLOAD CRC */
 static uint32_t        meas_up_pkt_fwd  = 0;     /* number of radio packet forwarded to the server */
+static uint32_t        meas_up_pkt_filtered = 0; /* number of valid packets dropped by the uplink filter */
 static uint32_t        meas_up_network_byte = 0; /* sum of UDP bytes sent for upstream traffic */
 static uint32_t        meas_up_payload_byte = 0; /* sum of radio payload bytes sent for upstream traffic */
 static uint32_t        meas_up_dgram_sent   = 0; /* number of datagrams sent for upstream traffic */
@@ -158,6 +180,37 @@ static uint32_t meas_nb_tx_rejected_too_late =
     0; /* count packets were TX request were rejected because it is too late to program it */
 static uint32_t meas_nb_tx_rejected_too_early =
     0; /* count packets were TX request were rejected because timestamp is too much in advance */
+static uint32_t meas_nb_tx_rx2_fallback = 0; /* count Class A packets moved to RX2 instead of being rejected */
+static uint32_t meas_nb_tx_preempted    = 0; /* count accepted packets dropped for a higher priority one */
+static uint32_t meas_nb_tx_rejected_duty_cycle =
+    0; /* count packets were TX request were rejected because the sub-band duty-cycle budget is exhausted */
+
+/* latency histograms, protected by mx_meas_up (PUSH_ACK) and mx_meas_dw (PULL_ACK, TX) */
+static uint32_t meas_up_ack_rtt_hist[PKT_FWD_HIST_NB] = { 0 }; /* PUSH_ACK round trip time */
+static uint32_t meas_dw_ack_rtt_hist[PKT_FWD_HIST_NB] = { 0 }; /* PULL_ACK round trip time */
+static uint32_t meas_tx_slack_hist[PKT_FWD_HIST_NB]   = { 0 }; /* time left before TX start once programmed */
+static int64_t  meas_up_ack_rtt_sum                   = 0;     /* sum of the values of each histogram */
+static int64_t  meas_dw_ack_rtt_sum                   = 0;
+static int64_t  meas_tx_slack_sum                     = 0;
+
+static const int32_t ack_rtt_bounds_ms[PKT_FWD_HIST_NB - 1]  = PKT_FWD_ACK_RTT_BOUNDS_MS;
+static const int32_t tx_slack_bounds_us[PKT_FWD_HIST_NB - 1] = PKT_FWD_TX_SLACK_BOUNDS_US;
+
+/* last packet received, protected by mx_meas_up */
+static float meas_last_rssi = 0.0;
+static float meas_last_snr  = 0.0;
+
+/* timestamps of the last uplinks forwarded, to recognize their RX1 downlinks, protected by mx_meas_up */
+static uint32_t rx1_uplink_count_us[RX1_UPLINK_NB] = { 0 };
+static uint8_t  rx1_uplink_nb                      = 0;
+static uint8_t  rx1_uplink_next                    = 0;
+
+/* tasks running the threads, for stack monitoring */
+static TaskHandle_t thread_tasks[PKT_FWD_THREAD_NB] = { NULL };
+
+/* statistics snapshot, written by thread_pktfwd only and read without lock (odd sequence while being written) */
+static pkt_fwd_stats_t stats_snapshot;
+static uint32_t        stats_snapshot_seq = 0;
 
 static pthread_mutex_t mx_stat_rep  = PTHREAD_MUTEX_INITIALIZER; /* control access to the status report */
 static bool            report_ready = false;       /* true when there is a new report to send to the server */
@@ -170,108 +223,171 @@ static uint32_t autoquit_threshold =
 /* Just In Time TX scheduling */
 static struct jit_queue_s jit_queue[LGW_RF_CHAIN_NB];
 
+/* Class A downlinks RX2 fallback, NULL if disabled */
+static const region_params_t* rx2_region = NULL;
+
 /* Gateway specificities */
 static int8_t antenna_gain = 0;
 
 /* TX capabilities */
 static bool tx_enable[LGW_RF_CHAIN_NB] = { false }; /* Is TX enabled for a given RF chain ? */
 
+/* RX channel in use, and configuration applied without reboot */
+static struct lgw_conf_rxrf_s chan_rxrf_conf;
+static struct lgw_conf_rxif_s chan_rxif_conf;
+static pthread_mutex_t        mx_reconf   = PTHREAD_MUTEX_INITIALIZER; /* one reconfiguration at a time */
+static bool                   fwd_running = false; /* concentrator and threads started, can be reconfigured */
+static bool                   pull_now    = false; /* server changed, send a PULL_DATA without waiting keepalive */
+static bool                   net_ready   = false; /* network connected, the server can be reached */
+static bool                   up_ready    = false; /* upstream socket connected, uplinks can be forwarded */
+
 static temperature_sensor_handle_t temp_sensor = NULL;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
-static double difftimespec( struct timespec end, struct timespec beginning );
+static int32_t     difftimespec_ms( struct timespec end, struct timespec beginning );
+static void        hist_add( uint32_t* hist, int64_t* sum, const int32_t* bounds, int32_t value );
+static void        counters_add( pkt_fwd_counters_t* total, const pkt_fwd_counters_t* window );
+static void        stats_publish( const pkt_fwd_stats_t* stats );
+static bool        is_rx1_of_uplink( uint32_t count_us );
+static int         send_tx_ack( uint8_t token_h, uint8_t token_l, enum jit_error_e error, int32_t error_value );
+static void        report_dropped( void );
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
-static int parse_radio_configuration( void )
+/* Get the RX channel from the loaded config */
+static int get_channel_configuration( struct lgw_conf_rxrf_s* rxrf_conf, struct lgw_conf_rxif_s* rxif_conf )
 {
-    int                    err_lgw;
-    struct lgw_conf_rxrf_s rxrf_conf;
-    struct lgw_conf_rxif_s rxif_conf;
-    uint16_t               bw;
+    uint16_t bw;
 
-    memset( &rxrf_conf, 0, sizeof( struct lgw_conf_rxrf_s ) );
-    memset( &rxif_conf, 0, sizeof( struct lgw_conf_rxif_s ) );
+    memset( rxrf_conf, 0, sizeof( struct lgw_conf_rxrf_s ) );
+    memset( rxif_conf, 0, sizeof( struct lgw_conf_rxif_s ) );
 
     /* Configure channel from loaded config */
     const lgw_nvs_cfg_t* nvs_cfg;
     lgw_nvs_get_config( &nvs_cfg );
-    rxrf_conf.freq_hz     = nvs_cfg->chan_freq_hz;
-    rxif_conf.datarate[0] = nvs_cfg->chan_datarate_1;
-    rxif_conf.datarate[1] = nvs_cfg->chan_datarate_2;
-    bw                    = nvs_cfg->chan_bandwidth_khz;
+    rxrf_conf->freq_hz     = nvs_cfg->chan_freq_hz;
+    rxif_conf->datarate[0] = nvs_cfg->chan_datarate_1;
+    rxif_conf->datarate[1] = nvs_cfg->chan_datarate_2;
+    bw                     = nvs_cfg->chan_bandwidth_khz;
 
     /* Radio config */
     /* rxrf_conf.freq_hz DONE above*/
-    rxrf_conf.rssi_offset = 0;
-    rxrf_conf.tx_enable   = true;
-    err_lgw               = lgw_rxrf_setconf( &rxrf_conf );
-    if( err_lgw != LGW_HAL_SUCCESS )
-    {
-        ESP_LOGE( TAG_PKT_FWD, "ERROR: lgw_rxrf_setconf() failed\n" );
-        return -1;
-    }
-
-    /* Save for later usage */
-    tx_enable[0] = rxrf_conf.tx_enable;
+    rxrf_conf->rssi_offset = 0;
+    rxrf_conf->tx_enable   = true;
 
     /* Modulation config */
-    rxif_conf.modulation = MOD_LORA;
+    rxif_conf->modulation = MOD_LORA;
     /* rxif_conf.datarate DONE above */
     switch( bw )
     {
     /* Sub-Ghz bandwidths */
     case 125:
-        rxif_conf.bandwidth = BW_125KHZ;
+        rxif_conf->bandwidth = BW_125KHZ;
         break;
     case 250:
-        rxif_conf.bandwidth = BW_250KHZ;
+        rxif_conf->bandwidth = BW_250KHZ;
         break;
     case 500:
-        rxif_conf.bandwidth = BW_500KHZ;
+        rxif_conf->bandwidth = BW_500KHZ;
         break;
     /* 2.4GHz bandwidths */
     case 200:
-        rxif_conf.bandwidth = BW_200KHZ;
+        rxif_conf->bandwidth = BW_200KHZ;
         break;
     case 400:
-        rxif_conf.bandwidth = BW_400KHZ;
+        rxif_conf->bandwidth = BW_400KHZ;
         break;
     case 800:
-        rxif_conf.bandwidth = BW_800KHZ;
+        rxif_conf->bandwidth = BW_800KHZ;
         break;
     default:
-        ESP_LOGE( TAG_PKT_FWD, "ERROR: bandwidth configuration not supported %d\n", CONFIG_CHANNEL_LORA_BANDWIDTH );
+        ESP_LOGE( TAG_PKT_FWD, "ERROR: bandwidth configuration not supported %u\n", bw );
         return -1;
     }
     /* Set coding rate according to current LoRaWAN regions specification */
-    if( rxrf_conf.freq_hz >= 2400000000 )
+    if( rxrf_conf->freq_hz >= 2400000000 )
     {
         /* For 2.4GHz */
-        rxif_conf.coderate = CR_LORA_LI_4_8;
+        rxif_conf->coderate = CR_LORA_LI_4_8;
     }
     else
     {
         /* For Sub-GHz */
-        rxif_conf.coderate = CR_LORA_4_5;
+        rxif_conf->coderate = CR_LORA_4_5;
     }
-    err_lgw = lgw_rxif_setconf( &rxif_conf );
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void display_channel_configuration( const struct lgw_conf_rxrf_s* rxrf_conf,
+                                           const struct lgw_conf_rxif_s* rxif_conf )
+{
+    const lgw_nvs_cfg_t* nvs_cfg;
+
+    /* Update OLED display with channel config */
+    lgw_nvs_get_config( &nvs_cfg );
+    display_channel_conf_t chan_cfg = { 0 };
+    chan_cfg.freq_hz                = rxrf_conf->freq_hz;
+    chan_cfg.datarate[0]            = rxif_conf->datarate[0];
+    chan_cfg.datarate[1]            = rxif_conf->datarate[1];
+    chan_cfg.bw_khz                 = nvs_cfg->chan_bandwidth_khz;
+    display_update_channel_config( &chan_cfg );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int parse_radio_configuration( void )
+{
+    int                   err_lgw;
+    struct lgw_conf_lbt_s lbt_conf;
+
+    memset( &lbt_conf, 0, sizeof( struct lgw_conf_lbt_s ) );
+
+    if( get_channel_configuration( &chan_rxrf_conf, &chan_rxif_conf ) != 0 )
+    {
+        return -1;
+    }
+
+    err_lgw = lgw_rxrf_setconf( &chan_rxrf_conf );
+    if( err_lgw != LGW_HAL_SUCCESS )
+    {
+        ESP_LOGE( TAG_PKT_FWD, "ERROR: lgw_rxrf_setconf() failed\n" );
+        return -1;
+    }
+
+    /* Save for later usage */
+    tx_enable[0] = chan_rxrf_conf.tx_enable;
+
+    err_lgw = lgw_rxif_setconf( &chan_rxif_conf );
     if( err_lgw != LGW_HAL_SUCCESS )
     {
         ESP_LOGE( TAG_PKT_FWD, "ERROR: lgw_rxif_setconf() failed\n" );
         return -1;
     }
 
-    /* Update OLED display with channel config */
-    display_channel_conf_t chan_cfg = { 0 };
-    chan_cfg.freq_hz                = rxrf_conf.freq_hz;
-    chan_cfg.datarate[0]            = rxif_conf.datarate[0];
-    chan_cfg.datarate[1]            = rxif_conf.datarate[1];
-    chan_cfg.bw_khz                 = bw;
-    display_update_channel_config( &chan_cfg );
+    /* Listen-Before-Talk config */
+#ifdef CONFIG_DOWNLINK_LBT
+    lbt_conf.enable       = true;
+    lbt_conf.rssi_target  = CONFIG_DOWNLINK_LBT_RSSI_TARGET;
+    lbt_conf.scan_time_us = CONFIG_DOWNLINK_LBT_SCAN_TIME_US;
+    ESP_LOGI( TAG_PKT_FWD, "INFO: LBT enabled (threshold %ddBm, scan %uus)", lbt_conf.rssi_target,
+              lbt_conf.scan_time_us );
+#else
+    lbt_conf.enable = false;
+#endif
+    err_lgw = lgw_lbt_setconf( &lbt_conf );
+    if( err_lgw != LGW_HAL_SUCCESS )
+    {
+        ESP_LOGE( TAG_PKT_FWD, "ERROR: lgw_lbt_setconf() failed\n" );
+        return -1;
+    }
+
+    display_channel_configuration( &chan_rxrf_conf, &chan_rxif_conf );
 
     return 0;
 }
@@ -304,6 +420,20 @@ static int parse_gateway_configuration( void )
 
     ESP_LOGI( TAG_PKT_FWD, "INFO: Auto-quit after %lu non-acknowledged PULL_DATA", autoquit_threshold );
 
+    /* Class A downlinks RX2 fallback (opt-in) */
+    rx2_region = region_get_rx2_fallback( );
+    if( rx2_region != NULL )
+    {
+        ESP_LOGI( TAG_PKT_FWD, "INFO: Class A downlink RX2 fallback enabled for %s (%lu Hz, SF%u)", rx2_region->name,
+                  rx2_region->rx2_freq_hz, rx2_region->rx2_datarate );
+    }
+
+    /* Uplink filter, invalid rules are ignored */
+    if( uplink_filter_init( CONFIG_UPLINK_FILTER_DEVADDR, CONFIG_UPLINK_FILTER_JOINEUI ) != 0 )
+    {
+        ESP_LOGW( TAG_PKT_FWD, "WARNING: invalid uplink filter rules ignored" );
+    }
+
     /* Configure LNS address and port from loaded config */
     const lgw_nvs_cfg_t* nvs_cfg;
     lgw_nvs_get_config( &nvs_cfg );
@@ -316,14 +446,75 @@ static int parse_gateway_configuration( void )
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static double difftimespec( struct timespec end, struct timespec beginning )
+/* Elapsed time in milliseconds, truncated */
+static int32_t difftimespec_ms( struct timespec end, struct timespec beginning )
+{
+    int64_t x;
+
+    x = ( int64_t ) ( end.tv_sec - beginning.tv_sec ) * 1000000000;
+    x += end.tv_nsec - beginning.tv_nsec;
+
+    return ( int32_t ) ( x / 1000000 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Only the RX1 window of an uplink forwarded recently can be moved to RX2, other downlinks already target RX2 or
+ * are not Class A replies */
+static bool is_rx1_of_uplink( uint32_t count_us )
 {
-    double x;
+    bool    found = false;
+    uint8_t i;
+
+    pthread_mutex_lock( &mx_meas_up );
+    for( i = 0; ( i < rx1_uplink_nb ) && ( found == false ); i++ )
+    {
+        found = region_is_rx1( rx2_region, rx1_uplink_count_us[i], count_us );
+    }
+    pthread_mutex_unlock( &mx_meas_up );
+
+    return found;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* The server got a TX_ACK for the downlinks evicted by a higher priority one, report them as not sent */
+static void report_dropped( void )
+{
+    struct jit_dropped_s dropped;
+    pkt_stream_event_t   stream_event;
+    int                  i;
+
+    for( i = 0; i < LGW_RF_CHAIN_NB; i++ )
+    {
+        while( jit_get_dropped( &jit_queue[i], &dropped ) == true )
+        {
+            if( dropped.error == JIT_ERROR_COLLISION_PACKET )
+            {
+                ESP_LOGW( TAG_DOWN, "WARNING: accepted downlink at %lu (prio=%d) dropped for a higher priority one\n",
+                          dropped.count_us, dropped.priority );
+                pthread_mutex_lock( &mx_meas_dw );
+                meas_nb_tx_preempted += 1;
+                pthread_mutex_unlock( &mx_meas_dw );
+            }
 
-    x = 1E-9 * ( double ) ( end.tv_nsec - beginning.tv_nsec );
-    x += ( double ) ( end.tv_sec - beginning.tv_sec );
+            /* the request has been acknowledged OK, a second TX_ACK with the same token tells the server it failed */
+            if( send_tx_ack( ( uint8_t ) ( dropped.token >> 8 ), ( uint8_t ) dropped.token, dropped.error, 0 ) < 0 )
+            {
+                ESP_LOGE( TAG_DOWN, "ERROR: Failed to send tx_ack datagram of a dropped downlink\n" );
+            }
 
-    return x;
+            memset( &stream_event, 0, sizeof stream_event );
+            stream_event.type      = PKT_STREAM_TX_ACK;
+            stream_event.count_us  = dropped.count_us;
+            stream_event.freq_hz   = dropped.freq_hz;
+            stream_event.size      = dropped.size;
+            stream_event.datarate  = dropped.datarate;
+            stream_event.bandwidth = dropped.bandwidth;
+            stream_event.status    = dropped.error;
+            pkt_stream_push( &stream_event );
+        }
+    }
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -357,6 +548,7 @@ static int send_tx_ack( uint8_t token_h, uint8_t token_l, enum jit_error_e error
         switch( error )
         {
         case JIT_ERROR_TX_POWER:
+        case JIT_ERROR_RX2_FALLBACK:
             memcpy( ( void* ) ( buff_tx_ack + buff_index ), ( void* ) "\"warn\":", 7 );
             buff_index += 7;
             break;
@@ -413,6 +605,18 @@ static int send_tx_ack( uint8_t token_h, uint8_t token_l, enum jit_error_e error
             memcpy( ( void* ) ( buff_tx_ack + buff_index ), ( void* ) "\"GPS_UNLOCKED\"", 14 );
             buff_index += 14;
             break;
+        case JIT_ERROR_RX2_FALLBACK:
+            memcpy( ( void* ) ( buff_tx_ack + buff_index ), ( void* ) "\"RX2_FALLBACK\"", 14 );
+            buff_index += 14;
+            break;
+        case JIT_ERROR_DUTY_CYCLE:
+            memcpy( ( void* ) ( buff_tx_ack + buff_index ), ( void* ) "\"DUTY_CYCLE\"", 12 );
+            buff_index += 12;
+            /* update stats */
+            pthread_mutex_lock( &mx_meas_dw );
+            meas_nb_tx_rejected_duty_cycle += 1;
+            pthread_mutex_unlock( &mx_meas_dw );
+            break;
         default:
             memcpy( ( void* ) ( buff_tx_ack + buff_index ), ( void* ) "\"UNKNOWN\"", 9 );
             buff_index += 9;
@@ -422,6 +626,7 @@ static int send_tx_ack( uint8_t token_h, uint8_t token_l, enum jit_error_e error
         switch( error )
         {
         case JIT_ERROR_TX_POWER:
+        case JIT_ERROR_RX2_FALLBACK:
             j = snprintf( ( char* ) ( buff_tx_ack + buff_index ), ACK_BUFF_SIZE - buff_index, ",\"value\":%ld",
                           error_value );
             if( j > 0 )
@@ -449,6 +654,53 @@ static int send_tx_ack( uint8_t token_h, uint8_t token_l, enum jit_error_e error
     return send( sock_down, ( void* ) buff_tx_ack, buff_index, 0 );
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Must be called with the mutex protecting the histogram locked */
+static void hist_add( uint32_t* hist, int64_t* sum, const int32_t* bounds, int32_t value )
+{
+    int i;
+
+    for( i = 0; i < ( PKT_FWD_HIST_NB - 1 ); i++ )
+    {
+        if( value <= bounds[i] )
+        {
+            break;
+        }
+    }
+    hist[i] += 1;
+    *sum += value;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void counters_add( pkt_fwd_counters_t* total, const pkt_fwd_counters_t* window )
+{
+    const uint32_t* src = ( const uint32_t* ) window;
+    uint32_t*       dst = ( uint32_t* ) total;
+    size_t          i;
+
+    /* the structure holds uint32_t counters, then the sums of the histograms */
+    for( i = 0; i < ( offsetof( pkt_fwd_counters_t, ack_rtt_sum_ms ) / sizeof( uint32_t ) ); i++ )
+    {
+        dst[i] += src[i];
+    }
+    total->ack_rtt_sum_ms += window->ack_rtt_sum_ms;
+    total->tx_slack_sum_us += window->tx_slack_sum_us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Sequence lock: the only writer makes the sequence odd while copying, readers retry until they get an even and
+ * unchanged sequence, so that the packet forwarder never waits for them */
+static void stats_publish( const pkt_fwd_stats_t* stats )
+{
+    __atomic_store_n( &stats_snapshot_seq, stats_snapshot_seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    memcpy( &stats_snapshot, stats, sizeof stats_snapshot );
+    __atomic_store_n( &stats_snapshot_seq, stats_snapshot_seq + 1, __ATOMIC_RELEASE );
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- THREAD 1: RECEIVING PACKETS AND FORWARDING THEM ---------------------- */
 
@@ -469,6 +721,7 @@ void thread_up( void )
 
     /* data buffers */
     int buff_index;
+    int snr_x10; /* LoRa SNR in tenths of dB */
 
     /* protocol variables */
     uint8_t token_h; /* random token for acknowledgement matching */
@@ -478,6 +731,9 @@ void thread_up( void )
     struct timespec send_time;
     struct timespec recv_time;
 
+    /* time of the fetch, for the device table */
+    struct timespec fetch_time;
+
     /* report management variable */
     bool send_report = false;
 
@@ -485,6 +741,39 @@ void thread_up( void )
     uint32_t mote_addr = 0;
     uint16_t mote_fcnt = 0;
 
+    /* live monitoring */
+    pkt_stream_event_t stream_event;
+
+    /* packet dropped by the uplink filter */
+    bool filtered;
+
+    /* packets received before the server can be reached */
+    uint32_t nb_pkt_early = 0;
+
+    /* register the task for stack monitoring */
+    thread_tasks[THREAD_UP] = xTaskGetCurrentTaskHandle( );
+
+    /* the radio receives while the network is being connected: fetch and drop these packets, the gateway
+     * configuration and the server are not known yet */
+    while( ( __atomic_load_n( &up_ready, __ATOMIC_ACQUIRE ) == false ) && !exit_sig )
+    {
+        pthread_mutex_lock( &mx_concent );
+        nb_pkt = lgw_receive( NB_PKT_MAX, rxpkt );
+        pthread_mutex_unlock( &mx_concent );
+        if( nb_pkt == LGW_HAL_ERROR )
+        {
+            ESP_LOGE( TAG_UP, "ERROR: [up] failed packet fetch, exiting\n" );
+            wait_on_error( LRHB_ERROR_HAL, __LINE__ );
+        }
+        nb_pkt_early += nb_pkt;
+        lgw_clock_sleep_ms( FETCH_SLEEP_MS );
+    }
+    if( nb_pkt_early > 0 )
+    {
+        ESP_LOGW( TAG_UP, "WARNING: [up] %lu packet(s) received before the network was up, dropped\n",
+                  nb_pkt_early );
+    }
+
     /* set upstream socket RX timeout */
     i = setsockopt( sock_up, SOL_SOCKET, SO_RCVTIMEO, ( void* ) &push_timeout_half, sizeof push_timeout_half );
     if( i != 0 )
@@ -520,13 +809,14 @@ void thread_up( void )
         /* wait a short time if no packets, nor status report */
         if( ( nb_pkt == 0 ) && ( send_report == false ) )
         {
-            vTaskDelay( FETCH_SLEEP_MS / portTICK_PERIOD_MS );
+            lgw_clock_sleep_ms( FETCH_SLEEP_MS );
             continue;
         }
 
         /* get timestamp for statistics */
         t = time( NULL );
         strftime( stat_timestamp, sizeof stat_timestamp, "%F %T %Z", gmtime( &t ) );
+        clock_gettime( CLOCK_MONOTONIC, &fetch_time );
 
         /* start composing datagram with the header */
         token_h    = ( uint8_t ) rand( ); /* random token */
@@ -547,15 +837,11 @@ void thread_up( void )
 
             /* Get mote information from current packet (addr, fcnt) */
             /* FHDR - DevAddr */
-            if( p->size >= 8 )
+            if( p->size >= LORAWAN_FCNT_END )
             {
-                mote_addr = p->payload[1];
-                mote_addr |= p->payload[2] << 8;
-                mote_addr |= p->payload[3] << 16;
-                mote_addr |= p->payload[4] << 24;
+                mote_addr = lorawan_get_devaddr( p->payload );
                 /* FHDR - FCnt */
-                mote_fcnt = p->payload[6];
-                mote_fcnt |= p->payload[7] << 8;
+                mote_fcnt = lorawan_get_fcnt( p->payload );
             }
             else
             {
@@ -563,13 +849,46 @@ void thread_up( void )
                 mote_fcnt = 0;
             }
 
+            /* publish the packet for live monitoring, filtered packets included */
+            memset( &stream_event, 0, sizeof stream_event );
+            stream_event.type      = PKT_STREAM_RXPK;
+            stream_event.count_us  = p->count_us;
+            stream_event.freq_hz   = p->freq_hz;
+            stream_event.devaddr   = mote_addr;
+            stream_event.rssi      = ( int16_t ) roundf( p->rssic );
+            stream_event.snr_x10   = ( int16_t ) roundf( p->snr * 10.0f );
+            stream_event.fcnt      = mote_fcnt;
+            stream_event.size      = p->size;
+            stream_event.datarate  = p->datarate;
+            stream_event.bandwidth = p->bandwidth;
+            stream_event.status    = p->status;
+            pkt_stream_push( &stream_event );
+
+            /* drop the uplinks of other networks before any serialization */
+            filtered = ( p->status == STAT_CRC_OK ) && ( uplink_filter_accept( p->payload, p->size ) == false );
+
+            /* track the link quality of the devices, from their data uplinks */
+            if( ( filtered == false ) && ( p->status == STAT_CRC_OK ) &&
+                ( lorawan_is_data_up( p->payload, p->size ) == true ) )
+            {
+                dev_table_update( mote_addr, mote_fcnt, p->rssic, p->snr, p->datarate, ( uint32_t ) fetch_time.tv_sec );
+            }
+
             /* basic packet filtering */
             pthread_mutex_lock( &mx_meas_up );
             meas_nb_rx_rcv += 1;
+            meas_last_rssi = p->rssic;
+            meas_last_snr  = p->snr;
             switch( p->status )
             {
             case STAT_CRC_OK:
                 meas_nb_rx_ok += 1;
+                if( filtered == true )
+                {
+                    meas_up_pkt_filtered += 1;
+                    pthread_mutex_unlock( &mx_meas_up );
+                    continue; /* skip that packet */
+                }
                 if( !fwd_valid_pkt )
                 {
                     pthread_mutex_unlock( &mx_meas_up );
@@ -602,6 +921,12 @@ void thread_up( void )
             }
             meas_up_pkt_fwd += 1;
             meas_up_payload_byte += p->size;
+            rx1_uplink_count_us[rx1_uplink_next] = p->count_us;
+            rx1_uplink_next                      = ( rx1_uplink_next + 1 ) % RX1_UPLINK_NB;
+            if( rx1_uplink_nb < RX1_UPLINK_NB )
+            {
+                rx1_uplink_nb += 1;
+            }
             pthread_mutex_unlock( &mx_meas_up );
             printf( "\nINFO: Received pkt from mote: %08lX (fcnt=%u)", mote_addr, mote_fcnt );
 
@@ -645,8 +970,8 @@ void thread_up( void )
 
             /* Packet concentrator channel, RF chain & RX frequency, 34-36 useful chars */
             j = snprintf( ( char* ) ( buff_up + buff_index ), TX_BUFF_SIZE - buff_index,
-                          ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf", p->if_chain, p->rf_chain,
-                          ( ( double ) p->freq_hz / 1e6 ) );
+                          ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%lu.%06lu", p->if_chain, p->rf_chain,
+                          p->freq_hz / 1000000, p->freq_hz % 1000000 );
             if( j > 0 )
             {
                 buff_index += j;
@@ -804,7 +1129,9 @@ void thread_up( void )
                 }
 
                 /* Lora SNR */
-                j = snprintf( ( char* ) ( buff_up + buff_index ), TX_BUFF_SIZE - buff_index, ",\"lsnr\":%.1f", p->snr );
+                snr_x10 = ( int ) roundf( p->snr * 10.0f );
+                j       = snprintf( ( char* ) ( buff_up + buff_index ), TX_BUFF_SIZE - buff_index, ",\"lsnr\":%s%d.%d",
+                                    ( snr_x10 < 0 ) ? "-" : "", abs( snr_x10 ) / 10, abs( snr_x10 ) % 10 );
                 if( j > 0 )
                 {
                     buff_index += j;
@@ -822,8 +1149,8 @@ void thread_up( void )
             }
 
             /* Channel RSSI, payload size, 18-23 useful chars */
-            j = snprintf( ( char* ) ( buff_up + buff_index ), TX_BUFF_SIZE - buff_index, ",\"rssi\":%.0f,\"size\":%u",
-                          roundf( p->rssic ), p->size );
+            j = snprintf( ( char* ) ( buff_up + buff_index ), TX_BUFF_SIZE - buff_index, ",\"rssi\":%d,\"size\":%u",
+                          ( int ) roundf( p->rssic ), p->size );
             if( j > 0 )
             {
                 buff_index += j;
@@ -949,8 +1276,9 @@ void thread_up( void )
             else
             {
                 ESP_LOGI( TAG_UP, "INFO: [up] PUSH_ACK received in %i ms",
-                          ( int ) ( 1000 * difftimespec( recv_time, send_time ) ) );
+                          ( int ) difftimespec_ms( recv_time, send_time ) );
                 meas_up_ack_rcv += 1;
+                hist_add( meas_up_ack_rtt_hist, &meas_up_ack_rtt_sum, ack_rtt_bounds_ms, difftimespec_ms( recv_time, send_time ) );
                 break;
             }
         }
@@ -983,6 +1311,7 @@ void thread_down( void )
 
     /* configuration and metadata for an outbound packet */
     struct lgw_pkt_tx_s txpkt;
+    struct lgw_pkt_tx_s rx2_txpkt;              /* RX1 packet moved to RX2 */
     bool                sent_immediate = false; /* option to sent the packet immediately */
 
     /* data buffers */
@@ -993,9 +1322,10 @@ void thread_down( void )
     struct timespec recv_time; /* time of return from recv socket call */
 
     /* protocol variables */
-    uint8_t token_h;         /* random token for acknowledgement matching */
-    uint8_t token_l;         /* random token for acknowledgement matching */
-    bool    req_ack = false; /* keep track of whether PULL_DATA was acknowledged or not */
+    uint8_t  token_h;         /* random token for acknowledgement matching */
+    uint8_t  token_l;         /* random token for acknowledgement matching */
+    bool     req_ack = false; /* keep track of whether PULL_DATA was acknowledged or not */
+    uint16_t downlink_token;  /* token of the PULL_RESP, given to the JiT queue to report a later drop */
 
     /* JSON parsing variables */
     JSON_Value*  root_val = NULL;
@@ -1013,6 +1343,10 @@ void thread_down( void )
     enum jit_pkt_type_e downlink_type;
     enum jit_error_e    warning_result = JIT_ERROR_OK;
     int32_t             warning_value  = 0;
+    uint32_t            toa_ms;
+
+    /* live monitoring */
+    pkt_stream_event_t stream_event;
 
     /* set downstream socket RX timeout */
     i = setsockopt( sock_down, SOL_SOCKET, SO_RCVTIMEO, ( void* ) &pull_timeout, sizeof pull_timeout );
@@ -1034,6 +1368,9 @@ void thread_down( void )
         jit_queue_init( &jit_queue[i] );
     }
 
+    /* register the task for stack monitoring */
+    thread_tasks[THREAD_DOWN] = xTaskGetCurrentTaskHandle( );
+
     while( !exit_sig )
     {
         // ESP_LOGI(TAG_DOWN, "DOWN");
@@ -1068,8 +1405,17 @@ void thread_down( void )
 
         /* listen to packets and process them until a new PULL request must be sent */
         recv_time = send_time;
-        while( ( int ) difftimespec( recv_time, send_time ) < keepalive_time )
+        while( difftimespec_ms( recv_time, send_time ) < ( keepalive_time * 1000 ) )
         {
+            /* the server has changed, announce the gateway to the new one right away */
+            if( __atomic_exchange_n( &pull_now, false, __ATOMIC_ACQ_REL ) == true )
+            {
+                break;
+            }
+
+            /* accepted downlinks dropped since the last datagram */
+            report_dropped( );
+
             /* try to receive a datagram */
             msg_len = recv( sock_down, ( void* ) buff_down, ( sizeof buff_down ) - 1, 0 );
             clock_gettime( CLOCK_MONOTONIC, &recv_time );
@@ -1105,9 +1451,10 @@ void thread_down( void )
                         autoquit_cnt = 0;
                         pthread_mutex_lock( &mx_meas_dw );
                         meas_dw_ack_rcv += 1;
+                        hist_add( meas_dw_ack_rtt_hist, &meas_dw_ack_rtt_sum, ack_rtt_bounds_ms, difftimespec_ms( recv_time, send_time ) );
                         pthread_mutex_unlock( &mx_meas_dw );
                         ESP_LOGI( TAG_DOWN, "INFO: [down] PULL_ACK received in %i ms",
-                                  ( int ) ( 1000 * difftimespec( recv_time, send_time ) ) );
+                                  ( int ) difftimespec_ms( recv_time, send_time ) );
                     }
                 }
                 else
@@ -1119,13 +1466,16 @@ void thread_down( void )
 
             /* the datagram is a PULL_RESP */
             buff_down[msg_len] = 0; /* add string terminator, just to be safe */
+            downlink_token     = ( uint16_t ) ( ( buff_down[1] << 8 ) | buff_down[2] );
             ESP_LOGI( TAG_DOWN, "INFO: [down] PULL_RESP received  - token[%d:%d] :)", buff_down[1],
                       buff_down[2] );                                   /* very verbose */
             printf( "\nJSON down: %s\n", ( char* ) ( buff_down + 4 ) ); /* DEBUG: display JSON payload */
 
             /* initialize TX struct and try to parse JSON */
             memset( &txpkt, 0, sizeof txpkt );
+            json_arena_attach( JSON_ARENA_DOWNLINK );
             root_val = json_parse_string_with_comments( ( const char* ) ( buff_down + 4 ) ); /* JSON offset */
+            json_arena_detach( );
             if( root_val == NULL )
             {
                 ESP_LOGW( TAG_DOWN, "WARNING: [down] invalid JSON, TX aborted\n" );
@@ -1193,7 +1543,12 @@ void thread_down( void )
                 json_value_free( root_val );
                 continue;
             }
-            txpkt.freq_hz = ( uint32_t )( ( double ) ( 1.0e6 ) * json_value_get_number( val ) );
+            if( freq_mhz_from_json( val, &txpkt.freq_hz ) != 0 )
+            {
+                ESP_LOGW( TAG_DOWN, "WARNING: [down] invalid \"txpk.freq\" value in JSON, TX aborted\n" );
+                json_value_free( root_val );
+                continue;
+            }
 
             /* parse RF chain used for TX (mandatory) */
             val = json_object_get_value( txpk_obj, "rfch" );
@@ -1419,6 +1774,18 @@ void thread_down( void )
             meas_dw_payload_byte += txpkt.size;
             pthread_mutex_unlock( &mx_meas_dw );
 
+            /* publish the downlink request for live monitoring */
+            memset( &stream_event, 0, sizeof stream_event );
+            stream_event.type      = PKT_STREAM_TXPK;
+            stream_event.count_us  = txpkt.count_us;
+            stream_event.freq_hz   = txpkt.freq_hz;
+            stream_event.size      = txpkt.size;
+            stream_event.datarate  = txpkt.datarate;
+            stream_event.bandwidth = txpkt.bandwidth;
+            stream_event.status    = txpkt.tx_mode;
+            stream_event.rf_power  = txpkt.rf_power;
+            pkt_stream_push( &stream_event );
+
             /* reset error/warning results */
             jit_result = warning_result = JIT_ERROR_OK;
             warning_value               = 0;
@@ -1463,9 +1830,57 @@ void thread_down( void )
             /* insert packet to be sent into JIT queue */
             if( jit_result == JIT_ERROR_OK )
             {
-                lgw_get_instcnt( &current_concentrator_time );
-                jit_result =
-                    jit_enqueue( &jit_queue[txpkt.rf_chain], current_concentrator_time, &txpkt, downlink_type );
+                /* check the duty-cycle budget of the sub-band, the airtime stays reserved until TX is done */
+                toa_ms = lgw_time_on_air( &txpkt );
+                if( airtime_reserve( txpkt.freq_hz, toa_ms ) != 0 )
+                {
+                    jit_result = JIT_ERROR_DUTY_CYCLE;
+                }
+                else
+                {
+                    lgw_get_instcnt( &current_concentrator_time );
+                    jit_result = jit_enqueue( &jit_queue[txpkt.rf_chain], current_concentrator_time, &txpkt,
+                                              downlink_type, downlink_token );
+                    if( jit_result != JIT_ERROR_OK )
+                    {
+                        airtime_release( txpkt.freq_hz, toa_ms );
+                    }
+                }
+                if( ( ( jit_result == JIT_ERROR_TOO_LATE ) || ( jit_result == JIT_ERROR_COLLISION_PACKET ) ) &&
+                    ( downlink_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A ) && ( rx2_region != NULL ) &&
+                    ( is_rx1_of_uplink( txpkt.count_us ) == true ) )
+                {
+                    /* RX1 is lost, try the RX2 window of the same uplink before rejecting the packet */
+                    rx2_txpkt = txpkt;
+                    if( ( region_move_to_rx2( rx2_region, &rx2_txpkt ) == true ) &&
+                        ( rx2_txpkt.freq_hz >= tx_freq_hz_min ) && ( rx2_txpkt.freq_hz <= tx_freq_hz_max ) )
+                    {
+                        toa_ms = lgw_time_on_air( &rx2_txpkt );
+                        if( airtime_reserve( rx2_txpkt.freq_hz, toa_ms ) == 0 )
+                        {
+                            lgw_get_instcnt( &current_concentrator_time );
+                            if( jit_enqueue( &jit_queue[rx2_txpkt.rf_chain], current_concentrator_time, &rx2_txpkt,
+                                             downlink_type, downlink_token ) == JIT_ERROR_OK )
+                            {
+                                ESP_LOGW( TAG_DOWN,
+                                          "WARNING: RX1 downlink rejected (jit error=%d), moved to RX2 at %lu\n",
+                                          jit_result, rx2_txpkt.count_us );
+                                txpkt          = rx2_txpkt;
+                                jit_result     = JIT_ERROR_OK;
+                                warning_result = JIT_ERROR_RX2_FALLBACK;
+                                warning_value  = ( int32_t ) txpkt.freq_hz;
+                                /* update stats */
+                                pthread_mutex_lock( &mx_meas_dw );
+                                meas_nb_tx_rx2_fallback += 1;
+                                pthread_mutex_unlock( &mx_meas_dw );
+                            }
+                            else
+                            {
+                                airtime_release( rx2_txpkt.freq_hz, toa_ms );
+                            }
+                        }
+                    }
+                }
                 if( jit_result != JIT_ERROR_OK )
                 {
                     ESP_LOGE( TAG_DOWN, "ERROR: Packet REJECTED (jit error=%d)\n", jit_result );
@@ -1486,6 +1901,17 @@ void thread_down( void )
             {
                 ESP_LOGE( TAG_DOWN, "ERROR: Failed to send tx_ack datagram - %d\n", i );
             }
+
+            /* publish the downlink result for live monitoring */
+            stream_event.type     = PKT_STREAM_TX_ACK;
+            stream_event.count_us = txpkt.count_us;
+            stream_event.freq_hz  = txpkt.freq_hz;
+            stream_event.status   = jit_result;
+            stream_event.value    = warning_value;
+            pkt_stream_push( &stream_event );
+
+            /* the downlinks evicted by this one have already been acknowledged */
+            report_dropped( );
         }
     }
     ESP_LOGI( TAG_DOWN, "\nINFO: End of downstream thread\n" );
@@ -1525,12 +1951,19 @@ void thread_jit( void )
     enum jit_error_e    jit_result;
     enum jit_pkt_type_e pkt_type;
     uint8_t             tx_status;
+    uint32_t            tx_config_us;
+    uint32_t            tx_lbt_us;
+    int32_t             tx_slack_us;
+    uint32_t            toa_ms;
     int                 i;
 
+    /* register the task for stack monitoring */
+    thread_tasks[THREAD_JIT] = xTaskGetCurrentTaskHandle( );
+
     while( !exit_sig )
     {
         // ESP_LOGI(TAG_JIT, "JIT");
-        vTaskDelay( 10 / portTICK_PERIOD_MS );
+        lgw_clock_sleep_ms( 10 );
 
         for( i = 0; i < LGW_RF_CHAIN_NB; i++ )
         {
@@ -1565,6 +1998,9 @@ void thread_jit( void )
 #endif
                         }
 
+                        /* airtime reserved by thread_down, to be committed or released */
+                        toa_ms = lgw_time_on_air( &pkt );
+
                         /* check if concentrator is free for sending new packet */
                         result = lgw_status( pkt.rf_chain, TX_STATUS, &tx_status );
                         if( result == LGW_HAL_ERROR )
@@ -1577,6 +2013,7 @@ void thread_jit( void )
                             {
                                 ESP_LOGE( TAG_JIT, "ERROR: concentrator is currently emitting on rf_chain %d\n", i );
                                 print_tx_status( tx_status );
+                                airtime_release( pkt.freq_hz, toa_ms );
                                 continue;
                             }
                             else if( tx_status == TX_SCHEDULED )
@@ -1597,11 +2034,23 @@ void thread_jit( void )
                         pthread_mutex_lock( &mx_concent ); /* may have to wait for a fetch to finish */
                         result = lgw_send( &pkt );
                         pthread_mutex_unlock( &mx_concent ); /* free concentrator ASAP */
-                        if( result != LGW_HAL_SUCCESS )
+                        if( result == LGW_LBT_NOT_ALLOWED )
                         {
+                            /* Channel busy, the packet acknowledged to the server is dropped */
                             pthread_mutex_lock( &mx_meas_dw );
                             meas_nb_tx_fail += 1;
                             pthread_mutex_unlock( &mx_meas_dw );
+                            airtime_release( pkt.freq_hz, toa_ms );
+                            ESP_LOGW( TAG_JIT, "WARNING: [jit] channel busy, TX aborted on rf_chain %d (count_us=%lu)\n", i,
+                                      pkt.count_us );
+                            continue;
+                        }
+                        else if( result != LGW_HAL_SUCCESS )
+                        {
+                            pthread_mutex_lock( &mx_meas_dw );
+                            meas_nb_tx_fail += 1;
+                            pthread_mutex_unlock( &mx_meas_dw );
+                            airtime_release( pkt.freq_hz, toa_ms );
                             ESP_LOGW( TAG_JIT, "WARNING: [jit] lgw_send failed on rf_chain %d\n", i );
                             continue;
                         }
@@ -1610,8 +2059,24 @@ void thread_jit( void )
                             pthread_mutex_lock( &mx_meas_dw );
                             meas_nb_tx_ok += 1;
                             pthread_mutex_unlock( &mx_meas_dw );
+                            airtime_commit( pkt.freq_hz, toa_ms );
                             MSG_DEBUG( DEBUG_PKT_FWD, "lgw_send done on rf_chain %d: count_us=%lu\n", i, pkt.count_us );
 
+                            /* Feed the immediate downlinks scheduler with the time spent from peek to TX programmed,
+                             * without LBT which waits for its scan slot right before the TX (scan time is a fixed
+                             * part of the lead time) */
+                            if( lgw_get_tx_timing( &tx_config_us, &tx_lbt_us, &tx_slack_us ) == LGW_HAL_SUCCESS )
+                            {
+                                pthread_mutex_lock( &mx_meas_dw );
+                                hist_add( meas_tx_slack_hist, &meas_tx_slack_sum, tx_slack_bounds_us, tx_slack_us );
+                                pthread_mutex_unlock( &mx_meas_dw );
+                                jit_asap_update(
+                                    ( pkt.count_us - ( uint32_t ) tx_slack_us ) - current_concentrator_time - tx_lbt_us,
+                                    tx_slack_us );
+                                MSG_DEBUG( DEBUG_JIT, "TX timing: config=%luus lbt=%luus slack=%ldus\n", tx_config_us,
+                                           tx_lbt_us, tx_slack_us );
+                            }
+
                             /* Update display */
                             display_stats_t rx_tx_stats = { .nb_rx = 0, .nb_tx = 1 };
                             display_update_statistics( &rx_tx_stats );
@@ -1659,6 +2124,7 @@ void thread_pktfwd( void )
     uint32_t cp_nb_rx_bad;
     uint32_t cp_nb_rx_nocrc;
     uint32_t cp_up_pkt_fwd;
+    uint32_t cp_up_pkt_filtered;
     uint32_t cp_up_network_byte;
     uint32_t cp_up_payload_byte;
     uint32_t cp_up_dgram_sent;
@@ -1675,6 +2141,16 @@ void thread_pktfwd( void )
     uint32_t cp_nb_tx_rejected_collision_beacon = 0;
     uint32_t cp_nb_tx_rejected_too_late         = 0;
     uint32_t cp_nb_tx_rejected_too_early        = 0;
+    uint32_t cp_nb_tx_rx2_fallback              = 0;
+    uint32_t cp_nb_tx_preempted                 = 0;
+    uint32_t cp_nb_tx_rejected_duty_cycle       = 0;
+
+    /* statistics snapshot, published for the HTTP server */
+    pkt_fwd_stats_t stats = { 0 };
+    struct timespec now;
+
+    /* devices heard during the interval */
+    dev_table_summary_t dev_summary;
 
     /* statistics variable */
     time_t t;
@@ -1685,6 +2161,13 @@ void thread_pktfwd( void )
     float  up_ack_ratio;
     float  dw_ack_ratio;
 
+    struct jit_asap_stats_s     asap_stats;
+    struct jit_overflow_stats_s overflow_stats;
+    struct jit_preempt_stats_s  preempt_stats;
+    airtime_stats_t             airtime_stats;
+    struct lgw_lbt_stats_s      lbt_stats = { 0 };
+    json_arena_stats_t          arena_stats;
+
     /* get timezone info */
     tzset( );
 
@@ -1696,6 +2179,33 @@ void thread_pktfwd( void )
         wait_on_error( LRHB_ERROR_UNKNOWN, __LINE__ );
     }
 
+    /* starting the hub, does not depend on the network which is being connected in parallel */
+    i = lgw_start( );
+    if( i == LGW_HAL_SUCCESS )
+    {
+        ESP_LOGI( TAG_PKT_FWD, "INFO: [main] LoRaHub started, packet can now be received" );
+    }
+    else
+    {
+        ESP_LOGE( TAG_PKT_FWD, "ERROR: [main] failed to start the concentrator\n" );
+        wait_on_error( LRHB_ERROR_HAL, __LINE__ );
+    }
+
+    /* spawn the upstream thread to fetch the packets, they are dropped until the server can be reached */
+    i = pthread_create( &thrid_up, NULL, ( void* ( * ) ( void* ) ) thread_up, NULL );
+    if( i != 0 )
+    {
+        ESP_LOGE( TAG_PKT_FWD, "ERROR: [main] impossible to create upstream thread\n" );
+        wait_on_error( LRHB_ERROR_OS, __LINE__ );
+    }
+    boot_phase_done( BOOT_PHASE_RADIO );
+
+    /* wait for the network to be connected */
+    while( __atomic_load_n( &net_ready, __ATOMIC_ACQUIRE ) == false )
+    {
+        lgw_clock_sleep_ms( 10 );
+    }
+
     /* Configure gateway parameters */
     i = parse_gateway_configuration( );
     if( i != 0 )
@@ -1769,25 +2279,8 @@ void thread_pktfwd( void )
     }
     freeaddrinfo( result );
 
-    /* starting the hub */
-    i = lgw_start( );
-    if( i == LGW_HAL_SUCCESS )
-    {
-        ESP_LOGI( TAG_PKT_FWD, "INFO: [main] LoRaHub started, packet can now be received" );
-    }
-    else
-    {
-        ESP_LOGE( TAG_PKT_FWD, "ERROR: [main] failed to start the concentrator\n" );
-        wait_on_error( LRHB_ERROR_HAL, __LINE__ );
-    }
-
-    /* spawn threads to manage upstream and downstream */
-    i = pthread_create( &thrid_up, NULL, ( void* ( * ) ( void* ) ) thread_up, NULL );
-    if( i != 0 )
-    {
-        ESP_LOGE( TAG_PKT_FWD, "ERROR: [main] impossible to create upstream thread\n" );
-        wait_on_error( LRHB_ERROR_OS, __LINE__ );
-    }
+    /* the upstream thread can forward the packets, spawn threads to manage downstream */
+    __atomic_store_n( &up_ready, true, __ATOMIC_RELEASE );
     i = pthread_create( &thrid_down, NULL, ( void* ( * ) ( void* ) ) thread_down, NULL );
     if( i != 0 )
     {
@@ -1801,16 +2294,23 @@ void thread_pktfwd( void )
         wait_on_error( LRHB_ERROR_OS, __LINE__ );
     }
 
+    /* the configuration can now be changed without restarting */
+    __atomic_store_n( &fwd_running, true, __ATOMIC_RELEASE );
+    boot_phase_done( BOOT_PHASE_FWD );
+
     /* Update status for display */
     display_update_status( DISPLAY_STATUS_RECEIVING );
     display_stats_t rx_tx_stats = { 0 };
     display_update_statistics( &rx_tx_stats );
 
     /* main loop task : statistics collection */
+    /* register the task for stack monitoring */
+    thread_tasks[THREAD_PKTFWD] = xTaskGetCurrentTaskHandle( );
+
     while( !exit_sig )
     {
         /* wait for next reporting interval */
-        vTaskDelay( stat_interval * 1000 / portTICK_PERIOD_MS );
+        lgw_clock_sleep_ms( stat_interval * 1000 );
 
         /* get timestamp for statistics */
         t = time( NULL );
@@ -1823,15 +2323,30 @@ void thread_pktfwd( void )
         cp_nb_rx_bad         = meas_nb_rx_bad;
         cp_nb_rx_nocrc       = meas_nb_rx_nocrc;
         cp_up_pkt_fwd        = meas_up_pkt_fwd;
+        cp_up_pkt_filtered   = meas_up_pkt_filtered;
         cp_up_network_byte   = meas_up_network_byte;
         cp_up_payload_byte   = meas_up_payload_byte;
         cp_up_dgram_sent     = meas_up_dgram_sent;
         cp_up_ack_rcv        = meas_up_ack_rcv;
+
+        stats.window.nb_rx_rcv     = meas_nb_rx_rcv;
+        stats.window.nb_rx_ok      = meas_nb_rx_ok;
+        stats.window.nb_rx_bad     = meas_nb_rx_bad;
+        stats.window.nb_rx_nocrc   = meas_nb_rx_nocrc;
+        stats.window.up_pkt_fwd    = meas_up_pkt_fwd;
+        stats.window.up_dgram_sent = meas_up_dgram_sent;
+        stats.window.up_ack_rcv    = meas_up_ack_rcv;
+        memcpy( stats.window.ack_rtt_hist, meas_up_ack_rtt_hist, sizeof meas_up_ack_rtt_hist );
+        memset( meas_up_ack_rtt_hist, 0, sizeof meas_up_ack_rtt_hist );
+        stats.window.ack_rtt_sum_ms = meas_up_ack_rtt_sum;
+        meas_up_ack_rtt_sum         = 0;
+
         meas_nb_rx_rcv       = 0;
         meas_nb_rx_ok        = 0;
         meas_nb_rx_bad       = 0;
         meas_nb_rx_nocrc     = 0;
         meas_up_pkt_fwd      = 0;
+        meas_up_pkt_filtered = 0;
         meas_up_network_byte = 0;
         meas_up_payload_byte = 0;
         meas_up_dgram_sent   = 0;
@@ -1872,6 +2387,35 @@ void thread_pktfwd( void )
         cp_nb_tx_rejected_collision_beacon += meas_nb_tx_rejected_collision_beacon;
         cp_nb_tx_rejected_too_late += meas_nb_tx_rejected_too_late;
         cp_nb_tx_rejected_too_early += meas_nb_tx_rejected_too_early;
+        cp_nb_tx_rx2_fallback += meas_nb_tx_rx2_fallback;
+        cp_nb_tx_preempted += meas_nb_tx_preempted;
+        cp_nb_tx_rejected_duty_cycle += meas_nb_tx_rejected_duty_cycle;
+
+        stats.window.dw_pull_sent                    = meas_dw_pull_sent;
+        stats.window.dw_ack_rcv                      = meas_dw_ack_rcv;
+        stats.window.dw_dgram_rcv                    = meas_dw_dgram_rcv;
+        stats.window.nb_tx_requested                 = meas_nb_tx_requested;
+        stats.window.nb_tx_ok                        = meas_nb_tx_ok;
+        stats.window.nb_tx_fail                      = meas_nb_tx_fail;
+        stats.window.nb_tx_rejected_collision_packet = meas_nb_tx_rejected_collision_packet;
+        stats.window.nb_tx_rejected_collision_beacon = meas_nb_tx_rejected_collision_beacon;
+        stats.window.nb_tx_rejected_too_late         = meas_nb_tx_rejected_too_late;
+        stats.window.nb_tx_rejected_too_early        = meas_nb_tx_rejected_too_early;
+        stats.window.nb_tx_rejected_duty_cycle       = meas_nb_tx_rejected_duty_cycle;
+        stats.window.nb_tx_rx2_fallback              = meas_nb_tx_rx2_fallback;
+        stats.window.nb_tx_preempted                 = meas_nb_tx_preempted;
+        for( i = 0; i < PKT_FWD_HIST_NB; i++ )
+        {
+            stats.window.ack_rtt_hist[i] += meas_dw_ack_rtt_hist[i];
+        }
+        memcpy( stats.window.tx_slack_hist, meas_tx_slack_hist, sizeof meas_tx_slack_hist );
+        memset( meas_dw_ack_rtt_hist, 0, sizeof meas_dw_ack_rtt_hist );
+        memset( meas_tx_slack_hist, 0, sizeof meas_tx_slack_hist );
+        stats.window.ack_rtt_sum_ms += meas_dw_ack_rtt_sum;
+        stats.window.tx_slack_sum_us = meas_tx_slack_sum;
+        meas_dw_ack_rtt_sum          = 0;
+        meas_tx_slack_sum            = 0;
+
         meas_dw_pull_sent                    = 0;
         meas_dw_ack_rcv                      = 0;
         meas_dw_dgram_rcv                    = 0;
@@ -1884,7 +2428,11 @@ void thread_pktfwd( void )
         meas_nb_tx_rejected_collision_beacon = 0;
         meas_nb_tx_rejected_too_late         = 0;
         meas_nb_tx_rejected_too_early        = 0;
+        meas_nb_tx_rx2_fallback              = 0;
+        meas_nb_tx_preempted                 = 0;
+        meas_nb_tx_rejected_duty_cycle       = 0;
         pthread_mutex_unlock( &mx_meas_dw );
+
         if( cp_dw_pull_sent > 0 )
         {
             dw_ack_ratio = ( float ) cp_dw_ack_rcv / ( float ) cp_dw_pull_sent;
@@ -1894,6 +2442,10 @@ void thread_pktfwd( void )
             dw_ack_ratio = 0.0;
         }
 
+        /* overview of the devices heard */
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        dev_table_get_summary( ( uint32_t ) now.tv_sec - stat_interval, &dev_summary );
+
         /* display a report */
         printf( "\n##### %s #####\n", stat_timestamp );
         printf( "### [UPSTREAM] ###\n" );
@@ -1901,8 +2453,11 @@ void thread_pktfwd( void )
         printf( "# CRC_OK: %.2f%%, CRC_FAIL: %.2f%%, NO_CRC: %.2f%%\n", 100.0 * rx_ok_ratio, 100.0 * rx_bad_ratio,
                 100.0 * rx_nocrc_ratio );
         printf( "# RF packets forwarded: %lu (%lu bytes)\n", cp_up_pkt_fwd, cp_up_payload_byte );
+        printf( "# RF packets dropped by the uplink filter: %lu\n", cp_up_pkt_filtered );
         printf( "# PUSH_DATA datagrams sent: %lu (%lu bytes)\n", cp_up_dgram_sent, cp_up_network_byte );
         printf( "# PUSH_DATA acknowledged: %.2f%%\n", 100.0 * up_ack_ratio );
+        printf( "# Devices: %lu (active: %lu, loss above %d%%: %lu, evicted: %lu)\n", dev_summary.nb_dev,
+                dev_summary.nb_active, DEV_TABLE_DEGRADED_LOSS_PCT, dev_summary.nb_degraded, dev_summary.nb_evicted );
         printf( "### [DOWNSTREAM] ###\n" );
         printf( "# PULL_DATA sent: %lu (%.2f%% acknowledged)\n", cp_dw_pull_sent, 100.0 * dw_ack_ratio );
         printf( "# PULL_RESP(onse) datagrams received: %lu (%lu bytes)\n", cp_dw_dgram_rcv, cp_dw_network_byte );
@@ -1923,9 +2478,62 @@ void thread_pktfwd( void )
             printf( "# TX rejected (too early): %.2f%% (req:%lu, rej:%lu)\n",
                     100.0 * cp_nb_tx_rejected_too_early / cp_nb_tx_requested, cp_nb_tx_requested,
                     cp_nb_tx_rejected_too_early );
+            printf( "# TX moved to RX2: %.2f%% (req:%lu, rx2:%lu)\n", 100.0 * cp_nb_tx_rx2_fallback / cp_nb_tx_requested,
+                    cp_nb_tx_requested, cp_nb_tx_rx2_fallback );
+            printf( "# TX preempted after acknowledge: %.2f%% (req:%lu, preempted:%lu)\n",
+                    100.0 * cp_nb_tx_preempted / cp_nb_tx_requested, cp_nb_tx_requested, cp_nb_tx_preempted );
+            printf( "# TX rejected (duty cycle): %.2f%% (req:%lu, rej:%lu)\n",
+                    100.0 * cp_nb_tx_rejected_duty_cycle / cp_nb_tx_requested, cp_nb_tx_requested,
+                    cp_nb_tx_rejected_duty_cycle );
+        }
+        if( lgw_lbt_get_stats( &lbt_stats ) == LGW_HAL_SUCCESS )
+        {
+            if( lbt_stats.nb_scan > 0 )
+            {
+                printf( "# LBT channel busy: %lu/%lu (max %ddBm), added latency avg:%luus max:%luus\n",
+                        lbt_stats.nb_busy, lbt_stats.nb_scan, lbt_stats.rssi_busy_max,
+                        lbt_stats.latency_us_sum / lbt_stats.nb_scan, lbt_stats.latency_us_max );
+            }
+        }
+        airtime_get_stats( &airtime_stats );
+        for( i = 0; i < airtime_stats.nb_subband; i++ )
+        {
+            if( ( airtime_stats.used_ms[i] + airtime_stats.pending_ms[i] ) > 0 )
+            {
+                printf( "# Airtime %.3f-%.3fMHz: %lu ms (+%lu ms queued) / %lu ms per %lu s%s\n",
+                        airtime_stats.freq_min_hz[i] / 1E6, airtime_stats.freq_max_hz[i] / 1E6,
+                        airtime_stats.used_ms[i], airtime_stats.pending_ms[i], airtime_stats.budget_ms[i],
+                        airtime_stats.window_s, ( airtime_stats.enforced == true ) ? "" : " (not enforced)" );
+            }
+        }
+        for( i = 0; i < JSON_ARENA_NB; i++ )
+        {
+            json_arena_get_stats( i, &arena_stats );
+            if( arena_stats.nb_reset > 0 )
+            {
+                printf( "# JSON arena %s: %lu/%lu bytes max (parsed:%lu, heap fallback:%lu)\n", arena_stats.name,
+                        arena_stats.high_water, arena_stats.size, arena_stats.nb_reset, arena_stats.nb_fallback );
+            }
         }
         printf( "### [JIT] ###\n" );
         jit_print_queue( &jit_queue[0], false, DEBUG_LOG );
+        jit_overflow_get_stats( &jit_queue[0], &overflow_stats );
+        if( overflow_stats.nb_deferred > 0 )
+        {
+            printf( "# Class C deferred: %lu (sent:%lu, expired:%lu, waiting:%u)\n", overflow_stats.nb_deferred,
+                    overflow_stats.nb_sent, overflow_stats.nb_expired, overflow_stats.num_waiting );
+        }
+        jit_preempt_get_stats( &jit_queue[0], &preempt_stats );
+        if( preempt_stats.nb_preempted > 0 )
+        {
+            printf( "# Preempted: %lu (deferred:%lu, dropped:%lu) - Class A:%lu, Class B:%lu, Class C:%lu\n",
+                    preempt_stats.nb_preempted, preempt_stats.nb_deferred, preempt_stats.nb_dropped,
+                    preempt_stats.nb_by_prio[JIT_PRIORITY_CLASS_A], preempt_stats.nb_by_prio[JIT_PRIORITY_CLASS_B],
+                    preempt_stats.nb_by_prio[JIT_PRIORITY_CLASS_C] );
+        }
+        jit_asap_get_stats( &asap_stats );
+        printf( "# ASAP lead time: %lu us (dispatch: %lu us +/- %lu us, late: %lu/%lu)\n", asap_stats.lead_us,
+                asap_stats.dispatch_us, asap_stats.dispatch_dev_us, asap_stats.nb_late, asap_stats.nb_sample );
         temperature = 0;
         if( temp_sensor != NULL )
         {
@@ -1945,17 +2553,51 @@ void thread_pktfwd( void )
         }
         printf( "##### END #####\n" );
 
+        /* publish counters of the interval and since start, and current state, for the HTTP server */
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        stats.uptime_s   = ( uint32_t ) now.tv_sec;
+        stats.interval_s = stat_interval;
+        counters_add( &stats.total, &stats.window );
+        pthread_mutex_lock( &mx_meas_up );
+        stats.state.last_rssi = meas_last_rssi;
+        stats.state.last_snr  = meas_last_snr;
+        pthread_mutex_unlock( &mx_meas_up );
+        stats.state.temperature_valid = ( temp_sensor != NULL ) && ( esp_err == ESP_OK );
+        stats.state.temperature       = temperature;
+        stats.state.jit_queue_len     = jit_queue[0].num_pkt;
+        stats.state.jit_overflow_len  = overflow_stats.num_waiting;
+        stats.state.jit_nb_deferred   = overflow_stats.nb_deferred;
+        stats.state.jit_nb_expired    = overflow_stats.nb_expired;
+        stats.state.jit_nb_preempted  = preempt_stats.nb_preempted;
+        stats.state.asap_lead_us      = asap_stats.lead_us;
+        stats.state.asap_nb_late      = asap_stats.nb_late;
+        stats.state.lbt_nb_scan       = lbt_stats.nb_scan;
+        stats.state.lbt_nb_busy       = lbt_stats.nb_busy;
+        for( i = 0; i < PKT_FWD_THREAD_NB; i++ )
+        {
+            stats.state.stack_free_min[i] =
+                ( thread_tasks[i] != NULL ) ? uxTaskGetStackHighWaterMark( thread_tasks[i] ) : 0;
+        }
+        stats_publish( &stats );
+
         /* generate a JSON report (will be sent to server by upstream thread) */
         pthread_mutex_lock( &mx_stat_rep );
         snprintf( status_report, STATUS_SIZE,
                   "\"stat\":{\"time\":\"%s\",\"rxnb\":%lu,\"rxok\":%lu,\"rxfw\":%lu,\"ackr\":%.1f,\"dwnb\":%lu,"
-                  "\"txnb\":%lu,\"temp\":%.0f}",
+                  "\"txnb\":%lu,\"temp\":%.0f,\"asap\":%lu,\"dcyc\":%.1f,\"devs\":{\"nb\":%lu,\"act\":%lu,"
+                  "\"lossy\":%lu}}",
                   stat_timestamp, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv,
-                  cp_nb_tx_ok, temperature );
+                  cp_nb_tx_ok, temperature, asap_stats.lead_us / 1000, airtime_stats.max_utilisation,
+                  dev_summary.nb_dev, dev_summary.nb_active, dev_summary.nb_degraded );
         report_ready = true;
         pthread_mutex_unlock( &mx_stat_rep );
     }
 
+    /* no more reconfiguration, wait for an ongoing one to finish */
+    pthread_mutex_lock( &mx_reconf );
+    __atomic_store_n( &fwd_running, false, __ATOMIC_RELEASE );
+    pthread_mutex_unlock( &mx_reconf );
+
     /* wait for upstream thread to finish (1 fetch cycle max) */
     pthread_join( thrid_up, NULL );
     pthread_cancel( thrid_down ); /* don't wait for downstream thread */
@@ -1995,5 +2637,148 @@ int launch_pkt_fwd( temperature_sensor_handle_t temperature_sensor )
         wait_on_error( LRHB_ERROR_UNKNOWN, __LINE__ );
     }
 
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void pkt_fwd_network_ready( void )
+{
+    __atomic_store_n( &net_ready, true, __ATOMIC_RELEASE );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void pkt_fwd_get_stats( pkt_fwd_stats_t* stats )
+{
+    uint32_t seq;
+
+    if( stats == NULL )
+    {
+        return;
+    }
+
+    do
+    {
+        seq = __atomic_load_n( &stats_snapshot_seq, __ATOMIC_ACQUIRE );
+        memcpy( stats, &stats_snapshot, sizeof stats_snapshot );
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    } while( ( ( seq & 1 ) != 0 ) || ( seq != __atomic_load_n( &stats_snapshot_seq, __ATOMIC_RELAXED ) ) );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int pkt_fwd_apply_config( pkt_fwd_reconf_t* reconf )
+{
+    const lgw_nvs_cfg_t*   nvs_cfg;
+    struct lgw_conf_rxrf_s rxrf_conf;
+    struct lgw_conf_rxif_s rxif_conf;
+    struct addrinfo        hints;
+    struct addrinfo*       result = NULL; /* store result of getaddrinfo */
+    char                   port[8];
+    uint32_t               count_us_start;
+    uint32_t               count_us_end;
+    int                    i;
+
+    if( reconf == NULL )
+    {
+        return -1;
+    }
+    memset( reconf, 0, sizeof *reconf );
+
+    pthread_mutex_lock( &mx_reconf );
+
+    if( __atomic_load_n( &fwd_running, __ATOMIC_ACQUIRE ) == false )
+    {
+        ESP_LOGW( TAG_PKT_FWD, "WARNING: packet forwarder not running, configuration will be applied at start\n" );
+        pthread_mutex_unlock( &mx_reconf );
+        return -1;
+    }
+
+    /* Compare the stored configuration with the one in use */
+    lgw_nvs_get_config( &nvs_cfg );
+    if( get_channel_configuration( &rxrf_conf, &rxif_conf ) != 0 )
+    {
+        pthread_mutex_unlock( &mx_reconf );
+        return -1;
+    }
+    snprintf( port, sizeof( port ), "%" PRIu16, nvs_cfg->lns_port );
+    reconf->radio_changed = ( memcmp( &rxrf_conf, &chan_rxrf_conf, sizeof rxrf_conf ) != 0 ) ||
+                            ( memcmp( &rxif_conf, &chan_rxif_conf, sizeof rxif_conf ) != 0 );
+    reconf->lns_changed = ( strcmp( nvs_cfg->lns_address, serv_addr ) != 0 ) || ( strcmp( port, serv_port_up ) != 0 );
+
+    /* Resolve the new server before changing anything, as it may take a while and fail */
+    if( reconf->lns_changed == true )
+    {
+        memset( &hints, 0, sizeof hints );
+        hints.ai_family   = AF_INET; /* WA: Forcing IPv4 as AF_UNSPEC makes connection on localhost to fail */
+        hints.ai_socktype = SOCK_DGRAM;
+
+        i = getaddrinfo( nvs_cfg->lns_address, port, &hints, &result );
+        if( i != 0 || result == NULL )
+        {
+            ESP_LOGE( TAG_PKT_FWD, "ERROR: getaddrinfo on address %s (PORT %s) returned %d\n", nvs_cfg->lns_address,
+                      port, i );
+            reconf->radio_changed = false;
+            reconf->lns_changed   = false;
+            pthread_mutex_unlock( &mx_reconf );
+            return -1;
+        }
+    }
+
+    /* Retune the receiver in place: holding the concentrator quiesces the upstream and JiT threads, and the JiT queue
+     * is kept as the concentrator counter keeps running (a downlink due meanwhile is sent late or dropped as usual) */
+    if( reconf->radio_changed == true )
+    {
+        pthread_mutex_lock( &mx_concent ); /* may have to wait for a fetch or a TX to finish */
+        lgw_get_instcnt( &count_us_start );
+        i = lgw_rx_retune( &rxrf_conf, &rxif_conf );
+        lgw_get_instcnt( &count_us_end );
+        pthread_mutex_unlock( &mx_concent );
+        reconf->downtime_us = count_us_end - count_us_start;
+        if( i != LGW_HAL_SUCCESS )
+        {
+            ESP_LOGE( TAG_PKT_FWD, "ERROR: failed to retune the concentrator, previous channel kept\n" );
+            if( result != NULL )
+            {
+                freeaddrinfo( result );
+            }
+            reconf->radio_changed = false;
+            reconf->lns_changed   = false;
+            pthread_mutex_unlock( &mx_reconf );
+            return -1;
+        }
+        memcpy( &chan_rxrf_conf, &rxrf_conf, sizeof chan_rxrf_conf );
+        memcpy( &chan_rxif_conf, &rxif_conf, sizeof chan_rxif_conf );
+        display_channel_configuration( &chan_rxrf_conf, &chan_rxif_conf );
+        ESP_LOGI( TAG_PKT_FWD, "INFO: RX channel changed to %lu Hz, receiver blind for %lu us", chan_rxrf_conf.freq_hz,
+                  reconf->downtime_us );
+    }
+
+    /* Connect the sockets to the new server, the threads keep using them */
+    if( reconf->lns_changed == true )
+    {
+        i = connect( sock_up, result->ai_addr, result->ai_addrlen );
+        if( i == 0 )
+        {
+            i = connect( sock_down, result->ai_addr, result->ai_addrlen );
+        }
+        freeaddrinfo( result );
+        if( i != 0 )
+        {
+            ESP_LOGE( TAG_PKT_FWD, "ERROR: connect returned %s\n", strerror( errno ) );
+            reconf->lns_changed = false;
+            pthread_mutex_unlock( &mx_reconf );
+            return -1;
+        }
+        snprintf( serv_addr, sizeof( serv_addr ), "%s", nvs_cfg->lns_address );
+        snprintf( serv_port_up, sizeof( serv_port_up ), "%s", port );
+        snprintf( serv_port_down, sizeof( serv_port_down ), "%s", port );
+        __atomic_store_n( &pull_now, true, __ATOMIC_RELEASE );
+        ESP_LOGI( TAG_PKT_FWD, "INFO: network server changed to %s:%s", serv_addr, serv_port_up );
+    }
+
+    pthread_mutex_unlock( &mx_reconf );
+
     return 0;
 }
\ No newline at end of file
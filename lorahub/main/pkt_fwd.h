@@ -18,6 +18,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDENCIES --------------------------------------------------------- */
 
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
 #include <driver/temperature_sensor.h>
 
 /* -------------------------------------------------------------------------- */
@@ -26,14 +29,120 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
+#define PKT_FWD_HIST_NB 8 /* Number of bins of the latency histograms, the last one has no upper bound */
+
+/* Upper bounds (included) of the histogram bins, as Prometheus "le" buckets */
+#define PKT_FWD_ACK_RTT_BOUNDS_MS { 10, 20, 50, 100, 200, 500, 1000 }
+#define PKT_FWD_TX_SLACK_BOUNDS_US { 0, 1000, 2000, 5000, 10000, 20000, 50000 }
+
+/* Threads of the packet forwarder, for stack monitoring */
+#define PKT_FWD_THREAD_NB 4
+#define PKT_FWD_THREAD_NAMES { "pktfwd", "up", "down", "jit" }
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
+/**
+@struct pkt_fwd_counters_s
+@brief Packet forwarder counters, over a statistics interval or since boot
+*/
+typedef struct pkt_fwd_counters_s
+{
+    uint32_t nb_rx_rcv;                       /* packets received */
+    uint32_t nb_rx_ok;                        /* packets received with PAYLOAD CRC OK */
+    uint32_t nb_rx_bad;                       /* packets received with PAYLOAD CRC ERROR */
+    uint32_t nb_rx_nocrc;                     /* packets received with NO PAYLOAD CRC */
+    uint32_t up_pkt_fwd;                      /* radio packets forwarded to the server */
+    uint32_t up_dgram_sent;                   /* PUSH_DATA datagrams sent */
+    uint32_t up_ack_rcv;                      /* PUSH_DATA datagrams acknowledged */
+    uint32_t dw_pull_sent;                    /* PULL_DATA datagrams sent */
+    uint32_t dw_ack_rcv;                      /* PULL_DATA datagrams acknowledged */
+    uint32_t dw_dgram_rcv;                    /* valid PULL_RESP datagrams received */
+    uint32_t nb_tx_requested;                 /* downlinks requested by the server */
+    uint32_t nb_tx_ok;                        /* downlinks emitted */
+    uint32_t nb_tx_fail;                      /* downlinks failed to be programmed */
+    uint32_t nb_tx_rejected_collision_packet; /* JiT rejection: collision with another downlink */
+    uint32_t nb_tx_rejected_collision_beacon; /* JiT rejection: collision with a beacon */
+    uint32_t nb_tx_rejected_too_late;         /* JiT rejection: too late to be programmed */
+    uint32_t nb_tx_rejected_too_early;        /* JiT rejection: too far in the future */
+    uint32_t nb_tx_rejected_duty_cycle;       /* JiT rejection: duty-cycle budget exhausted */
+    uint32_t nb_tx_rx2_fallback;              /* Class A downlinks moved to RX2 */
+    uint32_t nb_tx_preempted;                 /* accepted downlinks dropped for a higher priority one */
+    uint32_t ack_rtt_hist[PKT_FWD_HIST_NB];   /* PUSH_ACK and PULL_ACK round trip times */
+    uint32_t tx_slack_hist[PKT_FWD_HIST_NB];  /* time left before TX start once programmed, first bin is late */
+    int64_t  ack_rtt_sum_ms;                  /* sum of the round trip times counted in ack_rtt_hist */
+    int64_t  tx_slack_sum_us;                 /* sum of the times counted in tx_slack_hist, negative when late */
+} pkt_fwd_counters_t;
+
+/**
+@struct pkt_fwd_state_s
+@brief Instant values, and counters kept since boot by the HAL and the JiT queue
+*/
+typedef struct pkt_fwd_state_s
+{
+    float    last_rssi;                         /* RSSI of the last packet received, in dBm */
+    float    last_snr;                          /* SNR of the last packet received, in dB */
+    bool     temperature_valid;                 /* a temperature sensor is available */
+    float    temperature;                       /* concentrator temperature, in degrees Celsius */
+    uint32_t jit_queue_len;                     /* downlinks waiting in the JiT queue */
+    uint32_t jit_overflow_len;                  /* Class C downlinks waiting for a slot in the JiT queue */
+    uint32_t jit_nb_deferred;                   /* Class C downlinks deferred to the overflow queue */
+    uint32_t jit_nb_expired;                    /* deferred downlinks dropped as they waited for too long */
+    uint32_t jit_nb_preempted;                  /* downlinks evicted by a higher priority one */
+    uint32_t asap_lead_us;                      /* lead time given to immediate downlinks */
+    uint32_t asap_nb_late;                      /* downlinks programmed too close to their timestamp */
+    uint32_t lbt_nb_scan;                       /* Listen-Before-Talk channel scans */
+    uint32_t lbt_nb_busy;                       /* downlinks aborted because the channel was busy */
+    uint32_t stack_free_min[PKT_FWD_THREAD_NB]; /* lowest free stack space of each thread, in bytes */
+} pkt_fwd_state_t;
+
+/**
+@struct pkt_fwd_stats_s
+@brief Snapshot of the packet forwarder statistics, published at each statistics interval
+*/
+typedef struct pkt_fwd_stats_s
+{
+    uint32_t           uptime_s;   /* time of the snapshot, since boot */
+    uint32_t           interval_s; /* length of the statistics interval */
+    pkt_fwd_counters_t window;     /* counters of the last statistics interval */
+    pkt_fwd_counters_t total;      /* counters since the packet forwarder started */
+    pkt_fwd_state_t    state;      /* state at the time of the snapshot */
+} pkt_fwd_stats_t;
+
+/**
+@struct pkt_fwd_reconf_s
+@brief Outcome of a configuration applied without reboot
+*/
+typedef struct pkt_fwd_reconf_s
+{
+    bool     radio_changed; /* the receiver has been retuned to a new channel */
+    bool     lns_changed;   /* the sockets have been connected to a new network server */
+    uint32_t downtime_us;   /* time the receiver was blind while being retuned */
+} pkt_fwd_reconf_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
 int launch_pkt_fwd( temperature_sensor_handle_t temperature_sensor );
 
+/**
+@brief Let the packet forwarder connect to the server, the concentrator is started before the network is ready
+*/
+void pkt_fwd_network_ready( void );
+
+/**
+@brief Get the last statistics snapshot published by the packet forwarder, without blocking it
+@param stats[out] copy of the snapshot, all zeros until the first statistics interval elapsed
+*/
+void pkt_fwd_get_stats( pkt_fwd_stats_t* stats );
+
+/**
+@brief Apply the stored configuration (RX channel, network server) to the running packet forwarder, without reboot
+@param reconf[out] what has been changed, and the measured receiver downtime
+@return 0 on success, -1 if the packet forwarder is not running or if the configuration could not be applied
+*/
+int pkt_fwd_apply_config( pkt_fwd_reconf_t* reconf );
+
 #endif  // _PKTFWD_H
 
 /* --- EOF ------------------------------------------------------------------ */
\ No newline at end of file
@@ -0,0 +1,230 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Lock-free ring of packet events (rxpk, txpk, TX_ACK) for live monitoring
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <stdio.h>   /* snprintf */
+#include <string.h>  /* memcpy */
+
+#include "pkt_stream.h"
+#include "jitqueue.h"
+#include "lorahub_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+/* Sequence of a slot: odd while the event at position pos is being written, even once it is complete */
+#define SEQ_BUSY( pos ) ( 2 * ( pos ) + 1 )
+#define SEQ_DONE( pos ) ( 2 * ( pos ) + 2 )
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#if( PKT_STREAM_RING_SIZE & ( PKT_STREAM_RING_SIZE - 1 ) ) != 0
+#error "PKT_STREAM_RING_SIZE must be a power of 2"
+#endif
+
+typedef struct
+{
+    uint32_t           seq;
+    pkt_stream_event_t event;
+} pkt_stream_slot_t;
+
+/* Errors and warnings reported in TX_ACK, named as in the datagram sent to the server */
+static const char* jit_error_names[] = {
+    [JIT_ERROR_TOO_LATE]         = "TOO_LATE",
+    [JIT_ERROR_TOO_EARLY]        = "TOO_EARLY",
+    [JIT_ERROR_FULL]             = "COLLISION_PACKET",
+    [JIT_ERROR_COLLISION_PACKET] = "COLLISION_PACKET",
+    [JIT_ERROR_COLLISION_BEACON] = "COLLISION_BEACON",
+    [JIT_ERROR_TX_FREQ]          = "TX_FREQ",
+    [JIT_ERROR_TX_POWER]         = "TX_POWER",
+    [JIT_ERROR_GPS_UNLOCKED]     = "GPS_UNLOCKED",
+    [JIT_ERROR_RX2_FALLBACK]     = "RX2_FALLBACK",
+    [JIT_ERROR_DUTY_CYCLE]       = "DUTY_CYCLE",
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static pkt_stream_slot_t ring[PKT_STREAM_RING_SIZE];
+static uint32_t          ring_head = 0; /* position of the next event to be pushed */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static unsigned bandwidth_khz( uint8_t bandwidth )
+{
+    switch( bandwidth )
+    {
+    case BW_125KHZ:
+        return 125;
+    case BW_250KHZ:
+        return 250;
+    case BW_500KHZ:
+        return 500;
+    case BW_200KHZ:
+        return 203;
+    case BW_400KHZ:
+        return 406;
+    case BW_800KHZ:
+        return 812;
+    default:
+        return 0;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int crc_status( uint8_t status )
+{
+    switch( status )
+    {
+    case STAT_CRC_OK:
+        return 1;
+    case STAT_CRC_BAD:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void pkt_stream_push( const pkt_stream_event_t* event )
+{
+    pkt_stream_slot_t* slot;
+    uint32_t           pos;
+
+    /* Each writer owns its position, readers detect a slot being written or overwritten from its sequence */
+    pos  = __atomic_fetch_add( &ring_head, 1, __ATOMIC_RELAXED );
+    slot = &ring[pos & ( PKT_STREAM_RING_SIZE - 1 )];
+
+    __atomic_store_n( &slot->seq, SEQ_BUSY( pos ), __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    memcpy( &slot->event, event, sizeof slot->event );
+    __atomic_store_n( &slot->seq, SEQ_DONE( pos ), __ATOMIC_RELEASE );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t pkt_stream_get_head( void )
+{
+    return __atomic_load_n( &ring_head, __ATOMIC_ACQUIRE );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool pkt_stream_read( uint32_t* cursor, pkt_stream_event_t* event, uint32_t* nb_dropped )
+{
+    pkt_stream_slot_t* slot;
+    uint32_t           head;
+    uint32_t           seq;
+
+    while( true )
+    {
+        head = __atomic_load_n( &ring_head, __ATOMIC_ACQUIRE );
+        if( *cursor == head )
+        {
+            return false;
+        }
+
+        /* The reader is too slow, skip the events which have already been overwritten */
+        if( ( head - *cursor ) > PKT_STREAM_RING_SIZE )
+        {
+            *nb_dropped += ( head - *cursor ) - PKT_STREAM_RING_SIZE;
+            *cursor = head - PKT_STREAM_RING_SIZE;
+        }
+
+        slot = &ring[*cursor & ( PKT_STREAM_RING_SIZE - 1 )];
+        seq  = __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE );
+        if( seq != SEQ_DONE( *cursor ) )
+        {
+            if( ( int32_t ) ( seq - SEQ_DONE( *cursor ) ) < 0 )
+            {
+                /* The event is still being written, try again later */
+                return false;
+            }
+            /* Overwritten by a writer which wrapped around the ring */
+            *nb_dropped += 1;
+            *cursor += 1;
+            continue;
+        }
+
+        memcpy( event, &slot->event, sizeof *event );
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        if( __atomic_load_n( &slot->seq, __ATOMIC_RELAXED ) != seq )
+        {
+            /* Overwritten while it was copied */
+            *nb_dropped += 1;
+            *cursor += 1;
+            continue;
+        }
+
+        *cursor += 1;
+        return true;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int pkt_stream_format( const pkt_stream_event_t* event, char* dest, size_t size )
+{
+    const char* name;
+    int         snr_abs;
+
+    switch( event->type )
+    {
+    case PKT_STREAM_RXPK:
+        snr_abs = ( event->snr_x10 < 0 ) ? -event->snr_x10 : event->snr_x10;
+        return snprintf( dest, size,
+                         "{\"type\":\"rxpk\",\"tmst\":%lu,\"freq\":%lu.%06lu,\"datr\":\"SF%uBW%u\",\"rssi\":%d,"
+                         "\"lsnr\":%s%d.%d,\"size\":%u,\"stat\":%d,\"devaddr\":\"%08lX\",\"fcnt\":%u}",
+                         event->count_us, event->freq_hz / 1000000, event->freq_hz % 1000000, event->datarate,
+                         bandwidth_khz( event->bandwidth ), event->rssi, ( event->snr_x10 < 0 ) ? "-" : "",
+                         snr_abs / 10, snr_abs % 10, event->size, crc_status( event->status ), event->devaddr,
+                         event->fcnt );
+    case PKT_STREAM_TXPK:
+        return snprintf( dest, size,
+                         "{\"type\":\"txpk\",\"imme\":%s,\"tmst\":%lu,\"freq\":%lu.%06lu,\"datr\":\"SF%uBW%u\","
+                         "\"powe\":%d,\"size\":%u}",
+                         ( event->status == IMMEDIATE ) ? "true" : "false", event->count_us,
+                         event->freq_hz / 1000000, event->freq_hz % 1000000, event->datarate,
+                         bandwidth_khz( event->bandwidth ), event->rf_power, event->size );
+    case PKT_STREAM_TX_ACK:
+        if( event->status == JIT_ERROR_OK )
+        {
+            return snprintf( dest, size, "{\"type\":\"tx_ack\",\"tmst\":%lu}", event->count_us );
+        }
+        name = NULL;
+        if( event->status < ( sizeof jit_error_names / sizeof jit_error_names[0] ) )
+        {
+            name = jit_error_names[event->status];
+        }
+        return snprintf( dest, size, "{\"type\":\"tx_ack\",\"tmst\":%lu,\"%s\":\"%s\",\"value\":%ld}",
+                         event->count_us,
+                         ( ( event->status == JIT_ERROR_TX_POWER ) || ( event->status == JIT_ERROR_RX2_FALLBACK ) )
+                             ? "warn"
+                             : "error",
+                         ( name != NULL ) ? name : "UNKNOWN", event->value );
+    default:
+        return snprintf( dest, size, "{\"type\":\"unknown\"}" );
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
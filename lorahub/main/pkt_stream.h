@@ -0,0 +1,96 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Lock-free ring of packet events (rxpk, txpk, TX_ACK) for live monitoring
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_PKT_STREAM_H
+#define _LORAHUB_PKT_STREAM_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <stddef.h>  /* size_t */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define PKT_STREAM_RING_SIZE 64 /* Number of events kept for the readers, must be a power of 2 */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef enum
+{
+    PKT_STREAM_RXPK,  /* packet received by the concentrator */
+    PKT_STREAM_TXPK,  /* downlink request received from the server */
+    PKT_STREAM_TX_ACK /* result of the downlink request, as sent to the server */
+} pkt_stream_type_t;
+
+/**
+@struct pkt_stream_event_s
+@brief Compact description of a packet, fields not relevant to the event type are left to 0
+*/
+typedef struct pkt_stream_event_s
+{
+    uint32_t count_us;  /* concentrator timestamp of the packet */
+    uint32_t freq_hz;   /* RF frequency */
+    uint32_t devaddr;   /* rxpk: DevAddr of the frame, 0 if too short */
+    int32_t  value;     /* tx_ack: detail of the warning (actual TX power, RX2 frequency) */
+    int16_t  rssi;      /* rxpk: channel RSSI, in dBm */
+    int16_t  snr_x10;   /* rxpk: SNR, in tenths of dB */
+    uint16_t fcnt;      /* rxpk: frame counter */
+    uint16_t size;      /* payload size, in bytes */
+    uint8_t  type;      /* pkt_stream_type_t */
+    uint8_t  datarate;  /* DR_LORA_SFx */
+    uint8_t  bandwidth; /* BW_xxx */
+    uint8_t  status;    /* rxpk: STAT_xxx, txpk: tx_mode, tx_ack: enum jit_error_e */
+    int8_t   rf_power;  /* txpk: requested TX power, in dBm */
+} pkt_stream_event_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Add an event to the ring, overwriting the oldest one (thread safe, never blocks)
+@param event event to be copied in the ring
+*/
+void pkt_stream_push( const pkt_stream_event_t* event );
+
+/**
+@brief Get the position of the next event to be pushed, for a reader only interested in new events
+@return cursor to be given to pkt_stream_read()
+*/
+uint32_t pkt_stream_get_head( void );
+
+/**
+@brief Read the event at the position of a reader and move the reader forward (thread safe, never blocks)
+@param cursor[in,out] position of the reader in the stream
+@param event[out] event read
+@param nb_dropped[in,out] incremented by the number of events overwritten before they could be read
+@return true if an event has been read, false if the reader has caught up with the writers
+*/
+bool pkt_stream_read( uint32_t* cursor, pkt_stream_event_t* event, uint32_t* nb_dropped );
+
+/**
+@brief Format an event as a JSON object
+@param event event to be formatted
+@param dest destination string
+@param size size of the destination string
+@return number of characters which would have been written, as snprintf()
+*/
+int pkt_stream_format( const pkt_stream_event_t* event, char* dest, size_t size );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,145 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    LoRaWAN regional parameters used by the hub for downlink RX2 fallback
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stddef.h> /* NULL */
+
+#include "sdkconfig.h"
+
+#include "region.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/* Default values from LoRaWAN Regional Parameters RP002-1.0.4, PHYPayload = MHDR + MACPayload (M) + MIC */
+static const region_params_t region_table[] = {
+    { .id            = REGION_EU868,
+      .name          = "EU868",
+      .rx1_delay_us  = 1000000,
+      .join_delay_us = 5000000,
+      .rx2_delay_us  = 2000000,
+      .rx2_freq_hz   = 869525000,
+      .rx2_datarate  = DR_LORA_SF12,
+      .rx2_bandwidth = BW_125KHZ,
+      .rx2_max_size  = 59 + 5 },
+    { .id            = REGION_US915,
+      .name          = "US915",
+      .rx1_delay_us  = 1000000,
+      .join_delay_us = 5000000,
+      .rx2_delay_us  = 2000000,
+      .rx2_freq_hz   = 923300000,
+      .rx2_datarate  = DR_LORA_SF12,
+      .rx2_bandwidth = BW_500KHZ,
+      .rx2_max_size  = 61 + 5 },
+    { .id            = REGION_AS923,
+      .name          = "AS923",
+      .rx1_delay_us  = 1000000,
+      .join_delay_us = 5000000,
+      .rx2_delay_us  = 2000000,
+      .rx2_freq_hz   = 923200000,
+      .rx2_datarate  = DR_LORA_SF10,
+      .rx2_bandwidth = BW_125KHZ,
+      .rx2_max_size  = 59 + 5 },
+    { .id            = REGION_CN470,
+      .name          = "CN470",
+      .rx1_delay_us  = 1000000,
+      .join_delay_us = 5000000,
+      .rx2_delay_us  = 2000000,
+      .rx2_freq_hz   = 505300000,
+      .rx2_datarate  = DR_LORA_SF12,
+      .rx2_bandwidth = BW_125KHZ,
+      .rx2_max_size  = 59 + 5 },
+};
+
+#if defined( CONFIG_DOWNLINK_RX2_FALLBACK_EU868 )
+#define REGION_RX2_FALLBACK REGION_EU868
+#elif defined( CONFIG_DOWNLINK_RX2_FALLBACK_US915 )
+#define REGION_RX2_FALLBACK REGION_US915
+#elif defined( CONFIG_DOWNLINK_RX2_FALLBACK_AS923 )
+#define REGION_RX2_FALLBACK REGION_AS923
+#elif defined( CONFIG_DOWNLINK_RX2_FALLBACK_CN470 )
+#define REGION_RX2_FALLBACK REGION_CN470
+#else
+#define REGION_RX2_FALLBACK REGION_NONE
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+const region_params_t* region_get_rx2_fallback( void )
+{
+    size_t i;
+
+    for( i = 0; i < ( sizeof region_table / sizeof region_table[0] ); i++ )
+    {
+        if( region_table[i].id == REGION_RX2_FALLBACK )
+        {
+            return &region_table[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool region_is_rx1( const region_params_t* region, uint32_t uplink_count_us, uint32_t count_us )
+{
+    uint32_t delay_us = count_us - uplink_count_us; /* the counter may have wrapped in between */
+
+    if( region == NULL )
+    {
+        return false;
+    }
+
+    return ( delay_us == region->rx1_delay_us ) || ( delay_us == region->join_delay_us );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool region_move_to_rx2( const region_params_t* region, struct lgw_pkt_tx_s* pkt )
+{
+    if( ( region == NULL ) || ( pkt == NULL ) )
+    {
+        return false;
+    }
+
+    /* Only LoRa downlinks can be moved, and not if the server already targeted RX2 */
+    if( pkt->modulation != MOD_LORA )
+    {
+        return false;
+    }
+    if( ( pkt->freq_hz == region->rx2_freq_hz ) && ( pkt->datarate == region->rx2_datarate ) &&
+        ( pkt->bandwidth == region->rx2_bandwidth ) )
+    {
+        return false;
+    }
+
+    /* RX2 data rate is the most robust of the region, the payload may not fit */
+    if( pkt->size > region->rx2_max_size )
+    {
+        return false;
+    }
+
+    pkt->count_us += region->rx2_delay_us - region->rx1_delay_us;
+    pkt->freq_hz   = region->rx2_freq_hz;
+    pkt->datarate  = region->rx2_datarate;
+    pkt->bandwidth = region->rx2_bandwidth;
+
+    return true;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
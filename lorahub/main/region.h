@@ -0,0 +1,83 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    LoRaWAN regional parameters used by the hub for downlink RX2 fallback
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_REGION_H
+#define _LORAHUB_REGION_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+#include "lorahub_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef enum
+{
+    REGION_NONE,
+    REGION_EU868,
+    REGION_US915,
+    REGION_AS923,
+    REGION_CN470
+} region_id_t;
+
+/**
+@struct region_params_s
+@brief Regional parameters needed to move a Class A downlink from RX1 to RX2
+*/
+typedef struct region_params_s
+{
+    region_id_t id;
+    const char* name;
+    uint32_t    rx1_delay_us;  /* RECEIVE_DELAY1, RX1 offset from the end of the uplink */
+    uint32_t    join_delay_us; /* JOIN_ACCEPT_DELAY1, RX1 offset of a join-accept from the end of the join-request */
+    uint32_t    rx2_delay_us;  /* RECEIVE_DELAY2, RX2 offset from the end of the uplink */
+    uint32_t    rx2_freq_hz;   /* default RX2 frequency */
+    uint8_t     rx2_datarate;  /* default RX2 spreading factor */
+    uint8_t     rx2_bandwidth; /* default RX2 bandwidth */
+    uint16_t    rx2_max_size;  /* max PHYPayload size at the RX2 data rate, in bytes */
+} region_params_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Get the parameters of the region selected for RX2 fallback
+@return pointer to the regional parameters, NULL if RX2 fallback is disabled
+*/
+const region_params_t* region_get_rx2_fallback( void );
+
+/**
+@brief Check if a downlink timestamp is the RX1 window of an uplink
+@param region regional parameters
+@param uplink_count_us timestamp of the end of the uplink
+@param count_us timestamp of the downlink
+@return true if the downlink targets the RX1 window of the uplink (data or join-accept), false otherwise
+*/
+bool region_is_rx1( const region_params_t* region, uint32_t uplink_count_us, uint32_t count_us );
+
+/**
+@brief Move a Class A downlink from its RX1 window to the RX2 window of the region
+@param region regional parameters
+@param pkt packet to be modified (timestamp, frequency, datarate, bandwidth)
+@return true if the packet has been moved, false if it cannot be sent in RX2 (already targeting RX2, too big)
+*/
+bool region_move_to_rx2( const region_params_t* region, struct lgw_pkt_tx_s* pkt );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,324 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Filtering of the uplinks by DevAddr prefix and join requests by JoinEUI range
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <stdio.h>   /* snprintf */
+#include <stdlib.h>  /* strtoull */
+#include <string.h>  /* memchr, strchr, strspn, strcspn */
+
+#include <esp_log.h>
+
+#include "uplink_filter.h"
+#include "lorawan.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define RULE_SEPARATORS " ,;"
+
+/* A DevAddr prefix is the range of the addresses it covers, so that both lists are matched the same way */
+typedef struct
+{
+    uint64_t first;
+    uint64_t last;
+    bool     allow;
+    uint32_t nb_match;
+    char     text[UPLINK_FILTER_RULE_STR_MAX_SIZE];
+} filter_rule_t;
+
+typedef struct
+{
+    filter_rule_t rules[UPLINK_FILTER_RULE_NB_MAX]; /* sorted from the narrowest range, first match applies */
+    int           nb_rule;
+    bool          default_allow; /* action when no rule matches: deny if there is at least one allow rule */
+    uint32_t      nb_default;    /* frames which matched no rule */
+} filter_list_t;
+
+static const char* TAG_FILTER = "uplink_filter";
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* rules are written by uplink_filter_init() only, before the upstream thread is started */
+static filter_list_t lists[UPLINK_FILTER_NB];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Parse a hexadecimal number of 1 to nb_digits_max digits, ending at end */
+static int parse_hex( const char* str, const char* end, int nb_digits_max, uint64_t* value )
+{
+    const char* p;
+
+    if( ( end <= str ) || ( ( end - str ) > nb_digits_max ) )
+    {
+        return -1;
+    }
+    for( p = str; p < end; p++ )
+    {
+        if( strchr( "0123456789abcdefABCDEF", *p ) == NULL )
+        {
+            return -1;
+        }
+    }
+    *value = strtoull( str, NULL, 16 );
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* DevAddr prefix: hex address/prefix length */
+static int parse_devaddr_rule( const char* str, const char* end, filter_rule_t* rule )
+{
+    const char* slash;
+    const char* p;
+    uint64_t    addr;
+    uint32_t    len = 0;
+    uint32_t    mask;
+
+    slash = memchr( str, '/', end - str );
+    if( ( slash == NULL ) || ( parse_hex( str, slash, 8, &addr ) != 0 ) || ( ( slash + 1 ) == end ) )
+    {
+        return -1;
+    }
+    for( p = slash + 1; p < end; p++ )
+    {
+        if( ( *p < '0' ) || ( *p > '9' ) || ( len > 32 ) )
+        {
+            return -1;
+        }
+        len = ( len * 10 ) + ( *p - '0' );
+    }
+    if( len > 32 )
+    {
+        return -1;
+    }
+
+    mask        = ( len == 0 ) ? 0 : ( 0xFFFFFFFFUL << ( 32 - len ) );
+    rule->first = ( uint32_t ) addr & mask;
+    rule->last  = rule->first | ( uint32_t ) ~mask;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* JoinEUI range: hex first-last, or a single hex JoinEUI */
+static int parse_joineui_rule( const char* str, const char* end, filter_rule_t* rule )
+{
+    const char* dash;
+
+    dash = memchr( str, '-', end - str );
+    if( dash == NULL )
+    {
+        if( parse_hex( str, end, 16, &rule->first ) != 0 )
+        {
+            return -1;
+        }
+        rule->last = rule->first;
+        return 0;
+    }
+
+    if( ( parse_hex( str, dash, 16, &rule->first ) != 0 ) || ( parse_hex( dash + 1, end, 16, &rule->last ) != 0 ) ||
+        ( rule->first > rule->last ) )
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Compile a list of rules, sorted from the narrowest range so that the longest prefix applies */
+static int parse_list( uplink_filter_list_t id, const char* str )
+{
+    filter_list_t* list = &lists[id];
+    filter_rule_t  rule;
+    const char*    start; /* rule without its deny mark */
+    size_t         len;
+    int            err = 0;
+    int            i;
+
+    memset( list, 0, sizeof *list );
+    list->default_allow = true;
+    if( str == NULL )
+    {
+        return 0;
+    }
+
+    while( true )
+    {
+        str += strspn( str, RULE_SEPARATORS );
+        len = strcspn( str, RULE_SEPARATORS );
+        if( len == 0 )
+        {
+            break;
+        }
+
+        memset( &rule, 0, sizeof rule );
+        rule.allow = ( str[0] != '!' );
+        start      = ( rule.allow == true ) ? str : ( str + 1 );
+        if( ( len >= sizeof rule.text ) || ( list->nb_rule >= UPLINK_FILTER_RULE_NB_MAX ) ||
+            ( ( id == UPLINK_FILTER_DEVADDR ) && ( parse_devaddr_rule( start, str + len, &rule ) != 0 ) ) ||
+            ( ( id == UPLINK_FILTER_JOINEUI ) && ( parse_joineui_rule( start, str + len, &rule ) != 0 ) ) )
+        {
+            ESP_LOGE( TAG_FILTER, "ERROR: invalid %s filter rule \"%.*s\" ignored",
+                      ( id == UPLINK_FILTER_DEVADDR ) ? "DevAddr" : "JoinEUI", ( int ) len, str );
+            err = -1;
+            str += len;
+            continue;
+        }
+        snprintf( rule.text, sizeof rule.text, "%.*s", ( int ) len, str );
+
+        /* insert the rule after the narrower or equal ones */
+        for( i = list->nb_rule; ( i > 0 ) && ( ( list->rules[i - 1].last - list->rules[i - 1].first ) >
+                                               ( rule.last - rule.first ) );
+             i-- )
+        {
+            list->rules[i] = list->rules[i - 1];
+        }
+        list->rules[i] = rule;
+        list->nb_rule += 1;
+        if( rule.allow == true )
+        {
+            list->default_allow = false;
+        }
+        str += len;
+    }
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool list_accept( filter_list_t* list, uint64_t value )
+{
+    filter_rule_t* rule;
+    int            i;
+
+    for( i = 0; i < list->nb_rule; i++ )
+    {
+        rule = &list->rules[i];
+        if( ( value >= rule->first ) && ( value <= rule->last ) )
+        {
+            __atomic_fetch_add( &rule->nb_match, 1, __ATOMIC_RELAXED );
+            return rule->allow;
+        }
+    }
+
+    if( list->nb_rule > 0 )
+    {
+        __atomic_fetch_add( &list->nb_default, 1, __ATOMIC_RELAXED );
+    }
+    return list->default_allow;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int uplink_filter_init( const char* devaddr_rules, const char* joineui_rules )
+{
+    int err = 0;
+    int i;
+    int j;
+
+    err |= parse_list( UPLINK_FILTER_DEVADDR, devaddr_rules );
+    err |= parse_list( UPLINK_FILTER_JOINEUI, joineui_rules );
+
+    for( i = 0; i < UPLINK_FILTER_NB; i++ )
+    {
+        for( j = 0; j < lists[i].nb_rule; j++ )
+        {
+            ESP_LOGI( TAG_FILTER, "INFO: %s filter rule %s", ( i == UPLINK_FILTER_DEVADDR ) ? "DevAddr" : "JoinEUI",
+                      lists[i].rules[j].text );
+        }
+        if( lists[i].nb_rule > 0 )
+        {
+            ESP_LOGI( TAG_FILTER, "INFO: %s not matching any rule are %s",
+                      ( i == UPLINK_FILTER_DEVADDR ) ? "data uplinks" : "join requests",
+                      ( lists[i].default_allow == true ) ? "forwarded" : "dropped" );
+        }
+    }
+
+    return ( err != 0 ) ? -1 : 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool uplink_filter_accept( const uint8_t* payload, uint16_t size )
+{
+    if( size == 0 )
+    {
+        return true;
+    }
+
+    switch( lorawan_get_mtype( payload ) )
+    {
+    case LORAWAN_MTYPE_UNCONF_DATA_UP:
+    case LORAWAN_MTYPE_CONF_DATA_UP:
+        if( ( lorawan_is_data_up( payload, size ) == false ) || ( lists[UPLINK_FILTER_DEVADDR].nb_rule == 0 ) )
+        {
+            return true;
+        }
+        return list_accept( &lists[UPLINK_FILTER_DEVADDR], lorawan_get_devaddr( payload ) );
+    case LORAWAN_MTYPE_JOIN_REQUEST:
+        if( ( size != LORAWAN_JOIN_REQUEST_SIZE ) || ( lists[UPLINK_FILTER_JOINEUI].nb_rule == 0 ) )
+        {
+            return true;
+        }
+        return list_accept( &lists[UPLINK_FILTER_JOINEUI], lorawan_get_joineui( payload ) );
+    default:
+        /* rejoin requests, proprietary frames are not filtered */
+        return true;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int uplink_filter_get_stats( uplink_filter_rule_stats_t* stats, int nb_max )
+{
+    int nb = 0;
+    int i;
+    int j;
+
+    for( i = 0; i < UPLINK_FILTER_NB; i++ )
+    {
+        for( j = 0; ( j < lists[i].nb_rule ) && ( nb < nb_max ); j++ )
+        {
+            stats[nb].list     = i;
+            stats[nb].allow    = lists[i].rules[j].allow;
+            stats[nb].nb_match = __atomic_load_n( &lists[i].rules[j].nb_match, __ATOMIC_RELAXED );
+            snprintf( stats[nb].rule, sizeof stats[nb].rule, "%s", lists[i].rules[j].text );
+            nb += 1;
+        }
+        if( ( lists[i].nb_rule > 0 ) && ( nb < nb_max ) )
+        {
+            stats[nb].list     = i;
+            stats[nb].allow    = lists[i].default_allow;
+            stats[nb].nb_match = __atomic_load_n( &lists[i].nb_default, __ATOMIC_RELAXED );
+            snprintf( stats[nb].rule, sizeof stats[nb].rule, "default" );
+            nb += 1;
+        }
+    }
+
+    return nb;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
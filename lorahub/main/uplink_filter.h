@@ -0,0 +1,82 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Filtering of the uplinks by DevAddr prefix and join requests by JoinEUI range
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAHUB_UPLINK_FILTER_H
+#define _LORAHUB_UPLINK_FILTER_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define UPLINK_FILTER_RULE_NB_MAX 16 /* Number of rules of each list (DevAddr, JoinEUI) */
+#define UPLINK_FILTER_RULE_STR_MAX_SIZE 36 /* "!" + 2 x 16 hex digits + separator + null */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef enum
+{
+    UPLINK_FILTER_DEVADDR, /* data uplinks, by DevAddr prefix */
+    UPLINK_FILTER_JOINEUI, /* join requests, by JoinEUI range */
+    UPLINK_FILTER_NB
+} uplink_filter_list_t;
+
+/**
+@struct uplink_filter_rule_stats_s
+@brief Frames which matched a rule
+*/
+typedef struct uplink_filter_rule_stats_s
+{
+    uint8_t  list;                                  /* uplink_filter_list_t */
+    bool     allow;                                 /* matching frames are forwarded */
+    char     rule[UPLINK_FILTER_RULE_STR_MAX_SIZE]; /* rule as configured, "default" when no rule matched */
+    uint32_t nb_match;                              /* frames which matched the rule, since boot */
+} uplink_filter_rule_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Compile the filter rules, to be called before any packet is filtered
+@param devaddr_rules space separated DevAddr prefixes (hex address/length), "!" first to deny, for example
+"26000000/7 !260B0000/16"
+@param joineui_rules space separated JoinEUI ranges (hex first-last), "!" first to deny
+@return 0 if all rules are valid, -1 otherwise (invalid rules are ignored)
+*/
+int uplink_filter_init( const char* devaddr_rules, const char* joineui_rules );
+
+/**
+@brief Check if a frame received with a valid CRC has to be forwarded (never blocks)
+@param payload PHYPayload of the frame
+@param size size of the PHYPayload
+@return true if the frame is forwarded, false if it is filtered out
+*/
+bool uplink_filter_accept( const uint8_t* payload, uint16_t size );
+
+/**
+@brief Get the number of frames which matched each rule (thread safe)
+@param stats[out] rules of both lists, with the frames handled by the default action
+@param nb_max number of rules which can be copied
+@return number of rules copied
+*/
+int uplink_filter_get_stats( uplink_filter_rule_stats_t* stats, int nb_max );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
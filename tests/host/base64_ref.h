@@ -0,0 +1,38 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Former base64 encoding & decoding library, character by character, reference of test_base64
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _BASE64_REF_H
+#define _BASE64_REF_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h> /* C99 types */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/* Same API as base64.h, the decoding exits on a character out of the base64 alphabet */
+
+int ref_bin_to_b64_nopad( const uint8_t* in, int size, char* out, int max_len );
+
+int ref_b64_to_bin_nopad( const char* in, int size, uint8_t* out, int max_len );
+
+int ref_bin_to_b64( const uint8_t* in, int size, char* out, int max_len );
+
+int ref_b64_to_bin( const char* in, int size, uint8_t* out, int max_len );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,38 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Host replacement of the ESP-IDF logging macros, for the hub code built by the host tests
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _HOST_ESP_LOG_H
+#define _HOST_ESP_LOG_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdio.h> /* printf */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC MACROS -------------------------------------------------------- */
+
+/* errors and warnings are printed, the messages are already ended by a newline */
+#define ESP_LOGE( tag, fmt, ... ) printf( "E %s: " fmt, tag, ##__VA_ARGS__ )
+#define ESP_LOGW( tag, fmt, ... ) printf( "W %s: " fmt, tag, ##__VA_ARGS__ )
+#define ESP_LOGI( tag, fmt, ... ) \
+    do                            \
+    {                             \
+    } while( 0 )
+#define ESP_LOGD( tag, fmt, ... ) ESP_LOGI( tag, fmt, ##__VA_ARGS__ )
+#define ESP_LOGV( tag, fmt, ... ) ESP_LOGI( tag, fmt, ##__VA_ARGS__ )
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,232 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Host test and benchmark of the table-driven base64 codec, against the former character by character one
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <stdio.h>   /* printf */
+#include <stdlib.h>  /* rand, srand */
+#include <string.h>  /* memcmp, strcmp, strlen */
+#include <time.h>    /* clock_gettime */
+
+#include "base64.h"
+#include "base64_ref.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define PAYLOAD_SIZE_MAX 255
+#define B64_LEN_MAX 344 /* 4 * ceil(255 / 3) + null character */
+
+#define NB_RANDOM 20000
+#define BENCH_NB_BYTES 20000000 /* bytes encoded and decoded by each codec for each payload size */
+
+static const int bench_sizes[] = { 1, 12, 51, 115, 222, 255 };
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int nb_error = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+#define CHECK( cond )                                                         \
+    do                                                                        \
+    {                                                                         \
+        if( !( cond ) )                                                       \
+        {                                                                     \
+            printf( "FAIL: %s:%d: %s\n", __FUNCTION__, __LINE__, #cond );     \
+            nb_error += 1;                                                    \
+        }                                                                     \
+    } while( 0 )
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int64_t get_time_ns( void )
+{
+    struct timespec t;
+
+    clock_gettime( CLOCK_MONOTONIC, &t );
+
+    return ( ( int64_t ) t.tv_sec * 1000000000 ) + t.tv_nsec;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Same output as the former codec for random payloads, padded or not, and for every truncated output buffer */
+static int check_random( void )
+{
+    uint8_t payload[PAYLOAD_SIZE_MAX];
+    uint8_t bin[PAYLOAD_SIZE_MAX];
+    uint8_t bin_ref[PAYLOAD_SIZE_MAX];
+    char    b64[B64_LEN_MAX];
+    char    b64_ref[B64_LEN_MAX];
+    int     size;
+    int     len;
+    int     len_ref;
+    int     it;
+    int     i;
+
+    srand( 1 );
+    for( it = 0; it < NB_RANDOM; it++ )
+    {
+        size = rand( ) % ( PAYLOAD_SIZE_MAX + 1 );
+        for( i = 0; i < size; i++ )
+        {
+            payload[i] = ( uint8_t ) rand( );
+        }
+
+        len     = bin_to_b64( payload, size, b64, sizeof b64 );
+        len_ref = ref_bin_to_b64( payload, size, b64_ref, sizeof b64_ref );
+        CHECK( ( len == len_ref ) && ( strcmp( b64, b64_ref ) == 0 ) );
+        CHECK( b64_to_bin( b64, len, bin, sizeof bin ) == size );
+        CHECK( ref_b64_to_bin( b64_ref, len_ref, bin_ref, sizeof bin_ref ) == size );
+        CHECK( ( memcmp( bin, payload, size ) == 0 ) && ( memcmp( bin_ref, payload, size ) == 0 ) );
+
+        len     = bin_to_b64_nopad( payload, size, b64, sizeof b64 );
+        len_ref = ref_bin_to_b64_nopad( payload, size, b64_ref, sizeof b64_ref );
+        CHECK( ( len == len_ref ) && ( strcmp( b64, b64_ref ) == 0 ) );
+
+        /* every prefix of the unpadded string, with an output buffer one byte too short or just right */
+        for( i = 0; i <= len; i++ )
+        {
+            int max_len = ( ( 3 * i ) / 4 ) - 1;
+
+            if( i > 0 )
+            {
+                CHECK( b64_to_bin_nopad( b64, i, bin, max_len ) ==
+                       ref_b64_to_bin_nopad( b64_ref, i, bin_ref, max_len ) );
+            }
+            max_len += 1;
+            CHECK( b64_to_bin_nopad( b64, i, bin, max_len ) ==
+                   ref_b64_to_bin_nopad( b64_ref, i, bin_ref, max_len ) );
+            CHECK( memcmp( bin, bin_ref, ( max_len > 0 ) ? max_len : 0 ) == 0 );
+        }
+
+        /* output string one character too short */
+        if( size > 0 )
+        {
+            CHECK( bin_to_b64_nopad( payload, size, b64, len ) ==
+                   ref_bin_to_b64_nopad( payload, size, b64_ref, len ) );
+        }
+    }
+
+    return NB_RANDOM;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* The former codec exited on invalid characters, and returned 0 for an empty input whatever the output buffer */
+static void check_invalid( void )
+{
+    uint8_t bin[PAYLOAD_SIZE_MAX];
+    char    b64[4] = "xyz";
+
+    CHECK( b64_to_bin( "AB#D", 4, bin, sizeof bin ) == -1 );
+    CHECK( b64_to_bin( "AB\xC3\xA9", 4, bin, sizeof bin ) == -1 );
+    CHECK( b64_to_bin( "ABC=D===", 8, bin, sizeof bin ) == -1 );
+    CHECK( b64_to_bin( "A", 1, bin, sizeof bin ) == -1 );
+    CHECK( b64_to_bin( "AAAA", 4, bin, 2 ) == -1 );
+    CHECK( b64_to_bin( NULL, 4, bin, sizeof bin ) == -1 );
+    CHECK( bin_to_b64( bin, -1, ( char* ) bin, sizeof bin ) == -1 );
+    CHECK( b64_to_bin( "QUJD", 4, bin, sizeof bin ) == 3 );
+
+    CHECK( b64_to_bin_nopad( "", 0, bin, -1 ) == -1 );
+    CHECK( b64_to_bin_nopad( "", 0, bin, 0 ) == 0 );
+    CHECK( ( bin_to_b64_nopad( bin, 0, b64, 0 ) == -1 ) && ( b64[0] == 'x' ) );
+    CHECK( ( bin_to_b64_nopad( bin, 0, b64, 1 ) == 0 ) && ( b64[0] == '\0' ) );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void bench( void )
+{
+    uint8_t  payload[PAYLOAD_SIZE_MAX];
+    uint8_t  bin[PAYLOAD_SIZE_MAX];
+    char     b64[B64_LEN_MAX];
+    int64_t  t[5];
+    int      nb_loop;
+    int      size;
+    int      len;
+    unsigned k;
+    int      i;
+
+    for( i = 0; i < PAYLOAD_SIZE_MAX; i++ )
+    {
+        payload[i] = ( uint8_t ) rand( );
+    }
+
+    printf( "size  encode former -> table   decode former -> table\n" );
+    for( k = 0; k < sizeof bench_sizes / sizeof bench_sizes[0]; k++ )
+    {
+        size    = bench_sizes[k];
+        nb_loop = BENCH_NB_BYTES / ( size + 2 );
+        len     = bin_to_b64( payload, size, b64, sizeof b64 );
+
+        /* the first byte or character changes at each loop, so that the compiler keeps all the calls */
+        t[0] = get_time_ns( );
+        for( i = 0; i < nb_loop; i++ )
+        {
+            payload[0] = ( uint8_t ) i;
+            ref_bin_to_b64( payload, size, b64, sizeof b64 );
+        }
+        t[1] = get_time_ns( );
+        for( i = 0; i < nb_loop; i++ )
+        {
+            payload[0] = ( uint8_t ) i;
+            bin_to_b64( payload, size, b64, sizeof b64 );
+        }
+        t[2] = get_time_ns( );
+        for( i = 0; i < nb_loop; i++ )
+        {
+            b64[0] = "AB"[i & 1];
+            ref_b64_to_bin( b64, len, bin, sizeof bin );
+        }
+        t[3] = get_time_ns( );
+        for( i = 0; i < nb_loop; i++ )
+        {
+            b64[0] = "AB"[i & 1];
+            b64_to_bin( b64, len, bin, sizeof bin );
+        }
+        t[4] = get_time_ns( );
+
+        printf( "%4d  %9.1f -> %6.1f ns   %9.1f -> %6.1f ns\n", size, ( double ) ( t[1] - t[0] ) / nb_loop,
+                ( double ) ( t[2] - t[1] ) / nb_loop, ( double ) ( t[3] - t[2] ) / nb_loop,
+                ( double ) ( t[4] - t[3] ) / nb_loop );
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main( int argc, char** argv )
+{
+    int nb_payload;
+
+    ( void ) argc;
+
+    nb_payload = check_random( );
+    check_invalid( );
+
+    /* timings depend on the host, they are printed and not checked */
+    bench( );
+
+    printf( "%s: %d random payloads identical to the former codec, %d error(s)\n", argv[0], nb_payload, nb_error );
+    return ( nb_error == 0 ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
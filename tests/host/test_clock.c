@@ -0,0 +1,234 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Host test of the simulated discrete-event clock, across the count_us wraparound
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <stdio.h>   /* printf */
+#include <string.h>  /* memcmp, memcpy */
+#include <pthread.h>
+
+#include "lorahub_clock.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define THREAD_NB 3
+#define LOG_NB_MAX 1024
+
+/* start 100ms before the 32-bits count_us wraps, as the concentrator counter after ~71 minutes */
+#define START_TIME_US ( ( int64_t ) 0x100000000LL - 100000 )
+
+#define BUSY_WAIT_US 2500
+
+typedef struct
+{
+    uint32_t rank;
+    uint32_t period_ms;
+    int      nb_loop;
+    bool     busy_wait; /* busy wait after each wakeup, as the HAL does while programming a TX */
+} sim_thread_t;
+
+typedef struct
+{
+    int64_t  time_us;
+    uint32_t count_us;
+    uint32_t rank;
+} wakeup_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const sim_thread_t threads[THREAD_NB] = {
+    { .rank = 0, .period_ms = 10, .nb_loop = 30, .busy_wait = false }, /* JiT thread like */
+    { .rank = 1, .period_ms = 7, .nb_loop = 40, .busy_wait = true },
+    { .rank = 2, .period_ms = 13, .nb_loop = 12, .busy_wait = false }, /* exits first, detaching from the clock */
+};
+
+static pthread_mutex_t mx_log = PTHREAD_MUTEX_INITIALIZER;
+static wakeup_t        wakeups[LOG_NB_MAX];
+static int             nb_wakeup = 0;
+
+static int nb_error = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+#define CHECK( cond )                                                         \
+    do                                                                        \
+    {                                                                         \
+        if( !( cond ) )                                                       \
+        {                                                                     \
+            printf( "FAIL: %s:%d: %s\n", __FUNCTION__, __LINE__, #cond );     \
+            nb_error += 1;                                                    \
+        }                                                                     \
+    } while( 0 )
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void* thread_sim( void* arg )
+{
+    const sim_thread_t* t = arg;
+    int64_t             time_us;
+    int                 i;
+
+    lgw_clock_sim_attach( t->rank );
+    for( i = 0; i < t->nb_loop; i++ )
+    {
+        lgw_clock_sleep_ms( t->period_ms );
+
+        /* count_us is the 32 LSBs of the clock, as given by lgw_get_instcnt() */
+        time_us = lgw_clock_get_time_us( );
+        pthread_mutex_lock( &mx_log );
+        if( nb_wakeup < LOG_NB_MAX )
+        {
+            wakeups[nb_wakeup].time_us  = time_us;
+            wakeups[nb_wakeup].count_us = ( uint32_t ) time_us;
+            wakeups[nb_wakeup].rank     = t->rank;
+            nb_wakeup += 1;
+        }
+        pthread_mutex_unlock( &mx_log );
+
+        if( t->busy_wait == true )
+        {
+            lgw_clock_delay_us( BUSY_WAIT_US );
+        }
+    }
+    lgw_clock_sim_detach( );
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void run_simulation( void )
+{
+    pthread_t thrid[THREAD_NB];
+    int       i;
+
+    nb_wakeup = 0;
+    lgw_clock_set( lgw_clock_sim_get( ) );
+    lgw_clock_sim_set_time_us( START_TIME_US );
+    lgw_clock_sim_set_threads( THREAD_NB );
+    for( i = 0; i < THREAD_NB; i++ )
+    {
+        pthread_create( &thrid[i], NULL, thread_sim, ( void* ) &threads[i] );
+    }
+    for( i = 0; i < THREAD_NB; i++ )
+    {
+        pthread_join( thrid[i], NULL );
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Each sleep moves the time once, by its own duration, whatever the number of threads */
+static void check_timeline( void )
+{
+    int64_t  last_time_us[THREAD_NB];
+    uint32_t last_count_us[THREAD_NB];
+    int      nb_loop[THREAD_NB] = { 0 };
+    bool     wrapped            = false;
+    int      nb_expected        = 0;
+    int64_t  expected_us;
+    int      i;
+    int      r;
+
+    for( r = 0; r < THREAD_NB; r++ )
+    {
+        last_time_us[r]  = START_TIME_US;
+        last_count_us[r] = ( uint32_t ) START_TIME_US;
+        nb_expected += threads[r].nb_loop;
+    }
+    CHECK( nb_wakeup == nb_expected );
+
+    for( i = 0; i < nb_wakeup; i++ )
+    {
+        r = wakeups[i].rank;
+
+        /* wakeups come in time order, by rank at the same time */
+        if( i > 0 )
+        {
+            CHECK( ( wakeups[i].time_us > wakeups[i - 1].time_us ) ||
+                   ( ( wakeups[i].time_us == wakeups[i - 1].time_us ) && ( wakeups[i].rank > wakeups[i - 1].rank ) ) ||
+                   ( threads[wakeups[i - 1].rank].busy_wait == true ) );
+        }
+
+        /* a busy wait delays the next wakeups of the other threads, never its own period */
+        expected_us = last_time_us[r] + threads[r].period_ms * 1000;
+        if( threads[r].busy_wait == true )
+        {
+            expected_us += ( nb_loop[r] > 0 ) ? BUSY_WAIT_US : 0;
+            CHECK( wakeups[i].time_us == expected_us );
+        }
+        else
+        {
+            CHECK( wakeups[i].time_us >= expected_us );
+            CHECK( wakeups[i].time_us <= expected_us + BUSY_WAIT_US );
+        }
+
+        /* elapsed time is still right when computed on count_us across the wraparound */
+        CHECK( ( uint32_t ) ( wakeups[i].count_us - last_count_us[r] ) ==
+               ( uint32_t ) ( wakeups[i].time_us - last_time_us[r] ) );
+        if( wakeups[i].count_us < last_count_us[r] )
+        {
+            wrapped = true;
+        }
+
+        last_time_us[r]  = wakeups[i].time_us;
+        last_count_us[r] = wakeups[i].count_us;
+        nb_loop[r] += 1;
+    }
+    CHECK( wrapped == true );
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main( void )
+{
+    static wakeup_t first_run[LOG_NB_MAX];
+    int             first_nb;
+    int             run;
+
+    /* single threaded use: sleeps of a thread which is not attached move the time */
+    lgw_clock_set( lgw_clock_sim_get( ) );
+    lgw_clock_sim_set_time_us( 0 );
+    lgw_clock_sleep_ms( 5 );
+    lgw_clock_delay_us( 20 );
+    lgw_clock_sim_advance_us( 1000 );
+    CHECK( lgw_clock_get_time_us( ) == 6020 );
+
+    run_simulation( );
+    check_timeline( );
+    first_nb = nb_wakeup;
+    memcpy( first_run, wakeups, sizeof wakeups );
+
+    /* the same timeline is replayed at each run, whatever the host scheduling */
+    for( run = 0; run < 20; run++ )
+    {
+        run_simulation( );
+        CHECK( nb_wakeup == first_nb );
+        CHECK( memcmp( first_run, wakeups, first_nb * sizeof wakeups[0] ) == 0 );
+    }
+
+    printf( "%s: %d wakeups from 0x%08lX to 0x%08lX, %d error(s)\n", __FILE__, first_nb,
+            ( unsigned long ) first_run[0].count_us, ( unsigned long ) first_run[first_nb - 1].count_us, nb_error );
+
+    return ( nb_error == 0 ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
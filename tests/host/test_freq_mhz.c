@@ -0,0 +1,242 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Host test of the conversion of the txpk frequency from MHz to Hz, against the former double precision formula
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <stdio.h>   /* printf, snprintf */
+#include <stdlib.h>  /* strtod */
+#include <math.h>    /* llround, INFINITY, NAN */
+
+#include "freq_mhz.h"
+#include "parson.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define NB_RANDOM 2000000
+
+typedef struct
+{
+    uint32_t start_hz;
+    uint32_t stop_hz;
+} band_t;
+
+/* every Hz of these bands is checked */
+static const band_t bands[] = {
+    { 863000000, 870000000 }, /* EU868 */
+    { 902000000, 928000000 }, /* US915, AU915, AS923 */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int nb_error = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+#define CHECK( cond )                                                         \
+    do                                                                        \
+    {                                                                         \
+        if( !( cond ) )                                                       \
+        {                                                                     \
+            printf( "FAIL: %s:%d: %s\n", __FUNCTION__, __LINE__, #cond );     \
+            nb_error += 1;                                                    \
+        }                                                                     \
+    } while( 0 )
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Text of the frequency as sent by a network server, and checks of both conversions against the former formula */
+static bool check_freq( uint32_t freq_hz )
+{
+    char     str[32];
+    double   mhz;
+    uint32_t hz_text   = 0;
+    uint32_t hz_double = 0;
+    int      err_text;
+    int      err_double;
+
+    snprintf( str, sizeof str, "%lu.%06lu", ( unsigned long ) ( freq_hz / 1000000 ),
+              ( unsigned long ) ( freq_hz % 1000000 ) );
+    mhz = strtod( str, NULL ); /* as parson does */
+
+    err_text   = freq_mhz_parse( str, &hz_text );
+    err_double = freq_mhz_from_double( mhz, &hz_double );
+    if( ( err_text != 0 ) || ( err_double != 0 ) || ( hz_text != freq_hz ) || ( hz_double != freq_hz ) ||
+        ( ( uint32_t ) llround( 1.0e6 * mhz ) != freq_hz ) )
+    {
+        printf( "FAIL: %s: text %lu, double %lu, former %lu\n", str, ( unsigned long ) hz_text,
+                ( unsigned long ) hz_double, ( unsigned long ) llround( 1.0e6 * mhz ) );
+        nb_error += 1;
+        return false;
+    }
+
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t check_bands( void )
+{
+    uint32_t nb_freq = 0;
+    uint32_t freq_hz;
+    unsigned i;
+
+    for( i = 0; i < sizeof bands / sizeof bands[0]; i++ )
+    {
+        for( freq_hz = bands[i].start_hz; freq_hz <= bands[i].stop_hz; freq_hz++ )
+        {
+            if( check_freq( freq_hz ) == false )
+            {
+                return nb_freq;
+            }
+            nb_freq += 1;
+        }
+    }
+
+    return nb_freq;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t check_random( void )
+{
+    uint32_t seed = 0x12345678;
+    uint32_t nb_freq;
+
+    CHECK( check_freq( 0 ) == true );
+    CHECK( check_freq( UINT32_MAX ) == true );
+    for( nb_freq = 0; nb_freq < NB_RANDOM; nb_freq++ )
+    {
+        seed = ( seed * 1664525 ) + 1013904223;
+        if( check_freq( seed ) == false )
+        {
+            break;
+        }
+    }
+
+    return nb_freq + 2;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void check_text( void )
+{
+    uint32_t hz;
+
+    CHECK( ( freq_mhz_parse( "868", &hz ) == 0 ) && ( hz == 868000000 ) );
+    CHECK( ( freq_mhz_parse( "868.1", &hz ) == 0 ) && ( hz == 868100000 ) );
+    CHECK( ( freq_mhz_parse( "868.10000000", &hz ) == 0 ) && ( hz == 868100000 ) );
+    CHECK( ( freq_mhz_parse( "868.1000004", &hz ) == 0 ) && ( hz == 868100000 ) );
+    CHECK( ( freq_mhz_parse( "868.1000005", &hz ) == 0 ) && ( hz == 868100001 ) );
+    CHECK( ( freq_mhz_parse( "868.1999999999", &hz ) == 0 ) && ( hz == 868200000 ) );
+    CHECK( ( freq_mhz_parse( "4294.967295", &hz ) == 0 ) && ( hz == UINT32_MAX ) );
+
+    CHECK( freq_mhz_parse( "4294.967296", &hz ) == -1 );
+    CHECK( freq_mhz_parse( "4294.9672955", &hz ) == -1 );
+    CHECK( freq_mhz_parse( "4295", &hz ) == -1 );
+    CHECK( freq_mhz_parse( "-868.1", &hz ) == -1 );
+    CHECK( freq_mhz_parse( "8.681e2", &hz ) == -1 );
+    CHECK( freq_mhz_parse( "868.1 ", &hz ) == -1 );
+    CHECK( freq_mhz_parse( ".5", &hz ) == -1 );
+    CHECK( freq_mhz_parse( "", &hz ) == -1 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void check_double( void )
+{
+    uint32_t hz;
+
+    CHECK( ( freq_mhz_from_double( 8.681e2, &hz ) == 0 ) && ( hz == 868100000 ) );
+    CHECK( ( freq_mhz_from_double( 2425.1875, &hz ) == 0 ) && ( hz == 2425187500 ) );
+    CHECK( ( freq_mhz_from_double( 0.0, &hz ) == 0 ) && ( hz == 0 ) );
+    CHECK( ( freq_mhz_from_double( -0.0, &hz ) == 0 ) && ( hz == 0 ) );
+    CHECK( ( freq_mhz_from_double( 1.0e-300, &hz ) == 0 ) && ( hz == 0 ) );
+    CHECK( ( freq_mhz_from_double( 0x1p-21, &hz ) == 0 ) && ( hz == 0 ) ); /* 0.477 Hz */
+    CHECK( ( freq_mhz_from_double( 0x1p-20, &hz ) == 0 ) && ( hz == 1 ) ); /* 0.954 Hz */
+    CHECK( ( freq_mhz_from_double( 0.5, &hz ) == 0 ) && ( hz == 500000 ) );
+    CHECK( ( freq_mhz_from_double( 4294.9672954, &hz ) == 0 ) && ( hz == UINT32_MAX ) );
+
+    CHECK( freq_mhz_from_double( 4294.9672956, &hz ) == -1 );
+    CHECK( freq_mhz_from_double( 1.0e300, &hz ) == -1 );
+    CHECK( freq_mhz_from_double( -868.1, &hz ) == -1 );
+    CHECK( freq_mhz_from_double( INFINITY, &hz ) == -1 );
+    CHECK( freq_mhz_from_double( NAN, &hz ) == -1 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int json_freq( const char* json, uint32_t* hz )
+{
+    JSON_Value* root_val;
+    int         err;
+
+    root_val = json_parse_string_with_comments( json );
+    if( root_val == NULL )
+    {
+        return -2;
+    }
+    err = freq_mhz_from_json( json_object_dotget_value( json_value_get_object( root_val ), "txpk.freq" ), hz );
+    json_value_free( root_val );
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* The value is the one parsed by parson, whatever the other fields of the datagram */
+static void check_json( void )
+{
+    uint32_t hz;
+
+    CHECK( ( json_freq( "{\"txpk\":{\"freq\":868.1}}", &hz ) == 0 ) && ( hz == 868100000 ) );
+    CHECK( ( json_freq( "{\"txpk\":{\"freq\" : 8.681E2}}", &hz ) == 0 ) && ( hz == 868100000 ) );
+    CHECK( ( json_freq( "{\"txpk\":{\"freq\":\"868.100001\"}}", &hz ) == 0 ) && ( hz == 868100001 ) );
+    CHECK( ( json_freq( "{\"txpk\":{\"imme\":false,\"opts\":{\"freq\":869.525},\"freq\":923.3}}", &hz ) == 0 ) &&
+           ( hz == 923300000 ) );
+    CHECK( ( json_freq( "{\"data\":\"\\\"txpk\\\"{\\\"freq\\\":1\",\"txpk\":{\"freq\":869.525}}", &hz ) == 0 ) &&
+           ( hz == 869525000 ) );
+
+    CHECK( json_freq( "{\"txpk\":{\"freq\":true}}", &hz ) == -1 );
+    CHECK( json_freq( "{\"txpk\":{\"freq\":-868.1}}", &hz ) == -1 );
+    CHECK( json_freq( "{\"txpk\":{\"freq\":\"8.681e2\"}}", &hz ) == -1 );
+    CHECK( json_freq( "{\"txpk\":{}}", &hz ) == -1 );
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main( void )
+{
+    uint32_t nb_band;
+    uint32_t nb_random;
+
+    nb_band   = check_bands( );
+    nb_random = check_random( );
+    check_text( );
+    check_double( );
+    check_json( );
+
+    printf( "%s: %lu band and %lu random frequencies identical to the double formula, %d error(s)\n", __FILE__,
+            ( unsigned long ) nb_band, ( unsigned long ) nb_random, nb_error );
+
+    return ( nb_error == 0 ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,310 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Host test of the JiT queue across the count_us wraparound, driven by the simulated clock: a downlink thread
+    enqueues Class A and Class C packets while a JiT thread peeks and dequeues them, as in the packet forwarder
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <stdio.h>   /* printf */
+#include <string.h>  /* memset */
+#include <pthread.h>
+
+#include "lorahub_clock.h"
+#include "lorahub_hal.h"
+#include "lorahub_toa.h"
+#include "jitqueue.h"
+#include "airtime.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+/* start 2s before the 32-bits count_us wraps, as the concentrator counter after ~71 minutes */
+#define START_TIME_US ( ( int64_t ) 0x100000000LL - 2000000 )
+
+#define NB_DOWNLINK 40
+#define DOWN_PERIOD_MS 150    /* period of the downlink requests */
+#define CLASS_C_PERIOD 4      /* one request out of CLASS_C_PERIOD is an immediate Class C downlink */
+#define RX1_DELAY_US 1000000  /* Class A downlinks are timestamped one second ahead */
+#define JIT_PERIOD_MS 10      /* sleep of the JiT thread, as thread_jit() */
+#define JIT_PEEK_DELAY 30000  /* TX_JIT_DELAY of jitqueue.c: a packet is peeked at most this early */
+
+enum thread_rank_e
+{
+    RANK_JIT, /* runs first among wakeups due at the same time */
+    RANK_DOWN,
+    RANK_NB
+};
+
+typedef struct
+{
+    bool     enqueued;
+    bool     class_c;
+    uint32_t count_us;  /* requested for Class A, set by jit_enqueue() for Class C */
+    int      nb_sent;   /* dequeued by the JiT thread */
+    uint32_t sent_us;   /* count_us at dequeue */
+    int      nb_dropped;
+} downlink_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct jit_queue_s jit_queue;
+
+static pthread_mutex_t mx_log = PTHREAD_MUTEX_INITIALIZER;
+static downlink_t      downlinks[NB_DOWNLINK];
+static uint32_t        sent_order[NB_DOWNLINK]; /* count_us of the dequeued packets, in dequeue order */
+static int             nb_sent      = 0;
+static bool            down_done    = false;
+static int             nb_released  = 0;
+
+static int nb_error = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+#define CHECK( cond )                                                         \
+    do                                                                        \
+    {                                                                         \
+        if( !( cond ) )                                                       \
+        {                                                                     \
+            printf( "FAIL: %s:%d: %s\n", __FUNCTION__, __LINE__, #cond );     \
+            nb_error += 1;                                                    \
+        }                                                                     \
+    } while( 0 )
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void* thread_down( void* arg )
+{
+    struct lgw_pkt_tx_s pkt;
+    enum jit_pkt_type_e pkt_type;
+    enum jit_error_e    jit_result;
+    uint32_t            time_us;
+    int                 i;
+
+    ( void ) arg;
+
+    lgw_clock_sim_attach( RANK_DOWN );
+    for( i = 0; i < NB_DOWNLINK; i++ )
+    {
+        lgw_clock_sleep_ms( DOWN_PERIOD_MS );
+
+        memset( &pkt, 0, sizeof pkt );
+        pkt.freq_hz    = 869525000;
+        pkt.rf_power   = 14;
+        pkt.modulation = MOD_LORA;
+        pkt.bandwidth  = BW_125KHZ;
+        pkt.datarate   = DR_LORA_SF7;
+        pkt.coderate   = CR_LORA_4_5;
+        pkt.invert_pol = true;
+        pkt.preamble   = 8;
+        pkt.no_crc     = true;
+        pkt.size       = 20;
+        pkt.payload[0] = 0x60; /* unconfirmed data down */
+        pkt.payload[1] = ( uint8_t ) i;
+
+        lgw_get_instcnt( &time_us );
+        if( ( i % CLASS_C_PERIOD ) == ( CLASS_C_PERIOD - 1 ) )
+        {
+            pkt.tx_mode = IMMEDIATE;
+            pkt_type    = JIT_PKT_TYPE_DOWNLINK_CLASS_C;
+        }
+        else
+        {
+            pkt.tx_mode  = TIMESTAMPED;
+            pkt.count_us = time_us + RX1_DELAY_US;
+            pkt_type     = JIT_PKT_TYPE_DOWNLINK_CLASS_A;
+        }
+
+        pthread_mutex_lock( &mx_log );
+        jit_result = jit_enqueue( &jit_queue, time_us, &pkt, pkt_type, ( uint16_t ) i );
+        CHECK( jit_result == JIT_ERROR_OK );
+        downlinks[i].enqueued = ( jit_result == JIT_ERROR_OK );
+        downlinks[i].class_c  = ( pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C );
+        downlinks[i].count_us = pkt.count_us;
+        pthread_mutex_unlock( &mx_log );
+    }
+
+    pthread_mutex_lock( &mx_log );
+    down_done = true;
+    pthread_mutex_unlock( &mx_log );
+    lgw_clock_sim_detach( );
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void* thread_jit( void* arg )
+{
+    struct lgw_pkt_tx_s  pkt;
+    struct jit_dropped_s dropped;
+    enum jit_pkt_type_e  pkt_type;
+    enum jit_error_e     jit_result;
+    uint32_t             time_us;
+    int                  pkt_index;
+    bool                 done;
+
+    ( void ) arg;
+
+    lgw_clock_sim_attach( RANK_JIT );
+    do
+    {
+        lgw_clock_sleep_ms( JIT_PERIOD_MS );
+
+        /* read before the peek: the downlink thread does not run until the next sleep */
+        pthread_mutex_lock( &mx_log );
+        done = down_done;
+        pthread_mutex_unlock( &mx_log );
+
+        lgw_get_instcnt( &time_us );
+        jit_result = jit_peek( &jit_queue, time_us, &pkt_index );
+        if( ( jit_result == JIT_ERROR_OK ) && ( pkt_index > -1 ) )
+        {
+            CHECK( jit_dequeue( &jit_queue, pkt_index, &pkt, &pkt_type ) == JIT_ERROR_OK );
+
+            pthread_mutex_lock( &mx_log );
+            if( pkt.payload[1] < NB_DOWNLINK )
+            {
+                downlinks[pkt.payload[1]].nb_sent += 1;
+                downlinks[pkt.payload[1]].sent_us = time_us;
+            }
+            if( nb_sent < NB_DOWNLINK )
+            {
+                sent_order[nb_sent] = pkt.count_us;
+                nb_sent += 1;
+            }
+            pthread_mutex_unlock( &mx_log );
+        }
+
+        while( jit_get_dropped( &jit_queue, &dropped ) == true )
+        {
+            pthread_mutex_lock( &mx_log );
+            if( dropped.token < NB_DOWNLINK )
+            {
+                downlinks[dropped.token].nb_dropped += 1;
+            }
+            pthread_mutex_unlock( &mx_log );
+        }
+    } while( ( done == false ) || ( jit_queue_is_empty( &jit_queue ) == false ) );
+    lgw_clock_sim_detach( );
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void run_simulation( void )
+{
+    pthread_t thrid[RANK_NB];
+
+    jit_queue_init( &jit_queue );
+    lgw_clock_set( lgw_clock_sim_get( ) );
+    lgw_clock_sim_set_time_us( START_TIME_US );
+    lgw_clock_sim_set_threads( RANK_NB );
+    pthread_create( &thrid[RANK_JIT], NULL, thread_jit, NULL );
+    pthread_create( &thrid[RANK_DOWN], NULL, thread_down, NULL );
+    pthread_join( thrid[RANK_DOWN], NULL );
+    pthread_join( thrid[RANK_JIT], NULL );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Each accepted downlink is dequeued once, in time order, just before its count_us, on both sides of the wrap */
+static void check_downlinks( void )
+{
+    bool wrapped = false;
+    int  i;
+
+    CHECK( nb_sent == NB_DOWNLINK );
+    CHECK( nb_released == 0 );
+
+    for( i = 0; i < NB_DOWNLINK; i++ )
+    {
+        CHECK( downlinks[i].enqueued == true );
+        CHECK( downlinks[i].nb_sent == 1 );
+        CHECK( downlinks[i].nb_dropped == 0 );
+
+        /* not late, and not earlier than the JiT thread has to program the radio */
+        CHECK( ( int32_t ) ( downlinks[i].count_us - downlinks[i].sent_us ) > 0 );
+        CHECK( ( downlinks[i].count_us - downlinks[i].sent_us ) <= JIT_PEEK_DELAY );
+    }
+
+    for( i = 1; i < nb_sent; i++ )
+    {
+        CHECK( ( int32_t ) ( sent_order[i] - sent_order[i - 1] ) > 0 );
+        if( sent_order[i] < sent_order[i - 1] )
+        {
+            wrapped = true;
+        }
+    }
+    CHECK( wrapped == true );
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- HAL AND AIRTIME REPLACEMENTS ----------------------------------------- */
+
+/* The JiT queue only needs the counter and the time on air from the HAL, computed as it does */
+
+int lgw_get_instcnt( uint32_t* inst_cnt_us )
+{
+    *inst_cnt_us = ( uint32_t ) lgw_clock_get_time_us( );
+
+    return LGW_HAL_SUCCESS;
+}
+
+uint32_t lgw_time_on_air( const struct lgw_pkt_tx_s* packet )
+{
+    return lgw_lora_time_on_air_ms( packet );
+}
+
+uint32_t lgw_time_on_air_us( const struct lgw_pkt_tx_s* packet )
+{
+    return lgw_lora_time_on_air_us( packet );
+}
+
+/* Airtime is reserved by thread_down before the enqueue, the queue only gives back that of dropped packets */
+void airtime_release( uint32_t freq_hz, uint32_t toa_ms )
+{
+    ( void ) freq_hz;
+    ( void ) toa_ms;
+
+    nb_released += 1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main( int argc, char** argv )
+{
+    int nb_class_c = 0;
+    int i;
+
+    ( void ) argc;
+
+    run_simulation( );
+    check_downlinks( );
+
+    for( i = 0; i < NB_DOWNLINK; i++ )
+    {
+        nb_class_c += ( downlinks[i].class_c == true ) ? 1 : 0;
+    }
+    printf( "%s: %d downlinks (%d Class C) dequeued across the count_us wraparound, %d error(s)\n", argv[0],
+            nb_sent, nb_class_c, nb_error );
+    return ( nb_error == 0 ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
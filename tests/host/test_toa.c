@@ -0,0 +1,271 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Host test of the LoRa time on air, bit for bit against the formula of the radio drivers
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdint.h>  /* C99 types */
+#include <stdbool.h> /* bool type */
+#include <stdio.h>   /* printf */
+#include <string.h>  /* memset */
+
+#include "lorahub_toa.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define BW_NB 6
+
+static const uint8_t bw_list[BW_NB]    = { BW_125KHZ, BW_250KHZ, BW_500KHZ, BW_200KHZ, BW_400KHZ, BW_800KHZ };
+static const uint8_t preamble_list[]   = { 6, 8, 12, 16 };
+static const uint8_t invalid_dr_list[] = { 0, 4, 13, 0xFF };
+static const uint8_t invalid_bw_list[] = { BW_UNDEFINED, 0x01, 0x07, 0x0C, 0x10, 0xFF };
+static const uint8_t invalid_cr_list[] = { 0, CR_LORA_LI_4_5, CR_LORA_LI_4_6, CR_LORA_LI_4_8, 0xFF };
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int nb_error = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+#define CHECK( cond )                                                         \
+    do                                                                        \
+    {                                                                         \
+        if( !( cond ) )                                                       \
+        {                                                                     \
+            printf( "FAIL: %s:%d: %s\n", __FUNCTION__, __LINE__, #cond );     \
+            nb_error += 1;                                                    \
+        }                                                                     \
+    } while( 0 )
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Reference: sx126x_get_lora_bw_in_hz(), lr11xx_radio_get_lora_bw_in_hz() */
+static uint32_t ref_bw_in_hz( uint8_t bw )
+{
+    switch( bw )
+    {
+    case BW_125KHZ:
+        return 125000;
+    case BW_250KHZ:
+        return 250000;
+    case BW_500KHZ:
+        return 500000;
+    case BW_200KHZ:
+        return 203125;
+    case BW_400KHZ:
+        return 406250;
+    case BW_800KHZ:
+        return 812500;
+    default:
+        return 0;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Reference: ral_compute_lora_ldro() */
+static bool ref_ldro( uint8_t sf, uint8_t bw )
+{
+    switch( bw )
+    {
+    case BW_500KHZ:
+        return false;
+    case BW_250KHZ:
+        return sf == DR_LORA_SF12;
+    default:
+        return ( sf == DR_LORA_SF11 ) || ( sf == DR_LORA_SF12 );
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Reference: sx126x_get_lora_time_on_air_numerator(), as given to the RAL by the HAL before the integer tables */
+static uint32_t ref_numerator( const struct lgw_pkt_tx_s* pkt )
+{
+    const int32_t pld_len_in_bytes = pkt->size;
+    const int32_t sf               = pkt->datarate;
+    const bool    pld_is_fix       = pkt->no_header;
+    const int32_t cr_denom         = pkt->coderate + 4;
+    int32_t       ceil_denominator;
+    int32_t       ceil_numerator =
+        ( pld_len_in_bytes << 3 ) + ( ( pkt->no_crc == false ) ? 16 : 0 ) - ( 4 * sf ) + ( pld_is_fix ? 0 : 20 );
+    int32_t intermed;
+
+    if( sf <= 6 )
+    {
+        ceil_denominator = 4 * sf;
+    }
+    else
+    {
+        ceil_numerator += 8;
+        if( ref_ldro( pkt->datarate, pkt->bandwidth ) == true )
+        {
+            ceil_denominator = 4 * ( sf - 2 );
+        }
+        else
+        {
+            ceil_denominator = 4 * sf;
+        }
+    }
+
+    if( ceil_numerator < 0 )
+    {
+        ceil_numerator = 0;
+    }
+
+    intermed = ( ( ceil_numerator + ceil_denominator - 1 ) / ceil_denominator ) * cr_denom + pkt->preamble + 12;
+    if( sf <= 6 )
+    {
+        intermed += 2;
+    }
+
+    return ( uint32_t ) ( ( 4 * intermed + 1 ) * ( 1 << ( sf - 2 ) ) );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Reference: sx126x_get_lora_time_on_air_in_ms() */
+static uint32_t ref_time_on_air_ms( const struct lgw_pkt_tx_s* pkt )
+{
+    uint32_t numerator   = 1000U * ref_numerator( pkt );
+    uint32_t denominator = ref_bw_in_hz( pkt->bandwidth );
+
+    return ( numerator + denominator - 1 ) / denominator;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int check_valid_params( void )
+{
+    struct lgw_pkt_tx_s pkt;
+    uint32_t            numerator;
+    uint32_t            bw_hz;
+    uint32_t            toa_ms;
+    uint32_t            toa_us;
+    int                 nb_case = 0;
+    unsigned            b, p, size;
+    uint8_t             sf, cr, flags;
+
+    memset( &pkt, 0, sizeof pkt );
+    pkt.modulation = MOD_LORA;
+    for( sf = DR_LORA_SF5; sf <= DR_LORA_SF12; sf++ )
+    {
+        for( b = 0; b < BW_NB; b++ )
+        {
+            for( cr = CR_LORA_4_5; cr <= CR_LORA_4_8; cr++ )
+            {
+                for( p = 0; p < sizeof preamble_list; p++ )
+                {
+                    for( flags = 0; flags < 4; flags++ )
+                    {
+                        for( size = 0; size <= 255; size++ )
+                        {
+                            pkt.datarate  = sf;
+                            pkt.bandwidth = bw_list[b];
+                            pkt.coderate  = cr;
+                            pkt.preamble  = preamble_list[p];
+                            pkt.no_header = ( flags & 0x01 ) != 0;
+                            pkt.no_crc    = ( flags & 0x02 ) != 0;
+                            pkt.size      = size;
+
+                            numerator = lgw_lora_time_on_air_numerator( &pkt, &bw_hz );
+                            toa_ms    = lgw_lora_time_on_air_ms( &pkt );
+                            toa_us    = lgw_lora_time_on_air_us( &pkt );
+
+                            CHECK( numerator == ref_numerator( &pkt ) );
+                            CHECK( bw_hz == ref_bw_in_hz( pkt.bandwidth ) );
+                            CHECK( toa_ms == ref_time_on_air_ms( &pkt ) );
+                            /* both are the same exact value, rounded up to the microsecond or the millisecond */
+                            CHECK( ( ( toa_us + 999 ) / 1000 ) == toa_ms );
+                            if( ( numerator != ref_numerator( &pkt ) ) || ( toa_ms != ref_time_on_air_ms( &pkt ) ) )
+                            {
+                                printf( "  SF%u bw=0x%02X cr=%u preamble=%u flags=%u size=%u: %lu ms, expected %lu\n",
+                                        sf, pkt.bandwidth, cr, pkt.preamble, flags, size, ( unsigned long ) toa_ms,
+                                        ( unsigned long ) ref_time_on_air_ms( &pkt ) );
+                                return nb_case;
+                            }
+                            nb_case += 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return nb_case;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Parameters out of the tables are left to the caller (error log, or radio driver for long interleaver) */
+static void check_invalid_params( void )
+{
+    struct lgw_pkt_tx_s pkt;
+    uint32_t            bw_hz;
+    unsigned            i;
+
+    memset( &pkt, 0, sizeof pkt );
+    pkt.modulation = MOD_LORA;
+    pkt.preamble   = 8;
+    pkt.size       = 20;
+
+    pkt.bandwidth = BW_125KHZ;
+    pkt.coderate  = CR_LORA_4_5;
+    for( i = 0; i < sizeof invalid_dr_list; i++ )
+    {
+        pkt.datarate = invalid_dr_list[i];
+        CHECK( lgw_lora_time_on_air_numerator( &pkt, &bw_hz ) == 0 );
+        CHECK( lgw_lora_time_on_air_ms( &pkt ) == 0 );
+        CHECK( lgw_lora_time_on_air_us( &pkt ) == 0 );
+    }
+
+    pkt.datarate = DR_LORA_SF7;
+    for( i = 0; i < sizeof invalid_bw_list; i++ )
+    {
+        pkt.bandwidth = invalid_bw_list[i];
+        CHECK( lgw_lora_time_on_air_numerator( &pkt, &bw_hz ) == 0 );
+        CHECK( lgw_lora_time_on_air_ms( &pkt ) == 0 );
+        CHECK( lgw_lora_time_on_air_us( &pkt ) == 0 );
+    }
+
+    pkt.bandwidth = BW_125KHZ;
+    for( i = 0; i < sizeof invalid_cr_list; i++ )
+    {
+        pkt.coderate = invalid_cr_list[i];
+        CHECK( lgw_lora_time_on_air_numerator( &pkt, &bw_hz ) == 0 );
+        CHECK( lgw_lora_time_on_air_ms( &pkt ) == 0 );
+        CHECK( lgw_lora_time_on_air_us( &pkt ) == 0 );
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main( void )
+{
+    int nb_case;
+
+    nb_case = check_valid_params( );
+    check_invalid_params( );
+
+    printf( "%s: %d valid parameter sets compared with the radio drivers formula, %d error(s)\n", __FILE__, nb_case,
+            nb_error );
+
+    return ( nb_error == 0 ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -72,6 +72,22 @@ def set_config(base_url, config, step_number):
     response = requests.post(url, headers=headers, data=json.dumps(config))
     return response
 
+def apply_config(base_url, step_number):
+    """
+    Apply the stored configuration of the LoRaHub without reboot.
+
+    Args:
+        base_url (str): The base URL of the LoRaHub API.
+        step_number (int): The test step number.
+
+    Returns:
+        response (requests.Response): The response from the server.
+    """
+    url = f"{base_url}/api/v1/apply_config"
+    log_test_step(step_number, "Apply Configuration", url, "POST")
+    response = requests.post(url)
+    return response
+
 def reboot(base_url, step_number):
     """
     Trigger a reboot of the LoRaHub.
@@ -120,6 +136,266 @@ def get_info(base_url, step_number):
     response = requests.get(url)
     return response
 
+def get_stats(base_url, step_number):
+    """
+    Get the packet forwarder statistics of the LoRaHub.
+
+    Args:
+        base_url (str): The base URL of the LoRaHub API.
+        step_number (int): The test step number.
+
+    Returns:
+        response (requests.Response): The response from the server containing the statistics.
+    """
+    url = f"{base_url}/api/v1/stats"
+    log_test_step(step_number, "Get Statistics", url, "GET")
+    response = requests.get(url)
+    return response
+
+def get_devices(base_url, step_number):
+    """
+    Get the table of the devices heard by the LoRaHub.
+
+    Args:
+        base_url (str): The base URL of the LoRaHub API.
+        step_number (int): The test step number.
+
+    Returns:
+        response (requests.Response): The response from the server containing the devices and their link quality.
+    """
+    url = f"{base_url}/api/v1/devices"
+    log_test_step(step_number, "Get Devices", url, "GET")
+    response = requests.get(url)
+    return response
+
+def get_metrics(base_url, step_number):
+    """
+    Get the Prometheus metrics of the LoRaHub.
+
+    Args:
+        base_url (str): The base URL of the LoRaHub API.
+        step_number (int): The test step number.
+
+    Returns:
+        response (requests.Response): The response from the server containing the metrics in text format.
+    """
+    url = f"{base_url}/metrics"
+    log_test_step(step_number, "Get Metrics", url, "GET")
+    response = requests.get(url)
+    return response
+
+def get_live(base_url, step_number):
+    """
+    Get the live packet stream web page of the LoRaHub.
+
+    Args:
+        base_url (str): The base URL of the LoRaHub API.
+        step_number (int): The test step number.
+
+    Returns:
+        response (requests.Response): The response from the server containing the HTML page.
+    """
+    url = f"{base_url}/live"
+    log_test_step(step_number, "Get Live Page", url, "GET")
+    response = requests.get(url)
+    return response
+
+def exit_on_problems(description, problems):
+    """
+    Exit with an error if a response does not match its expected content.
+
+    Args:
+        description (str): Name of the checked response.
+        problems (list): Description of each mismatch, empty if the content is as expected.
+    """
+    if problems:
+        for problem in problems:
+            print(f"{COLOR_RED}{description}: {problem}{COLOR_RESET}")
+        sys.exit(1)
+    print(f"{COLOR_GREEN}{description}: content OK{COLOR_RESET}")
+
+def check_stats(response):
+    """
+    Check the statistics: counters of the last interval and since start, histograms matching their bounds.
+
+    Args:
+        response (requests.Response): The response from the server.
+
+    Returns:
+        list: Description of each mismatch with the expected content, empty if none.
+    """
+    problems = []
+    if not response.headers.get('Content-Type', '').startswith('application/json'):
+        problems.append(f"unexpected Content-Type '{response.headers.get('Content-Type')}'")
+    try:
+        stats = response.json()
+    except ValueError:
+        return problems + ["response is not JSON"]
+
+    for key in ("uptime_s", "interval_s", "hist_bounds", "window", "total", "boot_ms"):
+        if key not in stats:
+            problems.append(f"missing '{key}'")
+    bounds = stats.get("hist_bounds", {})
+    for hist in ("ack_rtt_ms", "tx_slack_us"):
+        if not isinstance(bounds.get(hist), list) or len(bounds[hist]) == 0:
+            problems.append(f"missing bounds of histogram '{hist}'")
+
+    for counters_name in ("window", "total"):
+        counters = stats.get(counters_name, {})
+        for group, keys in (("rx", ("received", "ok", "bad", "nocrc")),
+                            ("up", ("forwarded", "push_sent", "push_ack", "push_ack_ratio")),
+                            ("down", ("pull_sent", "pull_ack", "pull_ack_ratio", "pull_resp")),
+                            ("tx", ("requested", "ok", "fail", "rx2_fallback", "preempted", "rejected"))):
+            for key in keys:
+                if key not in counters.get(group, {}):
+                    problems.append(f"missing '{counters_name}.{group}.{key}'")
+        # one bin per bound, plus the last unbounded one
+        for hist in ("ack_rtt_ms", "tx_slack_us"):
+            bins = counters.get(hist)
+            if not isinstance(bins, list) or len(bins) != len(bounds.get(hist, [])) + 1:
+                problems.append(f"'{counters_name}.{hist}' does not match its {len(bounds.get(hist, []))} bounds")
+            elif any(not isinstance(b, int) or b < 0 for b in bins):
+                problems.append(f"'{counters_name}.{hist}' bins are not counts")
+    return problems
+
+def check_metrics(response):
+    """
+    Check the Prometheus metrics: text format version, counters and complete histograms.
+
+    Args:
+        response (requests.Response): The response from the server.
+
+    Returns:
+        list: Description of each mismatch with the expected content, empty if none.
+    """
+    problems = []
+    content_type = response.headers.get('Content-Type', '')
+    if not content_type.startswith('text/plain') or 'version=0.0.4' not in content_type:
+        problems.append(f"unexpected Content-Type '{content_type}'")
+
+    # "# TYPE <name> <type>" lines, then "<name>[{labels}] <value>" samples
+    types = {}
+    samples = {}
+    for line in response.text.splitlines():
+        if line.startswith('# TYPE '):
+            fields = line.split()
+            if len(fields) == 4:
+                types[fields[2]] = fields[3]
+        elif line and not line.startswith('#'):
+            name, _, value = line.rpartition(' ')
+            try:
+                samples[name] = float(value)
+            except ValueError:
+                problems.append(f"invalid sample '{line}'")
+
+    counters = [name for name, kind in types.items() if kind == 'counter']
+    if not any(name.startswith('lorahub_') for name in counters):
+        problems.append("no lorahub_ counter")
+    for name in ("lorahub_rx_packets_total", "lorahub_tx_ok_total"):
+        if types.get(name) != 'counter' or name not in samples:
+            problems.append(f"missing counter '{name}'")
+    for name in counters:
+        if not any(sample.split('{')[0] == name for sample in samples):
+            problems.append(f"counter '{name}' has no sample")
+    for name in (name for name, kind in types.items() if kind == 'histogram'):
+        for suffix in ('_bucket{le="+Inf"}', '_sum', '_count'):
+            if name + suffix not in samples:
+                problems.append(f"histogram '{name}' has no {suffix}")
+    return problems
+
+def check_live(response):
+    """
+    Check the live packet stream page: an HTML page opening the WebSocket stream.
+
+    Args:
+        response (requests.Response): The response from the server.
+
+    Returns:
+        list: Description of each mismatch with the expected content, empty if none.
+    """
+    problems = []
+    if not response.headers.get('Content-Type', '').startswith('text/html'):
+        problems.append(f"unexpected Content-Type '{response.headers.get('Content-Type')}'")
+    if not response.text.lstrip().lower().startswith('<!doctype html>'):
+        problems.append("response is not an HTML page")
+    if "new WebSocket(" not in response.text or "/api/v1/stream" not in response.text:
+        problems.append("page does not open the /api/v1/stream WebSocket")
+    return problems
+
+def check_apply_config(response, expect_change=None):
+    """
+    Check the result of applying the configuration: what changed, and how long the receiver was blind.
+
+    Args:
+        response (requests.Response): The response from the server.
+        expect_change (bool): Whether the radio or the server are expected to change, None if not known.
+
+    Returns:
+        list: Description of each mismatch with the expected content, empty if none.
+    """
+    problems = []
+    try:
+        result = response.json()
+    except ValueError:
+        return ["response is not JSON"]
+
+    for key in ("radio_changed", "lns_changed"):
+        if not isinstance(result.get(key), bool):
+            problems.append(f"missing boolean '{key}'")
+    downtime_us = result.get("downtime_us")
+    if not isinstance(downtime_us, int) or downtime_us < 0:
+        return problems + ["missing 'downtime_us'"]
+
+    # the receiver is only retuned, and blind, when the radio configuration changed
+    if result.get("radio_changed") is True and downtime_us == 0:
+        problems.append("radio changed without downtime")
+    if result.get("radio_changed") is False and downtime_us != 0:
+        problems.append(f"downtime of {downtime_us} us without radio change")
+    if expect_change is False and (result.get("radio_changed") or result.get("lns_changed")):
+        problems.append("configuration changed again while already applied")
+    return problems
+
+def check_devices(response):
+    """
+    Check the device table: an array of devices with their DevAddr, signal and estimated loss.
+
+    Args:
+        response (requests.Response): The response from the server.
+
+    Returns:
+        list: Description of each mismatch with the expected content, empty if none.
+    """
+    problems = []
+    if not response.headers.get('Content-Type', '').startswith('application/json'):
+        problems.append(f"unexpected Content-Type '{response.headers.get('Content-Type')}'")
+    try:
+        table = response.json()
+    except ValueError:
+        return problems + ["response is not JSON"]
+
+    devices = table.get("devices")
+    if not isinstance(table.get("sf_min"), int):
+        problems.append("missing 'sf_min'")
+    if not isinstance(devices, list):
+        return problems + ["missing 'devices' array"]
+
+    for device in devices:
+        devaddr = device.get("devaddr")
+        if not isinstance(devaddr, str) or len(devaddr) != 8 or any(c not in "0123456789ABCDEF" for c in devaddr):
+            problems.append(f"invalid devaddr {devaddr!r}")
+            continue
+        for key in ("rssi", "snr", "loss_pct"):
+            if not isinstance(device.get(key), (int, float)):
+                problems.append(f"device {devaddr}: missing '{key}'")
+        for key in ("age_s", "nb_pkt", "nb_lost", "fcnt"):
+            if not isinstance(device.get(key), int) or device[key] < 0:
+                problems.append(f"device {devaddr}: missing '{key}'")
+        if isinstance(device.get("loss_pct"), (int, float)) and not 0 <= device["loss_pct"] <= 100:
+            problems.append(f"device {devaddr}: loss_pct out of range")
+        if not isinstance(device.get("sf_hist"), list):
+            problems.append(f"device {devaddr}: missing 'sf_hist'")
+    return problems
+
 def parse_arguments():
     """
     Parse command line arguments.
@@ -201,6 +477,50 @@ if __name__ == "__main__":
     print_response(response)
     step_number += 1
 
+    # Get statistics
+    response = get_stats(base_url, step_number)
+    if response.status_code != 200:
+        print(f"{COLOR_RED}Get Stats Response: {response.status_code}{COLOR_RESET}")
+        print_response(response)
+        sys.exit(1)
+    print(f"{COLOR_GREEN}Get Stats Response: {response.status_code}{COLOR_RESET}")
+    print_response(response)
+    exit_on_problems("Get Stats Content", check_stats(response))
+    step_number += 1
+
+    # Get devices
+    response = get_devices(base_url, step_number)
+    if response.status_code != 200:
+        print(f"{COLOR_RED}Get Devices Response: {response.status_code}{COLOR_RESET}")
+        print_response(response)
+        sys.exit(1)
+    print(f"{COLOR_GREEN}Get Devices Response: {response.status_code}{COLOR_RESET}")
+    print_response(response)
+    exit_on_problems("Get Devices Content", check_devices(response))
+    step_number += 1
+
+    # Get metrics
+    response = get_metrics(base_url, step_number)
+    if response.status_code != 200:
+        print(f"{COLOR_RED}Get Metrics Response: {response.status_code}{COLOR_RESET}")
+        print_response(response)
+        sys.exit(1)
+    print(f"{COLOR_GREEN}Get Metrics Response: {response.status_code}{COLOR_RESET}")
+    print_response(response)
+    exit_on_problems("Get Metrics Content", check_metrics(response))
+    step_number += 1
+
+    # Get the live packet stream page
+    response = get_live(base_url, step_number)
+    if response.status_code != 200:
+        print(f"{COLOR_RED}Get Live Page Response: {response.status_code}{COLOR_RESET}")
+        print_response(response)
+        sys.exit(1)
+    print(f"{COLOR_GREEN}Get Live Page Response: {response.status_code}{COLOR_RESET}")
+    print_response(response)
+    exit_on_problems("Get Live Page Content", check_live(response))
+    step_number += 1
+
     # Set the configuration
     response = set_config(base_url, config, step_number)
     if response.status_code != 200:
@@ -211,6 +531,28 @@ if __name__ == "__main__":
     print_response(response)
     step_number += 1
 
+    # Apply the configuration without reboot
+    response = apply_config(base_url, step_number)
+    if response.status_code != 200:
+        print(f"{COLOR_RED}Apply Config Response: {response.status_code}{COLOR_RESET}")
+        print_response(response)
+        sys.exit(1)
+    print(f"{COLOR_GREEN}Apply Config Response: {response.status_code}{COLOR_RESET}")
+    print_response(response)
+    exit_on_problems("Apply Config Content", check_apply_config(response))
+    step_number += 1
+
+    # Apply it again, nothing changes anymore
+    response = apply_config(base_url, step_number)
+    if response.status_code != 200:
+        print(f"{COLOR_RED}Apply Config Again Response: {response.status_code}{COLOR_RESET}")
+        print_response(response)
+        sys.exit(1)
+    print(f"{COLOR_GREEN}Apply Config Again Response: {response.status_code}{COLOR_RESET}")
+    print_response(response)
+    exit_on_problems("Apply Config Again Content", check_apply_config(response, expect_change=False))
+    step_number += 1
+
     # Reboot the device
     response = reboot(base_url, step_number)
     if response.status_code != 200:
@@ -0,0 +1,99 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Class A downlink responder: answers each received rxpk in RX1 and
+    correlates TX_ACK results per spreading factor and network latency
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _CLASS_A_H
+#define _CLASS_A_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdbool.h> /* bool type */
+#include <stddef.h>  /* size_t */
+#include <stdint.h>  /* C99 types */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define CLASS_A_LATENCY_BUCKET_MS 50 /* width of the latency histogram bins */
+#define CLASS_A_LATENCY_BUCKETS 40   /* last bin also collects all larger latencies */
+#define CLASS_A_MAX_RESP 8           /* max number of responses built from one PUSH_DATA */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t rx1_delay_us; /* added to the uplink tmst */
+    int8_t   rf_power;     /* TX power of the responses, dBm */
+    uint8_t  pl_size;      /* payload size of the responses, bytes */
+} class_a_params_t;
+
+/**
+@struct class_a_resp_s
+@brief One downlink to be sent in answer to an uplink
+*/
+typedef struct class_a_resp_s
+{
+    uint8_t sf;
+    char    json[768]; /* txpk object, null terminated (fits a 255 bytes payload) */
+    int     len;
+} class_a_resp_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Initialize the responder and clear its statistics
+*/
+void class_a_init( const class_a_params_t* params );
+
+/**
+@brief Build the RX1 responses to the valid LoRa rxpk of a PUSH_DATA
+@param json PUSH_DATA JSON payload (after the 12 bytes header), null terminated
+@param resp array of CLASS_A_MAX_RESP responses to be filled
+@return number of responses built
+*/
+int class_a_build( const char* json, class_a_resp_t* resp );
+
+/**
+@brief Register a response about to be sent, to correlate its TX_ACK
+@param sf spreading factor of the response
+@param latency_us network latency added before sending the response
+@return token to be used in the PULL_RESP header
+*/
+uint16_t class_a_track( uint8_t sf, uint32_t latency_us );
+
+/**
+@brief Account for a response which could not be sent, releases its token
+*/
+void class_a_untrack( uint16_t token );
+
+/**
+@brief Correlate a TX_ACK with a tracked response
+@param token token of the TX_ACK header
+@param json TX_ACK JSON payload, null terminated (can be empty)
+@return true if the token matched a tracked response
+*/
+bool class_a_tx_ack( uint16_t token, const char* json );
+
+/**
+@brief Print the acceptance ratio per spreading factor and per latency
+*/
+void class_a_report( void );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
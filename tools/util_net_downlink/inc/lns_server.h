@@ -0,0 +1,101 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Multi-gateway LNS emulator (epoll based server mode of net_downlink)
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LNS_SERVER_H
+#define _LNS_SERVER_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdbool.h> /* bool type */
+#include <stddef.h>  /* size_t */
+#include <stdint.h>  /* C99 types */
+
+#include "class_a.h"
+#include "udp_sched.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LNS_SERVER_WORKERS_MAX 32
+#define LNS_SERVER_GW_TABLE_SIZE 16384 /* max number of gateways tracked, must be a power of 2 */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef enum
+{
+    LNS_IMPAIR_PUSH_ACK = 0,
+    LNS_IMPAIR_PULL_ACK,
+    LNS_IMPAIR_PULL_RESP,
+    LNS_IMPAIR_NB
+} lns_impair_target_t;
+
+/**
+@brief Callback building the JSON payload of a PULL_RESP sent by the downlink load generator
+@param ctx user context given in the server parameters
+@param seq downlink sequence number
+@param buf buffer where to write the JSON string (null terminated)
+@param size size of the buffer
+@return length of the JSON string, -1 on error
+*/
+typedef int ( *lns_server_dl_build_t )( void* ctx, uint32_t seq, char* buf, size_t size );
+
+typedef struct
+{
+    unsigned     nb_workers;            /* number of receiving threads (one SO_REUSEPORT socket each) */
+    unsigned     report_interval_s;     /* throughput report period */
+    impair_t     impair[LNS_IMPAIR_NB]; /* backhaul impairments, per kind of datagram sent to the gateways */
+    uint64_t     seed;                  /* seed of the pseudo-random generators, 0 for time based */
+
+    /* Downlink load generator ("imme" PULL_RESP to every gateway with a known PULL address) */
+    uint32_t              dl_nb_loop;  /* number of downlink rounds, 0 to disable */
+    uint32_t              dl_delay_ms; /* delay between 2 downlink rounds */
+    lns_server_dl_build_t dl_build;
+    void*                 dl_ctx;
+
+    /* Class A responder (RX1 answer to every uplink, see class_a.h) */
+    bool             class_a;
+    class_a_params_t class_a_params;
+    delay_dist_t     class_a_latency; /* network server processing latency added before sending the answer */
+
+    bool bin_log; /* hand PUSH_DATA over to the binary uplink log (see uplink_log.h), opened by the caller */
+} lns_server_params_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Parse a backhaul impairment option
+@param arg "<target>,<impairments>", target is push_ack, pull_ack, pull_resp, acks or all, impairments as accepted
+by impair_parse()
+@param params server configuration to be updated
+@return 0 on success, -1 on syntax error
+*/
+int lns_server_parse_impair( const char* arg, lns_server_params_t* params );
+
+/**
+@brief Run the multi-gateway server until one of the exit flags is set
+@param port UDP port to listen on
+@param params server configuration
+@param exit_flag pointer to a flag set by the signal handler to terminate
+@param quit_flag pointer to a flag set by the signal handler to terminate
+@return 0 on clean exit, -1 on setup error
+*/
+int lns_server_run( const char* port, const lns_server_params_t* params, const int* exit_flag, const int* quit_flag );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
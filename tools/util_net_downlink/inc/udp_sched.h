@@ -0,0 +1,205 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Deferred UDP datagram scheduler, delay distributions and pseudo-random generator
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _UDP_SCHED_H
+#define _UDP_SCHED_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdbool.h> /* bool type */
+#include <stddef.h>  /* size_t */
+#include <stdint.h>  /* C99 types */
+
+#include <sys/socket.h> /* sockaddr_storage, socklen_t */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define UDP_SCHED_DGRAM_MAX 1024 /* largest datagram which can be deferred (PULL_RESP of a 255 bytes payload) */
+#define UDP_SCHED_INLINE_MAX 16  /* datagrams up to this size (ACKs) are stored in the entry, not in a pool slot */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct rng_s
+@brief xorshift64* pseudo-random generator state, one per thread
+*/
+typedef struct rng_s
+{
+    uint64_t s;
+} rng_t;
+
+typedef enum
+{
+    DELAY_DIST_NONE = 0, /* no delay */
+    DELAY_DIST_CONST,    /* a ms */
+    DELAY_DIST_UNIFORM,  /* uniform in [a, b] ms */
+    DELAY_DIST_NORMAL,   /* mean a ms, standard deviation b ms, truncated at 0 */
+    DELAY_DIST_EXP,      /* a ms fixed part + exponential tail of mean b ms */
+} delay_dist_type_t;
+
+typedef struct
+{
+    delay_dist_type_t type;
+    double            a;
+    double            b;
+} delay_dist_t;
+
+/**
+@struct impair_s
+@brief Impairments applied to one kind of datagram sent on the backhaul
+*/
+typedef struct impair_s
+{
+    delay_dist_t delay;          /* one-way latency and jitter */
+    double       loss;           /* probability for the datagram to be dropped [0..1] */
+    double       dup;            /* probability for the datagram to be sent twice [0..1] */
+    double       reorder;        /* probability for the datagram to be held back and overtaken [0..1] */
+    uint32_t     reorder_gap_us; /* extra delay of reordered datagrams */
+} impair_t;
+
+/**
+@struct udp_sched_item_s
+@brief A datagram waiting for its due time
+*/
+typedef struct udp_sched_item_s
+{
+    uint64_t                due_ns; /* CLOCK_MONOTONIC time at which the datagram must be sent */
+    uint64_t                seq;    /* insertion order, keeps FIFO order between equal due times */
+    int                     sock;
+    struct sockaddr_storage addr;
+    socklen_t               addr_len;
+    uint16_t                len;
+    uint32_t                slot; /* pool slot holding the datagram, if longer than UDP_SCHED_INLINE_MAX */
+    uint8_t                 data_inline[UDP_SCHED_INLINE_MAX];
+} udp_sched_item_t;
+
+/**
+@struct udp_sched_s
+@brief Binary min-heap of deferred datagrams, owned by a single thread (no locking)
+
+Datagrams are copied in a pool of fixed size slots allocated with the heap, no allocation is done once started.
+*/
+typedef struct udp_sched_s
+{
+    udp_sched_item_t* heap;
+    uint32_t          size;
+    uint32_t          capacity;
+    uint8_t*          pool;         /* nb_slot slots of UDP_SCHED_DGRAM_MAX bytes */
+    uint32_t*         slots_free;   /* stack of the free slots */
+    uint32_t          nb_slot;
+    uint32_t          nb_slot_free;
+    uint64_t          seq;
+    uint64_t          nb_sent;       /* datagrams handed over to the kernel */
+    uint64_t          nb_send_error; /* datagrams the kernel refused */
+    uint64_t          nb_overflow;   /* datagrams dropped because the scheduler or its pool was full */
+} udp_sched_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Get current CLOCK_MONOTONIC time
+@return time in nanoseconds
+*/
+uint64_t udp_sched_now_ns( void );
+
+/**
+@brief Seed a pseudo-random generator
+@param rng generator to be seeded
+@param seed any value, 0 is remapped to a fixed non-null constant
+*/
+void rng_seed( rng_t* rng, uint64_t seed );
+
+/**
+@brief Draw a 64-bits pseudo-random number
+*/
+uint64_t rng_next( rng_t* rng );
+
+/**
+@brief Draw a pseudo-random number uniformly distributed in [0, 1)
+*/
+double rng_uniform( rng_t* rng );
+
+/**
+@brief Parse a delay distribution specification
+@param spec "none", "<a>" or "const:<a>", "uniform:<min>:<max>", "normal:<mean>:<sd>", "exp:<min>:<mean>" (ms)
+@param dist parsed distribution
+@return 0 on success, -1 on syntax error
+*/
+int delay_dist_parse( const char* spec, delay_dist_t* dist );
+
+/**
+@brief Draw a delay from a distribution
+@return delay in microseconds
+*/
+uint32_t delay_dist_draw_us( const delay_dist_t* dist, rng_t* rng );
+
+/**
+@brief Format a delay distribution as human readable string
+*/
+void delay_dist_to_str( const delay_dist_t* dist, char* str, size_t size );
+
+/**
+@brief Parse an impairment specification, fields not given are left unchanged
+@param spec comma separated list of "delay=<dist>", "loss=<%>", "dup=<%>", "reorder=<%>", "gap=<ms>"
+@param impair parsed impairments
+@return 0 on success, -1 on syntax error
+*/
+int impair_parse( const char* spec, impair_t* impair );
+
+/**
+@brief Format impairments as human readable string
+*/
+void impair_to_str( const impair_t* impair, char* str, size_t size );
+
+/**
+@brief Allocate the scheduler heap and its datagram pool
+@param capacity max number of deferred datagrams
+@param nb_slot max number of deferred datagrams longer than UDP_SCHED_INLINE_MAX
+@return 0 on success, -1 on allocation failure
+*/
+int udp_sched_init( udp_sched_t* sched, uint32_t capacity, uint32_t nb_slot );
+
+/**
+@brief Release the scheduler heap, its pool and pending datagrams (not sent)
+*/
+void udp_sched_free( udp_sched_t* sched );
+
+/**
+@brief Send a datagram after a delay, or immediately if delay is 0
+@return 0 if sent or scheduled, -1 otherwise (send error, too long or scheduler full)
+*/
+int udp_sched_send( udp_sched_t* sched, int sock, const void* buf, size_t len, const struct sockaddr* addr,
+                    socklen_t addr_len, uint32_t delay_us );
+
+/**
+@brief Send all datagrams whose due time is reached
+@param now_ns current CLOCK_MONOTONIC time
+@return number of datagrams sent
+*/
+int udp_sched_flush( udp_sched_t* sched, uint64_t now_ns );
+
+/**
+@brief Get the time until the next datagram is due, to be used as poll timeout
+@return -1 if nothing is pending, time in milliseconds (rounded up) otherwise
+*/
+int udp_sched_timeout_ms( const udp_sched_t* sched, uint64_t now_ns );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
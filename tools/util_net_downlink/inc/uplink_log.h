@@ -0,0 +1,93 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Binary uplink log: columnar blocks of fixed-size rxpk fields followed by a
+    payload side-buffer, written by a background thread
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _UPLINK_LOG_H
+#define _UPLINK_LOG_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdbool.h> /* bool type */
+#include <stddef.h>  /* size_t */
+#include <stdint.h>  /* C99 types */
+#include <stdio.h>   /* FILE */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define UPLINK_LOG_MAGIC "LHUL"
+#define UPLINK_LOG_VERSION 1
+#define UPLINK_LOG_BLOCK_RECORDS 4096   /* max number of rxpk per block */
+#define UPLINK_LOG_STAGING_SIZE 1048576 /* size of each of the 2 staging buffers, bytes */
+#define UPLINK_LOG_FLUSH_MS 1000        /* max time a datagram stays in memory */
+
+/*
+ * File layout (host byte order):
+ *   header: magic "LHUL", uint32 version
+ *   blocks: uint32 nb_rec, uint32 pl_bytes, then one array of nb_rec items per column:
+ *           uint64 host_ms, uint64 gw_mac, uint32 tmst, uint32 freq_hz, uint32 datr (SF or bps), uint32 pl_offset,
+ *           int16 rssi_x10, int16 lsnr_x10, uint16 bw_khz, uint8 chan, uint8 rfch, int8 stat, uint8 modu,
+ *           uint8 codr (4/x denominator, 0 if none), uint8 size,
+ *           then pl_bytes of payloads, indexed by pl_offset
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct
+{
+    uint64_t nb_dgram;   /* PUSH_DATA handed to the logger */
+    uint64_t nb_dropped; /* PUSH_DATA dropped because the writer could not keep up */
+    uint64_t nb_rec;     /* rxpk written */
+    uint64_t nb_invalid; /* rxpk skipped because of a format error */
+    uint64_t nb_bytes;   /* bytes written */
+} uplink_log_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Create the log file and start the writer thread
+@param fname path of the binary log file, overwritten if it exists
+@return 0 on success, -1 on error
+*/
+int uplink_log_open( const char* fname );
+
+/**
+@brief Hand a PUSH_DATA over to the writer, without blocking on disk I/O (thread safe)
+@param gw_mac MAC address of the gateway
+@param json PUSH_DATA JSON payload (after the 12 bytes header), not necessarily null terminated
+@param len length of the JSON payload
+*/
+void uplink_log_push( uint64_t gw_mac, const uint8_t* json, size_t len );
+
+/**
+@brief Write pending data, stop the writer thread and close the file
+@param stats statistics of the logger, can be NULL
+*/
+void uplink_log_close( uplink_log_stats_t* stats );
+
+/**
+@brief Convert a binary log to CSV (same columns as the -l option)
+@param fname path of the binary log file
+@param out output stream
+@return number of records converted, -1 on error
+*/
+long uplink_log_to_csv( const char* fname, FILE* out );
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,383 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Class A downlink responder: answers each received rxpk in RX1 and
+    correlates TX_ACK results per spreading factor and network latency
+
+    Every response gets its own PULL_RESP token, so that the TX_ACK sent
+    back by the packet forwarder (JIT enqueue result) can be matched with the
+    spreading factor and the network latency which was injected before the
+    response was sent.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#include <stdio.h>  /* printf, snprintf */
+#include <string.h> /* memset, strcmp */
+
+#include <pthread.h>
+
+#include "base64.h"
+#include "class_a.h"
+#include "parson.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SF_MIN 5
+#define SF_MAX 12
+#define SF_NB ( SF_MAX - SF_MIN + 1 )
+
+#define TOKEN_NB 65536
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef enum
+{
+    RES_SENT = 0,
+    RES_OK, /* no error, warnings (TX_POWER) included */
+    RES_TOO_LATE,
+    RES_TOO_EARLY,
+    RES_COLLISION_PACKET,
+    RES_COLLISION_BEACON,
+    RES_OTHER,  /* any other error reported by the forwarder */
+    RES_NO_ACK, /* no TX_ACK received, or not sent by us */
+    RES_NB
+} result_t;
+
+typedef struct
+{
+    bool    used;
+    uint8_t sf;
+    uint8_t bucket;
+} pending_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static class_a_params_t cfg;
+
+static pthread_mutex_t mx_class_a = PTHREAD_MUTEX_INITIALIZER; /* control access to the tables below */
+
+static uint32_t  results[SF_NB][CLASS_A_LATENCY_BUCKETS][RES_NB];
+static pending_t pending[TOKEN_NB];
+static uint16_t  next_token = 0;
+
+static const char* result_names[RES_NB] = { "sent",     "ok",       "too_late", "too_early",
+                                            "coll_pkt", "coll_bcn", "other",    "no_ack" };
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static result_t parse_tx_ack( const char* json )
+{
+    JSON_Value*  root_val;
+    JSON_Object* ack_obj;
+    const char*  err;
+    result_t     res = RES_OK;
+
+    if( ( json == NULL ) || ( json[0] == '\0' ) )
+    {
+        return RES_OK; /* legacy forwarders send an empty TX_ACK on success */
+    }
+    root_val = json_parse_string_with_comments( json );
+    if( root_val == NULL )
+    {
+        return RES_OTHER;
+    }
+    ack_obj = json_object_get_object( json_value_get_object( root_val ), "txpk_ack" );
+    err     = ( ack_obj != NULL ) ? json_object_get_string( ack_obj, "error" ) : NULL;
+    if( err != NULL )
+    {
+        if( strcmp( err, "NONE" ) == 0 )
+        {
+            res = RES_OK;
+        }
+        else if( strcmp( err, "TOO_LATE" ) == 0 )
+        {
+            res = RES_TOO_LATE;
+        }
+        else if( strcmp( err, "TOO_EARLY" ) == 0 )
+        {
+            res = RES_TOO_EARLY;
+        }
+        else if( strcmp( err, "COLLISION_PACKET" ) == 0 )
+        {
+            res = RES_COLLISION_PACKET;
+        }
+        else if( strcmp( err, "COLLISION_BEACON" ) == 0 )
+        {
+            res = RES_COLLISION_BEACON;
+        }
+        else
+        {
+            res = RES_OTHER;
+        }
+    }
+    json_value_free( root_val );
+
+    return res;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void print_row( const char* label, const uint32_t* r )
+{
+    unsigned k;
+    double   sent = ( double ) r[RES_SENT];
+
+    printf( "%-14s %7u", label, r[RES_SENT] );
+    for( k = RES_OK; k < RES_NB; k++ )
+    {
+        printf( " %8.1f%%", ( sent > 0 ) ? ( 100.0 * r[k] / sent ) : 0.0 );
+    }
+    printf( "\n" );
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS ----------------------------------------------------- */
+
+void class_a_init( const class_a_params_t* params )
+{
+    pthread_mutex_lock( &mx_class_a );
+    cfg = *params;
+    memset( results, 0, sizeof results );
+    memset( pending, 0, sizeof pending );
+    next_token = 0;
+    pthread_mutex_unlock( &mx_class_a );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int class_a_build( const char* json, class_a_resp_t* resp )
+{
+    JSON_Value*  root_val;
+    JSON_Array*  rxpk_arr;
+    JSON_Object* rxpk;
+    const char*  str;
+    const char*  codr;
+    unsigned     sf, bw;
+    uint32_t     tmst;
+    double       freq;
+    size_t       i;
+    int          j, nb_resp = 0;
+    uint8_t      payload[255];
+    char         payload_b64[341];
+
+    root_val = json_parse_string_with_comments( json );
+    if( root_val == NULL )
+    {
+        return 0;
+    }
+    rxpk_arr = json_object_get_array( json_value_get_object( root_val ), "rxpk" );
+    for( i = 0; ( rxpk_arr != NULL ) && ( i < json_array_get_count( rxpk_arr ) ) && ( nb_resp < CLASS_A_MAX_RESP );
+         i++ )
+    {
+        rxpk = json_array_get_object( rxpk_arr, i );
+        if( rxpk == NULL )
+        {
+            continue;
+        }
+
+        /* Only answer uplinks a network server would answer: LoRa with a valid CRC */
+        str = json_object_get_string( rxpk, "modu" );
+        if( ( str == NULL ) || ( strcmp( str, "LORA" ) != 0 ) )
+        {
+            continue;
+        }
+        if( json_object_get_number( rxpk, "stat" ) != 1 )
+        {
+            continue;
+        }
+        str = json_object_get_string( rxpk, "datr" );
+        if( ( str == NULL ) || ( sscanf( str, "SF%uBW%u", &sf, &bw ) != 2 ) || ( sf < SF_MIN ) || ( sf > SF_MAX ) )
+        {
+            continue;
+        }
+        if( json_object_get_value( rxpk, "tmst" ) == NULL )
+        {
+            continue;
+        }
+        tmst = ( uint32_t ) json_object_get_number( rxpk, "tmst" );
+        freq = json_object_get_number( rxpk, "freq" );
+        codr = json_object_get_string( rxpk, "codr" );
+
+        /* Fill last bytes of payload with the uplink timestamp, to ease sniffer correlation */
+        memset( payload, 0, sizeof payload );
+        for( j = 0; ( j < cfg.pl_size ) && ( j < 4 ); j++ )
+        {
+            payload[cfg.pl_size - ( j + 1 )] = ( uint8_t ) ( ( tmst >> ( j * 8 ) ) & 0xFF );
+        }
+        if( bin_to_b64( payload, cfg.pl_size, payload_b64, sizeof payload_b64 ) < 0 )
+        {
+            continue;
+        }
+
+        /* RX1: same channel and data rate as the uplink, tmst wraps around like the concentrator counter */
+        j = snprintf( resp[nb_resp].json, sizeof resp[nb_resp].json,
+                      "{\"txpk\":{\"imme\":false,\"tmst\":%u,\"freq\":%.6f,\"rfch\":0,\"powe\":%d,\"modu\":\"LORA\","
+                      "\"datr\":\"%s\",\"codr\":\"%s\",\"ipol\":true,\"size\":%u,\"ncrc\":true,\"data\":\"%s\"}}",
+                      ( uint32_t ) ( tmst + cfg.rx1_delay_us ), freq, cfg.rf_power, str,
+                      ( codr != NULL ) ? codr : "4/5", cfg.pl_size, payload_b64 );
+        if( ( j < 0 ) || ( ( size_t ) j >= sizeof resp[nb_resp].json ) )
+        {
+            continue;
+        }
+        resp[nb_resp].sf  = ( uint8_t ) sf;
+        resp[nb_resp].len = j;
+        nb_resp += 1;
+    }
+    json_value_free( root_val );
+
+    return nb_resp;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint16_t class_a_track( uint8_t sf, uint32_t latency_us )
+{
+    uint32_t   bucket = latency_us / ( CLASS_A_LATENCY_BUCKET_MS * 1000 );
+    uint16_t   token;
+    pending_t* p;
+
+    if( bucket >= CLASS_A_LATENCY_BUCKETS )
+    {
+        bucket = CLASS_A_LATENCY_BUCKETS - 1;
+    }
+
+    pthread_mutex_lock( &mx_class_a );
+    if( next_token == 0 )
+    {
+        next_token = 1; /* token 0 is used by the periodic downlink generator */
+    }
+    token = next_token++;
+    p     = &pending[token];
+    if( p->used )
+    {
+        /* token wrapped around before a TX_ACK came back */
+        results[p->sf - SF_MIN][p->bucket][RES_NO_ACK] += 1;
+    }
+    p->used   = true;
+    p->sf     = sf;
+    p->bucket = ( uint8_t ) bucket;
+    results[sf - SF_MIN][bucket][RES_SENT] += 1;
+    pthread_mutex_unlock( &mx_class_a );
+
+    return token;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void class_a_untrack( uint16_t token )
+{
+    pending_t* p = &pending[token];
+
+    pthread_mutex_lock( &mx_class_a );
+    if( p->used )
+    {
+        results[p->sf - SF_MIN][p->bucket][RES_NO_ACK] += 1;
+        p->used = false;
+    }
+    pthread_mutex_unlock( &mx_class_a );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool class_a_tx_ack( uint16_t token, const char* json )
+{
+    pending_t* p   = &pending[token];
+    result_t   res = parse_tx_ack( json );
+    bool       matched;
+
+    pthread_mutex_lock( &mx_class_a );
+    matched = p->used;
+    if( matched )
+    {
+        results[p->sf - SF_MIN][p->bucket][res] += 1;
+        p->used = false;
+    }
+    pthread_mutex_unlock( &mx_class_a );
+
+    return matched;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void class_a_report( void )
+{
+    uint32_t per_sf[SF_NB][RES_NB];
+    uint32_t per_bucket[CLASS_A_LATENCY_BUCKETS][RES_NB];
+    char     label[32];
+    unsigned sf, b, k;
+
+    memset( per_sf, 0, sizeof per_sf );
+    memset( per_bucket, 0, sizeof per_bucket );
+
+    pthread_mutex_lock( &mx_class_a );
+    for( sf = 0; sf < SF_NB; sf++ )
+    {
+        for( b = 0; b < CLASS_A_LATENCY_BUCKETS; b++ )
+        {
+            for( k = 0; k < RES_NB; k++ )
+            {
+                per_sf[sf][k] += results[sf][b][k];
+                per_bucket[b][k] += results[sf][b][k];
+            }
+        }
+    }
+    /* responses still waiting for their TX_ACK */
+    for( k = 0; k < TOKEN_NB; k++ )
+    {
+        if( pending[k].used )
+        {
+            per_sf[pending[k].sf - SF_MIN][RES_NO_ACK] += 1;
+            per_bucket[pending[k].bucket][RES_NO_ACK] += 1;
+        }
+    }
+    pthread_mutex_unlock( &mx_class_a );
+
+    printf( "INFO: Class A responder, RX1 delay %u ms\n", cfg.rx1_delay_us / 1000 );
+    printf( "%-14s %7s", "", result_names[RES_SENT] );
+    for( k = RES_OK; k < RES_NB; k++ )
+    {
+        printf( " %9s", result_names[k] );
+    }
+    printf( "\n" );
+    for( sf = 0; sf < SF_NB; sf++ )
+    {
+        if( per_sf[sf][RES_SENT] > 0 )
+        {
+            snprintf( label, sizeof label, "SF%u", sf + SF_MIN );
+            print_row( label, per_sf[sf] );
+        }
+    }
+    for( b = 0; b < CLASS_A_LATENCY_BUCKETS; b++ )
+    {
+        if( per_bucket[b][RES_SENT] > 0 )
+        {
+            if( b < ( CLASS_A_LATENCY_BUCKETS - 1 ) )
+            {
+                snprintf( label, sizeof label, "%4u-%4u ms", b * CLASS_A_LATENCY_BUCKET_MS,
+                          ( ( b + 1 ) * CLASS_A_LATENCY_BUCKET_MS ) - 1 );
+            }
+            else
+            {
+                snprintf( label, sizeof label, ">= %u ms", b * CLASS_A_LATENCY_BUCKET_MS );
+            }
+            print_row( label, per_bucket[b] );
+        }
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,1010 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Multi-gateway LNS emulator (epoll based server mode of net_downlink)
+
+    Each worker thread owns a non-blocking UDP socket bound with SO_REUSEPORT
+    on the server port, so that the kernel spreads gateways across workers.
+    Datagrams are drained by batches with recvmmsg() and acknowledged
+    immediately, or after an injected delay through a per-worker scheduler.
+    Optionally, every uplink is answered in RX1 by the Class A responder.
+
+    Backhaul impairments (latency, jitter, loss, duplication, reordering) are
+    emulated on the datagrams sent to the gateways, so that the forwarder ACK,
+    keepalive and auto-quit logic can be exercised without netem privileges.
+    The stat reports of the gateways are logged to observe their effects.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE /* recvmmsg, SO_REUSEPORT */
+
+#include <errno.h>  /* error messages */
+#include <stdio.h>  /* printf */
+#include <stdlib.h> /* calloc, free */
+#include <string.h> /* memset, memcpy */
+#include <time.h>   /* time, nanosleep */
+#include <unistd.h> /* close, usleep */
+
+#include <arpa/inet.h> /* ntohl */
+#include <inttypes.h>  /* PRIx64 */
+#include <netdb.h>     /* getaddrinfo */
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <pthread.h>
+
+#include "lns_server.h"
+#include "parson.h"
+#include "udp_sched.h"
+#include "uplink_log.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PROTOCOL_VERSION 2
+
+#define PKT_PUSH_DATA 0
+#define PKT_PUSH_ACK 1
+#define PKT_PULL_DATA 2
+#define PKT_PULL_RESP 3
+#define PKT_PULL_ACK 4
+#define PKT_TX_ACK 5
+
+#define RECV_BATCH 64        /* datagrams fetched per recvmmsg() call */
+#define RECV_DGRAM_MAX 8192  /* PUSH_DATA can carry several rxpk and a stat object */
+#define EPOLL_TIMEOUT_MAX_MS 100
+#define SCHED_CAPACITY 65536 /* max deferred datagrams per worker */
+#define SCHED_SLOTS 4096     /* max deferred datagrams longer than an ACK per worker, 4 MB of pool */
+#define GW_TABLE_LOCKS 64    /* lock striping of the gateway table, must be a power of 2 */
+#define DL_BUFF_SIZE 4096
+
+/* State of a gateway table slot, the MAC is written between the claim of the slot and its publication */
+#define GW_SLOT_FREE 0
+#define GW_SLOT_CLAIMED 1
+#define GW_SLOT_READY 2
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef struct
+{
+    uint8_t                 state; /* GW_SLOT_xxx, mac can be read once GW_SLOT_READY is loaded with acquire */
+    uint64_t                mac;
+    bool                    pull_valid;
+    struct sockaddr_storage pull_addr; /* where PULL_RESP must be sent */
+    socklen_t               pull_addr_len;
+    uint32_t                nb_push;
+    uint32_t                nb_pull;
+    uint32_t                nb_txack;
+    uint32_t                nb_stat;  /* number of stat reports received */
+    double                  ackr_sum; /* sum of the PUSH_DATA acknowledge ratios reported */
+    uint64_t                last_seen_ns;
+} gw_entry_t;
+
+typedef struct
+{
+    uint64_t nb_drop;
+    uint64_t nb_dup;
+    uint64_t nb_reorder;
+} impair_stats_t;
+
+typedef struct
+{
+    unsigned                   id;
+    int                        sock;
+    int                        epfd;
+    pthread_t                  thrid;
+    udp_sched_t                sched;
+    rng_t                      rng;
+    const lns_server_params_t* params;
+
+    /* statistics, written by the worker, read by the reporting thread */
+    uint64_t nb_rx;
+    uint64_t nb_rx_push;
+    uint64_t nb_rx_pull;
+    uint64_t nb_rx_txack;
+    uint64_t nb_rx_invalid;
+    uint64_t       nb_tx;
+    uint64_t       nb_tx_class_a;
+    uint64_t       nb_rx_stat;
+    impair_stats_t impair;
+} worker_t;
+
+typedef struct
+{
+    uint64_t nb_rx;
+    uint64_t nb_rx_push;
+    uint64_t nb_rx_pull;
+    uint64_t nb_rx_txack;
+    uint64_t nb_rx_invalid;
+    uint64_t       nb_tx;
+    uint64_t       nb_tx_class_a;
+    uint64_t       nb_rx_stat;
+    impair_stats_t impair;
+} worker_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static gw_entry_t*     gw_table = NULL;
+static pthread_mutex_t gw_locks[GW_TABLE_LOCKS];
+static uint32_t        gw_count      = 0; /* number of gateways seen */
+static uint32_t        gw_table_full = 0; /* datagrams from gateways which could not be tracked */
+
+static worker_t       workers[LNS_SERVER_WORKERS_MAX];
+static impair_stats_t dl_impair_stats; /* impairments applied by the downlink generator */
+
+static const char* impair_names[LNS_IMPAIR_NB] = { "push_ack", "pull_ack", "pull_resp" };
+
+static const int* srv_exit_flag = NULL;
+static const int* srv_quit_flag = NULL;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static bool must_stop( void )
+{
+    return ( *( volatile const int* ) srv_exit_flag == 1 ) || ( *( volatile const int* ) srv_quit_flag == 1 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t gw_hash( uint64_t mac )
+{
+    /* 64-bits finalizer (splitmix64) */
+    mac ^= mac >> 30;
+    mac *= 0xBF58476D1CE4E5B9ULL;
+    mac ^= mac >> 27;
+    mac *= 0x94D049BB133111EBULL;
+    mac ^= mac >> 31;
+    return ( uint32_t ) mac;
+}
+
+/**
+@brief Find or insert a gateway, returns with the stripe lock held
+@param mac gateway MAC address
+@param lock_idx index of the lock taken, to be released by the caller
+@return pointer to the gateway entry, NULL if the table is full (lock is released)
+*/
+static gw_entry_t* gw_get_locked( uint64_t mac, unsigned* lock_idx )
+{
+    uint32_t h = gw_hash( mac );
+    uint32_t i, idx;
+    uint8_t  state;
+
+    /* Entries are never removed, so probing sequences are stable and a stripe lock per home slot is enough to
+     * serialize concurrent inserts of the same MAC. Different MACs may share slots across stripes: the slot
+     * is claimed with an atomic compare and swap, then published once its MAC is written */
+    *lock_idx = h & ( GW_TABLE_LOCKS - 1 );
+    pthread_mutex_lock( &gw_locks[*lock_idx] );
+    for( i = 0; i < LNS_SERVER_GW_TABLE_SIZE; i++ )
+    {
+        idx   = ( h + i ) & ( LNS_SERVER_GW_TABLE_SIZE - 1 );
+        state = __atomic_load_n( &gw_table[idx].state, __ATOMIC_ACQUIRE );
+        if( state == GW_SLOT_READY )
+        {
+            if( gw_table[idx].mac == mac )
+            {
+                return &gw_table[idx];
+            }
+            continue;
+        }
+        if( state == GW_SLOT_CLAIMED )
+        {
+            continue; /* being inserted from another stripe, so it is another MAC */
+        }
+        if( __atomic_compare_exchange_n( &gw_table[idx].state, &state, GW_SLOT_CLAIMED, false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE ) )
+        {
+            gw_table[idx].mac = mac;
+            __atomic_store_n( &gw_table[idx].state, GW_SLOT_READY, __ATOMIC_RELEASE );
+            __atomic_add_fetch( &gw_count, 1, __ATOMIC_RELAXED );
+            return &gw_table[idx];
+        }
+        /* slot claimed meanwhile by a gateway of another stripe, keep probing */
+    }
+    pthread_mutex_unlock( &gw_locks[*lock_idx] );
+    __atomic_add_fetch( &gw_table_full, 1, __ATOMIC_RELAXED );
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void stat_inc( uint64_t* counter )
+{
+    __atomic_add_fetch( counter, 1, __ATOMIC_RELAXED );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+@brief Send a datagram through the backhaul emulation
+@param extra_delay_us delay added on top of the impairment latency
+@return 1 if sent or scheduled, 0 if dropped on purpose, -1 on error
+*/
+static int send_impaired( udp_sched_t* sched, rng_t* rng, impair_stats_t* stats, const impair_t* imp, int sock,
+                          const uint8_t* buf, size_t len, const struct sockaddr_storage* addr, socklen_t addr_len,
+                          uint32_t extra_delay_us )
+{
+    uint32_t delay_us;
+    int      ret;
+
+    if( ( imp->loss > 0.0 ) && ( rng_uniform( rng ) < imp->loss ) )
+    {
+        stat_inc( &stats->nb_drop );
+        return 0;
+    }
+
+    delay_us = extra_delay_us + delay_dist_draw_us( &imp->delay, rng );
+    if( ( imp->reorder > 0.0 ) && ( rng_uniform( rng ) < imp->reorder ) )
+    {
+        /* held back, datagrams sent meanwhile overtake it */
+        delay_us += imp->reorder_gap_us;
+        stat_inc( &stats->nb_reorder );
+    }
+    ret = udp_sched_send( sched, sock, buf, len, ( const struct sockaddr* ) addr, addr_len, delay_us );
+    if( ret != 0 )
+    {
+        return -1;
+    }
+
+    if( ( imp->dup > 0.0 ) && ( rng_uniform( rng ) < imp->dup ) )
+    {
+        /* the copy gets its own latency, as a retransmission on the radio link would */
+        delay_us = extra_delay_us + delay_dist_draw_us( &imp->delay, rng );
+        if( udp_sched_send( sched, sock, buf, len, ( const struct sockaddr* ) addr, addr_len, delay_us ) == 0 )
+        {
+            stat_inc( &stats->nb_dup );
+        }
+    }
+
+    return 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void send_ack( worker_t* w, const uint8_t* req, uint8_t ack_command, const struct sockaddr_storage* addr,
+                      socklen_t addr_len )
+{
+    uint8_t             ack[4];
+    lns_impair_target_t target = ( ack_command == PKT_PUSH_ACK ) ? LNS_IMPAIR_PUSH_ACK : LNS_IMPAIR_PULL_ACK;
+
+    ack[0] = PROTOCOL_VERSION;
+    ack[1] = req[1]; /* token */
+    ack[2] = req[2];
+    ack[3] = ack_command;
+
+    if( send_impaired( &w->sched, &w->rng, &w->impair, &w->params->impair[target], w->sock, ack, sizeof ack, addr,
+                       addr_len, 0 ) > 0 )
+    {
+        stat_inc( &w->nb_tx );
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void log_gw_stat( worker_t* w, const char* json, uint64_t gw_mac )
+{
+    JSON_Value*  root_val;
+    JSON_Object* stat_obj;
+    gw_entry_t*  gw;
+    unsigned     lock_idx;
+    double       ackr;
+
+    if( strstr( json, "\"stat\"" ) == NULL )
+    {
+        return; /* do not parse the JSON of every uplink */
+    }
+    root_val = json_parse_string_with_comments( json );
+    if( root_val == NULL )
+    {
+        return;
+    }
+    stat_obj = json_object_get_object( json_value_get_object( root_val ), "stat" );
+    if( stat_obj != NULL )
+    {
+        stat_inc( &w->nb_rx_stat );
+        ackr = json_object_get_number( stat_obj, "ackr" );
+        printf( "### [gw %016" PRIx64 "] stat: rxnb %.0f, rxok %.0f, rxfw %.0f, ackr %.1f%%, dwnb %.0f, txnb %.0f\n",
+                gw_mac, json_object_get_number( stat_obj, "rxnb" ), json_object_get_number( stat_obj, "rxok" ),
+                json_object_get_number( stat_obj, "rxfw" ), ackr, json_object_get_number( stat_obj, "dwnb" ),
+                json_object_get_number( stat_obj, "txnb" ) );
+        gw = gw_get_locked( gw_mac, &lock_idx );
+        if( gw != NULL )
+        {
+            gw->nb_stat += 1;
+            gw->ackr_sum += ackr;
+            pthread_mutex_unlock( &gw_locks[lock_idx] );
+        }
+    }
+    json_value_free( root_val );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void send_class_a( worker_t* w, const uint8_t* buf, uint64_t gw_mac )
+{
+    class_a_resp_t          resp[CLASS_A_MAX_RESP];
+    uint8_t                 dgram[4 + sizeof resp[0].json];
+    struct sockaddr_storage addr;
+    socklen_t               addr_len = 0;
+    gw_entry_t*             gw;
+    unsigned                lock_idx;
+    uint32_t                latency_us;
+    uint16_t                token;
+    int                     i, nb_resp;
+
+    nb_resp = class_a_build( ( const char* ) ( buf + 12 ), resp );
+    if( nb_resp == 0 )
+    {
+        return;
+    }
+
+    /* Answers go where the gateway pulls its downlinks */
+    gw = gw_get_locked( gw_mac, &lock_idx );
+    if( gw != NULL )
+    {
+        if( gw->pull_valid )
+        {
+            memcpy( &addr, &gw->pull_addr, gw->pull_addr_len );
+            addr_len = gw->pull_addr_len;
+        }
+        pthread_mutex_unlock( &gw_locks[lock_idx] );
+    }
+    if( addr_len == 0 )
+    {
+        return; /* no PULL_DATA received yet */
+    }
+
+    for( i = 0; i < nb_resp; i++ )
+    {
+        latency_us = delay_dist_draw_us( &w->params->class_a_latency, &w->rng );
+        token      = class_a_track( resp[i].sf, latency_us );
+        dgram[0]   = PROTOCOL_VERSION;
+        dgram[1]   = ( uint8_t ) ( token >> 8 );
+        dgram[2]   = ( uint8_t ) ( token & 0xFF );
+        dgram[3]   = PKT_PULL_RESP;
+        memcpy( dgram + 4, resp[i].json, resp[i].len );
+        if( send_impaired( &w->sched, &w->rng, &w->impair, &w->params->impair[LNS_IMPAIR_PULL_RESP], w->sock, dgram,
+                           4 + resp[i].len, &addr, addr_len, latency_us ) > 0 )
+        {
+            stat_inc( &w->nb_tx );
+            stat_inc( &w->nb_tx_class_a );
+        }
+        else
+        {
+            class_a_untrack( token ); /* lost on purpose or not sent, never acknowledged */
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void handle_datagram( worker_t* w, uint8_t* buf, int len, const struct sockaddr_storage* addr,
+                             socklen_t addr_len )
+{
+    uint64_t    gw_mac;
+    gw_entry_t* gw;
+    unsigned    lock_idx;
+
+    stat_inc( &w->nb_rx );
+
+    if( ( len < 12 ) || ( buf[0] != PROTOCOL_VERSION ) )
+    {
+        stat_inc( &w->nb_rx_invalid );
+        return;
+    }
+    gw_mac = ( ( uint64_t ) ntohl( *( ( uint32_t* ) ( buf + 4 ) ) ) << 32 ) +
+             ( uint64_t ) ntohl( *( ( uint32_t* ) ( buf + 8 ) ) );
+
+    switch( buf[3] )
+    {
+    case PKT_PUSH_DATA:
+        stat_inc( &w->nb_rx_push );
+        send_ack( w, buf, PKT_PUSH_ACK, addr, addr_len );
+        gw = gw_get_locked( gw_mac, &lock_idx );
+        if( gw != NULL )
+        {
+            gw->nb_push += 1;
+            gw->last_seen_ns = udp_sched_now_ns( );
+            pthread_mutex_unlock( &gw_locks[lock_idx] );
+        }
+        if( ( len > 12 ) && ( len < RECV_DGRAM_MAX ) )
+        {
+            buf[len] = 0; /* add string terminator, datagrams filling the whole buffer are truncated anyway */
+            log_gw_stat( w, ( const char* ) ( buf + 12 ), gw_mac );
+            if( w->params->bin_log )
+            {
+                uplink_log_push( gw_mac, buf + 12, ( size_t ) ( len - 12 ) );
+            }
+            if( w->params->class_a )
+            {
+                send_class_a( w, buf, gw_mac );
+            }
+        }
+        break;
+
+    case PKT_PULL_DATA:
+        stat_inc( &w->nb_rx_pull );
+        send_ack( w, buf, PKT_PULL_ACK, addr, addr_len );
+        gw = gw_get_locked( gw_mac, &lock_idx );
+        if( gw != NULL )
+        {
+            /* Record where the gateway expects its PULL_RESP */
+            memcpy( &gw->pull_addr, addr, addr_len );
+            gw->pull_addr_len = addr_len;
+            gw->pull_valid    = true;
+            gw->nb_pull += 1;
+            gw->last_seen_ns = udp_sched_now_ns( );
+            pthread_mutex_unlock( &gw_locks[lock_idx] );
+        }
+        break;
+
+    case PKT_TX_ACK:
+        stat_inc( &w->nb_rx_txack );
+        gw = gw_get_locked( gw_mac, &lock_idx );
+        if( gw != NULL )
+        {
+            gw->nb_txack += 1;
+            gw->last_seen_ns = udp_sched_now_ns( );
+            pthread_mutex_unlock( &gw_locks[lock_idx] );
+        }
+        if( w->params->class_a && ( len < RECV_DGRAM_MAX ) )
+        {
+            buf[len] = 0; /* add string terminator */
+            class_a_tx_ack( ( uint16_t ) ( ( buf[1] << 8 ) | buf[2] ), ( const char* ) ( buf + 12 ) );
+        }
+        break;
+
+    default:
+        stat_inc( &w->nb_rx_invalid );
+        break;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void* thread_worker( void* arg )
+{
+    worker_t*               w = ( worker_t* ) arg;
+    struct epoll_event      ev;
+    struct mmsghdr          msgs[RECV_BATCH];
+    struct iovec            iovecs[RECV_BATCH];
+    struct sockaddr_storage addrs[RECV_BATCH];
+    uint8_t ( *bufs )[RECV_DGRAM_MAX];
+    int      i, n, timeout_ms;
+    uint64_t now_ns;
+
+    bufs = malloc( RECV_BATCH * RECV_DGRAM_MAX );
+    if( bufs == NULL )
+    {
+        printf( "ERROR: [worker %u] failed to allocate receive buffers\n", w->id );
+        return NULL;
+    }
+
+    while( !must_stop( ) )
+    {
+        /* Sleep until a datagram arrives or a deferred datagram is due */
+        timeout_ms = udp_sched_timeout_ms( &w->sched, udp_sched_now_ns( ) );
+        if( ( timeout_ms < 0 ) || ( timeout_ms > EPOLL_TIMEOUT_MAX_MS ) )
+        {
+            timeout_ms = EPOLL_TIMEOUT_MAX_MS; /* to check exit flags */
+        }
+        n = epoll_wait( w->epfd, &ev, 1, timeout_ms );
+        if( ( n < 0 ) && ( errno != EINTR ) )
+        {
+            printf( "ERROR: [worker %u] epoll_wait returned %s\n", w->id, strerror( errno ) );
+            break;
+        }
+
+        /* Drain the socket */
+        while( n > 0 )
+        {
+            for( i = 0; i < RECV_BATCH; i++ )
+            {
+                iovecs[i].iov_base             = bufs[i];
+                iovecs[i].iov_len              = RECV_DGRAM_MAX;
+                msgs[i].msg_hdr.msg_name       = &addrs[i];
+                msgs[i].msg_hdr.msg_namelen    = sizeof addrs[i];
+                msgs[i].msg_hdr.msg_iov        = &iovecs[i];
+                msgs[i].msg_hdr.msg_iovlen     = 1;
+                msgs[i].msg_hdr.msg_control    = NULL;
+                msgs[i].msg_hdr.msg_controllen = 0;
+                msgs[i].msg_hdr.msg_flags      = 0;
+            }
+            n = recvmmsg( w->sock, msgs, RECV_BATCH, MSG_DONTWAIT, NULL );
+            if( n <= 0 )
+            {
+                break; /* EAGAIN: nothing left */
+            }
+            for( i = 0; i < n; i++ )
+            {
+                handle_datagram( w, bufs[i], ( int ) msgs[i].msg_len, &addrs[i], msgs[i].msg_hdr.msg_namelen );
+            }
+            if( n < RECV_BATCH )
+            {
+                break;
+            }
+        }
+
+        /* Send what is due */
+        now_ns = udp_sched_now_ns( );
+        udp_sched_flush( &w->sched, now_ns );
+    }
+
+    free( bufs );
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void* thread_dl_generator( void* arg )
+{
+    const lns_server_params_t* params = ( const lns_server_params_t* ) arg;
+    uint8_t                    databuf_down[DL_BUFF_SIZE];
+    struct sockaddr_storage    addr;
+    socklen_t                  addr_len;
+    udp_sched_t                sched;
+    rng_t                      rng;
+    uint32_t                   seq = 0;
+    uint32_t                   i, nb_sent;
+    unsigned                   lock_idx;
+    bool                       valid;
+    int                        len, timeout_ms;
+    uint64_t                   now_ns, next_round_ns;
+    struct timespec            sleep_time;
+
+    /* The generator has its own scheduler, workers ones are not thread safe */
+    if( udp_sched_init( &sched, SCHED_CAPACITY, LNS_SERVER_GW_TABLE_SIZE ) != 0 )
+    {
+        printf( "ERROR: failed to allocate downlink generator scheduler\n" );
+        return NULL;
+    }
+    rng_seed( &rng, ( ( params->seed != 0 ) ? params->seed : ( uint64_t ) time( NULL ) ) + LNS_SERVER_WORKERS_MAX );
+
+    while( !must_stop( ) && ( seq < params->dl_nb_loop ) )
+    {
+        /* Same downlink for every gateway of this round */
+        len = params->dl_build( params->dl_ctx, seq, ( char* ) ( databuf_down + 4 ), sizeof databuf_down - 4 );
+        if( len < 0 )
+        {
+            printf( "ERROR: failed to build downlink JSON\n" );
+            break;
+        }
+        databuf_down[0] = PROTOCOL_VERSION;
+        databuf_down[1] = 0;
+        databuf_down[2] = 0;
+        databuf_down[3] = PKT_PULL_RESP;
+
+        nb_sent = 0;
+        for( i = 0; i < LNS_SERVER_GW_TABLE_SIZE; i++ )
+        {
+            if( __atomic_load_n( &gw_table[i].state, __ATOMIC_ACQUIRE ) != GW_SLOT_READY )
+            {
+                continue; /* free, or MAC not published yet */
+            }
+            lock_idx = gw_hash( gw_table[i].mac ) & ( GW_TABLE_LOCKS - 1 );
+            pthread_mutex_lock( &gw_locks[lock_idx] );
+            valid = gw_table[i].pull_valid;
+            if( valid )
+            {
+                memcpy( &addr, &gw_table[i].pull_addr, gw_table[i].pull_addr_len );
+                addr_len = gw_table[i].pull_addr_len;
+            }
+            pthread_mutex_unlock( &gw_locks[lock_idx] );
+            if( valid && ( send_impaired( &sched, &rng, &dl_impair_stats, &params->impair[LNS_IMPAIR_PULL_RESP],
+                                          workers[0].sock, databuf_down, len + 4, &addr, addr_len, 0 ) > 0 ) )
+            {
+                nb_sent += 1;
+            }
+        }
+        printf( "<-  downlink round %u sent or scheduled to %u gateways\n", seq, nb_sent );
+        seq += 1;
+
+        /* Wait for next round, sending deferred downlinks meanwhile */
+        next_round_ns = udp_sched_now_ns( ) + ( ( uint64_t ) params->dl_delay_ms * 1000000 );
+        while( !must_stop( ) && ( ( now_ns = udp_sched_now_ns( ) ) < next_round_ns ) )
+        {
+            udp_sched_flush( &sched, now_ns );
+            timeout_ms = udp_sched_timeout_ms( &sched, now_ns );
+            if( ( timeout_ms < 0 ) || ( timeout_ms > EPOLL_TIMEOUT_MAX_MS ) )
+            {
+                timeout_ms = EPOLL_TIMEOUT_MAX_MS;
+            }
+            if( ( uint64_t ) timeout_ms * 1000000 > ( next_round_ns - now_ns ) )
+            {
+                timeout_ms = ( int ) ( ( next_round_ns - now_ns ) / 1000000 );
+            }
+            sleep_time.tv_sec  = 0;
+            sleep_time.tv_nsec = ( long ) ( timeout_ms > 0 ? timeout_ms : 1 ) * 1000000;
+            nanosleep( &sleep_time, NULL );
+        }
+    }
+
+    /* Let the last downlinks reach the gateways */
+    while( !must_stop( ) && ( sched.size > 0 ) )
+    {
+        udp_sched_flush( &sched, udp_sched_now_ns( ) );
+        sleep_time.tv_sec  = 0;
+        sleep_time.tv_nsec = 1000000;
+        nanosleep( &sleep_time, NULL );
+    }
+    if( ( sched.nb_send_error > 0 ) || ( sched.nb_overflow > 0 ) )
+    {
+        printf( "WARNING: downlink generator failed to send %lu datagrams, %lu dropped as scheduler was full\n",
+                ( unsigned long ) sched.nb_send_error, ( unsigned long ) sched.nb_overflow );
+    }
+    udp_sched_free( &sched );
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void get_stats( worker_stats_t* s, unsigned nb_workers )
+{
+    unsigned i;
+
+    memset( s, 0, sizeof *s );
+    for( i = 0; i < nb_workers; i++ )
+    {
+        s->nb_rx += __atomic_load_n( &workers[i].nb_rx, __ATOMIC_RELAXED );
+        s->nb_rx_push += __atomic_load_n( &workers[i].nb_rx_push, __ATOMIC_RELAXED );
+        s->nb_rx_pull += __atomic_load_n( &workers[i].nb_rx_pull, __ATOMIC_RELAXED );
+        s->nb_rx_txack += __atomic_load_n( &workers[i].nb_rx_txack, __ATOMIC_RELAXED );
+        s->nb_rx_invalid += __atomic_load_n( &workers[i].nb_rx_invalid, __ATOMIC_RELAXED );
+        s->nb_tx += __atomic_load_n( &workers[i].nb_tx, __ATOMIC_RELAXED );
+        s->nb_tx_class_a += __atomic_load_n( &workers[i].nb_tx_class_a, __ATOMIC_RELAXED );
+        s->nb_rx_stat += __atomic_load_n( &workers[i].nb_rx_stat, __ATOMIC_RELAXED );
+        s->impair.nb_drop += __atomic_load_n( &workers[i].impair.nb_drop, __ATOMIC_RELAXED );
+        s->impair.nb_dup += __atomic_load_n( &workers[i].impair.nb_dup, __ATOMIC_RELAXED );
+        s->impair.nb_reorder += __atomic_load_n( &workers[i].impair.nb_reorder, __ATOMIC_RELAXED );
+    }
+    s->impair.nb_drop += __atomic_load_n( &dl_impair_stats.nb_drop, __ATOMIC_RELAXED );
+    s->impair.nb_dup += __atomic_load_n( &dl_impair_stats.nb_dup, __ATOMIC_RELAXED );
+    s->impair.nb_reorder += __atomic_load_n( &dl_impair_stats.nb_reorder, __ATOMIC_RELAXED );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void print_gw_stat_summary( void )
+{
+    uint32_t i, nb_gw = 0;
+    double   ackr, ackr_min = 100.0, ackr_sum = 0.0;
+
+    for( i = 0; i < LNS_SERVER_GW_TABLE_SIZE; i++ )
+    {
+        if( ( gw_table[i].state == GW_SLOT_READY ) && ( gw_table[i].nb_stat > 0 ) )
+        {
+            ackr = gw_table[i].ackr_sum / gw_table[i].nb_stat;
+            ackr_sum += ackr;
+            ackr_min = ( ackr < ackr_min ) ? ackr : ackr_min;
+            nb_gw += 1;
+        }
+    }
+    if( nb_gw > 0 )
+    {
+        printf( "INFO: %u gateways sent stat reports, PUSH_DATA acknowledged: mean %.1f%%, worst gateway %.1f%%\n",
+                nb_gw, ackr_sum / nb_gw, ackr_min );
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int open_worker_socket( const char* port, worker_t* w )
+{
+    struct addrinfo    hints;
+    struct addrinfo*   result;
+    struct addrinfo*   q;
+    struct epoll_event ev;
+    int                x, one = 1;
+
+    memset( &hints, 0, sizeof hints );
+    hints.ai_family   = AF_UNSPEC; /* should handle IP v4 or v6 automatically */
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = AI_PASSIVE; /* will assign local IP automatically */
+
+    x = getaddrinfo( NULL, port, &hints, &result );
+    if( x != 0 )
+    {
+        printf( "ERROR: getaddrinfo returned %s\n", gai_strerror( x ) );
+        return -1;
+    }
+
+    w->sock = -1;
+    for( q = result; q != NULL; q = q->ai_next )
+    {
+        w->sock = socket( q->ai_family, q->ai_socktype | SOCK_NONBLOCK, q->ai_protocol );
+        if( w->sock == -1 )
+        {
+            continue;
+        }
+        setsockopt( w->sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one );
+        if( bind( w->sock, q->ai_addr, q->ai_addrlen ) == 0 )
+        {
+            break;
+        }
+        close( w->sock );
+        w->sock = -1;
+    }
+    freeaddrinfo( result );
+    if( w->sock == -1 )
+    {
+        printf( "ERROR: [worker %u] failed to open socket or to bind to it\n", w->id );
+        return -1;
+    }
+
+    w->epfd = epoll_create1( 0 );
+    if( w->epfd == -1 )
+    {
+        printf( "ERROR: [worker %u] epoll_create1 returned %s\n", w->id, strerror( errno ) );
+        return -1;
+    }
+    ev.events  = EPOLLIN;
+    ev.data.fd = w->sock;
+    if( epoll_ctl( w->epfd, EPOLL_CTL_ADD, w->sock, &ev ) == -1 )
+    {
+        printf( "ERROR: [worker %u] epoll_ctl returned %s\n", w->id, strerror( errno ) );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Release what open_worker_socket() and udp_sched_init() allocated, even partially */
+static void close_worker( worker_t* w )
+{
+    udp_sched_free( &w->sched );
+    if( w->epfd >= 0 )
+    {
+        close( w->epfd );
+        w->epfd = -1;
+    }
+    if( w->sock >= 0 )
+    {
+        close( w->sock );
+        w->sock = -1;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS ----------------------------------------------------- */
+
+int lns_server_parse_impair( const char* arg, lns_server_params_t* params )
+{
+    const char* spec = strchr( arg, ',' );
+    size_t      target_len;
+    unsigned    i;
+    bool        selected[LNS_IMPAIR_NB] = { false };
+
+    if( spec == NULL )
+    {
+        return -1;
+    }
+    target_len = ( size_t ) ( spec - arg );
+    spec += 1;
+
+    if( ( target_len == 3 ) && ( strncmp( arg, "all", 3 ) == 0 ) )
+    {
+        for( i = 0; i < LNS_IMPAIR_NB; i++ )
+        {
+            selected[i] = true;
+        }
+    }
+    else if( ( target_len == 4 ) && ( strncmp( arg, "acks", 4 ) == 0 ) )
+    {
+        selected[LNS_IMPAIR_PUSH_ACK] = true;
+        selected[LNS_IMPAIR_PULL_ACK] = true;
+    }
+    else
+    {
+        for( i = 0; i < LNS_IMPAIR_NB; i++ )
+        {
+            if( ( strlen( impair_names[i] ) == target_len ) && ( strncmp( arg, impair_names[i], target_len ) == 0 ) )
+            {
+                selected[i] = true;
+                break;
+            }
+        }
+        if( i == LNS_IMPAIR_NB )
+        {
+            return -1;
+        }
+    }
+
+    for( i = 0; i < LNS_IMPAIR_NB; i++ )
+    {
+        if( selected[i] && ( impair_parse( spec, &params->impair[i] ) != 0 ) )
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lns_server_run( const char* port, const lns_server_params_t* params, const int* exit_flag, const int* quit_flag )
+{
+    unsigned        i, nb_workers;
+    pthread_t       thrid_dl;
+    bool            dl_started = false;
+    char            dist_str[160];
+    worker_stats_t  prev, cur;
+    uint64_t        prev_ns, now_ns;
+    double          elapsed_s;
+    struct timespec report_sleep  = { 0, 100000000 }; /* 100 ms */
+    int             ret           = 0;
+    uint64_t        nb_send_error = 0;
+    uint64_t        nb_overflow   = 0;
+
+    srv_exit_flag = exit_flag;
+    srv_quit_flag = quit_flag;
+
+    nb_workers = params->nb_workers;
+    if( ( nb_workers == 0 ) || ( nb_workers > LNS_SERVER_WORKERS_MAX ) )
+    {
+        printf( "ERROR: invalid number of workers %u (max %u)\n", nb_workers, LNS_SERVER_WORKERS_MAX );
+        return -1;
+    }
+
+    gw_table = calloc( LNS_SERVER_GW_TABLE_SIZE, sizeof( gw_entry_t ) );
+    if( gw_table == NULL )
+    {
+        printf( "ERROR: failed to allocate gateway table\n" );
+        return -1;
+    }
+    for( i = 0; i < GW_TABLE_LOCKS; i++ )
+    {
+        pthread_mutex_init( &gw_locks[i], NULL );
+    }
+
+    /* Open sockets first, so that a bind error is reported before anything starts */
+    memset( workers, 0, sizeof workers );
+    for( i = 0; i < nb_workers; i++ )
+    {
+        workers[i].sock = -1;
+        workers[i].epfd = -1;
+    }
+    for( i = 0; i < nb_workers; i++ )
+    {
+        workers[i].id     = i;
+        workers[i].params = params;
+        rng_seed( &workers[i].rng, ( ( params->seed != 0 ) ? params->seed : ( uint64_t ) time( NULL ) ) + i );
+        if( ( open_worker_socket( port, &workers[i] ) != 0 ) ||
+            ( udp_sched_init( &workers[i].sched, SCHED_CAPACITY, SCHED_SLOTS ) != 0 ) )
+        {
+            printf( "ERROR: [worker %u] failed to start\n", i );
+            for( i = 0; i < nb_workers; i++ )
+            {
+                close_worker( &workers[i] );
+            }
+            free( gw_table );
+            gw_table = NULL;
+            return -1;
+        }
+    }
+
+    printf( "INFO: server mode listening on port %s with %u worker(s)\n", port, nb_workers );
+    for( i = 0; i < LNS_IMPAIR_NB; i++ )
+    {
+        impair_to_str( &params->impair[i], dist_str, sizeof dist_str );
+        printf( "INFO: backhaul %-9s %s\n", impair_names[i], dist_str );
+    }
+    if( params->class_a )
+    {
+        class_a_init( &params->class_a_params );
+        delay_dist_to_str( &params->class_a_latency, dist_str, sizeof dist_str );
+        printf( "INFO: Class A responder enabled, RX1 delay %u ms, processing latency: %s\n",
+                params->class_a_params.rx1_delay_us / 1000, dist_str );
+    }
+
+    for( i = 0; i < nb_workers; i++ )
+    {
+        if( pthread_create( &workers[i].thrid, NULL, thread_worker, &workers[i] ) != 0 )
+        {
+            printf( "ERROR: [main] impossible to create worker thread %u\n", i );
+            nb_workers = i;
+            ret        = -1;
+            break;
+        }
+    }
+    if( ( ret == 0 ) && ( params->dl_nb_loop > 0 ) && ( params->dl_build != NULL ) )
+    {
+        if( pthread_create( &thrid_dl, NULL, thread_dl_generator, ( void* ) params ) != 0 )
+        {
+            printf( "ERROR: [main] impossible to create downlink generator thread\n" );
+        }
+        else
+        {
+            dl_started = true;
+        }
+    }
+
+    /* Throughput report loop */
+    get_stats( &prev, nb_workers );
+    prev_ns = udp_sched_now_ns( );
+    while( ( ret == 0 ) && !must_stop( ) )
+    {
+        nanosleep( &report_sleep, NULL );
+        now_ns = udp_sched_now_ns( );
+        if( ( now_ns - prev_ns ) < ( ( uint64_t ) params->report_interval_s * 1000000000ULL ) )
+        {
+            continue;
+        }
+        get_stats( &cur, nb_workers );
+        elapsed_s = ( double ) ( now_ns - prev_ns ) / 1e9;
+        printf( "### rx: %.0f dgram/s (push %.0f, pull %.0f, tx_ack %.0f, invalid %.0f) | tx: %.0f dgram/s "
+                "(dropped %lu, duplicated %lu, reordered %lu) | gateways: %u (untracked dgrams: %u)\n",
+                ( double ) ( cur.nb_rx - prev.nb_rx ) / elapsed_s,
+                ( double ) ( cur.nb_rx_push - prev.nb_rx_push ) / elapsed_s,
+                ( double ) ( cur.nb_rx_pull - prev.nb_rx_pull ) / elapsed_s,
+                ( double ) ( cur.nb_rx_txack - prev.nb_rx_txack ) / elapsed_s,
+                ( double ) ( cur.nb_rx_invalid - prev.nb_rx_invalid ) / elapsed_s,
+                ( double ) ( cur.nb_tx - prev.nb_tx ) / elapsed_s,
+                ( unsigned long ) ( cur.impair.nb_drop - prev.impair.nb_drop ),
+                ( unsigned long ) ( cur.impair.nb_dup - prev.impair.nb_dup ),
+                ( unsigned long ) ( cur.impair.nb_reorder - prev.impair.nb_reorder ),
+                __atomic_load_n( &gw_count, __ATOMIC_RELAXED ),
+                __atomic_load_n( &gw_table_full, __ATOMIC_RELAXED ) );
+        fflush( stdout );
+        prev    = cur;
+        prev_ns = now_ns;
+    }
+
+    /* Wait for threads to finish */
+    for( i = 0; i < nb_workers; i++ )
+    {
+        pthread_join( workers[i].thrid, NULL );
+    }
+    if( dl_started )
+    {
+        pthread_join( thrid_dl, NULL );
+    }
+
+    get_stats( &cur, nb_workers );
+    printf( "INFO: server mode total rx %lu, tx %lu datagrams, %u gateways\n", ( unsigned long ) cur.nb_rx,
+            ( unsigned long ) cur.nb_tx, gw_count );
+    printf( "INFO: backhaul emulation dropped %lu, duplicated %lu, reordered %lu datagrams\n",
+            ( unsigned long ) cur.impair.nb_drop, ( unsigned long ) cur.impair.nb_dup,
+            ( unsigned long ) cur.impair.nb_reorder );
+    print_gw_stat_summary( );
+    if( params->class_a )
+    {
+        printf( "INFO: %lu Class A responses sent\n", ( unsigned long ) cur.nb_tx_class_a );
+        class_a_report( );
+    }
+
+    for( i = 0; i < params->nb_workers; i++ )
+    {
+        nb_send_error += workers[i].sched.nb_send_error;
+        nb_overflow += workers[i].sched.nb_overflow;
+        close_worker( &workers[i] );
+    }
+    if( ( nb_send_error > 0 ) || ( nb_overflow > 0 ) )
+    {
+        printf( "WARNING: workers failed to send %lu datagrams, %lu dropped as schedulers were full\n",
+                ( unsigned long ) nb_send_error, ( unsigned long ) nb_overflow );
+    }
+    free( gw_table );
+    gw_table = NULL;
+
+    return ret;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -52,7 +52,9 @@ forwarder.
 #include <pthread.h>
 
 #include "base64.h"
+#include "lns_server.h"
 #include "parson.h"
+#include "uplink_log.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- MACROS & CONSTANTS --------------------------------------------------- */
@@ -81,6 +83,8 @@ forwarder.
 #define DEFAULT_LORA_PREAMBLE_SIZE 8 /* LoRa preamble size */
 #define DEFAULT_PAYLOAD_SIZE 4       /* payload size, bytes */
 #define PUSH_TIMEOUT_MS 100
+#define DEFAULT_REPORT_INTERVAL_S 1 /* server mode throughput report period */
+#define DEFAULT_REORDER_GAP_MS 50   /* server mode extra delay of reordered datagrams */
 
 /* -------------------------------------------------------------------------- */
 /* --- CUSTOM TYPES --------------------------------------------------------- */
@@ -137,6 +141,7 @@ static void  sig_handler( int sigio );
 static void  usage( void );
 static void* thread_down( const void* arg );
 static void  log_csv( FILE* file, uint8_t* buf );
+static int   build_downlink_json( void* ctx, uint32_t seq, char* buf, size_t size );
 
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
@@ -153,9 +158,13 @@ int main( int argc, char** argv )
     bool                    parse_err = false;
 
     /* Logging file variables */
-    const char* log_fname = NULL; /* pointer to a string we won't touch */
-    FILE*       log_file  = NULL;
-    bool        is_first  = true;
+    const char*        log_fname = NULL; /* pointer to a string we won't touch */
+    FILE*              log_file  = NULL;
+    bool               is_first  = true;
+    const char*        bin_fname = NULL; /* binary uplink log */
+    const char*        cvt_fname = NULL; /* binary uplink log to be converted to CSV */
+    uplink_log_stats_t bin_stats;
+    long               lx;
 
     /* Server socket creation */
     int                     sock; /* socket file descriptor */
@@ -172,6 +181,7 @@ int main( int argc, char** argv )
     uint8_t databuf_up[32768];
     uint8_t databuf_ack[4];
     int     byte_nb;
+    int     byte_nb_up;
 
     /* Variables for protocol management */
     uint32_t raw_mac_h; /* Most Significant Nibble, network order */
@@ -194,14 +204,112 @@ int main( int argc, char** argv )
                                       .freq_nb       = 1,
                                       .ipol          = false };
 
+    /* Server mode variables */
+    bool                server_mode   = false;
+    lns_server_params_t server_params = { .nb_workers = 1, .report_interval_s = DEFAULT_REPORT_INTERVAL_S, .seed = 0 };
+    delay_dist_t        ack_delay;
+    char*               endptr;
+
     /* Threads ID */
     pthread_t thrid_down;
 
+    for( i = 0; i < LNS_IMPAIR_NB; i++ )
+    {
+        server_params.impair[i].reorder_gap_us = DEFAULT_REORDER_GAP_MS * 1000;
+    }
+
     /* Parse command line options */
-    while( ( i = getopt( argc, argv, "b:c:f:hij:l:p:r:s:t:x:z:P:m:d:q:" ) ) != -1 )
+    while( ( i = getopt( argc, argv, "b:c:f:hij:l:p:r:s:t:x:z:P:m:d:q:S:D:R:A:L:I:Z:B:X:" ) ) != -1 )
     {
         switch( i )
         {
+        case 'S': /* -S <uint>  server mode, number of worker threads */
+            j = sscanf( optarg, "%u", &arg_u );
+            if( ( j != 1 ) || ( arg_u == 0 ) || ( arg_u > LNS_SERVER_WORKERS_MAX ) )
+            {
+                printf( "ERROR: argument parsing of -S argument\n" );
+                usage( );
+                return EXIT_FAILURE;
+            }
+            else
+            {
+                server_mode              = true;
+                server_params.nb_workers = arg_u;
+            }
+            break;
+
+        case 'D': /* -D <dist>  ACK delay distribution (server mode) */
+            if( delay_dist_parse( optarg, &ack_delay ) != 0 )
+            {
+                printf( "ERROR: argument parsing of -D argument\n" );
+                usage( );
+                return EXIT_FAILURE;
+            }
+            else
+            {
+                server_params.impair[LNS_IMPAIR_PUSH_ACK].delay = ack_delay;
+                server_params.impair[LNS_IMPAIR_PULL_ACK].delay = ack_delay;
+            }
+            break;
+
+        case 'I': /* -I <target>,<impairments>  backhaul impairments (server mode) */
+            if( lns_server_parse_impair( optarg, &server_params ) != 0 )
+            {
+                printf( "ERROR: argument parsing of -I argument\n" );
+                usage( );
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'Z': /* -Z <uint>  seed of the pseudo-random generators (server mode) */
+            server_params.seed = strtoull( optarg, &endptr, 0 );
+            if( ( *optarg == '\0' ) || ( *endptr != '\0' ) )
+            {
+                printf( "ERROR: argument parsing of -Z argument\n" );
+                usage( );
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'A': /* -A <uint>  Class A responder RX1 delay in ms (server mode) */
+            j = sscanf( optarg, "%u", &arg_u );
+            if( ( j != 1 ) || ( arg_u > 15000 ) )
+            {
+                printf( "ERROR: argument parsing of -A argument\n" );
+                usage( );
+                return EXIT_FAILURE;
+            }
+            else
+            {
+                server_mode                               = true;
+                server_params.class_a                     = true;
+                server_params.class_a_params.rx1_delay_us = arg_u * 1000;
+            }
+            break;
+
+        case 'L': /* -L <dist>  Class A responder processing latency (server mode) */
+            if( delay_dist_parse( optarg, &server_params.class_a_latency ) != 0 )
+            {
+                printf( "ERROR: argument parsing of -L argument\n" );
+                usage( );
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'R': /* -R <uint>  throughput report interval (server mode) */
+            j = sscanf( optarg, "%u", &arg_u );
+            if( ( j != 1 ) || ( arg_u == 0 ) )
+            {
+                printf( "ERROR: argument parsing of -R argument\n" );
+                usage( );
+                return EXIT_FAILURE;
+            }
+            else
+            {
+                server_params.report_interval_s = arg_u;
+            }
+            break;
+
         case 'h':
             usage( );
             return EXIT_SUCCESS;
@@ -210,6 +318,14 @@ int main( int argc, char** argv )
             log_fname = optarg;
             break;
 
+        case 'B':
+            bin_fname = optarg;
+            break;
+
+        case 'X':
+            cvt_fname = optarg;
+            break;
+
         case 'P':
             port_arg = optarg;
             break;
@@ -391,6 +507,27 @@ int main( int argc, char** argv )
         }
     }
 
+    /* Offline conversion of a binary uplink log */
+    if( cvt_fname != NULL )
+    {
+        if( log_fname != NULL )
+        {
+            log_file = fopen( log_fname, "w" );
+            if( log_file == NULL )
+            {
+                printf( "ERROR: impossible to create log file %s\n", log_fname );
+                return EXIT_FAILURE;
+            }
+        }
+        lx = uplink_log_to_csv( cvt_fname, ( log_file != NULL ) ? log_file : stdout );
+        if( log_file != NULL )
+        {
+            fclose( log_file );
+            printf( "INFO: %ld records converted from %s to %s\n", lx, cvt_fname, log_fname );
+        }
+        return ( lx >= 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     /* Check input arguments */
     if( port_arg == NULL )
     {
@@ -402,6 +539,52 @@ int main( int argc, char** argv )
     /* Start message */
     printf( "+++ Start of LoRa network server utility +++\n" );
 
+    /* Multi-gateway server mode */
+    if( server_mode == true )
+    {
+        if( log_fname != NULL )
+        {
+            printf( "WARNING: CSV uplink logging is not supported in server mode (use -B), ignored\n" );
+        }
+        if( bin_fname != NULL )
+        {
+            if( uplink_log_open( bin_fname ) != 0 )
+            {
+                return EXIT_FAILURE;
+            }
+            server_params.bin_log = true;
+        }
+
+        /* Configure signal handling */
+        sigemptyset( &sigact.sa_mask );
+        sigact.sa_flags   = 0;
+        sigact.sa_handler = sig_handler;
+        sigaction( SIGQUIT, &sigact, NULL );
+        sigaction( SIGINT, &sigact, NULL );
+        sigaction( SIGTERM, &sigact, NULL );
+
+        server_params.dl_nb_loop  = thread_params.nb_loop;
+        server_params.dl_delay_ms = thread_params.delay_ms;
+        server_params.dl_build    = build_downlink_json;
+        server_params.dl_ctx      = &thread_params;
+
+        server_params.class_a_params.rf_power = thread_params.rf_power;
+        server_params.class_a_params.pl_size  = thread_params.pl_size;
+
+        x = lns_server_run( port_arg, &server_params, &exit_sig, &quit_sig );
+
+        if( bin_fname != NULL )
+        {
+            uplink_log_close( &bin_stats );
+            printf( "INFO: binary log: %lu rxpk written (%lu bytes), %lu invalid, %lu datagrams dropped\n",
+                    ( unsigned long ) bin_stats.nb_rec, ( unsigned long ) bin_stats.nb_bytes,
+                    ( unsigned long ) bin_stats.nb_invalid, ( unsigned long ) bin_stats.nb_dropped );
+        }
+
+        printf( "INFO: Exiting LoRa network server utility\n" );
+        return ( x == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     /* Prepare hints to open network sockets */
     memset( &hints, 0, sizeof hints );
     hints.ai_family   = AF_UNSPEC; /* should handle IP v4 or v6 automatically */
@@ -465,6 +648,10 @@ int main( int argc, char** argv )
             return EXIT_FAILURE;
         }
     }
+    if( ( bin_fname != NULL ) && ( uplink_log_open( bin_fname ) != 0 ) )
+    {
+        return EXIT_FAILURE;
+    }
 
     /* Configure signal handling */
     sigemptyset( &sigact.sa_mask );
@@ -492,6 +679,7 @@ int main( int argc, char** argv )
             printf( "ERROR: recvfrom returned %s \n", strerror( errno ) );
             continue;
         }
+        byte_nb_up = byte_nb;
 
         /* Display info about the sender */
         x = getnameinfo( ( struct sockaddr* ) &dist_addr, addr_len, host_name, sizeof host_name, port_name,
@@ -596,6 +784,10 @@ int main( int argc, char** argv )
                 }
                 log_csv( log_file, &databuf_up[12] );
             }
+            if( bin_fname != NULL )
+            {
+                uplink_log_push( gw_mac, &databuf_up[12], byte_nb_up - 12 );
+            }
         }
     }
 
@@ -610,6 +802,13 @@ int main( int argc, char** argv )
         fclose( log_file );
         log_file = NULL;
     }
+    if( bin_fname != NULL )
+    {
+        uplink_log_close( &bin_stats );
+        printf( "INFO: binary log: %lu rxpk written (%lu bytes), %lu invalid, %lu datagrams dropped\n",
+                ( unsigned long ) bin_stats.nb_rec, ( unsigned long ) bin_stats.nb_bytes,
+                ( unsigned long ) bin_stats.nb_invalid, ( unsigned long ) bin_stats.nb_dropped );
+    }
 
     return 0;
 }
@@ -855,6 +1054,18 @@ static void usage( void )
     printf( " -x <uint>          Number of downlinks to be sent\n" );
     printf( " -P <udp port>      UDP port of the Packet Forwarder\n" );
     printf( " -l <filename>      uplink logging CSV filename (optional)\n" );
+    printf( " -B <filename>      uplink logging binary filename, written by a background thread (optional)\n" );
+    printf( " -X <filename>      convert a binary uplink log to CSV (to the -l file, or stdout) and exit\n" );
+    printf( " -S <uint>          Server mode: multi-gateway epoll server with <uint> worker threads\n" );
+    printf( " -D <dist>          Server mode: ACK delay in ms, <ms> or const:<ms>, uniform:<min>:<max>,\n" );
+    printf( "                    normal:<mean>:<sd>, exp:<min>:<mean> (default: none)\n" );
+    printf( " -R <uint>          Server mode: throughput report interval in seconds (default: 1)\n" );
+    printf( " -A <uint>          Server mode: answer every uplink in RX1, <uint> is the RX1 delay in ms (LoRaWAN: 1000)\n" );
+    printf( " -L <dist>          Server mode: processing latency added before each RX1 answer, same format as -D\n" );
+    printf( " -I <target>,<imp>  Server mode: backhaul impairments, can be repeated\n" );
+    printf( "                    <target>: push_ack, pull_ack, pull_resp, acks or all\n" );
+    printf( "                    <imp>: comma separated delay=<dist>, loss=<%%>, dup=<%%>, reorder=<%%>, gap=<ms>\n" );
+    printf( " -Z <uint>          Server mode: seed of the pseudo-random generators (default: time based)\n" );
     printf(
         "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~"
         "~~~~~~\n" );
@@ -867,6 +1078,12 @@ static void usage( void )
     printf( "   ./net_downlink -f 865.1 -s 7 -b 125 -r 8 -t 500 -x 10 -P 1730\n" );
     printf( " Trigger continuous TX:\n" );
     printf( "   ./net_downlink -f 865.1 -s 11 -x 1 -r 65535 -P 1730\n" );
+    printf( " Soak test a fleet of gateways, 4 workers, 20 to 80 ms ACK latency:\n" );
+    printf( "   ./net_downlink -P 1730 -S 4 -D uniform:20:80\n" );
+    printf( " Find the RX1 latency budget of a hub, sweeping 0 to 1 s of processing latency:\n" );
+    printf( "   ./net_downlink -P 1730 -A 1000 -L uniform:0:1000\n" );
+    printf( " Emulate a lossy cellular backhaul, reproducible run:\n" );
+    printf( "   ./net_downlink -P 1730 -S 1 -I all,delay=exp:40:60,loss=2,reorder=1 -I pull_resp,dup=0.5 -Z 42\n" );
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -956,6 +1173,29 @@ void prepare_downlink_json( const thread_params_t* params, uint8_t rf_chain, uin
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+static int build_downlink_json( void* ctx, uint32_t seq, char* buf, size_t size )
+{
+    const thread_params_t* params   = ( const thread_params_t* ) ctx;
+    JSON_Value*            root_val = NULL;
+    int                    len      = -1;
+
+    root_val = json_value_init_object( );
+    if( root_val == NULL )
+    {
+        return -1;
+    }
+    prepare_downlink_json( params, 0, seq, root_val );
+    if( json_serialize_to_buffer( root_val, buf, size ) == JSONSuccess )
+    {
+        len = ( int ) strlen( buf );
+    }
+    json_value_free( root_val );
+
+    return len;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 static void* thread_down( const void* arg )
 {
     int                    x;
@@ -0,0 +1,504 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Deferred UDP datagram scheduler, delay distributions and pseudo-random generator
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+/* Fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+#define _XOPEN_SOURCE 600
+#else
+#define _XOPEN_SOURCE 500
+#endif
+
+#include <math.h>   /* log, sqrt, cos */
+#include <stdio.h>  /* sscanf, snprintf */
+#include <stdlib.h> /* calloc, free */
+#include <string.h> /* memcpy, strcmp, strtok_r */
+#include <time.h>   /* clock_gettime */
+
+#include "udp_sched.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define RNG_DEFAULT_SEED 0x9E3779B97F4A7C15ULL
+
+#define IMPAIR_SPEC_MAX 128
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static bool item_before( const udp_sched_item_t* a, const udp_sched_item_t* b )
+{
+    if( a->due_ns != b->due_ns )
+    {
+        return a->due_ns < b->due_ns;
+    }
+    return a->seq < b->seq;
+}
+
+static void heap_swap( udp_sched_item_t* a, udp_sched_item_t* b )
+{
+    udp_sched_item_t tmp = *a;
+    *a                   = *b;
+    *b                   = tmp;
+}
+
+static void heap_up( udp_sched_t* sched, uint32_t i )
+{
+    while( i > 0 )
+    {
+        uint32_t parent = ( i - 1 ) / 2;
+        if( !item_before( &sched->heap[i], &sched->heap[parent] ) )
+        {
+            break;
+        }
+        heap_swap( &sched->heap[i], &sched->heap[parent] );
+        i = parent;
+    }
+}
+
+static void heap_down( udp_sched_t* sched, uint32_t i )
+{
+    for( ;; )
+    {
+        uint32_t l   = ( 2 * i ) + 1;
+        uint32_t r   = l + 1;
+        uint32_t min = i;
+        if( ( l < sched->size ) && item_before( &sched->heap[l], &sched->heap[min] ) )
+        {
+            min = l;
+        }
+        if( ( r < sched->size ) && item_before( &sched->heap[r], &sched->heap[min] ) )
+        {
+            min = r;
+        }
+        if( min == i )
+        {
+            break;
+        }
+        heap_swap( &sched->heap[i], &sched->heap[min] );
+        i = min;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t* item_data( udp_sched_t* sched, udp_sched_item_t* item )
+{
+    if( item->len <= UDP_SCHED_INLINE_MAX )
+    {
+        return item->data_inline;
+    }
+    return sched->pool + ( ( size_t ) item->slot * UDP_SCHED_DGRAM_MAX );
+}
+
+static void item_release( udp_sched_t* sched, udp_sched_item_t* item )
+{
+    if( item->len > UDP_SCHED_INLINE_MAX )
+    {
+        sched->slots_free[sched->nb_slot_free] = item->slot;
+        sched->nb_slot_free += 1;
+    }
+}
+
+/* Datagrams are only counted as sent once the kernel took them */
+static int sched_sendto( udp_sched_t* sched, int sock, const void* buf, size_t len, const struct sockaddr* addr,
+                         socklen_t addr_len )
+{
+    if( sendto( sock, buf, len, 0, addr, addr_len ) < 0 )
+    {
+        sched->nb_send_error += 1;
+        return -1;
+    }
+    sched->nb_sent += 1;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS ----------------------------------------------------- */
+
+uint64_t udp_sched_now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( ( uint64_t ) ts.tv_sec * 1000000000ULL ) + ( uint64_t ) ts.tv_nsec;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void rng_seed( rng_t* rng, uint64_t seed )
+{
+    rng->s = ( seed != 0 ) ? seed : RNG_DEFAULT_SEED;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t rng_next( rng_t* rng )
+{
+    rng->s ^= rng->s >> 12;
+    rng->s ^= rng->s << 25;
+    rng->s ^= rng->s >> 27;
+    return rng->s * 0x2545F4914F6CDD1DULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+double rng_uniform( rng_t* rng )
+{
+    return ( double ) ( rng_next( rng ) >> 11 ) * ( 1.0 / 9007199254740992.0 ); /* 53 bits mantissa */
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int delay_dist_parse( const char* spec, delay_dist_t* dist )
+{
+    char   name[16];
+    double a = 0.0, b = 0.0;
+    int    n;
+
+    if( ( spec == NULL ) || ( dist == NULL ) )
+    {
+        return -1;
+    }
+
+    memset( dist, 0, sizeof *dist );
+    if( strcmp( spec, "none" ) == 0 )
+    {
+        dist->type = DELAY_DIST_NONE;
+        return 0;
+    }
+
+    /* plain number: constant delay */
+    if( sscanf( spec, "%lf%n", &a, &n ) == 1 && spec[n] == '\0' )
+    {
+        if( a < 0.0 )
+        {
+            return -1;
+        }
+        dist->type = ( a > 0.0 ) ? DELAY_DIST_CONST : DELAY_DIST_NONE;
+        dist->a    = a;
+        return 0;
+    }
+
+    n = sscanf( spec, "%15[a-z]:%lf:%lf", name, &a, &b );
+    if( n < 2 )
+    {
+        return -1;
+    }
+    if( ( strcmp( name, "const" ) == 0 ) && ( n == 2 ) && ( a >= 0.0 ) )
+    {
+        dist->type = DELAY_DIST_CONST;
+    }
+    else if( ( strcmp( name, "uniform" ) == 0 ) && ( n == 3 ) && ( a >= 0.0 ) && ( b >= a ) )
+    {
+        dist->type = DELAY_DIST_UNIFORM;
+    }
+    else if( ( strcmp( name, "normal" ) == 0 ) && ( n == 3 ) && ( a >= 0.0 ) && ( b >= 0.0 ) )
+    {
+        dist->type = DELAY_DIST_NORMAL;
+    }
+    else if( ( strcmp( name, "exp" ) == 0 ) && ( n == 3 ) && ( a >= 0.0 ) && ( b > 0.0 ) )
+    {
+        dist->type = DELAY_DIST_EXP;
+    }
+    else
+    {
+        return -1;
+    }
+    dist->a = a;
+    dist->b = b;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t delay_dist_draw_us( const delay_dist_t* dist, rng_t* rng )
+{
+    double ms;
+    double u1, u2;
+
+    switch( dist->type )
+    {
+    case DELAY_DIST_CONST:
+        ms = dist->a;
+        break;
+    case DELAY_DIST_UNIFORM:
+        ms = dist->a + ( ( dist->b - dist->a ) * rng_uniform( rng ) );
+        break;
+    case DELAY_DIST_NORMAL:
+        /* Box-Muller */
+        u1 = 1.0 - rng_uniform( rng ); /* (0, 1] */
+        u2 = rng_uniform( rng );
+        ms = dist->a + ( dist->b * sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * M_PI * u2 ) );
+        break;
+    case DELAY_DIST_EXP:
+        ms = dist->a - ( dist->b * log( 1.0 - rng_uniform( rng ) ) );
+        break;
+    case DELAY_DIST_NONE:
+    default:
+        ms = 0.0;
+        break;
+    }
+
+    if( ms <= 0.0 )
+    {
+        return 0;
+    }
+    if( ms > 4.0e6 )
+    {
+        ms = 4.0e6; /* keep it in 32 bits once converted to us */
+    }
+    return ( uint32_t ) ( ms * 1000.0 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void delay_dist_to_str( const delay_dist_t* dist, char* str, size_t size )
+{
+    switch( dist->type )
+    {
+    case DELAY_DIST_CONST:
+        snprintf( str, size, "const %.1fms", dist->a );
+        break;
+    case DELAY_DIST_UNIFORM:
+        snprintf( str, size, "uniform [%.1f..%.1f]ms", dist->a, dist->b );
+        break;
+    case DELAY_DIST_NORMAL:
+        snprintf( str, size, "normal mean=%.1fms sd=%.1fms", dist->a, dist->b );
+        break;
+    case DELAY_DIST_EXP:
+        snprintf( str, size, "%.1fms + exp mean=%.1fms", dist->a, dist->b );
+        break;
+    case DELAY_DIST_NONE:
+    default:
+        snprintf( str, size, "none" );
+        break;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int impair_parse( const char* spec, impair_t* impair )
+{
+    char   copy[IMPAIR_SPEC_MAX];
+    char*  field;
+    char*  save = NULL;
+    char*  val;
+    double x;
+    int    n;
+
+    if( ( spec == NULL ) || ( impair == NULL ) || ( strlen( spec ) >= sizeof copy ) )
+    {
+        return -1;
+    }
+    strcpy( copy, spec );
+
+    for( field = strtok_r( copy, ",", &save ); field != NULL; field = strtok_r( NULL, ",", &save ) )
+    {
+        val = strchr( field, '=' );
+        if( val == NULL )
+        {
+            return -1;
+        }
+        *val++ = '\0';
+
+        if( strcmp( field, "delay" ) == 0 )
+        {
+            if( delay_dist_parse( val, &impair->delay ) != 0 )
+            {
+                return -1;
+            }
+            continue;
+        }
+        if( ( sscanf( val, "%lf%n", &x, &n ) != 1 ) || ( val[n] != '\0' ) || ( x < 0.0 ) )
+        {
+            return -1;
+        }
+        if( strcmp( field, "gap" ) == 0 )
+        {
+            impair->reorder_gap_us = ( uint32_t ) ( x * 1000.0 );
+            continue;
+        }
+        if( x > 100.0 )
+        {
+            return -1;
+        }
+        if( strcmp( field, "loss" ) == 0 )
+        {
+            impair->loss = x / 100.0;
+        }
+        else if( strcmp( field, "dup" ) == 0 )
+        {
+            impair->dup = x / 100.0;
+        }
+        else if( strcmp( field, "reorder" ) == 0 )
+        {
+            impair->reorder = x / 100.0;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void impair_to_str( const impair_t* impair, char* str, size_t size )
+{
+    char dist_str[64];
+
+    delay_dist_to_str( &impair->delay, dist_str, sizeof dist_str );
+    snprintf( str, size, "delay %s, loss %.1f%%, dup %.1f%%, reorder %.1f%% (gap %u ms)", dist_str,
+              impair->loss * 100.0, impair->dup * 100.0, impair->reorder * 100.0, impair->reorder_gap_us / 1000 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int udp_sched_init( udp_sched_t* sched, uint32_t capacity, uint32_t nb_slot )
+{
+    uint32_t i;
+
+    memset( sched, 0, sizeof *sched );
+    sched->heap       = calloc( capacity, sizeof( udp_sched_item_t ) );
+    sched->pool       = calloc( nb_slot, UDP_SCHED_DGRAM_MAX );
+    sched->slots_free = calloc( nb_slot, sizeof( uint32_t ) );
+    if( ( sched->heap == NULL ) || ( sched->pool == NULL ) || ( sched->slots_free == NULL ) )
+    {
+        udp_sched_free( sched );
+        return -1;
+    }
+    sched->capacity = capacity;
+    sched->nb_slot  = nb_slot;
+    for( i = 0; i < nb_slot; i++ )
+    {
+        sched->slots_free[i] = nb_slot - 1 - i;
+    }
+    sched->nb_slot_free = nb_slot;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void udp_sched_free( udp_sched_t* sched )
+{
+    free( sched->heap );
+    free( sched->pool );
+    free( sched->slots_free );
+    memset( sched, 0, sizeof *sched );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int udp_sched_send( udp_sched_t* sched, int sock, const void* buf, size_t len, const struct sockaddr* addr,
+                    socklen_t addr_len, uint32_t delay_us )
+{
+    udp_sched_item_t* item;
+
+    if( addr_len > sizeof( struct sockaddr_storage ) )
+    {
+        return -1;
+    }
+
+    if( delay_us == 0 )
+    {
+        return sched_sendto( sched, sock, buf, len, addr, addr_len );
+    }
+
+    if( len > UDP_SCHED_DGRAM_MAX )
+    {
+        return -1;
+    }
+    if( ( sched->size >= sched->capacity ) || ( ( len > UDP_SCHED_INLINE_MAX ) && ( sched->nb_slot_free == 0 ) ) )
+    {
+        sched->nb_overflow += 1;
+        return -1;
+    }
+
+    item      = &sched->heap[sched->size];
+    item->len = ( uint16_t ) len;
+    if( len > UDP_SCHED_INLINE_MAX )
+    {
+        sched->nb_slot_free -= 1;
+        item->slot = sched->slots_free[sched->nb_slot_free];
+    }
+    memcpy( item_data( sched, item ), buf, len );
+    memcpy( &item->addr, addr, addr_len );
+    item->addr_len = addr_len;
+    item->sock     = sock;
+    item->due_ns   = udp_sched_now_ns( ) + ( ( uint64_t ) delay_us * 1000 );
+    item->seq      = sched->seq++;
+    sched->size += 1;
+    heap_up( sched, sched->size - 1 );
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int udp_sched_flush( udp_sched_t* sched, uint64_t now_ns )
+{
+    int              nb = 0;
+    udp_sched_item_t item;
+
+    while( ( sched->size > 0 ) && ( sched->heap[0].due_ns <= now_ns ) )
+    {
+        item           = sched->heap[0];
+        sched->size -= 1;
+        sched->heap[0] = sched->heap[sched->size];
+        heap_down( sched, 0 );
+
+        if( sched_sendto( sched, item.sock, item_data( sched, &item ), item.len, ( struct sockaddr* ) &item.addr,
+                          item.addr_len ) == 0 )
+        {
+            nb += 1;
+        }
+        item_release( sched, &item );
+    }
+
+    return nb;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int udp_sched_timeout_ms( const udp_sched_t* sched, uint64_t now_ns )
+{
+    uint64_t due_ns;
+
+    if( sched->size == 0 )
+    {
+        return -1;
+    }
+    due_ns = sched->heap[0].due_ns;
+    if( due_ns <= now_ns )
+    {
+        return 0;
+    }
+    return ( int ) ( ( due_ns - now_ns + 999999 ) / 1000000 );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,578 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2024 Semtech
+
+Description:
+    Binary uplink log: columnar blocks of fixed-size rxpk fields followed by a
+    payload side-buffer, written by a background thread
+
+    The receiving threads only copy the PUSH_DATA JSON into the active staging
+    buffer. When it is full, or every UPLINK_LOG_FLUSH_MS, the buffers are
+    swapped and the writer thread parses the staged datagrams, packs their
+    rxpk into columnar blocks and writes them. If the writer is still busy
+    with the other buffer, datagrams are dropped (and counted) rather than
+    delaying the ACKs.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDENCIES --------------------------------------------------------- */
+
+/* Fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+#define _XOPEN_SOURCE 600
+#else
+#define _XOPEN_SOURCE 500
+#endif
+
+#include <errno.h>  /* ETIMEDOUT */
+#include <math.h>   /* lround */
+#include <stdio.h>  /* fopen, fwrite, fprintf */
+#include <stdlib.h> /* malloc, free */
+#include <string.h> /* memcpy, strcmp */
+#include <time.h>   /* clock_gettime */
+
+#include <pthread.h>
+
+#include "base64.h"
+#include "parson.h"
+#include "uplink_log.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PAYLOAD_MAX 255
+#define STAGING_HDR_SIZE 20 /* uint64 gw_mac, uint64 host_ms, uint32 len */
+
+#define MODU_LORA 0
+#define MODU_FSK 1
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef struct
+{
+    uint8_t* data;
+    size_t   used;
+} staging_t;
+
+typedef struct
+{
+    uint32_t nb_rec;
+    uint32_t pl_bytes;
+    uint64_t host_ms[UPLINK_LOG_BLOCK_RECORDS];
+    uint64_t gw_mac[UPLINK_LOG_BLOCK_RECORDS];
+    uint32_t tmst[UPLINK_LOG_BLOCK_RECORDS];
+    uint32_t freq_hz[UPLINK_LOG_BLOCK_RECORDS];
+    uint32_t datr[UPLINK_LOG_BLOCK_RECORDS];
+    uint32_t pl_offset[UPLINK_LOG_BLOCK_RECORDS];
+    int16_t  rssi_x10[UPLINK_LOG_BLOCK_RECORDS];
+    int16_t  lsnr_x10[UPLINK_LOG_BLOCK_RECORDS];
+    uint16_t bw_khz[UPLINK_LOG_BLOCK_RECORDS];
+    uint8_t  chan[UPLINK_LOG_BLOCK_RECORDS];
+    uint8_t  rfch[UPLINK_LOG_BLOCK_RECORDS];
+    int8_t   stat[UPLINK_LOG_BLOCK_RECORDS];
+    uint8_t  modu[UPLINK_LOG_BLOCK_RECORDS];
+    uint8_t  codr[UPLINK_LOG_BLOCK_RECORDS];
+    uint8_t  size[UPLINK_LOG_BLOCK_RECORDS];
+    uint8_t  payload[UPLINK_LOG_BLOCK_RECORDS * PAYLOAD_MAX];
+} block_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static FILE*      log_file = NULL;
+static block_t*   block    = NULL; /* owned by the writer thread */
+static staging_t  staging[2];
+static staging_t* active   = NULL; /* filled by the receiving threads */
+static staging_t* pending  = NULL; /* handed to the writer thread, NULL when the writer is idle */
+static bool       stop     = false;
+
+static pthread_t       thrid_writer;
+static pthread_mutex_t mx_log = PTHREAD_MUTEX_INITIALIZER; /* control access to the staging buffers */
+static pthread_cond_t  cv_log = PTHREAD_COND_INITIALIZER;
+
+static uplink_log_stats_t log_stats;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static uint64_t now_ms( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+    return ( ( uint64_t ) ts.tv_sec * 1000 ) + ( ( uint64_t ) ts.tv_nsec / 1000000 );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void write_block( void )
+{
+    size_t n       = block->nb_rec;
+    size_t written = 0;
+
+    if( n == 0 )
+    {
+        return;
+    }
+
+    written += fwrite( &block->nb_rec, sizeof block->nb_rec, 1, log_file ) * sizeof block->nb_rec;
+    written += fwrite( &block->pl_bytes, sizeof block->pl_bytes, 1, log_file ) * sizeof block->pl_bytes;
+    written += fwrite( block->host_ms, sizeof block->host_ms[0], n, log_file ) * sizeof block->host_ms[0];
+    written += fwrite( block->gw_mac, sizeof block->gw_mac[0], n, log_file ) * sizeof block->gw_mac[0];
+    written += fwrite( block->tmst, sizeof block->tmst[0], n, log_file ) * sizeof block->tmst[0];
+    written += fwrite( block->freq_hz, sizeof block->freq_hz[0], n, log_file ) * sizeof block->freq_hz[0];
+    written += fwrite( block->datr, sizeof block->datr[0], n, log_file ) * sizeof block->datr[0];
+    written += fwrite( block->pl_offset, sizeof block->pl_offset[0], n, log_file ) * sizeof block->pl_offset[0];
+    written += fwrite( block->rssi_x10, sizeof block->rssi_x10[0], n, log_file ) * sizeof block->rssi_x10[0];
+    written += fwrite( block->lsnr_x10, sizeof block->lsnr_x10[0], n, log_file ) * sizeof block->lsnr_x10[0];
+    written += fwrite( block->bw_khz, sizeof block->bw_khz[0], n, log_file ) * sizeof block->bw_khz[0];
+    written += fwrite( block->chan, 1, n, log_file );
+    written += fwrite( block->rfch, 1, n, log_file );
+    written += fwrite( block->stat, 1, n, log_file );
+    written += fwrite( block->modu, 1, n, log_file );
+    written += fwrite( block->codr, 1, n, log_file );
+    written += fwrite( block->size, 1, n, log_file );
+    written += fwrite( block->payload, 1, block->pl_bytes, log_file );
+    fflush( log_file );
+
+    log_stats.nb_rec += n;
+    log_stats.nb_bytes += written;
+    block->nb_rec   = 0;
+    block->pl_bytes = 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool get_number( JSON_Object* obj, const char* name, double* val )
+{
+    JSON_Value* v = json_object_get_value( obj, name );
+
+    if( json_value_get_type( v ) != JSONNumber )
+    {
+        return false;
+    }
+    *val = json_value_get_number( v );
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool pack_rxpk( JSON_Object* rxpk, uint64_t gw_mac, uint64_t host_ms )
+{
+    uint32_t    i = block->nb_rec;
+    double      tmst, chan, rfch, freq, stat, datr, rssi, lsnr = 0.0, size;
+    const char* modu;
+    const char* str;
+    unsigned    sf, bw, cr;
+    int         x;
+
+    if( !get_number( rxpk, "tmst", &tmst ) || !get_number( rxpk, "chan", &chan ) ||
+        !get_number( rxpk, "rfch", &rfch ) || !get_number( rxpk, "freq", &freq ) ||
+        !get_number( rxpk, "stat", &stat ) || !get_number( rxpk, "rssi", &rssi ) ||
+        !get_number( rxpk, "size", &size ) || ( size > PAYLOAD_MAX ) )
+    {
+        return false;
+    }
+    modu = json_object_get_string( rxpk, "modu" );
+    if( modu == NULL )
+    {
+        return false;
+    }
+    if( strcmp( modu, "LORA" ) == 0 )
+    {
+        str = json_object_get_string( rxpk, "datr" );
+        if( ( str == NULL ) || ( sscanf( str, "SF%2uBW%3u", &sf, &bw ) != 2 ) || !get_number( rxpk, "lsnr", &lsnr ) )
+        {
+            return false;
+        }
+        str              = json_object_get_string( rxpk, "codr" );
+        block->modu[i]   = MODU_LORA;
+        block->datr[i]   = sf;
+        block->bw_khz[i] = ( uint16_t ) bw;
+        block->codr[i]   = ( ( str != NULL ) && ( sscanf( str, "4/%u", &cr ) == 1 ) ) ? ( uint8_t ) cr : 0;
+    }
+    else if( strcmp( modu, "FSK" ) == 0 )
+    {
+        if( !get_number( rxpk, "datr", &datr ) )
+        {
+            return false;
+        }
+        block->modu[i]   = MODU_FSK;
+        block->datr[i]   = ( uint32_t ) datr;
+        block->bw_khz[i] = 0;
+        block->codr[i]   = 0;
+    }
+    else
+    {
+        return false;
+    }
+
+    str = json_object_get_string( rxpk, "data" );
+    if( str == NULL )
+    {
+        return false;
+    }
+    x = b64_to_bin( str, strlen( str ), block->payload + block->pl_bytes, PAYLOAD_MAX );
+    if( x != ( int ) size )
+    {
+        return false;
+    }
+
+    block->host_ms[i]   = host_ms;
+    block->gw_mac[i]    = gw_mac;
+    block->tmst[i]      = ( uint32_t ) tmst;
+    block->freq_hz[i]   = ( uint32_t ) lround( freq * 1e6 );
+    block->pl_offset[i] = block->pl_bytes;
+    block->rssi_x10[i]  = ( int16_t ) lround( rssi * 10.0 );
+    block->lsnr_x10[i]  = ( int16_t ) lround( lsnr * 10.0 );
+    block->chan[i]      = ( uint8_t ) chan;
+    block->rfch[i]      = ( uint8_t ) rfch;
+    block->stat[i]      = ( int8_t ) stat;
+    block->size[i]      = ( uint8_t ) size;
+    block->pl_bytes += ( uint32_t ) size;
+    block->nb_rec += 1;
+
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void process_staging( staging_t* s )
+{
+    size_t       pos = 0;
+    uint64_t     gw_mac, host_ms;
+    uint32_t     len;
+    char*        json;
+    JSON_Value*  root_val;
+    JSON_Array*  rxpk_array;
+    JSON_Object* rxpk;
+    size_t       i, rxpk_nb;
+
+    while( pos + STAGING_HDR_SIZE <= s->used )
+    {
+        memcpy( &gw_mac, s->data + pos, 8 );
+        memcpy( &host_ms, s->data + pos + 8, 8 );
+        memcpy( &len, s->data + pos + 16, 4 );
+        json = ( char* ) ( s->data + pos + STAGING_HDR_SIZE ); /* null terminated when staged */
+        pos += STAGING_HDR_SIZE + len + 1;
+
+        root_val   = json_parse_string( json );
+        rxpk_array = json_object_get_array( json_value_get_object( root_val ), "rxpk" );
+        rxpk_nb    = ( rxpk_array != NULL ) ? json_array_get_count( rxpk_array ) : 0;
+        for( i = 0; i < rxpk_nb; i++ )
+        {
+            if( block->nb_rec == UPLINK_LOG_BLOCK_RECORDS )
+            {
+                write_block( );
+            }
+            rxpk = json_array_get_object( rxpk_array, i );
+            if( ( rxpk == NULL ) || !pack_rxpk( rxpk, gw_mac, host_ms ) )
+            {
+                log_stats.nb_invalid += 1;
+            }
+        }
+        json_value_free( root_val );
+    }
+    write_block( );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void* thread_writer( void* arg )
+{
+    staging_t*      s;
+    struct timespec deadline;
+    int             x;
+
+    ( void ) arg;
+
+    pthread_mutex_lock( &mx_log );
+    while( true )
+    {
+        clock_gettime( CLOCK_REALTIME, &deadline );
+        deadline.tv_sec += UPLINK_LOG_FLUSH_MS / 1000;
+        deadline.tv_nsec += ( UPLINK_LOG_FLUSH_MS % 1000 ) * 1000000L;
+        if( deadline.tv_nsec >= 1000000000L )
+        {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        x = 0;
+        while( ( pending == NULL ) && !stop && ( x != ETIMEDOUT ) )
+        {
+            x = pthread_cond_timedwait( &cv_log, &mx_log, &deadline );
+        }
+        if( ( pending == NULL ) && ( active->used > 0 ) )
+        {
+            /* periodic flush: take the active buffer, the other one is free */
+            pending = active;
+            active  = ( active == &staging[0] ) ? &staging[1] : &staging[0];
+        }
+        if( pending == NULL )
+        {
+            if( stop )
+            {
+                break;
+            }
+            continue;
+        }
+        s = pending;
+        pthread_mutex_unlock( &mx_log );
+
+        process_staging( s );
+
+        pthread_mutex_lock( &mx_log );
+        s->used = 0;
+        pending = NULL;
+    }
+    pthread_mutex_unlock( &mx_log );
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS ----------------------------------------------------- */
+
+int uplink_log_open( const char* fname )
+{
+    uint32_t version = UPLINK_LOG_VERSION;
+
+    memset( &log_stats, 0, sizeof log_stats );
+    block           = calloc( 1, sizeof( block_t ) );
+    staging[0].data = malloc( UPLINK_LOG_STAGING_SIZE );
+    staging[1].data = malloc( UPLINK_LOG_STAGING_SIZE );
+    if( ( block == NULL ) || ( staging[0].data == NULL ) || ( staging[1].data == NULL ) )
+    {
+        printf( "ERROR: failed to allocate binary log buffers\n" );
+        goto fail;
+    }
+    staging[0].used = 0;
+    staging[1].used = 0;
+    active          = &staging[0];
+    pending         = NULL;
+    stop            = false;
+
+    log_file = fopen( fname, "wb" ); /* create log file, overwrite if file already exist */
+    if( log_file == NULL )
+    {
+        printf( "ERROR: impossible to create log file %s\n", fname );
+        goto fail;
+    }
+    if( ( fwrite( UPLINK_LOG_MAGIC, 4, 1, log_file ) != 1 ) || ( fwrite( &version, 4, 1, log_file ) != 1 ) )
+    {
+        printf( "ERROR: failed to write log file header\n" );
+        goto fail;
+    }
+
+    if( pthread_create( &thrid_writer, NULL, thread_writer, NULL ) != 0 )
+    {
+        printf( "ERROR: impossible to create log writer thread\n" );
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    if( log_file != NULL )
+    {
+        fclose( log_file );
+        log_file = NULL;
+    }
+    free( staging[0].data );
+    free( staging[1].data );
+    free( block );
+    staging[0].data = NULL;
+    staging[1].data = NULL;
+    block           = NULL;
+    active          = NULL;
+    return -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void uplink_log_push( uint64_t gw_mac, const uint8_t* json, size_t len )
+{
+    uint64_t host_ms = now_ms( );
+    uint32_t len32   = ( uint32_t ) len;
+    size_t   need    = STAGING_HDR_SIZE + len + 1;
+
+    if( need > UPLINK_LOG_STAGING_SIZE )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &mx_log );
+    if( active == NULL )
+    {
+        pthread_mutex_unlock( &mx_log );
+        return;
+    }
+    log_stats.nb_dgram += 1;
+    if( active->used + need > UPLINK_LOG_STAGING_SIZE )
+    {
+        if( pending != NULL )
+        {
+            /* writer still busy with the other buffer */
+            log_stats.nb_dropped += 1;
+            pthread_mutex_unlock( &mx_log );
+            return;
+        }
+        pending = active;
+        active  = ( active == &staging[0] ) ? &staging[1] : &staging[0];
+        pthread_cond_signal( &cv_log );
+    }
+    memcpy( active->data + active->used, &gw_mac, 8 );
+    memcpy( active->data + active->used + 8, &host_ms, 8 );
+    memcpy( active->data + active->used + 16, &len32, 4 );
+    memcpy( active->data + active->used + STAGING_HDR_SIZE, json, len );
+    active->data[active->used + STAGING_HDR_SIZE + len] = '\0';
+    active->used += need;
+    pthread_mutex_unlock( &mx_log );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void uplink_log_close( uplink_log_stats_t* stats )
+{
+    if( log_file == NULL )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &mx_log );
+    stop = true;
+    pthread_cond_signal( &cv_log );
+    pthread_mutex_unlock( &mx_log );
+    pthread_join( thrid_writer, NULL );
+
+    /* writer is stopped, flush what is left */
+    pthread_mutex_lock( &mx_log );
+    process_staging( active );
+    active->used = 0;
+    active       = NULL;
+    pthread_mutex_unlock( &mx_log );
+
+    fclose( log_file );
+    log_file = NULL;
+    free( staging[0].data );
+    free( staging[1].data );
+    free( block );
+    staging[0].data = NULL;
+    staging[1].data = NULL;
+    block           = NULL;
+
+    if( stats != NULL )
+    {
+        *stats = log_stats;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+long uplink_log_to_csv( const char* fname, FILE* out )
+{
+    FILE*    file;
+    block_t* b;
+    char     magic[4];
+    uint32_t version;
+    uint32_t i, j, n;
+    long     nb_rec = 0;
+    bool     ok;
+
+    file = fopen( fname, "rb" );
+    if( file == NULL )
+    {
+        printf( "ERROR: impossible to open log file %s\n", fname );
+        return -1;
+    }
+    if( ( fread( magic, 4, 1, file ) != 1 ) || ( memcmp( magic, UPLINK_LOG_MAGIC, 4 ) != 0 ) ||
+        ( fread( &version, 4, 1, file ) != 1 ) || ( version != UPLINK_LOG_VERSION ) )
+    {
+        printf( "ERROR: %s is not a binary uplink log (or unsupported version)\n", fname );
+        fclose( file );
+        return -1;
+    }
+    b = malloc( sizeof( block_t ) );
+    if( b == NULL )
+    {
+        fclose( file );
+        return -1;
+    }
+
+    fprintf( out, "tmst,chan,rfch,freq,stat,modu,datr,bw,codr,rssi,lsnr,size,data\n" );
+    while( ( fread( &b->nb_rec, 4, 1, file ) == 1 ) && ( fread( &b->pl_bytes, 4, 1, file ) == 1 ) )
+    {
+        n = b->nb_rec;
+        if( ( n > UPLINK_LOG_BLOCK_RECORDS ) || ( b->pl_bytes > sizeof b->payload ) )
+        {
+            printf( "ERROR: corrupted block after %ld records\n", nb_rec );
+            break;
+        }
+        ok = ( fread( b->host_ms, sizeof b->host_ms[0], n, file ) == n ) &&
+             ( fread( b->gw_mac, sizeof b->gw_mac[0], n, file ) == n ) &&
+             ( fread( b->tmst, sizeof b->tmst[0], n, file ) == n ) &&
+             ( fread( b->freq_hz, sizeof b->freq_hz[0], n, file ) == n ) &&
+             ( fread( b->datr, sizeof b->datr[0], n, file ) == n ) &&
+             ( fread( b->pl_offset, sizeof b->pl_offset[0], n, file ) == n ) &&
+             ( fread( b->rssi_x10, sizeof b->rssi_x10[0], n, file ) == n ) &&
+             ( fread( b->lsnr_x10, sizeof b->lsnr_x10[0], n, file ) == n ) &&
+             ( fread( b->bw_khz, sizeof b->bw_khz[0], n, file ) == n ) && ( fread( b->chan, 1, n, file ) == n ) &&
+             ( fread( b->rfch, 1, n, file ) == n ) && ( fread( b->stat, 1, n, file ) == n ) &&
+             ( fread( b->modu, 1, n, file ) == n ) && ( fread( b->codr, 1, n, file ) == n ) &&
+             ( fread( b->size, 1, n, file ) == n ) && ( fread( b->payload, 1, b->pl_bytes, file ) == b->pl_bytes );
+        if( !ok )
+        {
+            printf( "ERROR: truncated block after %ld records\n", nb_rec );
+            break;
+        }
+
+        for( i = 0; i < n; i++ )
+        {
+            fprintf( out, "%u,%u,%u,%f,%d", b->tmst[i], b->chan[i], b->rfch[i], ( double ) b->freq_hz[i] / 1e6,
+                     b->stat[i] );
+            if( b->modu[i] == MODU_LORA )
+            {
+                fprintf( out, ",LORA,%u,%u", b->datr[i], b->bw_khz[i] );
+                if( b->codr[i] != 0 )
+                {
+                    fprintf( out, ",4/%u", b->codr[i] );
+                }
+                else
+                {
+                    fprintf( out, ",OFF" );
+                }
+                fprintf( out, ",%.1f,%.1f", b->rssi_x10[i] / 10.0, b->lsnr_x10[i] / 10.0 );
+            }
+            else
+            {
+                /* bw, codr and lsnr fields are left empty */
+                fprintf( out, ",FSK,%u,,,%.1f,", b->datr[i], b->rssi_x10[i] / 10.0 );
+            }
+            fprintf( out, ",%u,", b->size[i] );
+            if( ( b->pl_offset[i] + b->size[i] ) <= b->pl_bytes )
+            {
+                for( j = 0; j < b->size[i]; j++ )
+                {
+                    fprintf( out, "%02x", b->payload[b->pl_offset[i] + j] );
+                }
+            }
+            fprintf( out, "\n" );
+        }
+        nb_rec += n;
+    }
+
+    free( b );
+    fclose( file );
+
+    return nb_rec;
+}
+
+/* --- EOF ------------------------------------------------------------------ */